@@ -28,6 +28,18 @@ void lab_destroy_texture(lab_context ctx, lab_texture texture);
 lab_result lab_create_buffer(lab_context ctx, const lab_buffer_desc* desc, lab_buffer* out_buffer);
 void lab_destroy_buffer(lab_context ctx, lab_buffer buffer);
 
+/* Asynchronous texture loading. The file is decoded to RGBA8 on worker threads while
+   out_texture is usable at once, showing a transparent 1x1 placeholder. The image
+   replaces the placeholder in the first lab_begin_frame after decoding finished, or in
+   lab_wait_texture_load, which blocks until then. lab_texture_load_result returns
+   LAB_RESULT_NOT_READY until the image is in place and the outcome of the load after.
+   Releasing a load does not affect its texture; destroying the texture drops its image. */
+lab_result lab_load_texture_async(lab_context ctx, const char* path, lab_texture* out_texture,
+                                  lab_texture_load* out_load);
+lab_result lab_texture_load_result(lab_context ctx, lab_texture_load load);
+lab_result lab_wait_texture_load(lab_context ctx, lab_texture_load load);
+void lab_release_texture_load(lab_context ctx, lab_texture_load load);
+
 lab_result lab_texture_width(lab_texture texture, int* width);
 lab_result lab_texture_height(lab_texture texture, int* height);
 
@@ -38,11 +50,49 @@ lab_result lab_resize_render_target(lab_context ctx, lab_render_target target, u
 lab_result lab_set_render_target(lab_context ctx, lab_render_target target);
 lab_result lab_save_render_target(lab_context ctx, lab_render_target target, const char* filename);
 lab_result lab_get_render_target_data(lab_context ctx, lab_render_target target, lab_render_target_desc* desc, uint8_t** out_data, size_t* out_size);
+/* Copies only what changed since the previous call into data, a full-size RGBA8 image
+   kept by the caller, and reports up to max_rects of the changed rectangles */
+lab_result lab_read_render_target_changes(lab_context ctx, lab_render_target target, uint8_t* data, size_t size,
+                                          lab_rect* out_rects, uint32_t max_rects, uint32_t* out_rect_count);
+
+/* Destroyed textures and render targets, and the targets replaced by a resize, are kept
+   in a pool and reused by creations of the same format, size and usage, with cleared
+   contents. The pool holds at most budget_bytes, 64 MiB by default, freeing what was
+   released longest ago first; a budget of zero frees the pool and disables it. */
+lab_result lab_set_texture_pool_budget(lab_context ctx, size_t budget_bytes);
+
+/* Caps the backend memory of the context's resources; zero, the default, is no cap.
+   At the start of a frame over budget, the texture pool is trimmed and then textures
+   loaded with lab_load_texture or lab_load_texture_async that were not bound in the
+   current frame are evicted, least recently bound first. An evicted texture keeps its
+   size and draws as transparent; binding it loads the file again in the background.
+   If that load fails, the texture stays evicted and the next bind tries again. */
+lab_result lab_set_memory_budget(lab_context ctx, size_t budget_bytes);
+lab_result lab_get_resource_memory_stats(lab_context ctx, lab_resource_memory_stats* out_stats);
 
 /* Frame management */
 lab_result lab_begin_frame(lab_context ctx);
 lab_result lab_end_frame(lab_context ctx);
 
+/* With pipelined_frames set, submissions are recorded and lab_end_frame hands the frame
+   to a render thread, blocking only while that many frames are already queued. Backend
+   errors of earlier frames are returned by later lab_end_frame and lab_wait_for_frame
+   calls. Calls that use the backend otherwise, such as resource creation and readback,
+   first wait for the render thread to finish all recorded work.
+   Fences increase monotonically: out_submitted is the fence of the last ended frame and
+   a frame has been executed once out_completed reaches its fence. Without a render
+   thread both are always equal. */
+lab_result lab_get_frame_fences(lab_context ctx, uint64_t* out_submitted, uint64_t* out_completed);
+lab_result lab_wait_for_frame(lab_context ctx, uint64_t fence);
+
+/* Records frame boundaries, submitted commands with their vertices, texture uploads and
+   render target changes to a file that the labfont_replay tool plays back with timing.
+   Textures and render targets created before the capture began are recorded when first
+   used, with their contents if the backend can read them back. lab_end_capture returns
+   LAB_RESULT_FILE_IO_FAILED if any part of the capture could not be written. */
+lab_result lab_begin_capture(lab_context ctx, const char* path);
+lab_result lab_end_capture(lab_context ctx);
+
 /* Coordinate system management */
 lab_result lab_init_coordinate_system(lab_coordinate_system* coord_system, const lab_coordinate_desc* desc);
 lab_result lab_set_coordinate_system(lab_context ctx, const lab_coordinate_system* coord_system);
@@ -57,6 +107,43 @@ lab_result lab_transform_vertex(const lab_coordinate_system* coord_system,
 /* Draw commands */
 lab_result lab_submit_commands(lab_context ctx, const lab_draw_command* commands, uint32_t commandCount);
 
+/* Submissions are optimized on the way to the backend: redundant state changes are
+   dropped and consecutive compatible draws merged */
+lab_result lab_get_command_stats(lab_context ctx, lab_command_stats* out_stats);
+lab_result lab_reset_command_stats(lab_context ctx);
+
+/* Opt-in draw sorting. LAB_DRAW_COMMAND_SET_LAYER gives the draws that follow it a layer,
+   zero at the start of each submission, command list and encoder. With sorting enabled,
+   layers are drawn in increasing order and the draws within a layer are grouped by blend
+   mode and texture to reduce state changes, so they must not depend on each other's
+   order. Clears are not reordered. Without sorting, layers are ignored. */
+lab_result lab_set_draw_sorting(lab_context ctx, bool enabled);
+
+/* Frame memory for transient data such as immediate mode vertices. Allocations are
+   16-byte aligned and stay valid until lab_end_frame has been called three times,
+   after which the memory is reused; nothing is freed individually. Returns NULL
+   for a size of zero or when out of memory. Thread safe. */
+void* lab_frame_alloc(lab_context ctx, size_t size);
+lab_vertex_2TC* lab_frame_alloc_vertices(lab_context ctx, uint32_t count);
+
+/* Retained command lists: commands are validated and their vertices copied when
+   recorded, so a list can be submitted repeatedly at little cost. A list is
+   submitted to and destroyed through the context that created it; other
+   contexts are rejected. */
+lab_result lab_create_command_list(lab_context ctx, lab_command_list* out_list);
+void lab_destroy_command_list(lab_context ctx, lab_command_list list);
+lab_result lab_record_commands(lab_command_list list, const lab_draw_command* commands, uint32_t commandCount);
+lab_result lab_reset_command_list(lab_command_list list);
+lab_result lab_submit_command_list(lab_context ctx, lab_command_list list);
+
+/* Encoders record commands on any thread, one thread per encoder at a time, without
+   locking. lab_end_frame submits everything encoded during the frame, ordered by
+   sort_key and then by encoder creation, and resets the encoders. Encoders must not
+   be in use during lab_end_frame. */
+lab_result lab_create_encoder(lab_context ctx, uint32_t sort_key, lab_encoder* out_encoder);
+void lab_destroy_encoder(lab_context ctx, lab_encoder encoder);
+lab_result lab_encode_commands(lab_encoder encoder, const lab_draw_command* commands, uint32_t commandCount);
+
 /* Text rendering */
 lab_result lab_draw_text(lab_context ctx, lab_font font, const char* text, float x, float y, lab_color color);
 lab_result lab_draw_text_formatted(lab_context ctx, lab_font font, const char* text, float x, float y, 
@@ -42,6 +42,8 @@ typedef enum lab_result
     LAB_RESULT_COMMAND_ENCODER_INITIALIZATION_FAILED = -27,
     LAB_RESULT_INVALID_COMMAND_BUFFER = -28,
     LAB_RESULT_TEXTURE_LOAD_FAILED = -29,
+    LAB_RESULT_FILE_IO_FAILED = -30,
+    LAB_RESULT_NOT_READY = -31,
 } lab_result;
 
 /* Texture formats */
@@ -60,6 +62,21 @@ typedef enum lab_texture_format {
     LAB_TEXTURE_FORMAT_D32F     /* 32-bit floating point depth format with no stencil */
 } lab_texture_format;
 
+/* Texture sampling filters */
+typedef enum lab_texture_filter {
+    LAB_TEXTURE_FILTER_LINEAR,   /* Bilinear filtering (default) */
+    LAB_TEXTURE_FILTER_NEAREST   /* Nearest texel */
+} lab_texture_filter;
+
+/* Render target anti-aliasing. Edge pixels are resolved from this many
+   coverage samples per pixel; interior pixels cost the same as without. */
+typedef enum lab_antialias {
+    LAB_ANTIALIAS_NONE = 0,
+    LAB_ANTIALIAS_4X = 4,
+    LAB_ANTIALIAS_8X = 8,
+    LAB_ANTIALIAS_16X = 16
+} lab_antialias;
+
 /* Backend types */
 typedef enum lab_backend_type
 {
@@ -119,6 +136,8 @@ typedef struct lab_backend_desc {
     unsigned int width;        /* Initial viewport width */
     unsigned int height;       /* Initial viewport height */
     void* native_window;      /* Native window handle (platform-specific) */
+    unsigned int worker_threads; /* CPU backend: tile-binned rendering on this many worker threads (0 = serial) */
+    unsigned int pipelined_frames; /* Frames recorded ahead of a dedicated render thread (0 = synchronous) */
 } lab_backend_desc;
 
 /* Context description */
@@ -129,6 +148,8 @@ typedef struct lab_context_desc {
     unsigned int max_vertices;  /* Maximum number of vertices for immediate mode drawing */
     unsigned int atlas_width;   /* Width of the font atlas texture */
     unsigned int atlas_height;  /* Height of the font atlas texture */
+    unsigned int worker_threads; /* CPU backend: tile-binned rendering on this many worker threads (0 = serial) */
+    unsigned int pipelined_frames; /* Frames recorded ahead of a dedicated render thread (0 = synchronous) */
 } lab_context_desc;
 
 /* Vertex type with position, texture coordinates, and color */
@@ -138,12 +159,35 @@ typedef struct lab_vertex_2TC {
     float color[4];     /* r, g, b, a */
 } lab_vertex_2TC;
 
+/* Compact vertex for text and UI, 16 bytes instead of 32, drawn with
+   LAB_DRAW_COMMAND_TRIANGLES_PACKED. Texture coordinates are unsigned
+   normalized (65535 is 1.0) and the color is RGBA8. */
+typedef struct lab_vertex_2TC_packed {
+    float position[2];     /* x, y */
+    uint16_t texcoord[2];  /* u, v */
+    uint8_t color[4];      /* r, g, b, a */
+} lab_vertex_2TC_packed;
+
+/* One axis-aligned textured quad of a LAB_DRAW_COMMAND_QUADS command, in the
+   same space as vertex positions. position is the corner that samples
+   (uv[0], uv[1]); the opposite corner is position + size and samples
+   (uv[2], uv[3]). */
+typedef struct lab_quad_instance {
+    float position[2];
+    float size[2];
+    float uv[4];       /* u0, v0, u1, v1 */
+    uint8_t color[4];  /* r, g, b, a */
+} lab_quad_instance;
+
 /* Opaque handle types */
 typedef struct lab_context_t* lab_context;
 typedef struct lab_font_t* lab_font;
 typedef struct lab_texture_t* lab_texture;
 typedef struct lab_buffer_t* lab_buffer;
 typedef struct lab_render_target_t* lab_render_target;
+typedef struct lab_command_list_t* lab_command_list;
+typedef struct lab_encoder_t* lab_encoder;
+typedef struct lab_texture_load_t* lab_texture_load;
 
 /* Draw command types */
 typedef enum lab_draw_command_type {
@@ -152,6 +196,10 @@ typedef enum lab_draw_command_type {
     LAB_DRAW_COMMAND_LINES,
     LAB_DRAW_COMMAND_BIND_TEXTURE,
     LAB_DRAW_COMMAND_SET_VIEWPORT,
+    LAB_DRAW_COMMAND_INDEXED_TRIANGLES,  /* Triangles from indices into a vertex array */
+    LAB_DRAW_COMMAND_QUADS,              /* Axis-aligned quads, one instance each */
+    LAB_DRAW_COMMAND_TRIANGLES_PACKED,   /* Triangles of lab_vertex_2TC_packed vertices */
+    LAB_DRAW_COMMAND_SET_LAYER,          /* Sort layer of the draws that follow */
 } lab_draw_command_type;
 
 /* Draw command data */
@@ -170,13 +218,31 @@ typedef struct lab_draw_command {
             uint32_t vertexCount;
             float lineWidth;
         } lines;
+        struct {
+            const lab_vertex_2TC* vertices;
+            const uint16_t* indices;  /* Three per triangle, each below vertexCount */
+            uint32_t vertexCount;
+            uint32_t indexCount;
+        } indexed_triangles;
+        struct {
+            const lab_quad_instance* instances;
+            uint32_t instanceCount;
+        } quads;
+        struct {
+            const lab_vertex_2TC_packed* vertices;
+            uint32_t vertexCount;
+        } triangles_packed;
         struct {
             const lab_texture texture;
+            lab_texture_filter filter;
         } bind_texture;
         struct {
             float x, y;           /* Viewport top-left corner */
             float width, height;  /* Viewport dimensions */
         } set_viewport;
+        struct {
+            uint32_t layer;       /* Lower layers are drawn first */
+        } set_layer;
     };
 } lab_draw_command;
 
@@ -186,8 +252,24 @@ typedef struct lab_render_target_desc {
     uint32_t height;
     lab_texture_format format;
     bool hasDepth;
+    lab_antialias antialias;  /* LAB_ANTIALIAS_NONE by default */
 } lab_render_target_desc;
 
+/* Command stream statistics, accumulated over all submissions of a context */
+typedef struct lab_command_stats {
+    uint64_t commandsSubmitted;
+    uint64_t commandsExecuted;     /* Reaching the backend after optimization */
+    uint64_t drawsMerged;          /* Draws appended to the preceding draw */
+    uint64_t stateChangesDropped;  /* Repeated or overwritten state changes */
+    uint64_t drawsReordered;       /* Draws moved by draw sorting */
+} lab_command_stats;
+
+/* Rectangle in render target pixels */
+typedef struct lab_rect {
+    int32_t x, y;
+    uint32_t width, height;
+} lab_rect;
+
 
 /* Resource descriptors */
 typedef struct lab_texture_desc {
@@ -240,6 +322,20 @@ typedef struct lab_memory_stats
     size_t categoryUsage[5];  /* One for each lab_memory_category */
 } lab_memory_stats;
 
+/* Backend memory of a context's resources */
+typedef struct lab_resource_memory_stats
+{
+    size_t textureBytes;      /* Textures, including those of render targets */
+    size_t totalBytes;        /* Everything the backend allocated for resources */
+    size_t pooledBytes;       /* Held by the texture pool for reuse */
+    size_t budget;            /* Zero if unlimited */
+    uint32_t evictableCount;  /* Live textures loaded from files */
+    uint32_t residentCount;   /* Of those, holding their image */
+    uint64_t evictions;
+    uint64_t reloads;
+    uint64_t loadFailures;    /* Images that could not be loaded; drawing retries them */
+} lab_resource_memory_stats;
+
 #ifdef __cplusplus
 }
 #endif
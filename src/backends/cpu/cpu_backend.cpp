@@ -1,10 +1,91 @@
 #include "cpu_backend.h"
 #include "rasterizer.h"
+#include "core/resource.h"
+#include "core/vertex.h"
+#include <cstdint>
 #include <cstring>
 
 namespace labfont {
 
+void CPUBackend::BindTexture(lab_texture texture, lab_texture_filter filter) {
+    m_textureBound = false;
+    
+    auto textureResource = reinterpret_cast<TextureResource*>(texture);
+    if (!textureResource || !textureResource->IsValid() || !textureResource->texture) {
+        return;
+    }
+    auto cpuTexture = dynamic_cast<CPUTexture*>(textureResource->texture.get());
+    if (!cpuTexture) {
+        return;
+    }
+    
+    // Only 8-bit formats are sampled: R8 as an alpha mask, RGBA8 as color
+    uint32_t channels;
+    switch (cpuTexture->GetFormat()) {
+        case LAB_TEXTURE_FORMAT_R8_UNORM:
+            channels = 1;
+            break;
+        case LAB_TEXTURE_FORMAT_RGBA8_UNORM:
+            channels = 4;
+            break;
+        default:
+            return;
+    }
+    if (cpuTexture->GetBytesPerPixel() != channels) {
+        return;
+    }
+    
+    m_sampler = {cpuTexture->GetData(), cpuTexture->GetWidth(), cpuTexture->GetHeight(),
+                 channels, filter};
+    m_textureBound = true;
+}
+
+lab_result CPUBackend::ReadbackChanges(RenderTarget* target, void* data, size_t size,
+                                       lab_rect* rects, uint32_t maxRects, uint32_t& rectCount) {
+    auto cpuTarget = static_cast<CPURenderTarget*>(target);
+    auto colorTexture = cpuTarget ? static_cast<CPUTexture*>(cpuTarget->GetColorTexture()) : nullptr;
+    if (!colorTexture) {
+        return LAB_RESULT_INVALID_RENDER_TARGET;
+    }
+    if (!colorTexture->SupportsReadback()) {
+        return LAB_RESULT_READBACK_NOT_SUPPORTED;
+    }
+    const size_t rowBytes = size_t(colorTexture->GetWidth()) * 4;
+    if (size < rowBytes * colorTexture->GetHeight()) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    
+    // Copy only the changed rows of the changed rectangles
+    cpu::DirtyRegion& dirty = cpuTarget->GetDirtyRegion();
+    const uint8_t* source = colorTexture->GetData();
+    uint8_t* dest = static_cast<uint8_t*>(data);
+    for (uint32_t i = 0; i < dirty.GetCount(); ++i) {
+        const cpu::ClipRect& rect = dirty.GetRects()[i];
+        size_t offset = size_t(rect.x0) * 4;
+        size_t bytes = size_t(rect.x1 - rect.x0) * 4;
+        for (int32_t y = rect.y0; y < rect.y1; ++y) {
+            memcpy(dest + y * rowBytes + offset, source + y * rowBytes + offset, bytes);
+        }
+        if (i < maxRects) {
+            rects[i] = {rect.x0, rect.y0, static_cast<uint32_t>(rect.x1 - rect.x0),
+                        static_cast<uint32_t>(rect.y1 - rect.y0)};
+        }
+    }
+    rectCount = dirty.GetCount();
+    dirty.Clear();
+    return LAB_RESULT_OK;
+}
+
 lab_result CPUBackend::SubmitCommands(const std::vector<DrawCommand>& commands) {
+    return Execute(commands);
+}
+
+lab_result CPUBackend::SubmitCommandStream(const CommandStream& stream) {
+    return Execute(stream);
+}
+
+template<typename Commands>
+lab_result CPUBackend::Execute(const Commands& commands) {
     // Get current render target
     if (!m_currentRenderTarget) {
         return LAB_RESULT_STATE_NO_RENDER_TARGET_SET;
@@ -15,10 +96,54 @@ lab_result CPUBackend::SubmitCommands(const std::vector<DrawCommand>& commands)
         return LAB_RESULT_INVALID_RENDER_TARGET;
     }
     
+    m_currentRenderTarget->BeginDrawing(commands.begin() != commands.end() &&
+                                        (*commands.begin()).type == DrawCommandType::Clear);
+    
     // Get render target dimensions and buffer
     uint32_t width = colorTexture->GetWidth();
     uint32_t height = colorTexture->GetHeight();
     uint8_t* colorBuffer = colorTexture->GetData();
+    const cpu::SampleBuffer* multisample = m_currentRenderTarget->GetSampleBuffer();
+    const uint32_t sampleCount = multisample ? multisample->sampleCount : 1;
+    cpu::DirtyRegion& dirty = m_currentRenderTarget->GetDirtyRegion();
+    
+    // Draws are clipped to the scissor rectangle, if one is set
+    const cpu::ClipRect fullClip = cpu::FullClipRect(width, height);
+    cpu::ClipRect clip = m_scissorEnabled ? m_scissor.Intersect(fullClip) : fullClip;
+    
+    // In tiled mode draws are recorded here and rasterized at the end
+    cpu::TiledRenderer* tiled = m_tiledRenderer.get();
+    if (tiled) {
+        tiled->Begin(width, height, multisample);
+    }
+    
+    // Triangle vertices are transformed in fixed-size batches on the stack
+    // and handed straight to the rasterizer, so drawing allocates nothing
+    // however large a command is
+    constexpr uint32_t kBatchVertices = 3 * 64;
+    lab_vertex_2TC batch[kBatchVertices];
+    auto drawBatch = [&](uint32_t count) {
+        for (uint32_t i = 0; i < count; i += 3) {
+            dirty.Add(cpu::TriangleBounds(&batch[i], width, height, sampleCount).Intersect(clip));
+        }
+        if (tiled) {
+            tiled->AddTriangles(batch, count, m_currentBlendMode, clip, m_textureBound ? &m_sampler : nullptr);
+            return;
+        }
+        for (uint32_t i = 0; i < count; i += 3) {
+            cpu::DrawTriangle(
+                colorBuffer,
+                nullptr, // TODO: Depth buffer
+                width,
+                height,
+                &batch[i],
+                m_currentBlendMode,
+                clip,
+                m_textureBound ? &m_sampler : nullptr,
+                multisample
+            );
+        }
+    };
     
     // Process each command
     for (const auto& cmd : commands) {
@@ -27,41 +152,123 @@ lab_result CPUBackend::SubmitCommands(const std::vector<DrawCommand>& commands)
                 // Convert float color to uint8_t
                 uint8_t clearColor[4];
                 for (int i = 0; i < 4; ++i) {
-                    clearColor[i] = static_cast<uint8_t>(cpu::Clamp(cmd.clear.color[i] * 255.0f, 0.0f, 255.0f));
+                    clearColor[i] = cpu::ToUnorm8(cmd.clear.color[i]);
                 }
                 
                 // Fill color buffer
-                for (size_t i = 0; i < width * height; ++i) {
-                    std::memcpy(&colorBuffer[i * 4], clearColor, 4);
+                dirty.Add(fullClip);
+                if (tiled) {
+                    tiled->AddClear(cpu::PackRGBA8(clearColor));
+                } else {
+                    cpu::GetSpanKernels().fill(colorBuffer, width * height, cpu::PackRGBA8(clearColor));
+                    m_currentRenderTarget->ClearSamples();
                 }
                 break;
             }
             
             case DrawCommandType::DrawTriangles: {
                 const auto& params = cmd.triangles;
-                // Create a copy of vertices to transform
-                std::vector<lab_vertex_2TC> transformedVertices(params.vertices, params.vertices + params.vertexCount);
-                
-                // Apply coordinate transformation to each vertex
-                for (auto& vertex : transformedVertices) {
-                    TransformVertexToViewport(vertex);
+                if (clip.IsEmpty()) {
+                    break;
                 }
-                
-                for (uint32_t i = 0; i < params.vertexCount; i += 3) {
-                    cpu::DrawTriangle(
-                        colorBuffer,
-                        nullptr, // TODO: Depth buffer
-                        width,
-                        height,
-                        &transformedVertices[i],
-                        m_currentBlendMode
-                    );
+                const uint32_t vertexCount = params.vertexCount - params.vertexCount % 3;
+                for (uint32_t first = 0; first < vertexCount; first += kBatchVertices) {
+                    uint32_t count = std::min(kBatchVertices, vertexCount - first);
+                    for (uint32_t i = 0; i < count; ++i) {
+                        batch[i] = params.vertices[first + i];
+                        TransformVertexToViewport(batch[i]);
+                    }
+                    drawBatch(count);
+                }
+                break;
+            }
+            
+            case DrawCommandType::DrawTrianglesPacked: {
+                // Packed vertices are expanded as they are fetched into the batch
+                const auto& params = cmd.triangles_packed;
+                if (clip.IsEmpty()) {
+                    break;
+                }
+                const uint32_t vertexCount = params.vertexCount - params.vertexCount % 3;
+                for (uint32_t first = 0; first < vertexCount; first += kBatchVertices) {
+                    uint32_t count = std::min(kBatchVertices, vertexCount - first);
+                    for (uint32_t i = 0; i < count; ++i) {
+                        batch[i] = UnpackVertex(params.vertices[first + i]);
+                        TransformVertexToViewport(batch[i]);
+                    }
+                    drawBatch(count);
+                }
+                break;
+            }
+            
+            case DrawCommandType::DrawIndexedTriangles: {
+                const auto& params = cmd.indexed_triangles;
+                if (clip.IsEmpty()) {
+                    break;
+                }
+                // Vertices are fetched through the indices into the batch;
+                // triangles with an index out of range are skipped
+                uint32_t count = 0;
+                for (uint32_t t = 0; t + 3 <= params.indexCount; t += 3) {
+                    const uint16_t* index = &params.indices[t];
+                    if (index[0] >= params.vertexCount || index[1] >= params.vertexCount ||
+                        index[2] >= params.vertexCount) {
+                        continue;
+                    }
+                    for (int k = 0; k < 3; ++k) {
+                        batch[count] = params.vertices[index[k]];
+                        TransformVertexToViewport(batch[count++]);
+                    }
+                    if (count == kBatchVertices) {
+                        drawBatch(count);
+                        count = 0;
+                    }
+                }
+                if (count > 0) {
+                    drawBatch(count);
+                }
+                break;
+            }
+            
+            case DrawCommandType::DrawQuads: {
+                const auto& params = cmd.quads;
+                if (clip.IsEmpty()) {
+                    break;
+                }
+                constexpr uint32_t kBatchQuads = 64;
+                cpu::Quad quads[kBatchQuads];
+                const cpu::TextureSampler* sampler = m_textureBound ? &m_sampler : nullptr;
+                for (uint32_t first = 0; first < params.instanceCount; first += kBatchQuads) {
+                    uint32_t count = std::min(kBatchQuads, params.instanceCount - first);
+                    for (uint32_t i = 0; i < count; ++i) {
+                        quads[i] = TransformQuadToViewport(params.instances[first + i]);
+                        dirty.Add(cpu::QuadBounds(quads[i], width, height, sampleCount).Intersect(clip));
+                    }
+                    if (tiled) {
+                        tiled->AddQuads(quads, count, m_currentBlendMode, clip, sampler);
+                        continue;
+                    }
+                    for (uint32_t i = 0; i < count; ++i) {
+                        cpu::DrawQuad(colorBuffer, width, height, quads[i], m_currentBlendMode, clip,
+                                      sampler, multisample);
+                    }
                 }
                 break;
             }
             
             case DrawCommandType::DrawLines: {
                 const auto& params = cmd.lines;
+                if (clip.IsEmpty()) {
+                    break;
+                }
+                for (uint32_t i = 0; i + 2 <= params.vertexCount; i += 2) {
+                    dirty.Add(cpu::LineBounds(&params.vertices[i], params.lineWidth, width, height).Intersect(clip));
+                }
+                if (tiled) {
+                    tiled->AddLines(params.vertices, params.vertexCount, params.lineWidth, m_currentBlendMode,
+                                    clip);
+                    break;
+                }
                 for (uint32_t i = 0; i < params.vertexCount; i += 2) {
                     cpu::DrawLine(
                         colorBuffer,
@@ -69,13 +276,16 @@ lab_result CPUBackend::SubmitCommands(const std::vector<DrawCommand>& commands)
                         height,
                         &params.vertices[i],
                         params.lineWidth,
-                        m_currentBlendMode
+                        m_currentBlendMode,
+                        clip,
+                        multisample
                     );
                 }
                 break;
             }
                 
             case DrawCommandType::BindTexture: {
+                BindTexture(cmd.bind_texture.texture, cmd.bind_texture.filter);
                 break;
             }
             
@@ -93,8 +303,22 @@ lab_result CPUBackend::SubmitCommands(const std::vector<DrawCommand>& commands)
                 break;
             }
             
+            case DrawCommandType::SetLayer:
+                // Consumed by draw sorting in the context
+                break;
+            
             case DrawCommandType::SetScissor: {
-                // TODO: Implement scissor clipping in CPU backend
+                // Clears are not affected, as with a render pass load action
+                int64_t x1 = int64_t(cmd.scissor.x) + cmd.scissor.width;
+                int64_t y1 = int64_t(cmd.scissor.y) + cmd.scissor.height;
+                m_scissor = {
+                    cmd.scissor.x,
+                    cmd.scissor.y,
+                    static_cast<int32_t>(std::min<int64_t>(x1, INT32_MAX)),
+                    static_cast<int32_t>(std::min<int64_t>(y1, INT32_MAX))
+                };
+                m_scissorEnabled = true;
+                clip = m_scissor.Intersect(fullClip);
                 break;
             }
             
@@ -109,11 +333,13 @@ lab_result CPUBackend::SubmitCommands(const std::vector<DrawCommand>& commands)
         }
     }
     
-    // Update the texture with the modified buffer
-    colorTexture->SetData(colorBuffer, width * height * 4);
+    if (tiled) {
+        tiled->Flush(colorBuffer);
+    }
 
-    // Store commands for testing/debugging
-    m_commands.insert(m_commands.end(), commands.begin(), commands.end());
+    if (m_history.IsEnabled()) {
+        m_history.Record(commands);
+    }
     
     return LAB_RESULT_OK;
 }
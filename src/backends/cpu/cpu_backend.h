@@ -3,23 +3,47 @@
 
 #include "labfont/labfont_types.h"
 #include "core/backend.h"
+#include "core/command_history.h"
+#include "dirty_region.h"
+#include "tiled_renderer.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <vector>
 
 namespace labfont {
 
+// Bytes held by live CPU backend objects. Shared with the objects, which may
+// outlive their backend.
+struct CPUMemoryCounter {
+    std::atomic<size_t> textureBytes{0};  // Texture and render target pixels
+    std::atomic<size_t> otherBytes{0};    // Antialiasing sample storage
+};
+
 class CPUTexture : public Texture {
 public:
-    CPUTexture(const TextureDesc& desc)
+    CPUTexture(const TextureDesc& desc, std::shared_ptr<CPUMemoryCounter> counter = nullptr)
         : m_width(desc.width)
         , m_height(desc.height)
         , m_format(desc.format)
         , m_renderTarget(desc.renderTarget)
         , m_readback(desc.readback)
-        , m_data(desc.width * desc.height * 4) // Always RGBA8
+        // Render targets are always RGBA8; sampled textures keep their own format
+        , m_bytesPerPixel(desc.renderTarget ? 4 : GetTextureFormatBytesPerPixel(desc.format))
+        , m_data(size_t(desc.width) * desc.height * m_bytesPerPixel)
     {
         if (desc.data && desc.dataSize > 0) {
-            memcpy(m_data.data(), desc.data, desc.dataSize);
+            memcpy(m_data.data(), desc.data, std::min(desc.dataSize, m_data.size()));
+        }
+        if (counter) {
+            counter->textureBytes += m_data.size();
+            m_counter = std::move(counter);
+        }
+    }
+    
+    ~CPUTexture() override {
+        if (m_counter) {
+            m_counter->textureBytes -= m_data.size();
         }
     }
     
@@ -30,30 +54,52 @@ public:
     bool SupportsReadback() const override { return m_readback; }
     
     // CPU-specific methods
-    uint8_t* GetData() { return m_data.data(); }
-    const uint8_t* GetData() const { return m_data.data(); }
+    uint32_t GetBytesPerPixel() const { return m_bytesPerPixel; }
+    uint8_t* GetData() { ResolveClear(); return m_data.data(); }
+    const uint8_t* GetData() const { ResolveClear(); return m_data.data(); }
     void SetData(const void* data, size_t size) {
         if (size <= m_data.size()) {
-            memcpy(m_data.data(), data, size);
+            if (size == m_data.size()) {
+                m_clearPending = false;
+            }
+            memcpy(GetData(), data, size);
         }
     }
     
+    // Zeroes the contents when they are next accessed, unless every byte is
+    // overwritten first, so that a recycled texture costs nothing to reset
+    void Clear() { m_clearPending = true; }
+    // For callers about to overwrite every byte
+    void DiscardContents() { m_clearPending = false; }
+    
 private:
+    void ResolveClear() const {
+        if (m_clearPending) {
+            std::fill(m_data.begin(), m_data.end(), 0);
+            m_clearPending = false;
+        }
+    }
+    
     uint32_t m_width;
     uint32_t m_height;
     lab_texture_format m_format;
     bool m_renderTarget;
     bool m_readback;
-    std::vector<uint8_t> m_data;
+    uint32_t m_bytesPerPixel;
+    // Mutable so that the pending clear can happen on const access
+    mutable std::vector<uint8_t> m_data;
+    mutable bool m_clearPending = false;
+    std::shared_ptr<CPUMemoryCounter> m_counter;
 };
 
 class CPURenderTarget : public RenderTarget {
 public:
-    CPURenderTarget(const RenderTargetDesc& desc)
+    CPURenderTarget(const RenderTargetDesc& desc, std::shared_ptr<CPUMemoryCounter> counter = nullptr)
         : m_width(desc.width)
         , m_height(desc.height)
         , m_format(desc.format)
         , m_hasDepth(desc.hasDepth)
+        , m_antialias(desc.antialias)
     {
         // Create color texture
         TextureDesc colorDesc = {
@@ -65,7 +111,7 @@ public:
             .readback = true,
             .dataSize = 0
         };
-        m_colorTexture = std::make_shared<CPUTexture>(colorDesc);
+        m_colorTexture = std::make_shared<CPUTexture>(colorDesc, counter);
         
         // Create depth texture if needed
         if (m_hasDepth) {
@@ -78,29 +124,95 @@ public:
                 .readback = true,
                 .dataSize = 0
             };
-            m_depthTexture = std::make_shared<CPUTexture>(depthDesc);
+            m_depthTexture = std::make_shared<CPUTexture>(depthDesc, counter);
         }
+        
+        // Sample storage is only written for pixels on primitive edges, so
+        // most of it is never touched and the pages are never committed
+        if (m_antialias != LAB_ANTIALIAS_NONE) {
+            size_t pixelCount = size_t(desc.width) * desc.height;
+            uint32_t sampleCount = static_cast<uint32_t>(m_antialias);
+            m_sampleFlags.assign(pixelCount, 0);
+            m_samples.reset(new uint8_t[pixelCount * sampleCount * 4]);
+            m_sampleBuffer = {sampleCount, m_sampleFlags.data(), m_samples.get()};
+            if (counter) {
+                m_sampleBytes = pixelCount * (sampleCount * 4 + 1);
+                counter->otherBytes += m_sampleBytes;
+                m_counter = std::move(counter);
+            }
+        }
+        
+        // Nothing has been read back yet
+        m_dirtyRegion.Add(cpu::FullClipRect(m_width, m_height));
     }
     
     virtual ~CPURenderTarget() {
         std::cout << "destructing CPURenderTarget\n";
+        if (m_counter) {
+            m_counter->otherBytes -= m_sampleBytes;
+        }
     }
     
     uint32_t GetWidth() const override { return m_width; }
     uint32_t GetHeight() const override { return m_height; }
     lab_texture_format GetFormat() const override { return m_format; }
     bool HasDepth() const override { return m_hasDepth; }
+    lab_antialias GetAntialias() const override { return m_antialias; }
+    
+    // Sample storage for anti-aliased rendering, nullptr without anti-aliasing
+    const cpu::SampleBuffer* GetSampleBuffer() const {
+        return m_antialias == LAB_ANTIALIAS_NONE ? nullptr : &m_sampleBuffer;
+    }
+    
+    // Drops the samples of all pixels, after the color buffer was cleared
+    void ClearSamples() {
+        std::fill(m_sampleFlags.begin(), m_sampleFlags.end(), 0);
+    }
     
     Texture* GetColorTexture() override { return m_colorTexture.get(); }
     Texture* GetDepthTexture() override { return m_depthTexture.get(); }
     
+    // Pixels drawn since the last ReadbackChanges
+    cpu::DirtyRegion& GetDirtyRegion() { return m_dirtyRegion; }
+    
+    // Back to the state of a new target, for reuse from the texture pool.
+    // The buffers are cleared when first used, see BeginDrawing.
+    void Reset() {
+        m_colorTexture->Clear();
+        if (m_depthTexture) {
+            m_depthTexture->Clear();
+        }
+        m_samplesClearPending = m_antialias != LAB_ANTIALIAS_NONE;
+        m_dirtyRegion.Clear();
+        m_dirtyRegion.Add(cpu::FullClipRect(m_width, m_height));
+    }
+    
+    // Called before drawing. A leading clear overwrites every pixel and
+    // sample, so clears pending from Reset are dropped rather than done.
+    void BeginDrawing(bool leadingClear) {
+        if (leadingClear) {
+            m_colorTexture->DiscardContents();
+        } else if (m_samplesClearPending) {
+            ClearSamples();
+        }
+        m_samplesClearPending = false;
+    }
+    
 private:
     uint32_t m_width;
     uint32_t m_height;
     lab_texture_format m_format;
     bool m_hasDepth;
+    lab_antialias m_antialias;
+    std::vector<uint8_t> m_sampleFlags;
+    std::unique_ptr<uint8_t[]> m_samples;
+    cpu::SampleBuffer m_sampleBuffer = {};
+    bool m_samplesClearPending = false;
+    cpu::DirtyRegion m_dirtyRegion;
     std::shared_ptr<CPUTexture> m_colorTexture;
     std::shared_ptr<CPUTexture> m_depthTexture;
+    std::shared_ptr<CPUMemoryCounter> m_counter;
+    size_t m_sampleBytes = 0;
 };
 
 class CPUBackend : public Backend {
@@ -122,7 +234,7 @@ public:
     
     lab_result CreateTexture(const TextureDesc& desc, std::shared_ptr<Texture>& out_texture) override {
         try {
-            out_texture = std::make_shared<CPUTexture>(desc);
+            out_texture = std::make_shared<CPUTexture>(desc, m_memory);
             return LAB_RESULT_OK;
         }
         catch (const std::exception& e) {
@@ -151,9 +263,12 @@ public:
         return LAB_RESULT_OK;
     }
     
+    lab_result ReadbackChanges(RenderTarget* target, void* data, size_t size,
+                               lab_rect* rects, uint32_t maxRects, uint32_t& rectCount) override;
+    
     lab_result CreateRenderTarget(const RenderTargetDesc& desc, std::shared_ptr<RenderTarget>& out_target) override {
         try {
-            out_target = std::make_shared<CPURenderTarget>(desc);
+            out_target = std::make_shared<CPURenderTarget>(desc, m_memory);
             return LAB_RESULT_OK;
         } catch (const std::exception& e) {
             return LAB_RESULT_OUT_OF_MEMORY;
@@ -162,6 +277,8 @@ public:
     
     lab_result SetRenderTarget(RenderTarget* target) override {
         m_currentRenderTarget = static_cast<CPURenderTarget*>(target);
+        // Like a new render pass, a new target starts without a scissor
+        m_scissorEnabled = false;
         return LAB_RESULT_OK;
     }
     
@@ -170,8 +287,10 @@ public:
     }
     
     lab_result SubmitCommands(const std::vector<DrawCommand>& commands) override;
+    lab_result SubmitCommandStream(const CommandStream& stream) override;
     
     lab_result EndFrame() override {
+        m_history.EndFrame();
         return LAB_RESULT_OK;
     }
     
@@ -180,8 +299,15 @@ public:
         // The actual resource will be destroyed when the shared_ptr goes out of scope
     }
     
-    size_t GetTextureMemoryUsage() const override { return 0; }
-    size_t GetTotalMemoryUsage() const override { return 0; }
+    void ResetTexture(Texture* texture) override {
+        static_cast<CPUTexture*>(texture)->Clear();
+    }
+    void ResetRenderTarget(RenderTarget* target) override {
+        static_cast<CPURenderTarget*>(target)->Reset();
+    }
+    
+    size_t GetTextureMemoryUsage() const override { return m_memory->textureBytes; }
+    size_t GetTotalMemoryUsage() const override { return m_memory->textureBytes + m_memory->otherBytes; }
     
     bool SupportsTextureFormat(lab_texture_format format) const override {
         return true; // CPU backend supports all formats
@@ -191,18 +317,54 @@ public:
         return true; // CPU backend supports all blend modes
     }
     
+    bool SupportsDrawCommand(DrawCommandType) const override {
+        return true; // Indexed triangles, quads and packed vertices are rasterized directly
+    }
+    
     uint32_t GetMaxTextureSize() const override {
         return 8192; // Arbitrary limit
     }
     
-    // For testing
-    const std::vector<DrawCommand>& GetCommands() const { return m_commands; }
-    void ClearCommands() { m_commands.clear(); }
+    // Tile-binned multithreaded rendering. With a non-zero worker count,
+    // triangles, lines and clears are binned into tiles and rasterized on a
+    // pool of that many threads plus the caller; zero renders serially on the
+    // calling thread. The output is identical either way.
+    void SetWorkerThreads(uint32_t count) {
+        if (count == 0) {
+            m_tiledRenderer.reset();
+        } else if (!m_tiledRenderer || m_tiledRenderer->GetWorkerCount() != count) {
+            m_tiledRenderer = std::make_unique<cpu::TiledRenderer>(count);
+        }
+    }
+    uint32_t GetWorkerThreads() const {
+        return m_tiledRenderer ? m_tiledRenderer->GetWorkerCount() : 0;
+    }
+    
+    // Debug capture of the commands of the last `frames` frames, with
+    // copies of their vertices; zero, the default, records nothing
+    void SetCommandHistory(uint32_t frames) { m_history.SetCapacity(frames); }
+    const CommandHistory& GetCommandHistory() const { return m_history; }
     
 private:
+    // Binds a texture for sampling by subsequent triangles; a null or
+    // unsampleable texture unbinds
+    void BindTexture(lab_texture texture, lab_texture_filter filter);
+    
+    // Executes a command vector or a stream, decoding as it goes
+    template<typename Commands>
+    lab_result Execute(const Commands& commands);
+    
+    std::shared_ptr<CPUMemoryCounter> m_memory = std::make_shared<CPUMemoryCounter>();
     CPURenderTarget* m_currentRenderTarget = nullptr;
     BlendMode m_currentBlendMode = BlendMode::Alpha;
-    std::vector<DrawCommand> m_commands;
+    cpu::TextureSampler m_sampler = {};
+    bool m_textureBound = false;
+    
+    // Scissor rectangle in render target pixels; draws are clipped to it
+    cpu::ClipRect m_scissor = {0, 0, 0, 0};
+    bool m_scissorEnabled = false;
+    CommandHistory m_history;
+    std::unique_ptr<cpu::TiledRenderer> m_tiledRenderer;
     
     // Viewport state for coordinate transformation
     float m_viewportX = 0.0f;
@@ -222,6 +384,27 @@ private:
         vertex.position[0] = m_viewportX + vertex.position[0] * m_viewportWidth;
         vertex.position[1] = m_viewportY + vertex.position[1] * m_viewportHeight;
     };
+    
+    cpu::Quad TransformQuadToViewport(const lab_quad_instance& instance) {
+        // Corners go through the same transformation as vertices
+        float x0 = instance.position[0];
+        float y0 = instance.position[1];
+        float x1 = x0 + instance.size[0];
+        float y1 = y0 + instance.size[1];
+        cpu::Quad quad;
+        quad.x0 = m_viewportX + (x0 + 1.0f) * 0.5f * m_viewportWidth;
+        quad.y0 = m_viewportY + (y0 + 1.0f) * 0.5f * m_viewportHeight;
+        quad.x1 = m_viewportX + (x1 + 1.0f) * 0.5f * m_viewportWidth;
+        quad.y1 = m_viewportY + (y1 + 1.0f) * 0.5f * m_viewportHeight;
+        quad.u0 = instance.uv[0];
+        quad.v0 = instance.uv[1];
+        quad.u1 = instance.uv[2];
+        quad.v1 = instance.uv[3];
+        for (int c = 0; c < 4; ++c) {
+            quad.color[c] = instance.color[c] / 255.0f;
+        }
+        return quad;
+    }
 };
 
 } // namespace labfont
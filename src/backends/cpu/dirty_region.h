@@ -0,0 +1,88 @@
+#ifndef LABFONT_CPU_DIRTY_REGION_H
+#define LABFONT_CPU_DIRTY_REGION_H
+
+#include "rasterizer.h"
+#include <cstdint>
+
+namespace labfont {
+namespace cpu {
+
+// Damaged area of a render target, kept as a few disjoint rectangles.
+// Rectangles that touch are merged, so the glyphs of a text label collapse
+// into one rectangle; when all slots are in use, a new rectangle is merged
+// into the one that grows least.
+class DirtyRegion {
+public:
+    static constexpr uint32_t kMaxRects = 16;
+
+    void Add(ClipRect rect) {
+        if (rect.IsEmpty()) {
+            return;
+        }
+        for (uint32_t i = 0; i < m_count; ++i) {
+            if (Contains(m_rects[i], rect)) {
+                return;
+            }
+        }
+
+        // Absorb everything the rectangle touches, again after it grows
+        for (uint32_t i = 0; i < m_count;) {
+            if (Touches(m_rects[i], rect)) {
+                rect = Union(rect, m_rects[i]);
+                m_rects[i] = m_rects[--m_count];
+                i = 0;
+            } else {
+                ++i;
+            }
+        }
+
+        if (m_count == kMaxRects) {
+            uint32_t best = 0;
+            int64_t bestGrowth = INT64_MAX;
+            for (uint32_t i = 0; i < m_count; ++i) {
+                int64_t growth = Area(Union(m_rects[i], rect)) - Area(m_rects[i]);
+                if (growth < bestGrowth) {
+                    best = i;
+                    bestGrowth = growth;
+                }
+            }
+            rect = Union(rect, m_rects[best]);
+            m_rects[best] = m_rects[--m_count];
+            Add(rect);
+            return;
+        }
+        m_rects[m_count++] = rect;
+    }
+
+    void Clear() { m_count = 0; }
+
+    uint32_t GetCount() const { return m_count; }
+    const ClipRect* GetRects() const { return m_rects; }
+
+private:
+    static bool Contains(const ClipRect& outer, const ClipRect& inner) {
+        return inner.x0 >= outer.x0 && inner.y0 >= outer.y0 &&
+               inner.x1 <= outer.x1 && inner.y1 <= outer.y1;
+    }
+
+    static bool Touches(const ClipRect& a, const ClipRect& b) {
+        return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+    }
+
+    static ClipRect Union(const ClipRect& a, const ClipRect& b) {
+        return {std::min(a.x0, b.x0), std::min(a.y0, b.y0),
+                std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+    }
+
+    static int64_t Area(const ClipRect& r) {
+        return int64_t(r.x1 - r.x0) * (r.y1 - r.y0);
+    }
+
+    ClipRect m_rects[kMaxRects];
+    uint32_t m_count = 0;
+};
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_DIRTY_REGION_H
@@ -2,10 +2,13 @@
 #define LABFONT_CPU_RASTERIZER_H
 
 #include "core/internal_types.h"
+#include "span_kernels.h"
+#include "texture_sampler.h"
 #include <vector>
 #include <cstdint>
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 namespace labfont {
 namespace cpu {
@@ -31,115 +34,697 @@ inline Vertex ConvertVertex(const lab_vertex_2TC& v) {
     return result;
 }
 
+// Sub-pixel precision used by the triangle rasterizer. Vertex positions are
+// snapped to a 1/16th pixel grid and edge functions are evaluated exactly in
+// integer arithmetic, so shared edges never produce cracks or double hits.
+constexpr int kSubPixelBits = 4;
+constexpr int64_t kSubPixelScale = int64_t(1) << kSubPixelBits;
+constexpr int64_t kSubPixelHalf = kSubPixelScale / 2;
 
-// Helper function to blend colors
-inline void BlendPixel(uint8_t* pixel, const float* color, BlendMode blendMode) {
-    // RGBA format (assuming 8 bits per channel)
-    uint8_t r = static_cast<uint8_t>(color[0] * 255.0f);
-    uint8_t g = static_cast<uint8_t>(color[1] * 255.0f);
-    uint8_t b = static_cast<uint8_t>(color[2] * 255.0f);
-    uint8_t a = static_cast<uint8_t>(color[3] * 255.0f);
+// Coordinates beyond this many pixels from the origin are rejected; it keeps
+// every edge product comfortably inside 64 bits.
+constexpr float kGuardBand = float(1 << 24);
+
+// Integer edge function E(p) = A * p.x + B * p.y + C for the directed edge a->b.
+// E is positive on the interior side of a clockwise (y down) triangle.
+struct EdgeFunction {
+    int64_t a;
+    int64_t b;
+    int64_t c;
     
-    // Simple alpha blending for now
-    if (blendMode == BlendMode::Alpha) {
-        float alpha = color[3];
-        float invAlpha = 1.0f - alpha;
+    void Setup(int64_t ax, int64_t ay, int64_t bx, int64_t by) {
+        a = ay - by;
+        b = bx - ax;
+        c = ax * by - ay * bx;
         
-        pixel[0] = static_cast<uint8_t>(pixel[0] * invAlpha + r * alpha);
-        pixel[1] = static_cast<uint8_t>(pixel[1] * invAlpha + g * alpha);
-        pixel[2] = static_cast<uint8_t>(pixel[2] * invAlpha + b * alpha);
-        pixel[3] = std::max(pixel[3], a);
-    } else {
-        // Replace mode
-        pixel[0] = r;
-        pixel[1] = g;
-        pixel[2] = b;
-        pixel[3] = a;
+        // Top-left fill rule: samples exactly on an edge belong to the triangle
+        // only if the edge is a top edge or a left edge. Biasing the constant
+        // term by one turns ">= 0" into "> 0" for the other edges.
+        bool isTop = (a == 0) && (b > 0);
+        bool isLeft = a > 0;
+        if (!isTop && !isLeft) {
+            c -= 1;
+        }
+    }
+    
+    int64_t Evaluate(int64_t x, int64_t y) const {
+        return a * x + b * y + c;
+    }
+};
+
+inline int64_t ToFixed(float v) {
+    return static_cast<int64_t>(std::lround(v * static_cast<float>(kSubPixelScale)));
+}
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1). Rasterization is restricted
+// to a clip rectangle so a target can be rendered in independent tiles.
+struct ClipRect {
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+    
+    bool IsEmpty() const { return x0 >= x1 || y0 >= y1; }
+    
+    ClipRect Intersect(const ClipRect& other) const {
+        return {std::max(x0, other.x0), std::max(y0, other.y0),
+                std::min(x1, other.x1), std::min(y1, other.y1)};
+    }
+};
+
+inline ClipRect FullClipRect(uint32_t width, uint32_t height) {
+    return {0, 0, static_cast<int32_t>(width), static_cast<int32_t>(height)};
+}
+
+// Snaps a triangle to the sub-pixel grid. Returns false if it lies outside the guard band.
+inline bool SnapTriangle(const lab_vertex_2TC* vertices, uint32_t width, uint32_t height,
+                         int64_t fx[3], int64_t fy[3]) {
+    for (int i = 0; i < 3; ++i) {
+        float sx = vertices[i].position[0] * width;
+        float sy = vertices[i].position[1] * height;
+        if (!(std::fabs(sx) < kGuardBand && std::fabs(sy) < kGuardBand)) {
+            return false;
+        }
+        fx[i] = ToFixed(sx);
+        fy[i] = ToFixed(sy);
+    }
+    return true;
+}
+
+// Anti-aliased rasterization samples coverage at sparse sub-pixel positions.
+// These are the standard 4x, 8x and 16x patterns, in sub-pixel units from the
+// pixel center.
+struct SampleOffset {
+    int8_t x;
+    int8_t y;
+};
+
+constexpr SampleOffset kSampleOffsets4[4] = {
+    {-2, -6}, {6, -2}, {-6, 2}, {2, 6}
+};
+constexpr SampleOffset kSampleOffsets8[8] = {
+    {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}
+};
+constexpr SampleOffset kSampleOffsets16[16] = {
+    {1, 1}, {-1, -3}, {-3, 2}, {4, -1}, {-5, -2}, {2, 5}, {5, 3}, {3, -5},
+    {-2, 6}, {0, -7}, {-4, -6}, {-6, 4}, {-8, 0}, {7, -4}, {6, 7}, {-7, -8}
+};
+constexpr uint32_t kMaxSampleCount = 16;
+
+// Sample positions for a sample count, or nullptr for aliased rendering
+inline const SampleOffset* GetSampleOffsets(uint32_t sampleCount) {
+    switch (sampleCount) {
+        case 4: return kSampleOffsets4;
+        case 8: return kSampleOffsets8;
+        case 16: return kSampleOffsets16;
+        default: return nullptr;
+    }
+}
+
+// How far, in sub-pixel units, coverage samples reach beyond pixel centers
+inline int64_t CoverageMargin(uint32_t sampleCount) {
+    return GetSampleOffsets(sampleCount) ? kSubPixelHalf : 0;
+}
+
+// Pixels whose centers fall inside the bounding box of a snapped triangle,
+// grown by `margin` sub-pixel units and clipped to the target
+inline ClipRect SnappedTriangleBounds(const int64_t fx[3], const int64_t fy[3],
+                                      uint32_t width, uint32_t height, int64_t margin = 0) {
+    int64_t minFx = std::min({fx[0], fx[1], fx[2]}) - margin;
+    int64_t minFy = std::min({fy[0], fy[1], fy[2]}) - margin;
+    int64_t maxFx = std::max({fx[0], fx[1], fx[2]}) + margin;
+    int64_t maxFy = std::max({fy[0], fy[1], fy[2]}) + margin;
+    
+    int64_t minX = (minFx - kSubPixelHalf + kSubPixelScale - 1) >> kSubPixelBits;
+    int64_t minY = (minFy - kSubPixelHalf + kSubPixelScale - 1) >> kSubPixelBits;
+    int64_t maxX = (maxFx - kSubPixelHalf) >> kSubPixelBits;
+    int64_t maxY = (maxFy - kSubPixelHalf) >> kSubPixelBits;
+    
+    ClipRect bounds;
+    bounds.x0 = static_cast<int32_t>(std::max<int64_t>(0, minX));
+    bounds.y0 = static_cast<int32_t>(std::max<int64_t>(0, minY));
+    bounds.x1 = static_cast<int32_t>(std::min<int64_t>(width, maxX + 1));
+    bounds.y1 = static_cast<int32_t>(std::min<int64_t>(height, maxY + 1));
+    return bounds;
+}
+
+// Conservative pixel bounds of a triangle, clipped to the target
+inline ClipRect TriangleBounds(const lab_vertex_2TC* vertices, uint32_t width, uint32_t height,
+                               uint32_t sampleCount = 1) {
+    int64_t fx[3], fy[3];
+    if (!SnapTriangle(vertices, width, height, fx, fy)) {
+        return {0, 0, 0, 0};
+    }
+    return SnappedTriangleBounds(fx, fy, width, height, CoverageMargin(sampleCount));
+}
+
+// An axis-aligned quad in the rasterizer's normalized target space. Corner
+// (x0, y0) samples (u0, v0) and corner (x1, y1) samples (u1, v1); either may
+// be the top left one. The color is flat.
+struct Quad {
+    float x0, y0, x1, y1;
+    float u0, v0, u1, v1;
+    float color[4];
+};
+
+// Snaps a quad's corners to the sub-pixel grid. Returns false if it lies outside the guard band.
+inline bool SnapQuad(const Quad& quad, uint32_t width, uint32_t height, int64_t fx[2], int64_t fy[2]) {
+    const float sx[2] = {quad.x0 * width, quad.x1 * width};
+    const float sy[2] = {quad.y0 * height, quad.y1 * height};
+    for (int i = 0; i < 2; ++i) {
+        if (!(std::fabs(sx[i]) < kGuardBand && std::fabs(sy[i]) < kGuardBand)) {
+            return false;
+        }
+        fx[i] = ToFixed(sx[i]);
+        fy[i] = ToFixed(sy[i]);
+    }
+    return true;
+}
+
+// The two triangles covering a quad, as drawn by DrawTriangle
+inline void QuadTriangles(const Quad& quad, lab_vertex_2TC out[6]) {
+    const float* c = quad.color;
+    const lab_vertex_2TC corners[4] = {
+        {{quad.x0, quad.y0}, {quad.u0, quad.v0}, {c[0], c[1], c[2], c[3]}},
+        {{quad.x1, quad.y0}, {quad.u1, quad.v0}, {c[0], c[1], c[2], c[3]}},
+        {{quad.x0, quad.y1}, {quad.u0, quad.v1}, {c[0], c[1], c[2], c[3]}},
+        {{quad.x1, quad.y1}, {quad.u1, quad.v1}, {c[0], c[1], c[2], c[3]}},
+    };
+    out[0] = corners[0];
+    out[1] = corners[1];
+    out[2] = corners[2];
+    out[3] = corners[2];
+    out[4] = corners[1];
+    out[5] = corners[3];
+}
+
+// Conservative pixel bounds of a quad, clipped to the target
+inline ClipRect QuadBounds(const Quad& quad, uint32_t width, uint32_t height, uint32_t sampleCount = 1) {
+    int64_t fx[2], fy[2];
+    if (!SnapQuad(quad, width, height, fx, fy)) {
+        return {0, 0, 0, 0};
+    }
+    const int64_t cornersX[3] = {fx[0], fx[1], fx[0]};
+    const int64_t cornersY[3] = {fy[0], fy[1], fy[1]};
+    return SnappedTriangleBounds(cornersX, cornersY, width, height, CoverageMargin(sampleCount));
+}
+
+// Solves the run of a row where all three edge functions are non-negative.
+// e holds the edge values at pixel 0 of the row and step their increments
+// per pixel; on return pixels [first, last] are covered, and first > last
+// if none are. The caller initializes the range to the pixels of interest.
+inline void SolveSpan(const int64_t e[3], const int64_t step[3], int64_t& first, int64_t& last) {
+    for (int k = 0; k < 3 && first <= last; ++k) {
+        if (step[k] > 0) {
+            // Covered from the first n with e + n * step >= 0
+            if (e[k] < 0) {
+                first = std::max(first, (-e[k] + step[k] - 1) / step[k]);
+            }
+        } else if (step[k] < 0) {
+            // Covered up to the last n with e + n * step >= 0
+            last = e[k] < 0 ? -1 : std::min(last, e[k] / -step[k]);
+        } else if (e[k] < 0) {
+            last = -1;
+        }
+    }
+}
+
+// Conservative pixel bounds of a line drawn by DrawLine, clipped to the target
+inline ClipRect LineBounds(const lab_vertex_2TC* vertices, float lineWidth,
+                           uint32_t width, uint32_t height) {
+    float x0 = vertices[0].position[0] * width;
+    float y0 = vertices[0].position[1] * height;
+    float x1 = vertices[1].position[0] * width;
+    float y1 = vertices[1].position[1] * height;
+    if (!(std::fabs(x0) < kGuardBand && std::fabs(y0) < kGuardBand &&
+          std::fabs(x1) < kGuardBand && std::fabs(y1) < kGuardBand)) {
+        return FullClipRect(width, height);
+    }
+    
+    // Brush half-width plus a pixel of slack for truncation and the Bresenham step
+    int32_t margin = static_cast<int32_t>(std::max(1.0f, lineWidth)) / 2 + 2;
+    ClipRect bounds;
+    bounds.x0 = static_cast<int32_t>(std::floor(std::min(x0, x1))) - margin;
+    bounds.y0 = static_cast<int32_t>(std::floor(std::min(y0, y1))) - margin;
+    bounds.x1 = static_cast<int32_t>(std::ceil(std::max(x0, x1))) + margin + 1;
+    bounds.y1 = static_cast<int32_t>(std::ceil(std::max(y0, y1))) + margin + 1;
+    return bounds.Intersect(FullClipRect(width, height));
+}
+
+// Sample storage of an anti-aliased render target. Shading is done once per
+// pixel, coverage and blending per sample, and the color buffer always holds
+// the resolved (averaged) image. Only pixels on primitive edges need their
+// samples kept: such a pixel is flagged complex and its samples live in
+// `samples`, while every other pixel is simply its color buffer value.
+// Interior spans of simple pixels therefore render exactly as without
+// anti-aliasing.
+struct SampleBuffer {
+    uint32_t sampleCount;  // 4, 8 or 16
+    uint8_t* complex;      // One flag per pixel
+    uint8_t* samples;      // sampleCount RGBA8 values per pixel, valid if complex
+};
+
+// Blends a source pixel into the samples of a pixel selected by `mask` and
+// updates the resolved color
+inline void BlendSamples(uint8_t* colorBuffer, const SampleBuffer& ms, size_t pixel,
+                         const uint8_t src[4], uint32_t mask, BlendSpanFn blend) {
+    const uint32_t n = ms.sampleCount;
+    uint8_t* color = colorBuffer + pixel * 4;
+    uint8_t* samples = ms.samples + pixel * n * 4;
+    if (!ms.complex[pixel]) {
+        if (mask == (1u << n) - 1) {
+            blend(color, src, 1);
+            return;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            std::memcpy(samples + i * 4, color, 4);
+        }
+        ms.complex[pixel] = 1;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        if (mask & (1u << i)) {
+            blend(samples + i * 4, src, 1);
+        }
+    }
+    
+    // Resolve, and go back to a simple pixel once the samples agree again
+    uint32_t sum[4] = {0, 0, 0, 0};
+    bool uniform = true;
+    for (uint32_t i = 0; i < n; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            sum[c] += samples[i * 4 + c];
+        }
+        uniform = uniform && std::memcmp(samples + i * 4, samples, 4) == 0;
+    }
+    for (int c = 0; c < 4; ++c) {
+        color[c] = static_cast<uint8_t>((sum[c] + n / 2) / n);
+    }
+    if (uniform) {
+        ms.complex[pixel] = 0;
     }
 }
 
 // Rasterization functions
-void DrawTriangle(
+
+// Draws a single triangle and returns the number of pixels written. Only
+// pixels inside `clip` are touched; drawing a triangle once with the full
+// target as clip, or piecewise with any set of disjoint clips covering the
+// target, produces identical results. With a sampler, the interpolated
+// vertex color is modulated by the texture. With a sample buffer the
+// triangle is rendered anti-aliased into it.
+inline size_t DrawTriangle(
     uint8_t* colorBuffer,
     uint8_t* depthBuffer,
     uint32_t width,
     uint32_t height,
     const lab_vertex_2TC* vertices,
-    BlendMode blendMode
+    BlendMode blendMode,
+    const ClipRect& clip,
+    const TextureSampler* sampler = nullptr,
+    const SampleBuffer* multisample = nullptr
 ) {
-    // Convert vertices
-    Vertex cpuVertices[3];
-    for (int i = 0; i < 3; ++i) {
-        cpuVertices[i] = ConvertVertex(vertices[i]);
+    // Snap to the sub-pixel grid
+    int64_t fx[3], fy[3];
+    if (!SnapTriangle(vertices, width, height, fx, fy)) {
+        return 0;
     }
     
-    // Scale vertices to screen space
-    float x0 = cpuVertices[0].position[0] * width;
-    float y0 = cpuVertices[0].position[1] * height;
-    float x1 = cpuVertices[1].position[0] * width;
-    float y1 = cpuVertices[1].position[1] * height;
-    float x2 = cpuVertices[2].position[0] * width;
-    float y2 = cpuVertices[2].position[1] * height;
-    
-    // Compute bounding box
-    int minX = static_cast<int>(std::floor(std::min({x0, x1, x2})));
-    int minY = static_cast<int>(std::floor(std::min({y0, y1, y2})));
-    int maxX = static_cast<int>(std::ceil(std::max({x0, x1, x2})));
-    int maxY = static_cast<int>(std::ceil(std::max({y0, y1, y2})));
-    
-    // Clip to screen
-    minX = std::max(0, minX);
-    minY = std::max(0, minY);
-    maxX = std::min(static_cast<int>(width) - 1, maxX);
-    maxY = std::min(static_cast<int>(height) - 1, maxY);
-    
-    // Precompute edge functions
-    float edge01 = (y0 - y1) * x2 + (x1 - x0) * y2 + (x0 * y1 - y0 * x1);
-    float edge12 = (y1 - y2) * x0 + (x2 - x1) * y0 + (x1 * y2 - y1 * x2);
-    float edge20 = (y2 - y0) * x1 + (x0 - x2) * y1 + (x2 * y0 - y2 * x0);
-    
-    // Check if triangle is backfacing
-    if (edge01 + edge12 + edge20 < 0) {
-        // Flip edges for backfacing triangles
-        edge01 = -edge01;
-        edge12 = -edge12;
-        edge20 = -edge20;
-    }
-    
-    // Rasterize
-    for (int y = minY; y <= maxY; ++y) {
-        for (int x = minX; x <= maxX; ++x) {
-            // Compute barycentric coordinates
-            float w0 = ((y1 - y2) * (x - x2) + (x2 - x1) * (y - y2)) / edge01;
-            float w1 = ((y2 - y0) * (x - x2) + (x0 - x2) * (y - y2)) / edge12;
-            float w2 = 1.0f - w0 - w1;
+    // Compute bounding box in pixels, sampling at pixel centers, and reject
+    // triangles outside the clip before any setup. Colors are anchored at the
+    // left edge of the unclipped box so they do not depend on the clip
+    // rectangle.
+    const uint32_t sampleCount = multisample ? multisample->sampleCount : 1;
+    const SampleOffset* samples = GetSampleOffsets(sampleCount);
+    ClipRect bounds = SnappedTriangleBounds(fx, fy, width, height, CoverageMargin(sampleCount));
+    const int64_t anchorX = bounds.x0;
+    ClipRect clipped = bounds.Intersect(clip);
+    if (clipped.IsEmpty()) {
+        return 0;
+    }
+    
+    // Orient the triangle clockwise so the interior is where all edge
+    // functions are non-negative; both windings are drawn.
+    int i0 = 0, i1 = 1, i2 = 2;
+    int64_t area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+    if (area == 0) {
+        return 0;
+    }
+    if (area < 0) {
+        std::swap(i1, i2);
+        area = -area;
+    }
+    
+    int64_t minX = clipped.x0;
+    int64_t minY = clipped.y0;
+    int64_t maxX = clipped.x1 - 1;
+    int64_t maxY = clipped.y1 - 1;
+    
+    // Edge k is opposite vertex k, so its value is that vertex's barycentric weight
+    EdgeFunction edges[3];
+    edges[0].Setup(fx[i1], fy[i1], fx[i2], fy[i2]);
+    edges[1].Setup(fx[i2], fy[i2], fx[i0], fy[i0]);
+    edges[2].Setup(fx[i0], fy[i0], fx[i1], fy[i1]);
+    
+    // Color gradients per pixel step, derived once from the edge coefficients
+    const float* c0 = vertices[i0].color;
+    const float* c1 = vertices[i1].color;
+    const float* c2 = vertices[i2].color;
+    const float invArea = 1.0f / static_cast<float>(area);
+    float dcdx[4];
+    for (int i = 0; i < 4; ++i) {
+        dcdx[i] = (edges[0].a * c0[i] + edges[1].a * c1[i] + edges[2].a * c2[i]) *
+                  static_cast<float>(kSubPixelScale) * invArea;
+    }
+    
+    // Edge values at the center of the top-left pixel of the clipped box
+    int64_t px = minX * kSubPixelScale + kSubPixelHalf;
+    int64_t py = minY * kSubPixelScale + kSubPixelHalf;
+    int64_t rowE[3];
+    int64_t stepX[3];
+    int64_t stepY[3];
+    for (int k = 0; k < 3; ++k) {
+        rowE[k] = edges[k].Evaluate(px, py);
+        stepX[k] = edges[k].a * kSubPixelScale;
+        stepY[k] = edges[k].b * kSubPixelScale;
+    }
+    
+    // Edge value offsets from the pixel center to each coverage sample
+    int64_t sampleDelta[kMaxSampleCount][3];
+    if (samples) {
+        for (uint32_t s = 0; s < sampleCount; ++s) {
+            for (int k = 0; k < 3; ++k) {
+                sampleDelta[s][k] = edges[k].a * samples[s].x + edges[k].b * samples[s].y;
+            }
+        }
+    }
+    
+    // Texture coordinate gradients, in fixed point texels per pixel step
+    SampleSpanFn sampleSpan = sampler ? GetSampleSpanFn(*sampler) : nullptr;
+    const float* t0 = vertices[i0].texcoord;
+    const float* t1 = vertices[i1].texcoord;
+    const float* t2 = vertices[i2].texcoord;
+    TexcoordSpan texcoords = {0, 0, 0, 0};
+    if (sampleSpan) {
+        float dudx = (edges[0].a * t0[0] + edges[1].a * t1[0] + edges[2].a * t2[0]) *
+                     static_cast<float>(kSubPixelScale) * invArea;
+        float dvdx = (edges[0].a * t0[1] + edges[1].a * t1[1] + edges[2].a * t2[1]) *
+                     static_cast<float>(kSubPixelScale) * invArea;
+        texcoords.dudx = ToTexelFixed(dudx, sampler->width);
+        texcoords.dvdx = ToTexelFixed(dvdx, sampler->height);
+    }
+    
+    const SpanKernels& kernels = GetSpanKernels();
+    ShadeSpanFn shadeSpan = kernels.Shade(blendMode);
+    BlendSpanFn blendSpan = kernels.Blend(blendMode);
+    ShadeSpanFn replaceSpan = kernels.Shade(BlendMode::None);
+    size_t pixelsWritten = 0;
+    
+    // Rasterize. Triangles are convex, so the covered pixels of a row are
+    // one contiguous span; its ends are solved from the edge functions
+    // directly instead of testing pixels, so clipped-away parts cost nothing.
+    // With anti-aliasing every sample position has its own span: pixels in
+    // all of them are fully covered, the rest are edge pixels.
+    const int64_t lastIndex = maxX - minX;
+    const uint32_t fullMask = (1u << sampleCount) - 1;
+    for (int64_t y = minY; y <= maxY; ++y) {
+        int64_t first = 0;
+        int64_t last = lastIndex;
+        int64_t outerFirst = 0;
+        int64_t outerLast = -1;
+        int64_t sampleFirst[kMaxSampleCount];
+        int64_t sampleLast[kMaxSampleCount];
+        if (samples) {
+            outerFirst = lastIndex + 1;
+            for (uint32_t s = 0; s < sampleCount; ++s) {
+                int64_t e[3] = {
+                    rowE[0] + sampleDelta[s][0],
+                    rowE[1] + sampleDelta[s][1],
+                    rowE[2] + sampleDelta[s][2]
+                };
+                sampleFirst[s] = 0;
+                sampleLast[s] = lastIndex;
+                SolveSpan(e, stepX, sampleFirst[s], sampleLast[s]);
+                if (sampleFirst[s] <= sampleLast[s]) {
+                    outerFirst = std::min(outerFirst, sampleFirst[s]);
+                    outerLast = std::max(outerLast, sampleLast[s]);
+                }
+                first = std::max(first, sampleFirst[s]);
+                last = std::min(last, sampleLast[s]);
+            }
+        } else {
+            SolveSpan(rowE, stepX, first, last);
+        }
+        
+        if (first <= last || outerFirst <= outerLast) {
+            // Interpolate the row color at the anchor from the unbiased edge
+            // values; the bias is at most one sub-pixel unit and invisible in
+            // 8-bit color.
+            int64_t toAnchor = anchorX - minX;
+            float w0 = static_cast<float>(rowE[0] + toAnchor * stepX[0]) * invArea;
+            float w1 = static_cast<float>(rowE[1] + toAnchor * stepX[1]) * invArea;
+            float w2 = static_cast<float>(rowE[2] + toAnchor * stepX[2]) * invArea;
+            float color[4];
+            for (int i = 0; i < 4; ++i) {
+                color[i] = w0 * c0[i] + w1 * c1[i] + w2 * c2[i];
+            }
+            if (sampleSpan) {
+                texcoords.u = ToTexelFixed(w0 * t0[0] + w1 * t1[0] + w2 * t2[0], sampler->width);
+                texcoords.v = ToTexelFixed(w0 * t0[1] + w1 * t1[1] + w2 * t2[1], sampler->height);
+            }
+            const size_t rowPixel = size_t(y) * width + size_t(minX);
+            uint8_t* row = &colorBuffer[rowPixel * 4];
+            const uint32_t anchorOffset = static_cast<uint32_t>(minX - anchorX);
             
-            // Check if pixel is inside triangle
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-                // Interpolate color
-                float color[4] = {0, 0, 0, 0};
-                for (int i = 0; i < 4; ++i) {
-                    color[i] = w0 * cpuVertices[0].color[i] + 
-                               w1 * cpuVertices[1].color[i] + 
-                               w2 * cpuVertices[2].color[i];
+            // Shades and blends pixels [from, from + count) of the row
+            auto shadeRun = [&](int64_t from, uint32_t count) {
+                uint32_t index = anchorOffset + static_cast<uint32_t>(from);
+                if (sampleSpan) {
+                    ShadeTexturedSpan(row + from * 4, count, index, color, dcdx, texcoords,
+                                      *sampler, sampleSpan, blendSpan);
+                } else {
+                    shadeSpan(row + from * 4, count, color, dcdx, index);
+                }
+            };
+            
+            // Writes the unblended source colors of pixels [from, from + count)
+            auto shadeSource = [&](uint8_t* out, int64_t from, uint32_t count) {
+                uint32_t index = anchorOffset + static_cast<uint32_t>(from);
+                if (sampleSpan) {
+                    sampleSpan(out, count, index, color, dcdx, texcoords, *sampler);
+                } else {
+                    replaceSpan(out, count, color, dcdx, index);
+                }
+            };
+            
+            // Fully covered pixels. Simple ones are shaded as whole runs;
+            // complex ones blend every sample.
+            if (first <= last && !samples) {
+                shadeRun(first, static_cast<uint32_t>(last - first + 1));
+            } else if (first <= last) {
+                const uint8_t* complex = multisample->complex + rowPixel;
+                int64_t x = first;
+                while (x <= last) {
+                    const void* hit = std::memchr(complex + x, 1, size_t(last - x + 1));
+                    int64_t runEnd = hit ? static_cast<const uint8_t*>(hit) - complex : last + 1;
+                    if (runEnd > x) {
+                        shadeRun(x, static_cast<uint32_t>(runEnd - x));
+                    }
+                    for (x = runEnd; x <= last && complex[x]; ++x) {
+                        uint8_t src[4];
+                        shadeSource(src, x, 1);
+                        BlendSamples(colorBuffer, *multisample, rowPixel + x, src, fullMask, blendSpan);
+                    }
+                }
+            }
+            if (first <= last) {
+                pixelsWritten += static_cast<size_t>(last - first + 1);
+            }
+            
+            // Partly covered pixels left and right of the fully covered ones
+            if (outerFirst <= outerLast) {
+                int64_t ranges[2][2] = {{outerFirst, outerLast}, {1, 0}};
+                if (first <= last) {
+                    ranges[0][1] = first - 1;
+                    ranges[1][0] = last + 1;
+                    ranges[1][1] = outerLast;
+                }
+                for (const auto& range : ranges) {
+                    for (int64_t start = range[0]; start <= range[1]; start += 64) {
+                        uint32_t n = static_cast<uint32_t>(std::min<int64_t>(64, range[1] - start + 1));
+                        uint8_t src[64 * 4];
+                        shadeSource(src, start, n);
+                        for (uint32_t i = 0; i < n; ++i) {
+                            int64_t x = start + i;
+                            uint32_t mask = 0;
+                            for (uint32_t s = 0; s < sampleCount; ++s) {
+                                if (x >= sampleFirst[s] && x <= sampleLast[s]) {
+                                    mask |= 1u << s;
+                                }
+                            }
+                            if (mask) {
+                                BlendSamples(colorBuffer, *multisample, rowPixel + x, src + i * 4,
+                                             mask, blendSpan);
+                                ++pixelsWritten;
+                            }
+                        }
+                    }
                 }
-                
-                // Write pixel
-                uint8_t* pixel = &colorBuffer[(y * width + x) * 4];
-                BlendPixel(pixel, color, blendMode);
             }
         }
+        
+        rowE[0] += stepY[0];
+        rowE[1] += stepY[1];
+        rowE[2] += stepY[2];
     }
+    
+    return pixelsWritten;
 }
 
-void DrawLine(
+inline size_t DrawTriangle(
     uint8_t* colorBuffer,
+    uint8_t* depthBuffer,
     uint32_t width,
     uint32_t height,
     const lab_vertex_2TC* vertices,
-    float lineWidth,
     BlendMode blendMode
 ) {
+    return DrawTriangle(colorBuffer, depthBuffer, width, height, vertices, blendMode,
+                        FullClipRect(width, height));
+}
+
+// Draws a quad and returns the number of pixels written. The covered pixels
+// are exactly those of its two triangles: pixel centers inside the quad, or
+// on its top or left edge. Aliased quads are filled row by row without any
+// edge setup; with a sample buffer the triangles are drawn instead.
+inline size_t DrawQuad(
+    uint8_t* colorBuffer,
+    uint32_t width,
+    uint32_t height,
+    const Quad& quad,
+    BlendMode blendMode,
+    const ClipRect& clip,
+    const TextureSampler* sampler = nullptr,
+    const SampleBuffer* multisample = nullptr
+) {
+    if (multisample) {
+        lab_vertex_2TC vertices[6];
+        QuadTriangles(quad, vertices);
+        return DrawTriangle(colorBuffer, nullptr, width, height, vertices, blendMode, clip, sampler, multisample) +
+               DrawTriangle(colorBuffer, nullptr, width, height, vertices + 3, blendMode, clip, sampler, multisample);
+    }
+    
+    int64_t fx[2], fy[2];
+    if (!SnapQuad(quad, width, height, fx, fy) || fx[0] == fx[1] || fy[0] == fy[1]) {
+        return 0;
+    }
+    
+    // First pixel whose center is at or beyond a sub-pixel coordinate
+    auto firstCenter = [](int64_t f, uint32_t size) {
+        int64_t pixel = (f - kSubPixelHalf + kSubPixelScale - 1) >> kSubPixelBits;
+        return static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(pixel, 0), size));
+    };
+    const ClipRect bounds = {
+        firstCenter(std::min(fx[0], fx[1]), width),
+        firstCenter(std::min(fy[0], fy[1]), height),
+        firstCenter(std::max(fx[0], fx[1]), width),
+        firstCenter(std::max(fy[0], fy[1]), height)
+    };
+    const ClipRect clipped = bounds.Intersect(clip);
+    if (clipped.IsEmpty()) {
+        return 0;
+    }
+    
+    // Texture coordinates are linear in x and y. As for triangles, spans are
+    // anchored at the unclipped left edge so results do not depend on the clip.
+    SampleSpanFn sampleSpan = sampler ? GetSampleSpanFn(*sampler) : nullptr;
+    TexcoordSpan texcoords = {0, 0, 0, 0};
+    float dvdy = 0.0f;
+    if (sampleSpan) {
+        float dudx = (quad.u1 - quad.u0) * static_cast<float>(kSubPixelScale) / static_cast<float>(fx[1] - fx[0]);
+        dvdy = (quad.v1 - quad.v0) * static_cast<float>(kSubPixelScale) / static_cast<float>(fy[1] - fy[0]);
+        float toAnchor = static_cast<float>(int64_t(bounds.x0) * kSubPixelScale + kSubPixelHalf - fx[0]) /
+                         static_cast<float>(kSubPixelScale);
+        texcoords.u = ToTexelFixed(quad.u0 + toAnchor * dudx, sampler->width);
+        texcoords.dudx = ToTexelFixed(dudx, sampler->width);
+    }
+    
+    const float flat[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const SpanKernels& kernels = GetSpanKernels();
+    ShadeSpanFn shadeSpan = kernels.Shade(blendMode);
+    BlendSpanFn blendSpan = kernels.Blend(blendMode);
+    const uint32_t count = static_cast<uint32_t>(clipped.x1 - clipped.x0);
+    const uint32_t index = static_cast<uint32_t>(clipped.x0 - bounds.x0);
+    for (int32_t y = clipped.y0; y < clipped.y1; ++y) {
+        uint8_t* row = &colorBuffer[(size_t(y) * width + size_t(clipped.x0)) * 4];
+        if (sampleSpan) {
+            float toRow = static_cast<float>(int64_t(y) * kSubPixelScale + kSubPixelHalf - fy[0]) /
+                          static_cast<float>(kSubPixelScale);
+            texcoords.v = ToTexelFixed(quad.v0 + toRow * dvdy, sampler->height);
+            ShadeTexturedSpan(row, count, index, quad.color, flat, texcoords, *sampler, sampleSpan, blendSpan);
+        } else {
+            shadeSpan(row, count, quad.color, flat, index);
+        }
+    }
+    return size_t(count) * size_t(clipped.y1 - clipped.y0);
+}
+
+// Draws an anti-aliased line as a quad of the line's width around it
+inline void DrawLineQuad(
+    uint8_t* colorBuffer,
+    uint32_t width,
+    uint32_t height,
+    const lab_vertex_2TC* vertices,
+    float lineWidth,
+    BlendMode blendMode,
+    const ClipRect& clip,
+    const SampleBuffer* multisample
+) {
+    float dx = (vertices[1].position[0] - vertices[0].position[0]) * width;
+    float dy = (vertices[1].position[1] - vertices[0].position[1]) * height;
+    float length = std::sqrt(dx * dx + dy * dy);
+    if (!(length > 0.0f)) {
+        return;
+    }
+    
+    // Half-width normal, back in normalized target units
+    float halfWidth = std::max(1.0f, lineWidth) * 0.5f;
+    float nx = -dy / length * halfWidth / width;
+    float ny = dx / length * halfWidth / height;
+    auto corner = [&](int end, float side) {
+        lab_vertex_2TC v = vertices[end];
+        v.position[0] += side * nx;
+        v.position[1] += side * ny;
+        return v;
+    };
+    const lab_vertex_2TC quad[6] = {
+        corner(0, -1.0f), corner(1, -1.0f), corner(1, 1.0f),
+        corner(0, -1.0f), corner(1, 1.0f), corner(0, 1.0f)
+    };
+    DrawTriangle(colorBuffer, nullptr, width, height, quad, blendMode, clip, nullptr, multisample);
+    DrawTriangle(colorBuffer, nullptr, width, height, quad + 3, blendMode, clip, nullptr, multisample);
+}
+
+// Draws a line with Bresenham's algorithm, touching only pixels inside `clip`.
+// With a sample buffer the line is drawn anti-aliased into it instead.
+inline void DrawLine(
+    uint8_t* colorBuffer,
+    uint32_t width,
+    uint32_t height,
+    const lab_vertex_2TC* vertices,
+    float lineWidth,
+    BlendMode blendMode,
+    const ClipRect& clip,
+    const SampleBuffer* multisample = nullptr
+) {
+    // Lines entirely outside the clip are rejected up front
+    if (LineBounds(vertices, lineWidth, width, height).Intersect(clip).IsEmpty()) {
+        return;
+    }
+    if (multisample) {
+        DrawLineQuad(colorBuffer, width, height, vertices, lineWidth, blendMode, clip, multisample);
+        return;
+    }
+    
     // Convert vertices
     Vertex cpuVertices[2];
     for (int i = 0; i < 2; ++i) {
@@ -176,44 +761,84 @@ void DrawLine(
     int thickness = static_cast<int>(std::max(1.0f, lineWidth));
     int halfThickness = thickness / 2;
     
-    for (int x = static_cast<int>(x0); x <= static_cast<int>(x1); ++x) {
-        // Draw thick line by drawing multiple pixels perpendicular to the line
-        for (int t = -halfThickness; t <= halfThickness; ++t) {
-            int px, py;
-            if (steep) {
-                px = y + t;
-                py = x;
-            } else {
-                px = x;
-                py = y + t;
-            }
-            
-            // Check bounds
-            if (px >= 0 && px < static_cast<int>(width) && 
-                py >= 0 && py < static_cast<int>(height)) {
-                
-                // Interpolate color based on position along the line
-                float alpha = (x - x0) / dx;
-                float color[4];
-                for (int i = 0; i < 4; ++i) {
-                    color[i] = (1.0f - alpha) * cpuVertices[0].color[i] + 
-                               alpha * cpuVertices[1].color[i];
-                }
-                
-                // Write pixel
-                uint8_t* pixel = &colorBuffer[(py * width + px) * 4];
-                BlendPixel(pixel, color, blendMode);
-            }
+    // Color changes linearly along the major axis, anchored at the first
+    // step so runs are shaded the same however they are clipped
+    const float* c0 = cpuVertices[0].color;
+    const float* c1 = cpuVertices[1].color;
+    float dcdx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    if (dx > 0.0f) {
+        for (int i = 0; i < 4; ++i) {
+            dcdx[i] = (c1[i] - c0[i]) / dx;
+        }
+    }
+    auto colorAt = [&](int x, float* color) {
+        float t = static_cast<float>(x) - x0;
+        for (int i = 0; i < 4; ++i) {
+            color[i] = c0[i] + t * dcdx[i];
+        }
+    };
+    const int xStart = static_cast<int>(x0);
+    const int xEnd = static_cast<int>(x1);
+    float anchorColor[4];
+    colorAt(xStart, anchorColor);
+    
+    ShadeSpanFn shadeSpan = GetSpanKernels().Shade(blendMode);
+    const float flat[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    
+    // Emits the horizontal run [xa, xb] on row py, clipped. Pixel x of the run
+    // is shaded with color + (x - anchor) * step.
+    auto emitSpan = [&](int py, int xa, int xb, const float* color, const float* step, int anchor) {
+        if (py < clip.y0 || py >= clip.y1) {
+            return;
+        }
+        int clippedStart = std::max(xa, clip.x0);
+        int clippedEnd = std::min(xb, clip.x1 - 1);
+        if (clippedStart > clippedEnd) {
+            return;
+        }
+        shadeSpan(&colorBuffer[(static_cast<size_t>(py) * width + clippedStart) * 4],
+                  static_cast<uint32_t>(clippedEnd - clippedStart + 1), color, step,
+                  static_cast<uint32_t>(clippedStart - anchor));
+    };
+    
+    int runStart = xStart;
+    for (int x = xStart; x <= xEnd; ++x) {
+        if (steep) {
+            // The brush is horizontal: one run per major step
+            float color[4];
+            colorAt(x, color);
+            emitSpan(x, y - halfThickness, y + halfThickness, color, flat, y - halfThickness);
         }
         
+        int currentY = y;
         error -= dy;
         if (error < 0) {
             y += ystep;
             error += dx;
         }
+        
+        if (!steep && (y != currentY || x == xEnd)) {
+            // The brush is vertical: each brush row gets one run per y step
+            for (int t = -halfThickness; t <= halfThickness; ++t) {
+                emitSpan(currentY + t, runStart, x, anchorColor, dcdx, xStart);
+            }
+            runStart = x + 1;
+        }
     }
 }
 
+inline void DrawLine(
+    uint8_t* colorBuffer,
+    uint32_t width,
+    uint32_t height,
+    const lab_vertex_2TC* vertices,
+    float lineWidth,
+    BlendMode blendMode
+) {
+    DrawLine(colorBuffer, width, height, vertices, lineWidth, blendMode,
+             FullClipRect(width, height));
+}
+
 } // namespace cpu
 } // namespace labfont
 
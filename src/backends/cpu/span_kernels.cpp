@@ -0,0 +1,140 @@
+#include "span_kernels.h"
+#include <cstring>
+#include <initializer_list>
+
+#if defined(LABFONT_CPU_X86_KERNELS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace labfont {
+namespace cpu {
+
+void FillSpanScalar(uint8_t* dst, uint32_t count, uint32_t rgba) {
+    uint8_t bytes[4] = {
+        static_cast<uint8_t>(rgba),
+        static_cast<uint8_t>(rgba >> 8),
+        static_cast<uint8_t>(rgba >> 16),
+        static_cast<uint8_t>(rgba >> 24)
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        std::memcpy(dst + i * 4, bytes, 4);
+    }
+}
+
+void BlendSpanCopy(uint8_t* dst, const uint8_t* src, uint32_t count) {
+    std::memcpy(dst, src, size_t(count) * 4);
+}
+
+namespace {
+
+// The blend is a template parameter so each mode gets its own loop
+template<void (*BlendPixel)(uint8_t*, const uint8_t*)>
+void ShadeSpan(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+               uint32_t first) {
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t src[4];
+        SpanColorAt(color, dcdx, first + i, src);
+        BlendPixel(dst + i * 4, src);
+    }
+}
+
+template<void (*BlendPixel)(uint8_t*, const uint8_t*)>
+void BlendSpan(uint8_t* dst, const uint8_t* src, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        BlendPixel(dst + i * 4, src + i * 4);
+    }
+}
+
+const SpanKernels kSpanKernelsScalar = {
+    SpanKernelLevel::Scalar,
+    FillSpanScalar,
+    {
+        ShadeSpan<BlendPixelReplace>,   // None
+        ShadeSpan<BlendPixelAlpha>,     // Alpha
+        ShadeSpan<BlendPixelAdditive>,  // Additive
+        ShadeSpan<BlendPixelMultiply>,  // Multiply
+        ShadeSpan<BlendPixelScreen>,    // Screen
+    },
+    {
+        BlendSpanCopy,                  // None
+        BlendSpan<BlendPixelAlpha>,     // Alpha
+        BlendSpan<BlendPixelAdditive>,  // Additive
+        BlendSpan<BlendPixelMultiply>,  // Multiply
+        BlendSpan<BlendPixelScreen>,    // Screen
+    }
+};
+
+#if defined(LABFONT_CPU_X86_KERNELS)
+bool CPUSupports(SpanKernelLevel level) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    return level == SpanKernelLevel::SSE4 ? sse41 : avx2;
+#else
+    __builtin_cpu_init();
+    if (level == SpanKernelLevel::SSE4) {
+        return __builtin_cpu_supports("sse4.1");
+    }
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+const SpanKernels& SelectSpanKernels() {
+    for (SpanKernelLevel level : {SpanKernelLevel::AVX2, SpanKernelLevel::SSE4,
+                                  SpanKernelLevel::NEON}) {
+        if (const SpanKernels* kernels = GetSpanKernels(level)) {
+            return *kernels;
+        }
+    }
+    return kSpanKernelsScalar;
+}
+
+} // namespace
+
+const SpanKernels& GetSpanKernels() {
+    static const SpanKernels& kernels = SelectSpanKernels();
+    return kernels;
+}
+
+const SpanKernels* GetSpanKernels(SpanKernelLevel level) {
+    switch (level) {
+        case SpanKernelLevel::Scalar:
+            return &kSpanKernelsScalar;
+#if defined(LABFONT_CPU_X86_KERNELS)
+        case SpanKernelLevel::SSE4:
+            return CPUSupports(level) ? &kSpanKernelsSSE4 : nullptr;
+        case SpanKernelLevel::AVX2:
+            return CPUSupports(level) ? &kSpanKernelsAVX2 : nullptr;
+#endif
+#if defined(LABFONT_CPU_NEON_KERNELS)
+        case SpanKernelLevel::NEON:
+            return &kSpanKernelsNEON;  // NEON is part of the AArch64 baseline
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const char* GetSpanKernelLevelName(SpanKernelLevel level) {
+    switch (level) {
+        case SpanKernelLevel::Scalar: return "scalar";
+        case SpanKernelLevel::SSE4: return "sse4.1";
+        case SpanKernelLevel::AVX2: return "avx2";
+        case SpanKernelLevel::NEON: return "neon";
+    }
+    return "unknown";
+}
+
+} // namespace cpu
+} // namespace labfont
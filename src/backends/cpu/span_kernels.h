@@ -0,0 +1,173 @@
+#ifndef LABFONT_CPU_SPAN_KERNELS_H
+#define LABFONT_CPU_SPAN_KERNELS_H
+
+#include "core/internal_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace labfont {
+namespace cpu {
+
+// Span kernels shade and blend a horizontal run of RGBA8 pixels. The
+// rasterizers reduce every primitive to spans, so these loops are where the
+// CPU backend spends its time. Each kernel exists as a scalar reference and
+// as SIMD variants; the best one for the running CPU is selected once.
+//
+// All variants use the same integer arithmetic and produce identical results:
+// colors are clamped to [0,1], scaled by 255 and rounded to nearest, and
+// blends use an exactly rounded division by 255.
+//
+// Source pixels carry straight alpha and are premultiplied by the blend; the
+// target holds premultiplied color. With S = (src.rgb * src.a, src.a):
+//
+//   None      dst = src
+//   Alpha     dst = S + dst * (1 - src.a)
+//   Additive  dst = min(S + dst, 1)
+//   Multiply  dst.rgb = S.rgb * dst.rgb + dst.rgb * (1 - src.a), dst.a kept
+//   Screen    dst = S + dst * (1 - S)
+
+constexpr int kBlendModeCount = 5;
+
+// Fills `count` pixels with a packed RGBA8 value (byte order R, G, B, A)
+using FillSpanFn = void (*)(uint8_t* dst, uint32_t count, uint32_t rgba);
+
+// Shades `count` pixels of a linear color gradient and blends them into `dst`.
+// Pixel i receives color + (first + i) * dcdx; anchoring the gradient at a
+// fixed pixel keeps the result independent of where a span is split.
+using ShadeSpanFn = void (*)(uint8_t* dst, uint32_t count, const float color[4],
+                             const float dcdx[4], uint32_t first);
+
+// Blends `count` RGBA8 source pixels into `dst`
+using BlendSpanFn = void (*)(uint8_t* dst, const uint8_t* src, uint32_t count);
+
+enum class SpanKernelLevel {
+    Scalar,
+    SSE4,
+    AVX2,
+    NEON
+};
+
+struct SpanKernels {
+    SpanKernelLevel level;
+    FillSpanFn fill;
+    ShadeSpanFn shade[kBlendModeCount];  // Indexed by BlendMode
+    BlendSpanFn blend[kBlendModeCount];  // Indexed by BlendMode
+
+    ShadeSpanFn Shade(BlendMode mode) const {
+        return shade[static_cast<int>(mode)];
+    }
+
+    BlendSpanFn Blend(BlendMode mode) const {
+        return blend[static_cast<int>(mode)];
+    }
+};
+
+// Best kernels supported by the running CPU, resolved on first use
+const SpanKernels& GetSpanKernels();
+
+// Kernels for a specific instruction set, or nullptr if the CPU (or this
+// build) does not support it. Used to compare variants in tests and benchmarks.
+const SpanKernels* GetSpanKernels(SpanKernelLevel level);
+
+const char* GetSpanKernelLevelName(SpanKernelLevel level);
+
+// Scalar building blocks for the reference kernels
+
+// x / 255, rounded to nearest, for x in [0, 65535]
+inline uint32_t Div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Clamps to [0,1] and scales to [0,255], rounding to nearest even like the
+// SIMD conversions. Adding 1.5 * 2^23 leaves the rounded integer in the low
+// mantissa bits, which is much cheaper than calling lrint per channel.
+inline uint8_t ToUnorm8(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    float scaled = value * 255.0f;
+    float biased = scaled + 12582912.0f;
+    uint32_t bits;
+    std::memcpy(&bits, &biased, sizeof(bits));
+    return static_cast<uint8_t>(bits);
+}
+
+inline uint32_t PackRGBA8(const uint8_t rgba[4]) {
+    return uint32_t(rgba[0]) | (uint32_t(rgba[1]) << 8) | (uint32_t(rgba[2]) << 16) |
+           (uint32_t(rgba[3]) << 24);
+}
+
+// Color of pixel i of a gradient span, as 8-bit RGBA
+inline void SpanColorAt(const float color[4], const float dcdx[4], uint32_t i, uint8_t out[4]) {
+    // The kernel sources are built with FP contraction disabled, so this
+    // rounds the multiply and the add separately just like the SIMD kernels.
+    float fi = static_cast<float>(i);
+    for (int c = 0; c < 4; ++c) {
+        float step = fi * dcdx[c];
+        out[c] = ToUnorm8(color[c] + step);
+    }
+}
+
+inline void BlendPixelReplace(uint8_t* dst, const uint8_t src[4]) {
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+    dst[3] = src[3];
+}
+
+// Premultiplies and blends in one rounding step
+inline void BlendPixelAlpha(uint8_t* dst, const uint8_t src[4]) {
+    uint32_t a = src[3];
+    uint32_t ia = 255 - a;
+    dst[0] = static_cast<uint8_t>(Div255(dst[0] * ia + src[0] * a));
+    dst[1] = static_cast<uint8_t>(Div255(dst[1] * ia + src[1] * a));
+    dst[2] = static_cast<uint8_t>(Div255(dst[2] * ia + src[2] * a));
+    dst[3] = static_cast<uint8_t>(Div255(dst[3] * ia + 255 * a));
+}
+
+inline void BlendPixelAdditive(uint8_t* dst, const uint8_t src[4]) {
+    uint32_t a = src[3];
+    for (int c = 0; c < 3; ++c) {
+        uint32_t sum = dst[c] + Div255(src[c] * a);
+        dst[c] = static_cast<uint8_t>(sum > 255 ? 255 : sum);
+    }
+    uint32_t sum = dst[3] + a;
+    dst[3] = static_cast<uint8_t>(sum > 255 ? 255 : sum);
+}
+
+inline void BlendPixelMultiply(uint8_t* dst, const uint8_t src[4]) {
+    uint32_t a = src[3];
+    for (int c = 0; c < 3; ++c) {
+        uint32_t factor = Div255(src[c] * a) + 255 - a;
+        dst[c] = static_cast<uint8_t>(Div255(dst[c] * factor));
+    }
+}
+
+inline void BlendPixelScreen(uint8_t* dst, const uint8_t src[4]) {
+    uint32_t a = src[3];
+    for (int c = 0; c < 3; ++c) {
+        uint32_t s = Div255(src[c] * a);
+        dst[c] = static_cast<uint8_t>(s + Div255(dst[c] * (255 - s)));
+    }
+    dst[3] = static_cast<uint8_t>(a + Div255(dst[3] * (255 - a)));
+}
+
+// Scalar fill, also used by the SIMD fills for the last few pixels of a span
+void FillSpanScalar(uint8_t* dst, uint32_t count, uint32_t rgba);
+
+// Replace blend of a source span; a plain copy on every instruction set
+void BlendSpanCopy(uint8_t* dst, const uint8_t* src, uint32_t count);
+
+// Per instruction set tables, defined in span_kernels_<isa>.cpp
+#if defined(LABFONT_CPU_X86_KERNELS)
+extern const SpanKernels kSpanKernelsSSE4;
+extern const SpanKernels kSpanKernelsAVX2;
+#endif
+#if defined(LABFONT_CPU_NEON_KERNELS)
+extern const SpanKernels kSpanKernelsNEON;
+#endif
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_SPAN_KERNELS_H
@@ -0,0 +1,194 @@
+// AVX2 span kernels, eight pixels per step. This file is compiled with
+// -mavx2 and is only called after a runtime CPU check.
+
+#include "span_kernels.h"
+
+#if defined(LABFONT_CPU_X86_KERNELS)
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace labfont {
+namespace cpu {
+
+namespace {
+
+struct Gradient {
+    __m256 color[4];
+    __m256 dcdx[4];
+};
+
+inline Gradient LoadGradient(const float color[4], const float dcdx[4]) {
+    Gradient g;
+    for (int c = 0; c < 4; ++c) {
+        g.color[c] = _mm256_set1_ps(color[c]);
+        g.dcdx[c] = _mm256_set1_ps(dcdx[c]);
+    }
+    return g;
+}
+
+// Shades pixels i..i+7 of a gradient span into eight packed RGBA8 pixels
+inline __m256i ShadeOctet(const Gradient& g, uint32_t i) {
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(255.0f);
+    __m256 fi = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lane);
+
+    __m256i channel[4];
+    for (int c = 0; c < 4; ++c) {
+        __m256 v = _mm256_add_ps(g.color[c], _mm256_mul_ps(fi, g.dcdx[c]));
+        v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+        channel[c] = _mm256_cvtps_epi32(_mm256_mul_ps(v, scale));
+    }
+
+    // The packs work within 128-bit lanes, so each lane ends up holding
+    // planar bytes for four consecutive pixels, already in memory order.
+    __m256i rg = _mm256_packus_epi32(channel[0], channel[1]);
+    __m256i ba = _mm256_packus_epi32(channel[2], channel[3]);
+    __m256i planar = _mm256_packus_epi16(rg, ba);
+    const __m256i interleave = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                                2, 6, 10, 14, 3, 7, 11, 15,
+                                                0, 4, 8, 12, 1, 5, 9, 13,
+                                                2, 6, 10, 14, 3, 7, 11, 15);
+    return _mm256_shuffle_epi8(planar, interleave);
+}
+
+inline __m256i Div255(__m256i x) {
+    __m256i t = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// The blends work on two pixels per 128-bit lane widened to 16-bit words;
+// see span_kernels.h for the formulas. Word 3 of each pixel is alpha.
+inline __m256i AlphaWords(__m256i s) {
+    const __m256i alphaWords = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7,
+                                                14, 15, 14, 15, 14, 15, 14, 15,
+                                                6, 7, 6, 7, 6, 7, 6, 7,
+                                                14, 15, 14, 15, 14, 15, 14, 15);
+    return _mm256_shuffle_epi8(s, alphaWords);
+}
+
+// (s.rgb * a, a)
+inline __m256i Premultiply(__m256i s, __m256i a) {
+    return Div255(_mm256_mullo_epi16(s, _mm256_blend_epi16(a, _mm256_set1_epi16(255), 0x88)));
+}
+
+inline __m256i BlendWordsAlpha(__m256i s, __m256i d) {
+    const __m256i full = _mm256_set1_epi16(255);
+    __m256i a = AlphaWords(s);
+    s = _mm256_blend_epi16(s, full, 0x88);
+    return Div255(_mm256_add_epi16(_mm256_mullo_epi16(s, a),
+                                   _mm256_mullo_epi16(d, _mm256_sub_epi16(full, a))));
+}
+
+// Sums above 255 saturate when the words are packed back to bytes
+inline __m256i BlendWordsAdditive(__m256i s, __m256i d) {
+    return _mm256_add_epi16(Premultiply(s, AlphaWords(s)), d);
+}
+
+// The alpha word of the factor is 255, which keeps dst.a
+inline __m256i BlendWordsMultiply(__m256i s, __m256i d) {
+    __m256i a = AlphaWords(s);
+    __m256i factor = _mm256_sub_epi16(_mm256_add_epi16(Premultiply(s, a), _mm256_set1_epi16(255)), a);
+    return Div255(_mm256_mullo_epi16(d, factor));
+}
+
+inline __m256i BlendWordsScreen(__m256i s, __m256i d) {
+    __m256i p = Premultiply(s, AlphaWords(s));
+    return _mm256_add_epi16(p, Div255(_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), p))));
+}
+
+// Blends eight packed RGBA8 source pixels into eight destination pixels. The
+// unpacks and the pack both work within 128-bit lanes, so pixel order is kept.
+template<__m256i (*BlendWords)(__m256i, __m256i)>
+inline __m256i BlendOctet(__m256i src, __m256i dst) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = BlendWords(_mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi8(dst, zero));
+    __m256i hi = BlendWords(_mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi8(dst, zero));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+void FillSpan(uint8_t* dst, uint32_t count, uint32_t rgba) {
+    const __m256i value = _mm256_set1_epi32(static_cast<int>(rgba));
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), value);
+    }
+    FillSpanScalar(dst + i * 4, count - i, rgba);
+}
+
+void ShadeSpanReplace(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+                      uint32_t first) {
+    Gradient g = LoadGradient(color, dcdx);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), ShadeOctet(g, first + i));
+    }
+    if (i < count) {
+        // Shade a whole octet and keep only the pixels inside the span
+        __m256i tail = ShadeOctet(g, first + i);
+        std::memcpy(dst + i * 4, &tail, (count - i) * 4);
+    }
+}
+
+template<__m256i (*Blend)(__m256i, __m256i)>
+void ShadeSpanBlend(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+                    uint32_t first) {
+    Gradient g = LoadGradient(color, dcdx);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i* p = reinterpret_cast<__m256i*>(dst + i * 4);
+        _mm256_storeu_si256(p, Blend(ShadeOctet(g, first + i), _mm256_loadu_si256(p)));
+    }
+    if (i < count) {
+        __m256i tail = _mm256_setzero_si256();
+        std::memcpy(&tail, dst + i * 4, (count - i) * 4);
+        tail = Blend(ShadeOctet(g, first + i), tail);
+        std::memcpy(dst + i * 4, &tail, (count - i) * 4);
+    }
+}
+
+template<__m256i (*Blend)(__m256i, __m256i)>
+void BlendSpan(uint8_t* dst, const uint8_t* src, uint32_t count) {
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i* p = reinterpret_cast<__m256i*>(dst + i * 4);
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(p, Blend(s, _mm256_loadu_si256(p)));
+    }
+    if (i < count) {
+        __m256i s = _mm256_setzero_si256();
+        __m256i d = _mm256_setzero_si256();
+        std::memcpy(&s, src + i * 4, (count - i) * 4);
+        std::memcpy(&d, dst + i * 4, (count - i) * 4);
+        d = Blend(s, d);
+        std::memcpy(dst + i * 4, &d, (count - i) * 4);
+    }
+}
+
+} // namespace
+
+const SpanKernels kSpanKernelsAVX2 = {
+    SpanKernelLevel::AVX2,
+    FillSpan,
+    {
+        ShadeSpanReplace,                                // None
+        ShadeSpanBlend<BlendOctet<BlendWordsAlpha>>,     // Alpha
+        ShadeSpanBlend<BlendOctet<BlendWordsAdditive>>,  // Additive
+        ShadeSpanBlend<BlendOctet<BlendWordsMultiply>>,  // Multiply
+        ShadeSpanBlend<BlendOctet<BlendWordsScreen>>,    // Screen
+    },
+    {
+        BlendSpanCopy,                                   // None
+        BlendSpan<BlendOctet<BlendWordsAlpha>>,          // Alpha
+        BlendSpan<BlendOctet<BlendWordsAdditive>>,       // Additive
+        BlendSpan<BlendOctet<BlendWordsMultiply>>,       // Multiply
+        BlendSpan<BlendOctet<BlendWordsScreen>>,         // Screen
+    }
+};
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_X86_KERNELS
@@ -0,0 +1,178 @@
+// NEON span kernels, eight pixels per step. NEON is part of the AArch64
+// baseline, so no runtime check is needed.
+
+#include "span_kernels.h"
+
+#if defined(LABFONT_CPU_NEON_KERNELS)
+
+#include <arm_neon.h>
+#include <cstring>
+
+namespace labfont {
+namespace cpu {
+
+namespace {
+
+struct Gradient {
+    float32x4_t color[4];
+    float32x4_t dcdx[4];
+};
+
+inline Gradient LoadGradient(const float color[4], const float dcdx[4]) {
+    Gradient g;
+    for (int c = 0; c < 4; ++c) {
+        g.color[c] = vdupq_n_f32(color[c]);
+        g.dcdx[c] = vdupq_n_f32(dcdx[c]);
+    }
+    return g;
+}
+
+inline uint16x4_t ShadeChannel(float32x4_t color, float32x4_t dcdx, float32x4_t fi) {
+    float32x4_t v = vaddq_f32(color, vmulq_f32(fi, dcdx));
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+    return vqmovun_s32(vcvtnq_s32_f32(vmulq_f32(v, vdupq_n_f32(255.0f))));
+}
+
+// Shades pixels i..i+7 of a gradient span as planar R, G, B, A bytes
+inline uint8x8x4_t ShadeOctet(const Gradient& g, uint32_t i) {
+    const float lanesLo[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    const float lanesHi[4] = {4.0f, 5.0f, 6.0f, 7.0f};
+    float32x4_t base = vdupq_n_f32(static_cast<float>(i));
+    float32x4_t fiLo = vaddq_f32(base, vld1q_f32(lanesLo));
+    float32x4_t fiHi = vaddq_f32(base, vld1q_f32(lanesHi));
+
+    uint8x8x4_t out;
+    for (int c = 0; c < 4; ++c) {
+        uint16x8_t wide = vcombine_u16(ShadeChannel(g.color[c], g.dcdx[c], fiLo),
+                                       ShadeChannel(g.color[c], g.dcdx[c], fiHi));
+        out.val[c] = vqmovn_u16(wide);
+    }
+    return out;
+}
+
+inline uint8x8_t Div255(uint16x8_t x) {
+    uint16x8_t t = vaddq_u16(x, vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+void FillSpan(uint8_t* dst, uint32_t count, uint32_t rgba) {
+    const uint32x4_t value = vdupq_n_u32(rgba);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(value));
+    }
+    FillSpanScalar(dst + i * 4, count - i, rgba);
+}
+
+void ShadeSpanReplace(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+                      uint32_t first) {
+    Gradient g = LoadGradient(color, dcdx);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst4_u8(dst + i * 4, ShadeOctet(g, first + i));
+    }
+    if (i < count) {
+        // Shade a whole octet and keep only the pixels inside the span
+        uint8_t tail[32];
+        vst4_u8(tail, ShadeOctet(g, first + i));
+        std::memcpy(dst + i * 4, tail, (count - i) * 4);
+    }
+}
+
+// Blends eight planar source pixels into eight destination pixels; see
+// span_kernels.h for the formulas
+inline uint8x8x4_t BlendAlpha(uint8x8x4_t s, uint8x8x4_t d) {
+    uint8x8_t a = s.val[3];
+    uint8x8_t ia = vsub_u8(vdup_n_u8(255), a);
+    for (int c = 0; c < 3; ++c) {
+        d.val[c] = Div255(vmlal_u8(vmull_u8(d.val[c], ia), s.val[c], a));
+    }
+    d.val[3] = Div255(vmlal_u8(vmull_u8(d.val[3], ia), vdup_n_u8(255), a));
+    return d;
+}
+
+inline uint8x8x4_t BlendAdditive(uint8x8x4_t s, uint8x8x4_t d) {
+    uint8x8_t a = s.val[3];
+    for (int c = 0; c < 3; ++c) {
+        d.val[c] = vqadd_u8(d.val[c], Div255(vmull_u8(s.val[c], a)));
+    }
+    d.val[3] = vqadd_u8(d.val[3], a);
+    return d;
+}
+
+inline uint8x8x4_t BlendMultiply(uint8x8x4_t s, uint8x8x4_t d) {
+    uint8x8_t a = s.val[3];
+    uint8x8_t ia = vsub_u8(vdup_n_u8(255), a);
+    for (int c = 0; c < 3; ++c) {
+        uint8x8_t factor = vadd_u8(Div255(vmull_u8(s.val[c], a)), ia);
+        d.val[c] = Div255(vmull_u8(d.val[c], factor));
+    }
+    return d;
+}
+
+inline uint8x8x4_t BlendScreen(uint8x8x4_t s, uint8x8x4_t d) {
+    uint8x8_t a = s.val[3];
+    for (int c = 0; c < 4; ++c) {
+        uint8x8_t p = c < 3 ? Div255(vmull_u8(s.val[c], a)) : a;
+        d.val[c] = vadd_u8(p, Div255(vmull_u8(d.val[c], vmvn_u8(p))));
+    }
+    return d;
+}
+
+template<uint8x8x4_t (*Blend)(uint8x8x4_t, uint8x8x4_t)>
+void ShadeSpanBlend(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+                    uint32_t first) {
+    Gradient g = LoadGradient(color, dcdx);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst4_u8(dst + i * 4, Blend(ShadeOctet(g, first + i), vld4_u8(dst + i * 4)));
+    }
+    if (i < count) {
+        uint8_t tail[32] = {};
+        std::memcpy(tail, dst + i * 4, (count - i) * 4);
+        vst4_u8(tail, Blend(ShadeOctet(g, first + i), vld4_u8(tail)));
+        std::memcpy(dst + i * 4, tail, (count - i) * 4);
+    }
+}
+
+template<uint8x8x4_t (*Blend)(uint8x8x4_t, uint8x8x4_t)>
+void BlendSpan(uint8_t* dst, const uint8_t* src, uint32_t count) {
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vst4_u8(dst + i * 4, Blend(vld4_u8(src + i * 4), vld4_u8(dst + i * 4)));
+    }
+    if (i < count) {
+        uint8_t s[32] = {};
+        uint8_t d[32] = {};
+        std::memcpy(s, src + i * 4, (count - i) * 4);
+        std::memcpy(d, dst + i * 4, (count - i) * 4);
+        vst4_u8(d, Blend(vld4_u8(s), vld4_u8(d)));
+        std::memcpy(dst + i * 4, d, (count - i) * 4);
+    }
+}
+
+} // namespace
+
+const SpanKernels kSpanKernelsNEON = {
+    SpanKernelLevel::NEON,
+    FillSpan,
+    {
+        ShadeSpanReplace,               // None
+        ShadeSpanBlend<BlendAlpha>,     // Alpha
+        ShadeSpanBlend<BlendAdditive>,  // Additive
+        ShadeSpanBlend<BlendMultiply>,  // Multiply
+        ShadeSpanBlend<BlendScreen>,    // Screen
+    },
+    {
+        BlendSpanCopy,                  // None
+        BlendSpan<BlendAlpha>,          // Alpha
+        BlendSpan<BlendAdditive>,       // Additive
+        BlendSpan<BlendMultiply>,       // Multiply
+        BlendSpan<BlendScreen>,         // Screen
+    }
+};
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_NEON_KERNELS
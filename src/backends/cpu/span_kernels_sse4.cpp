@@ -0,0 +1,187 @@
+// SSE4.1 span kernels, four pixels per step. This file is compiled with
+// -msse4.1 and is only called after a runtime CPU check.
+
+#include "span_kernels.h"
+
+#if defined(LABFONT_CPU_X86_KERNELS)
+
+#include <smmintrin.h>
+#include <cstring>
+
+namespace labfont {
+namespace cpu {
+
+namespace {
+
+struct Gradient {
+    __m128 color[4];
+    __m128 dcdx[4];
+};
+
+inline Gradient LoadGradient(const float color[4], const float dcdx[4]) {
+    Gradient g;
+    for (int c = 0; c < 4; ++c) {
+        g.color[c] = _mm_set1_ps(color[c]);
+        g.dcdx[c] = _mm_set1_ps(dcdx[c]);
+    }
+    return g;
+}
+
+// Shades pixels i..i+3 of a gradient span into four packed RGBA8 pixels
+inline __m128i ShadeQuad(const Gradient& g, uint32_t i) {
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    __m128 fi = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lane);
+
+    __m128i channel[4];
+    for (int c = 0; c < 4; ++c) {
+        __m128 v = _mm_add_ps(g.color[c], _mm_mul_ps(fi, g.dcdx[c]));
+        v = _mm_min_ps(_mm_max_ps(v, zero), one);
+        channel[c] = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+    }
+
+    // Planar RRRR GGGG BBBB AAAA bytes, then interleave into RGBA pixels
+    __m128i rg = _mm_packus_epi32(channel[0], channel[1]);
+    __m128i ba = _mm_packus_epi32(channel[2], channel[3]);
+    __m128i planar = _mm_packus_epi16(rg, ba);
+    const __m128i interleave = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                             2, 6, 10, 14, 3, 7, 11, 15);
+    return _mm_shuffle_epi8(planar, interleave);
+}
+
+inline __m128i Div255(__m128i x) {
+    __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// The blends work on two pixels per register widened to 16-bit words; see
+// span_kernels.h for the formulas. Word 3 of each pixel is alpha.
+inline __m128i AlphaWords(__m128i s) {
+    const __m128i alphaWords = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7,
+                                             14, 15, 14, 15, 14, 15, 14, 15);
+    return _mm_shuffle_epi8(s, alphaWords);
+}
+
+// (s.rgb * a, a)
+inline __m128i Premultiply(__m128i s, __m128i a) {
+    return Div255(_mm_mullo_epi16(s, _mm_blend_epi16(a, _mm_set1_epi16(255), 0x88)));
+}
+
+inline __m128i BlendWordsAlpha(__m128i s, __m128i d) {
+    const __m128i full = _mm_set1_epi16(255);
+    __m128i a = AlphaWords(s);
+    s = _mm_blend_epi16(s, full, 0x88);
+    return Div255(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(full, a))));
+}
+
+// Sums above 255 saturate when the words are packed back to bytes
+inline __m128i BlendWordsAdditive(__m128i s, __m128i d) {
+    return _mm_add_epi16(Premultiply(s, AlphaWords(s)), d);
+}
+
+// The alpha word of the factor is 255, which keeps dst.a
+inline __m128i BlendWordsMultiply(__m128i s, __m128i d) {
+    __m128i a = AlphaWords(s);
+    __m128i factor = _mm_sub_epi16(_mm_add_epi16(Premultiply(s, a), _mm_set1_epi16(255)), a);
+    return Div255(_mm_mullo_epi16(d, factor));
+}
+
+inline __m128i BlendWordsScreen(__m128i s, __m128i d) {
+    __m128i p = Premultiply(s, AlphaWords(s));
+    return _mm_add_epi16(p, Div255(_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), p))));
+}
+
+// Blends four packed RGBA8 source pixels into four destination pixels
+template<__m128i (*BlendWords)(__m128i, __m128i)>
+inline __m128i BlendQuad(__m128i src, __m128i dst) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = BlendWords(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero));
+    __m128i hi = BlendWords(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero));
+    return _mm_packus_epi16(lo, hi);
+}
+
+void FillSpan(uint8_t* dst, uint32_t count, uint32_t rgba) {
+    const __m128i value = _mm_set1_epi32(static_cast<int>(rgba));
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), value);
+    }
+    FillSpanScalar(dst + i * 4, count - i, rgba);
+}
+
+void ShadeSpanReplace(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+                      uint32_t first) {
+    Gradient g = LoadGradient(color, dcdx);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), ShadeQuad(g, first + i));
+    }
+    if (i < count) {
+        // Shade a whole quad and keep only the pixels inside the span
+        __m128i tail = ShadeQuad(g, first + i);
+        std::memcpy(dst + i * 4, &tail, (count - i) * 4);
+    }
+}
+
+template<__m128i (*Blend)(__m128i, __m128i)>
+void ShadeSpanBlend(uint8_t* dst, uint32_t count, const float color[4], const float dcdx[4],
+                    uint32_t first) {
+    Gradient g = LoadGradient(color, dcdx);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i* p = reinterpret_cast<__m128i*>(dst + i * 4);
+        _mm_storeu_si128(p, Blend(ShadeQuad(g, first + i), _mm_loadu_si128(p)));
+    }
+    if (i < count) {
+        __m128i tail = _mm_setzero_si128();
+        std::memcpy(&tail, dst + i * 4, (count - i) * 4);
+        tail = Blend(ShadeQuad(g, first + i), tail);
+        std::memcpy(dst + i * 4, &tail, (count - i) * 4);
+    }
+}
+
+template<__m128i (*Blend)(__m128i, __m128i)>
+void BlendSpan(uint8_t* dst, const uint8_t* src, uint32_t count) {
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i* p = reinterpret_cast<__m128i*>(dst + i * 4);
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(p, Blend(s, _mm_loadu_si128(p)));
+    }
+    if (i < count) {
+        __m128i s = _mm_setzero_si128();
+        __m128i d = _mm_setzero_si128();
+        std::memcpy(&s, src + i * 4, (count - i) * 4);
+        std::memcpy(&d, dst + i * 4, (count - i) * 4);
+        d = Blend(s, d);
+        std::memcpy(dst + i * 4, &d, (count - i) * 4);
+    }
+}
+
+} // namespace
+
+const SpanKernels kSpanKernelsSSE4 = {
+    SpanKernelLevel::SSE4,
+    FillSpan,
+    {
+        ShadeSpanReplace,                               // None
+        ShadeSpanBlend<BlendQuad<BlendWordsAlpha>>,     // Alpha
+        ShadeSpanBlend<BlendQuad<BlendWordsAdditive>>,  // Additive
+        ShadeSpanBlend<BlendQuad<BlendWordsMultiply>>,  // Multiply
+        ShadeSpanBlend<BlendQuad<BlendWordsScreen>>,    // Screen
+    },
+    {
+        BlendSpanCopy,                                  // None
+        BlendSpan<BlendQuad<BlendWordsAlpha>>,          // Alpha
+        BlendSpan<BlendQuad<BlendWordsAdditive>>,       // Additive
+        BlendSpan<BlendQuad<BlendWordsMultiply>>,       // Multiply
+        BlendSpan<BlendQuad<BlendWordsScreen>>,         // Screen
+    }
+};
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_X86_KERNELS
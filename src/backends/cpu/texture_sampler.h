@@ -0,0 +1,153 @@
+#ifndef LABFONT_CPU_TEXTURE_SAMPLER_H
+#define LABFONT_CPU_TEXTURE_SAMPLER_H
+
+#include "span_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace labfont {
+namespace cpu {
+
+// Texture coordinates are stepped across a span in fixed point texel units.
+// 24 fractional bits keep the accumulated error below 1/2000 of a texel over
+// an 8K span.
+constexpr int kTexcoordBits = 24;
+constexpr int64_t kTexcoordOne = int64_t(1) << kTexcoordBits;
+
+// A texture bound for sampling. Only 8-bit formats are sampled: single
+// channel textures act as alpha masks (font atlases), four channel textures
+// as RGBA images. Addressing clamps to the edge.
+struct TextureSampler {
+    const uint8_t* texels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;  // 1 or 4
+    lab_texture_filter filter;
+};
+
+// Position of a span in texture space: pixel i samples at
+// (u + (first + i) * dudx, v + (first + i) * dvdx), all in fixed point texels.
+// Stepping from a fixed anchor in integers gives the same coordinates no
+// matter where a span is split.
+struct TexcoordSpan {
+    int64_t u;
+    int64_t v;
+    int64_t dudx;
+    int64_t dvdx;
+};
+
+inline int64_t ToTexelFixed(float texcoord, uint32_t size) {
+    return static_cast<int64_t>(std::llround(static_cast<double>(texcoord) * size * kTexcoordOne));
+}
+
+// Fetches are written per format and filter so the inner loops carry no
+// per-texel branching.
+template<uint32_t kChannels>
+inline const uint8_t* TexelAt(const TextureSampler& s, int64_t x, int64_t y) {
+    x = std::min<int64_t>(std::max<int64_t>(x, 0), s.width - 1);
+    y = std::min<int64_t>(std::max<int64_t>(y, 0), s.height - 1);
+    return s.texels + (size_t(y) * s.width + size_t(x)) * kChannels;
+}
+
+template<uint32_t kChannels>
+inline void FetchNearest(const TextureSampler& s, int64_t u, int64_t v, uint8_t out[kChannels]) {
+    const uint8_t* t = TexelAt<kChannels>(s, u >> kTexcoordBits, v >> kTexcoordBits);
+    for (uint32_t c = 0; c < kChannels; ++c) {
+        out[c] = t[c];
+    }
+}
+
+// Bilinear filter with 8-bit weights between the four nearest texel centers
+template<uint32_t kChannels>
+inline void FetchBilinear(const TextureSampler& s, int64_t u, int64_t v, uint8_t out[kChannels]) {
+    const int64_t half = kTexcoordOne / 2;
+    int64_t x = u - half;
+    int64_t y = v - half;
+    int64_t x0 = x >> kTexcoordBits;
+    int64_t y0 = y >> kTexcoordBits;
+    uint32_t fx = static_cast<uint32_t>(x >> (kTexcoordBits - 8)) & 0xff;
+    uint32_t fy = static_cast<uint32_t>(y >> (kTexcoordBits - 8)) & 0xff;
+
+    const uint8_t* t00 = TexelAt<kChannels>(s, x0, y0);
+    const uint8_t* t10 = TexelAt<kChannels>(s, x0 + 1, y0);
+    const uint8_t* t01 = TexelAt<kChannels>(s, x0, y0 + 1);
+    const uint8_t* t11 = TexelAt<kChannels>(s, x0 + 1, y0 + 1);
+    for (uint32_t c = 0; c < kChannels; ++c) {
+        uint32_t top = t00[c] * (256 - fx) + t10[c] * fx;
+        uint32_t bottom = t01[c] * (256 - fx) + t11[c] * fx;
+        out[c] = static_cast<uint8_t>((top * (256 - fy) + bottom * fy + 32768) >> 16);
+    }
+}
+
+// Writes `count` shaded source pixels: the vertex color gradient modulated by
+// the texture. Alpha masks only scale the alpha channel.
+template<uint32_t kChannels, lab_texture_filter kFilter>
+void SampleSpan(uint8_t* out, uint32_t count, uint32_t first, const float color[4],
+                const float dcdx[4], const TexcoordSpan& tc, const TextureSampler& s) {
+    bool flat = dcdx[0] == 0.0f && dcdx[1] == 0.0f && dcdx[2] == 0.0f && dcdx[3] == 0.0f;
+    uint8_t c8[4];
+    SpanColorAt(color, dcdx, first, c8);
+
+    int64_t u = tc.u + int64_t(first) * tc.dudx;
+    int64_t v = tc.v + int64_t(first) * tc.dvdx;
+    for (uint32_t i = 0; i < count; ++i, u += tc.dudx, v += tc.dvdx) {
+        if (!flat) {
+            SpanColorAt(color, dcdx, first + i, c8);
+        }
+        uint8_t t[kChannels];
+        if (kFilter == LAB_TEXTURE_FILTER_NEAREST) {
+            FetchNearest<kChannels>(s, u, v, t);
+        } else {
+            FetchBilinear<kChannels>(s, u, v, t);
+        }
+
+        uint8_t* p = out + i * 4;
+        if (kChannels == 1) {
+            p[0] = c8[0];
+            p[1] = c8[1];
+            p[2] = c8[2];
+            p[3] = static_cast<uint8_t>(Div255(c8[3] * t[0]));
+        } else {
+            for (uint32_t c = 0; c < 4; ++c) {
+                p[c] = static_cast<uint8_t>(Div255(c8[c] * t[c % kChannels]));
+            }
+        }
+    }
+}
+
+using SampleSpanFn = void (*)(uint8_t* out, uint32_t count, uint32_t first, const float color[4],
+                              const float dcdx[4], const TexcoordSpan& tc, const TextureSampler& s);
+
+// Sampling loop for a texture, or nullptr if its format cannot be sampled
+inline SampleSpanFn GetSampleSpanFn(const TextureSampler& s) {
+    bool nearest = s.filter == LAB_TEXTURE_FILTER_NEAREST;
+    switch (s.channels) {
+        case 1:
+            return nearest ? SampleSpan<1, LAB_TEXTURE_FILTER_NEAREST>
+                           : SampleSpan<1, LAB_TEXTURE_FILTER_LINEAR>;
+        case 4:
+            return nearest ? SampleSpan<4, LAB_TEXTURE_FILTER_NEAREST>
+                           : SampleSpan<4, LAB_TEXTURE_FILTER_LINEAR>;
+        default:
+            return nullptr;
+    }
+}
+
+// Samples and blends a textured span in cache-sized chunks
+inline void ShadeTexturedSpan(uint8_t* dst, uint32_t count, uint32_t first, const float color[4],
+                              const float dcdx[4], const TexcoordSpan& tc, const TextureSampler& s,
+                              SampleSpanFn sample, BlendSpanFn blend) {
+    constexpr uint32_t kChunk = 64;
+    uint8_t src[kChunk * 4];
+    for (uint32_t offset = 0; offset < count; offset += kChunk) {
+        uint32_t n = std::min(kChunk, count - offset);
+        sample(src, n, first + offset, color, dcdx, tc, s);
+        blend(dst + offset * 4, src, n);
+    }
+}
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_TEXTURE_SAMPLER_H
@@ -0,0 +1,180 @@
+#include "tiled_renderer.h"
+#include "rasterizer.h"
+#include "span_kernels.h"
+
+namespace labfont {
+namespace cpu {
+
+TiledRenderer::TiledRenderer(uint32_t workerCount)
+    : m_pool(workerCount)
+{
+}
+
+void TiledRenderer::Begin(uint32_t width, uint32_t height, const SampleBuffer* multisample) {
+    m_width = width;
+    m_height = height;
+    m_multisample = multisample;
+    m_tilesX = (width + kTileSize - 1) / kTileSize;
+    m_tilesY = (height + kTileSize - 1) / kTileSize;
+    
+    // Bins keep their capacity from frame to frame
+    m_bins.resize(size_t(m_tilesX) * m_tilesY);
+    for (auto& bin : m_bins) {
+        bin.clear();
+    }
+    m_vertices.clear();
+    m_quads.clear();
+    m_primitives.clear();
+    m_samplers.clear();
+}
+
+uint32_t TiledRenderer::AddSampler(const TextureSampler* sampler) {
+    if (!sampler) {
+        return kNoSampler;
+    }
+    m_samplers.push_back(*sampler);
+    return static_cast<uint32_t>(m_samplers.size() - 1);
+}
+
+void TiledRenderer::AddPrimitive(const Primitive& primitive, int32_t x0, int32_t y0,
+                                 int32_t x1, int32_t y1) {
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    uint32_t index = static_cast<uint32_t>(m_primitives.size());
+    m_primitives.push_back(primitive);
+    
+    uint32_t tx0 = static_cast<uint32_t>(x0) / kTileSize;
+    uint32_t ty0 = static_cast<uint32_t>(y0) / kTileSize;
+    uint32_t tx1 = static_cast<uint32_t>(x1 - 1) / kTileSize;
+    uint32_t ty1 = static_cast<uint32_t>(y1 - 1) / kTileSize;
+    for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+        for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+            m_bins[ty * m_tilesX + tx].push_back(index);
+        }
+    }
+}
+
+void TiledRenderer::AddClear(uint32_t rgba) {
+    // A clear overwrites everything recorded before it
+    for (auto& bin : m_bins) {
+        bin.clear();
+    }
+    Primitive primitive = {PrimitiveType::Clear, BlendMode::None, 0.0f, rgba, kNoSampler,
+                           FullClipRect(m_width, m_height)};
+    AddPrimitive(primitive, 0, 0, static_cast<int32_t>(m_width), static_cast<int32_t>(m_height));
+}
+
+void TiledRenderer::AddTriangles(const lab_vertex_2TC* vertices, uint32_t vertexCount,
+                                 BlendMode blendMode, const ClipRect& scissor,
+                                 const TextureSampler* sampler) {
+    uint32_t samplerIndex = AddSampler(sampler);
+    uint32_t sampleCount = m_multisample ? m_multisample->sampleCount : 1;
+    for (uint32_t i = 0; i + 3 <= vertexCount; i += 3) {
+        ClipRect bounds = TriangleBounds(&vertices[i], m_width, m_height, sampleCount).Intersect(scissor);
+        if (bounds.IsEmpty()) {
+            continue;
+        }
+        Primitive primitive = {PrimitiveType::Triangle, blendMode, 0.0f,
+                               static_cast<uint32_t>(m_vertices.size()), samplerIndex, scissor};
+        m_vertices.insert(m_vertices.end(), &vertices[i], &vertices[i] + 3);
+        AddPrimitive(primitive, bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+    }
+}
+
+void TiledRenderer::AddLines(const lab_vertex_2TC* vertices, uint32_t vertexCount,
+                             float lineWidth, BlendMode blendMode, const ClipRect& scissor) {
+    for (uint32_t i = 0; i + 2 <= vertexCount; i += 2) {
+        ClipRect bounds = LineBounds(&vertices[i], lineWidth, m_width, m_height).Intersect(scissor);
+        if (bounds.IsEmpty()) {
+            continue;
+        }
+        Primitive primitive = {PrimitiveType::Line, blendMode, lineWidth,
+                               static_cast<uint32_t>(m_vertices.size()), kNoSampler, scissor};
+        m_vertices.insert(m_vertices.end(), &vertices[i], &vertices[i] + 2);
+        AddPrimitive(primitive, bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+    }
+}
+
+void TiledRenderer::AddQuads(const Quad* quads, uint32_t quadCount, BlendMode blendMode,
+                             const ClipRect& scissor, const TextureSampler* sampler) {
+    uint32_t samplerIndex = AddSampler(sampler);
+    uint32_t sampleCount = m_multisample ? m_multisample->sampleCount : 1;
+    for (uint32_t i = 0; i < quadCount; ++i) {
+        ClipRect bounds = QuadBounds(quads[i], m_width, m_height, sampleCount).Intersect(scissor);
+        if (bounds.IsEmpty()) {
+            continue;
+        }
+        Primitive primitive = {PrimitiveType::Quad, blendMode, 0.0f,
+                               static_cast<uint32_t>(m_quads.size()), samplerIndex, scissor};
+        m_quads.push_back(quads[i]);
+        AddPrimitive(primitive, bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+    }
+}
+
+void TiledRenderer::RenderTile(uint32_t tile, uint8_t* colorBuffer) const {
+    const auto& bin = m_bins[tile];
+    if (bin.empty()) {
+        return;
+    }
+    
+    uint32_t tx = tile % m_tilesX;
+    uint32_t ty = tile / m_tilesX;
+    ClipRect clip = {
+        static_cast<int32_t>(tx * kTileSize),
+        static_cast<int32_t>(ty * kTileSize),
+        static_cast<int32_t>(std::min(m_width, (tx + 1) * kTileSize)),
+        static_cast<int32_t>(std::min(m_height, (ty + 1) * kTileSize))
+    };
+    
+    for (uint32_t index : bin) {
+        const Primitive& primitive = m_primitives[index];
+        ClipRect primitiveClip = clip.Intersect(primitive.scissor);
+        switch (primitive.type) {
+            case PrimitiveType::Clear: {
+                FillSpanFn fill = GetSpanKernels().fill;
+                uint32_t count = static_cast<uint32_t>(clip.x1 - clip.x0);
+                for (int32_t y = clip.y0; y < clip.y1; ++y) {
+                    fill(&colorBuffer[(size_t(y) * m_width + clip.x0) * 4], count, primitive.data);
+                    if (m_multisample) {
+                        std::fill_n(&m_multisample->complex[size_t(y) * m_width + clip.x0], count, 0);
+                    }
+                }
+                break;
+            }
+            case PrimitiveType::Triangle:
+                DrawTriangle(colorBuffer, nullptr, m_width, m_height, &m_vertices[primitive.data],
+                             primitive.blendMode, primitiveClip,
+                             primitive.sampler == kNoSampler ? nullptr : &m_samplers[primitive.sampler],
+                             m_multisample);
+                break;
+            case PrimitiveType::Line:
+                DrawLine(colorBuffer, m_width, m_height, &m_vertices[primitive.data],
+                         primitive.lineWidth, primitive.blendMode, primitiveClip, m_multisample);
+                break;
+            case PrimitiveType::Quad:
+                DrawQuad(colorBuffer, m_width, m_height, m_quads[primitive.data], primitive.blendMode,
+                         primitiveClip,
+                         primitive.sampler == kNoSampler ? nullptr : &m_samplers[primitive.sampler],
+                         m_multisample);
+                break;
+        }
+    }
+}
+
+void TiledRenderer::Flush(uint8_t* colorBuffer) {
+    m_pool.ParallelFor(static_cast<uint32_t>(m_bins.size()), [&](uint32_t tile) {
+        RenderTile(tile, colorBuffer);
+    });
+    
+    for (auto& bin : m_bins) {
+        bin.clear();
+    }
+    m_vertices.clear();
+    m_quads.clear();
+    m_primitives.clear();
+    m_samplers.clear();
+}
+
+} // namespace cpu
+} // namespace labfont
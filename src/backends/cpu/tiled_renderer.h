@@ -0,0 +1,85 @@
+#ifndef LABFONT_CPU_TILED_RENDERER_H
+#define LABFONT_CPU_TILED_RENDERER_H
+
+#include "core/internal_types.h"
+#include "core/thread_pool.h"
+#include "rasterizer.h"
+#include <cstdint>
+#include <vector>
+
+namespace labfont {
+namespace cpu {
+
+constexpr uint32_t kTileSize = 64;
+
+// Tile-binned renderer for the CPU backend. Primitives of a submission are
+// recorded in order and binned into kTileSize x kTileSize screen tiles; at
+// Flush every tile replays its own bin on the worker pool. Tiles never share
+// pixels and each replays in submission order, so the result is identical
+// to rendering the same primitives serially.
+class TiledRenderer {
+public:
+    explicit TiledRenderer(uint32_t workerCount);
+    
+    uint32_t GetWorkerCount() const { return m_pool.GetWorkerCount(); }
+    
+    // Starts recording for a target of the given size. With a sample buffer,
+    // which must stay alive until Flush, rendering is anti-aliased.
+    void Begin(uint32_t width, uint32_t height, const SampleBuffer* multisample = nullptr);
+    
+    void AddClear(uint32_t rgba);
+    
+    // Vertices are in the rasterizer's normalized target space and are copied.
+    // The sampler, if any, is copied too; its texels must stay alive until
+    // Flush. Primitives are only drawn inside `scissor` and are not binned
+    // into tiles it excludes.
+    void AddTriangles(const lab_vertex_2TC* vertices, uint32_t vertexCount, BlendMode blendMode,
+                      const ClipRect& scissor, const TextureSampler* sampler = nullptr);
+    void AddLines(const lab_vertex_2TC* vertices, uint32_t vertexCount, float lineWidth,
+                  BlendMode blendMode, const ClipRect& scissor);
+    void AddQuads(const Quad* quads, uint32_t quadCount, BlendMode blendMode, const ClipRect& scissor,
+                  const TextureSampler* sampler = nullptr);
+    
+    // Rasterizes everything recorded since Begin into colorBuffer
+    void Flush(uint8_t* colorBuffer);
+    
+private:
+    enum class PrimitiveType : uint8_t {
+        Clear,
+        Triangle,
+        Line,
+        Quad
+    };
+    
+    static constexpr uint32_t kNoSampler = ~0u;
+    
+    struct Primitive {
+        PrimitiveType type;
+        BlendMode blendMode;
+        float lineWidth;
+        uint32_t data;     // First vertex in m_vertices, index into m_quads, or the packed clear color
+        uint32_t sampler;  // Index into m_samplers, or kNoSampler
+        ClipRect scissor;
+    };
+    
+    uint32_t AddSampler(const TextureSampler* sampler);
+    void AddPrimitive(const Primitive& primitive, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+    void RenderTile(uint32_t tile, uint8_t* colorBuffer) const;
+    
+    ThreadPool m_pool;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    const SampleBuffer* m_multisample = nullptr;
+    uint32_t m_tilesX = 0;
+    uint32_t m_tilesY = 0;
+    std::vector<lab_vertex_2TC> m_vertices;
+    std::vector<Quad> m_quads;
+    std::vector<Primitive> m_primitives;
+    std::vector<TextureSampler> m_samplers;
+    std::vector<std::vector<uint32_t>> m_bins;  // Primitive indices per tile
+};
+
+} // namespace cpu
+} // namespace labfont
+
+#endif // LABFONT_CPU_TILED_RENDERER_H
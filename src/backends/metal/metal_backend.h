@@ -127,6 +127,11 @@ public:
     bool SupportsBlendMode(BlendMode mode) const override;
     uint32_t GetMaxTextureSize() const override;
     
+    bool SupportsDrawCommand(DrawCommandType type) const override {
+        // Packed vertices are expanded while converting to Vertex
+        return type == DrawCommandType::DrawTrianglesPacked || Backend::SupportsDrawCommand(type);
+    }
+    
 private:
     uint32_t m_width = 0;
     uint32_t m_height = 0;
@@ -614,6 +614,17 @@ lab_result MetalBackend::SubmitCommands(const std::vector<DrawCommand>& commands
                 break;
             }
             
+            case DrawCommandType::DrawTrianglesPacked: {
+                const auto& params = cmd.triangles_packed;
+                std::vector<Vertex> vertices;
+                vertices.reserve(params.vertexCount);
+                for (uint32_t i = 0; i < params.vertexCount; ++i) {
+                    vertices.push_back(Vertex(params.vertices[i]));
+                }
+                m_currentCommandBuffer->DrawTriangles(vertices.data(), params.vertexCount);
+                break;
+            }
+            
             case DrawCommandType::DrawLines: {
                 const auto& params = cmd.lines;
                 // Convert lab_vertex_2TC to Vertex
@@ -656,6 +667,15 @@ lab_result MetalBackend::SubmitCommands(const std::vector<DrawCommand>& commands
                 );
                 break;
             }
+            
+            case DrawCommandType::DrawIndexedTriangles:
+            case DrawCommandType::DrawQuads:
+                // Expanded into triangles by the context before submission
+                break;
+            
+            case DrawCommandType::SetLayer:
+                // Consumed by draw sorting in the context
+                break;
         }
     }
     
@@ -689,9 +709,22 @@ void MetalBackend::DestroyRenderTarget(RenderTarget* target) {
     }
 }
 
+static size_t GetAllocatedSize(Texture* texture) {
+    MetalTextureRef mtlTexture = texture ? static_cast<MetalTexture*>(texture)->GetMTLTexture() : nil;
+    return mtlTexture ? [mtlTexture allocatedSize] : 0;
+}
+
 size_t MetalBackend::GetTextureMemoryUsage() const {
-    // TODO: Implement texture memory tracking
-    return 0;
+    // Every texture and render target is referenced from these lists until
+    // it is destroyed
+    size_t bytes = 0;
+    for (const auto& texture : m_textures) {
+        bytes += GetAllocatedSize(texture.get());
+    }
+    for (const auto& target : m_renderTargets) {
+        bytes += GetAllocatedSize(target->GetColorTexture()) + GetAllocatedSize(target->GetDepthTexture());
+    }
+    return bytes;
 }
 
 size_t MetalBackend::GetTotalMemoryUsage() const {
@@ -58,6 +58,7 @@ VulkanTexture::VulkanTexture(const labfont::TextureDesc& desc, VulkanDevice* dev
 
     result = vkAllocateMemory(m_device->GetDevice(), &allocInfo, nullptr, &m_memory);
     assert(result == VK_SUCCESS);
+    m_memorySize = allocInfo.allocationSize;
 
     vkBindImageMemory(m_device->GetDevice(), m_image, m_memory, 0);
 
@@ -324,14 +325,25 @@ void VulkanBackend::DestroyRenderTarget(labfont::RenderTarget* target) {
     // The actual resource will be destroyed when the shared_ptr goes out of scope
 }
 
+static size_t GetMemorySize(labfont::Texture* texture) {
+    return texture ? static_cast<size_t>(static_cast<VulkanTexture*>(texture)->GetMemorySize()) : 0;
+}
+
 size_t VulkanBackend::GetTextureMemoryUsage() const {
-    // TODO: Implement memory tracking
-    return 0;
+    // Every texture and render target is referenced from these lists until
+    // it is destroyed
+    size_t bytes = 0;
+    for (const auto& texture : m_textures) {
+        bytes += GetMemorySize(texture.get());
+    }
+    for (const auto& target : m_renderTargets) {
+        bytes += GetMemorySize(target->GetColorTexture()) + GetMemorySize(target->GetDepthTexture());
+    }
+    return bytes;
 }
 
 size_t VulkanBackend::GetTotalMemoryUsage() const {
-    // TODO: Implement memory tracking
-    return 0;
+    return GetTextureMemoryUsage();
 }
 
 bool VulkanBackend::SupportsTextureFormat(lab_texture_format format) const {
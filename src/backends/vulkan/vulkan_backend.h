@@ -26,6 +26,7 @@ public:
     // Vulkan-specific methods
     VkImage GetImage() const { return m_image; }
     VkImageView GetImageView() const { return m_imageView; }
+    VkDeviceSize GetMemorySize() const { return m_memorySize; }
     
 private:
     uint32_t m_width;
@@ -35,6 +36,7 @@ private:
     bool m_readback;
     VkImage m_image;
     VkDeviceMemory m_memory;
+    VkDeviceSize m_memorySize = 0;
     VkImageView m_imageView;
     VulkanDevice* m_device;
 };
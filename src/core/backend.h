@@ -3,6 +3,7 @@
 
 #include "backend_types.h"
 #include "internal_types.h"
+#include "command_stream.h"
 #include "error.h"
 #include <memory>
 #include <vector>
@@ -27,6 +28,13 @@ public:
     virtual lab_result UpdateTexture(Texture* texture, const void* data, size_t size) = 0;
     virtual lab_result ReadbackTexture(Texture* texture, void* data, size_t size) = 0;
     
+    // Copies the parts of a render target that changed since the previous
+    // call into `data`, a full-size RGBA8 image kept by the caller. Writes up
+    // to maxRects of the changed rectangles and their total count. Backends
+    // that do not track damage copy and report the whole target.
+    virtual lab_result ReadbackChanges(RenderTarget* target, void* data, size_t size,
+                                       lab_rect* rects, uint32_t maxRects, uint32_t& rectCount);
+    
     // Render target management
     virtual lab_result CreateRenderTarget(const RenderTargetDesc& desc, std::shared_ptr<RenderTarget>& out_target) = 0;
     virtual lab_result SetRenderTarget(RenderTarget* target) = 0;
@@ -34,12 +42,21 @@ public:
     // Draw command submission
     virtual lab_result BeginFrame() = 0;
     virtual lab_result SubmitCommands(const std::vector<DrawCommand>& commands) = 0;
+    
+    // Executes a packed stream. Backends that decode commands one at a time
+    // override this; the default unpacks the stream for SubmitCommands.
+    virtual lab_result SubmitCommandStream(const CommandStream& stream);
     virtual lab_result EndFrame() = 0;
     
     // Resource cleanup
     virtual void DestroyTexture(Texture* texture) = 0;
     virtual void DestroyRenderTarget(RenderTarget* target) = 0;
-    
+
+    // Give an object from the texture pool the contents and state of a new
+    // one. Backends whose new objects start undefined have nothing to reset.
+    virtual void ResetTexture(Texture*) {}
+    virtual void ResetRenderTarget(RenderTarget*) {}
+
     // Memory management
     virtual size_t GetTextureMemoryUsage() const = 0;
     virtual size_t GetTotalMemoryUsage() const = 0;
@@ -49,6 +66,14 @@ public:
     virtual bool SupportsBlendMode(BlendMode mode) const = 0;
     virtual uint32_t GetMaxTextureSize() const = 0;
     
+    // Indexed triangles, quads and packed vertices reach only backends that
+    // draw them; for the others the context expands them into triangle
+    // lists of full vertices first
+    virtual bool SupportsDrawCommand(DrawCommandType type) const {
+        return type != DrawCommandType::DrawIndexedTriangles && type != DrawCommandType::DrawQuads &&
+               type != DrawCommandType::DrawTrianglesPacked;
+    }
+    
 protected:
     Backend() = default;
     
@@ -80,6 +105,7 @@ public:
     virtual uint32_t GetHeight() const = 0;
     virtual lab_texture_format GetFormat() const = 0;
     virtual bool HasDepth() const = 0;
+    virtual lab_antialias GetAntialias() const { return LAB_ANTIALIAS_NONE; }
     virtual Texture* GetColorTexture() = 0;
     virtual Texture* GetDepthTexture() = 0;
     
@@ -87,6 +113,24 @@ protected:
     RenderTarget() = default;
 };
 
+inline lab_result Backend::ReadbackChanges(RenderTarget* target, void* data, size_t size,
+                                           lab_rect* rects, uint32_t maxRects, uint32_t& rectCount) {
+    lab_result result = ReadbackTexture(target->GetColorTexture(), data, size);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
+    if (maxRects > 0) {
+        rects[0] = {0, 0, target->GetWidth(), target->GetHeight()};
+    }
+    rectCount = 1;
+    return LAB_RESULT_OK;
+}
+
+inline lab_result Backend::SubmitCommandStream(const CommandStream& stream) {
+    std::vector<DrawCommand> commands(stream.begin(), stream.end());
+    return SubmitCommands(commands);
+}
+
 // Backend factory function (to be implemented by each backend)
 std::unique_ptr<Backend> CreateBackend(lab_backend_type type);
 
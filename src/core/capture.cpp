@@ -0,0 +1,471 @@
+#include "capture.h"
+#include "backend.h"
+#include "resource_manager.h"
+#include <chrono>
+#include <cstring>
+
+namespace labfont {
+
+namespace {
+
+constexpr uint32_t kCaptureMagic = 0x5043464c;  // "LFCP"
+constexpr uint32_t kCaptureVersion = 2;
+
+enum EventType : uint32_t {
+    kEventBeginFrame = 1,
+    kEventEndFrame,
+    kEventSubmit,               // Command count, then the stream's records
+    kEventTexture,              // ResourceInfo, then pixels if captured
+    kEventDestroyTexture,
+    kEventRenderTarget,         // ResourceInfo, then RGBA8 pixels if captured
+    kEventSetRenderTarget,      // Id zero unsets the target
+    kEventDestroyRenderTarget,
+};
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct EventHeader {
+    uint32_t type;
+    uint32_t id;     // Of the texture or render target, if any
+    uint64_t size;   // Of the payload that follows
+};
+
+struct ResourceInfo {
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t hasDepth;   // Render targets only
+    uint32_t antialias;  // Render targets only
+    uint32_t hasPixels;
+};
+
+// No backend creates larger textures; a capture asking for more is damaged
+constexpr uint32_t kMaxDimension = 16384;
+
+// Accepts what lab_create_texture and lab_create_render_target can create
+bool IsValidResource(const ResourceInfo& info) {
+    if (info.width == 0 || info.height == 0 || info.width > kMaxDimension || info.height > kMaxDimension ||
+        info.format > LAB_TEXTURE_FORMAT_D32F) {
+        return false;
+    }
+    switch (info.antialias) {
+        case LAB_ANTIALIAS_NONE:
+        case LAB_ANTIALIAS_4X:
+        case LAB_ANTIALIAS_8X:
+        case LAB_ANTIALIAS_16X:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint64_t PixelBytes(uint32_t width, uint32_t height, lab_texture_format format) {
+    return uint64_t(width) * height * GetTextureFormatBytesPerPixel(format);
+}
+
+} // namespace
+
+CaptureWriter::~CaptureWriter() {
+    Close();
+}
+
+lab_result CaptureWriter::Open(const char* path, Backend& backend) {
+    Close();
+    if (!path) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    m_file = std::fopen(path, "wb");
+    if (!m_file) {
+        return LAB_RESULT_FILE_IO_FAILED;
+    }
+    m_backend = &backend;
+    m_failed = false;
+    m_ids.clear();
+    m_nextId = 1;
+
+    FileHeader header = {kCaptureMagic, kCaptureVersion};
+    m_failed = std::fwrite(&header, sizeof(header), 1, m_file) != 1;
+    return m_failed ? LAB_RESULT_FILE_IO_FAILED : LAB_RESULT_OK;
+}
+
+lab_result CaptureWriter::Close() {
+    if (!m_file) {
+        return LAB_RESULT_OK;
+    }
+    bool ok = std::fclose(m_file) == 0 && !m_failed;
+    m_file = nullptr;
+    m_backend = nullptr;
+    m_ids.clear();
+    return ok ? LAB_RESULT_OK : LAB_RESULT_FILE_IO_FAILED;
+}
+
+void CaptureWriter::Write(uint32_t type, uint32_t id, const void* data, size_t size,
+                          const void* extra, size_t extraSize) {
+    if (!m_file || m_failed) {
+        return;
+    }
+    EventHeader header = {type, id, uint64_t(size) + extraSize};
+    m_failed = std::fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+               (size > 0 && std::fwrite(data, size, 1, m_file) != 1) ||
+               (extraSize > 0 && std::fwrite(extra, extraSize, 1, m_file) != 1);
+}
+
+void CaptureWriter::BeginFrame() {
+    Write(kEventBeginFrame, 0, nullptr, 0);
+}
+
+void CaptureWriter::EndFrame() {
+    Write(kEventEndFrame, 0, nullptr, 0);
+}
+
+void CaptureWriter::Submit(const std::vector<DrawCommand>& commands) {
+    // Texture handles are replaced by capture ids, which replay maps back
+    m_stream.Clear();
+    for (const DrawCommand& command : commands) {
+        if (command.type != DrawCommandType::BindTexture || !command.bind_texture.texture) {
+            m_stream.Append(command);
+            continue;
+        }
+        DrawCommand bind = command;
+        uint32_t id = TextureId(reinterpret_cast<const TextureResource*>(command.bind_texture.texture));
+        bind.bind_texture.texture = reinterpret_cast<lab_texture>(static_cast<uintptr_t>(id));
+        m_stream.Append(bind);
+    }
+    uint64_t count = m_stream.GetCommandCount();
+    Write(kEventSubmit, 0, &count, sizeof(count), m_stream.GetData(), m_stream.GetByteSize());
+}
+
+void CaptureWriter::CreateTexture(const TextureResource* texture, const void* data) {
+    if (!m_file) {
+        return;
+    }
+    uint32_t id = m_nextId++;
+    m_ids[texture] = id;
+    WriteTexture(id, texture, data);
+}
+
+void CaptureWriter::DestroyTexture(const TextureResource* texture) {
+    auto it = m_ids.find(texture);
+    if (it == m_ids.end()) {
+        return;
+    }
+    Write(kEventDestroyTexture, it->second, nullptr, 0);
+    m_ids.erase(it);
+}
+
+uint32_t CaptureWriter::TextureId(const TextureResource* texture) {
+    auto it = m_ids.find(texture);
+    if (it != m_ids.end()) {
+        return it->second;
+    }
+
+    // Created before the capture began; its contents are recorded if they
+    // can be read back
+    uint32_t id = m_nextId++;
+    m_ids[texture] = id;
+    const void* data = nullptr;
+    Texture* backendTexture = texture->texture.get();
+    if (backendTexture && backendTexture->SupportsReadback()) {
+        m_pixels.resize(PixelBytes(texture->GetWidth(), texture->GetHeight(), texture->GetFormat()));
+        if (m_backend->ReadbackTexture(backendTexture, m_pixels.data(), m_pixels.size()) == LAB_RESULT_OK) {
+            data = m_pixels.data();
+        }
+    }
+    WriteTexture(id, texture, data);
+    return id;
+}
+
+void CaptureWriter::WriteTexture(uint32_t id, const TextureResource* texture, const void* data) {
+    ResourceInfo info = {
+        texture->GetWidth(),
+        texture->GetHeight(),
+        static_cast<uint32_t>(texture->GetFormat()),
+        0,
+        0,
+        data ? 1u : 0u
+    };
+    size_t size = data ? PixelBytes(info.width, info.height, texture->GetFormat()) : 0;
+    Write(kEventTexture, id, &info, sizeof(info), data, size);
+}
+
+void CaptureWriter::SetRenderTarget(const RenderTargetResource* target) {
+    Write(kEventSetRenderTarget, target ? RenderTargetId(target) : 0, nullptr, 0);
+}
+
+uint32_t CaptureWriter::RenderTargetId(const RenderTargetResource* target) {
+    auto it = m_ids.find(target);
+    if (it != m_ids.end()) {
+        return it->second;
+    }
+    // Created before the capture began, and possibly drawn to already
+    uint32_t id = m_nextId++;
+    m_ids[target] = id;
+    WriteRenderTarget(id, target, true);
+    return id;
+}
+
+void CaptureWriter::ResizeRenderTarget(const RenderTargetResource* target) {
+    auto it = m_ids.find(target);
+    if (it == m_ids.end()) {
+        RenderTargetId(target);
+        return;
+    }
+    WriteRenderTarget(it->second, target, false);
+}
+
+void CaptureWriter::DestroyRenderTarget(const RenderTargetResource* target) {
+    auto it = m_ids.find(target);
+    if (it == m_ids.end()) {
+        return;
+    }
+    Write(kEventDestroyRenderTarget, it->second, nullptr, 0);
+    m_ids.erase(it);
+}
+
+void CaptureWriter::WriteRenderTarget(uint32_t id, const RenderTargetResource* target, bool withContents) {
+    RenderTarget* backendTarget = target->GetBackendTarget();
+    if (!backendTarget || !m_file) {
+        return;
+    }
+    ResourceInfo info = {
+        backendTarget->GetWidth(),
+        backendTarget->GetHeight(),
+        static_cast<uint32_t>(backendTarget->GetFormat()),
+        backendTarget->HasDepth() ? 1u : 0u,
+        static_cast<uint32_t>(backendTarget->GetAntialias()),
+        0
+    };
+    Texture* color = backendTarget->GetColorTexture();
+    if (withContents && color && color->SupportsReadback()) {
+        m_pixels.resize(size_t(info.width) * info.height * 4);
+        info.hasPixels = m_backend->ReadbackTexture(color, m_pixels.data(), m_pixels.size()) == LAB_RESULT_OK;
+    }
+    Write(kEventRenderTarget, id, &info, sizeof(info), m_pixels.data(), info.hasPixels ? m_pixels.size() : 0);
+}
+
+CaptureReplay::CaptureReplay() = default;
+CaptureReplay::~CaptureReplay() = default;
+
+lab_result CaptureReplay::Load(const char* path) {
+    if (!path) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return LAB_RESULT_FILE_IO_FAILED;
+    }
+
+    std::vector<Event> events;
+    uint32_t frameCount = 0;
+    size_t commandCount = 0;
+    uint32_t blankTextureCount = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    FileHeader fileHeader;
+    bool ok = std::fread(&fileHeader, sizeof(fileHeader), 1, file) == 1 &&
+              fileHeader.magic == kCaptureMagic && fileHeader.version == kCaptureVersion;
+    // Event sizes are checked against the bytes left in the file before
+    // anything is allocated for them
+    long start = ok ? std::ftell(file) : -1;
+    ok = ok && start >= 0 && std::fseek(file, 0, SEEK_END) == 0;
+    long end = ok ? std::ftell(file) : -1;
+    ok = ok && end >= start && std::fseek(file, start, SEEK_SET) == 0;
+    EventHeader header;
+    while (ok) {
+        // A clean end of file falls between events
+        size_t headerBytes = std::fread(&header, 1, sizeof(header), file);
+        if (headerBytes != sizeof(header)) {
+            ok = headerBytes == 0 && std::feof(file);
+            break;
+        }
+        long offset = std::ftell(file);
+        if (offset < 0 || header.size > static_cast<uint64_t>(end - offset)) {
+            ok = false;
+            break;
+        }
+        Event event = {header.type, header.id, {}, {}, {}};
+        switch (header.type) {
+            case kEventBeginFrame:
+            case kEventEndFrame:
+            case kEventDestroyTexture:
+            case kEventSetRenderTarget:
+            case kEventDestroyRenderTarget:
+                ok = header.size == 0;
+                frameCount += header.type == kEventEndFrame;
+                break;
+            case kEventSubmit: {
+                uint64_t count = 0;
+                ok = header.size >= sizeof(count) && std::fread(&count, sizeof(count), 1, file) == 1;
+                if (ok) {
+                    std::vector<uint8_t> bytes(header.size - sizeof(count));
+                    ok = (bytes.empty() || std::fread(bytes.data(), bytes.size(), 1, file) == 1) &&
+                         event.commands.Assign(std::move(bytes), count, true) == LAB_RESULT_OK;
+                    commandCount += count;
+                }
+                break;
+            }
+            case kEventTexture:
+            case kEventRenderTarget: {
+                ResourceInfo info;
+                ok = header.size >= sizeof(info) && std::fread(&info, sizeof(info), 1, file) == 1 &&
+                     IsValidResource(info);
+                if (!ok) {
+                    break;
+                }
+                event.desc.width = info.width;
+                event.desc.height = info.height;
+                event.desc.format = static_cast<lab_texture_format>(info.format);
+                event.desc.hasDepth = info.hasDepth != 0;
+                event.desc.antialias = static_cast<lab_antialias>(info.antialias);
+                const uint64_t pixelBytes = header.type == kEventTexture
+                    ? PixelBytes(info.width, info.height, event.desc.format)
+                    : uint64_t(info.width) * info.height * 4;
+                ok = header.size - sizeof(info) == (info.hasPixels ? pixelBytes : 0);
+                if (ok && info.hasPixels) {
+                    event.pixels.resize(pixelBytes);
+                    ok = std::fread(event.pixels.data(), event.pixels.size(), 1, file) == 1;
+                }
+                if (header.type == kEventTexture) {
+                    blankTextureCount += !info.hasPixels;
+                } else if (width == 0) {
+                    width = info.width;
+                    height = info.height;
+                }
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+        if (ok) {
+            events.push_back(std::move(event));
+        }
+    }
+    std::fclose(file);
+    if (!ok) {
+        return LAB_RESULT_INVALID_COMMAND_BUFFER;
+    }
+
+    m_events = std::move(events);
+    m_frameCount = frameCount;
+    m_commandCount = commandCount;
+    m_blankTextureCount = blankTextureCount;
+    m_width = width;
+    m_height = height;
+    return LAB_RESULT_OK;
+}
+
+lab_result CaptureReplay::Replay(Backend& backend, bool optimize, std::vector<CommandTiming>* timings) {
+    using Clock = std::chrono::steady_clock;
+
+    m_currentTarget.reset();
+    m_targets.clear();
+    m_textures.clear();
+    m_resources = std::make_unique<ResourceManagerImpl>(&backend);
+
+    lab_result firstError = LAB_RESULT_OK;
+    auto check = [&firstError](lab_result result) {
+        if (firstError == LAB_RESULT_OK) {
+            firstError = result;
+        }
+    };
+
+    uint32_t frame = 0;
+    uint32_t index = 0;
+    std::vector<uint8_t> blank;
+    std::vector<DrawCommand> single(1);
+    for (const Event& event : m_events) {
+        switch (event.type) {
+            case kEventBeginFrame:
+                check(backend.BeginFrame());
+                break;
+            case kEventEndFrame:
+                check(backend.EndFrame());
+                ++frame;
+                index = 0;
+                break;
+            case kEventTexture: {
+                const void* data = event.pixels.data();
+                if (event.pixels.empty()) {
+                    blank.assign(PixelBytes(event.desc.width, event.desc.height, event.desc.format), 0);
+                    data = blank.data();
+                }
+                TextureParams params = {event.desc.width, event.desc.height, event.desc.format, data};
+                std::shared_ptr<TextureResource> texture;
+                lab_result result = m_resources->CreateTexture(params, texture);
+                check(result);
+                if (result == LAB_RESULT_OK) {
+                    m_textures[event.id] = texture;
+                }
+                break;
+            }
+            case kEventDestroyTexture: {
+                auto it = m_textures.find(event.id);
+                if (it != m_textures.end()) {
+                    // Released first so that the texture can be pooled
+                    ResourceHandle handle = it->second->GetHandle();
+                    m_textures.erase(it);
+                    m_resources->DestroyResource(handle);
+                }
+                break;
+            }
+            case kEventRenderTarget: {
+                std::shared_ptr<RenderTarget> target;
+                lab_result result = backend.CreateRenderTarget(event.desc, target);
+                check(result);
+                if (result != LAB_RESULT_OK) {
+                    break;
+                }
+                if (!event.pixels.empty()) {
+                    check(backend.UpdateTexture(target->GetColorTexture(), event.pixels.data(), event.pixels.size()));
+                }
+                m_targets[event.id] = target;
+                break;
+            }
+            case kEventSetRenderTarget: {
+                auto it = m_targets.find(event.id);
+                m_currentTarget = it != m_targets.end() ? it->second : nullptr;
+                check(backend.SetRenderTarget(m_currentTarget.get()));
+                break;
+            }
+            case kEventDestroyRenderTarget:
+                m_targets.erase(event.id);
+                break;
+            case kEventSubmit: {
+                m_decoded.assign(event.commands.begin(), event.commands.end());
+                for (DrawCommand& command : m_decoded) {
+                    if (command.type == DrawCommandType::BindTexture) {
+                        auto it = m_textures.find(static_cast<uint32_t>(
+                            reinterpret_cast<uintptr_t>(command.bind_texture.texture)));
+                        command.bind_texture.texture = it != m_textures.end()
+                            ? reinterpret_cast<lab_texture>(it->second.get()) : nullptr;
+                    }
+                }
+                const std::vector<DrawCommand>* commands = &m_decoded;
+                if (optimize) {
+                    lab_command_stats stats = {};
+                    m_optimizer.Optimize(m_decoded.data(), m_decoded.size(), m_optimized, stats);
+                    commands = &m_optimized;
+                }
+                for (const DrawCommand& command : *commands) {
+                    single[0] = command;
+                    auto start = Clock::now();
+                    check(backend.SubmitCommands(single));
+                    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                    if (timings) {
+                        timings->push_back({frame, index, command.type, seconds});
+                    }
+                    ++index;
+                }
+                break;
+            }
+        }
+    }
+    return firstError;
+}
+
+} // namespace labfont
@@ -0,0 +1,136 @@
+#ifndef LABFONT_CAPTURE_H
+#define LABFONT_CAPTURE_H
+
+#include "command_optimizer.h"
+#include "command_stream.h"
+#include "internal_types.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace labfont {
+
+class Backend;
+class RenderTarget;
+class RenderTargetResource;
+class ResourceManagerImpl;
+class TextureResource;
+
+// Records what an application hands to a context, in order, to a file that
+// CaptureReplay plays back: submitted commands with their vertices, texture
+// uploads, render target changes and frame boundaries. Commands are recorded
+// as submitted, before optimization.
+//
+// Textures and render targets get capture ids when first seen. Those that
+// existed before the capture began are recorded when first used, with their
+// contents if the backend can read them back; textures it cannot read back
+// replay as transparent black.
+class CaptureWriter {
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // The backend is used to read back existing resources
+    lab_result Open(const char* path, Backend& backend);
+    // LAB_RESULT_FILE_IO_FAILED if any write failed
+    lab_result Close();
+
+    void BeginFrame();
+    void EndFrame();
+    void Submit(const std::vector<DrawCommand>& commands);
+
+    void CreateTexture(const TextureResource* texture, const void* data);
+    void DestroyTexture(const TextureResource* texture);
+
+    // Null unsets the target
+    void SetRenderTarget(const RenderTargetResource* target);
+    // Records the target again at its new size, without contents
+    void ResizeRenderTarget(const RenderTargetResource* target);
+    void DestroyRenderTarget(const RenderTargetResource* target);
+
+private:
+    uint32_t TextureId(const TextureResource* texture);
+    uint32_t RenderTargetId(const RenderTargetResource* target);
+    void WriteTexture(uint32_t id, const TextureResource* texture, const void* data);
+    void WriteRenderTarget(uint32_t id, const RenderTargetResource* target, bool withContents);
+    void Write(uint32_t type, uint32_t id, const void* data, size_t size,
+               const void* extra = nullptr, size_t extraSize = 0);
+
+    FILE* m_file = nullptr;
+    Backend* m_backend = nullptr;
+    bool m_failed = false;
+
+    // Textures and render targets by resource
+    std::unordered_map<const void*, uint32_t> m_ids;
+    uint32_t m_nextId = 1;
+
+    CommandStream m_stream;  // Reused for every submission
+    std::vector<uint8_t> m_pixels;
+};
+
+// A capture loaded for replay. Replay recreates the captured resources on
+// a backend and executes the commands one at a time, so each can be timed.
+class CaptureReplay {
+public:
+    struct CommandTiming {
+        uint32_t frame;
+        uint32_t index;  // Within the frame
+        DrawCommandType type;
+        double seconds;
+    };
+
+    CaptureReplay();
+    ~CaptureReplay();
+
+    lab_result Load(const char* path);
+
+    uint32_t GetFrameCount() const { return m_frameCount; }
+    size_t GetCommandCount() const { return m_commandCount; }
+    // Textures captured without their contents
+    uint32_t GetBlankTextureCount() const { return m_blankTextureCount; }
+    // Size of the first render target, or zero if there is none
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+
+    // Replays on an initialized backend. Optimizing runs each submission
+    // through the CommandOptimizer first, as a context does. Timings, if
+    // given, are appended. Returns the first error the backend reported.
+    lab_result Replay(Backend& backend, bool optimize, std::vector<CommandTiming>* timings);
+
+    // The render target current at the end of the last replay
+    RenderTarget* GetRenderTarget() const { return m_currentTarget.get(); }
+
+private:
+    struct Event {
+        uint32_t type;
+        uint32_t id;
+        RenderTargetDesc desc;         // Textures use size and format
+        std::vector<uint8_t> pixels;   // Empty if not captured
+        CommandStream commands;
+    };
+
+    std::vector<Event> m_events;
+    uint32_t m_frameCount = 0;
+    size_t m_commandCount = 0;
+    uint32_t m_blankTextureCount = 0;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+
+    // Replay state, kept so the final target can be read back
+    std::unique_ptr<ResourceManagerImpl> m_resources;
+    std::unordered_map<uint32_t, std::shared_ptr<TextureResource>> m_textures;
+    std::unordered_map<uint32_t, std::shared_ptr<RenderTarget>> m_targets;
+    std::shared_ptr<RenderTarget> m_currentTarget;
+    CommandOptimizer m_optimizer;
+    std::vector<DrawCommand> m_decoded;
+    std::vector<DrawCommand> m_optimized;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_CAPTURE_H
@@ -0,0 +1,83 @@
+#include "command_buffer.h"
+
+namespace labfont {
+
+template<typename Command>
+void CommandBuffer::AppendCommands(const Command* commands, size_t count) {
+    const lab_vertex_2TC* vertexBase = m_vertices.data();
+    const lab_vertex_2TC_packed* packedBase = m_packedVertices.data();
+    const uint16_t* indexBase = m_indices.data();
+    const lab_quad_instance* instanceBase = m_instances.data();
+    size_t firstNew = m_commands.size();
+    for (size_t i = 0; i < count; ++i) {
+        const DrawCommand command(commands[i]);
+        Offsets offsets = {
+            static_cast<uint32_t>(command.type == DrawCommandType::DrawTrianglesPacked
+                                  ? m_packedVertices.size() : m_vertices.size()),
+            static_cast<uint32_t>(m_indices.size()),
+            static_cast<uint32_t>(m_instances.size())
+        };
+        if (command.type == DrawCommandType::DrawTriangles && command.triangles.vertices) {
+            m_vertices.insert(m_vertices.end(), command.triangles.vertices,
+                              command.triangles.vertices + command.triangles.vertexCount);
+        } else if (command.type == DrawCommandType::DrawLines && command.lines.vertices) {
+            m_vertices.insert(m_vertices.end(), command.lines.vertices,
+                              command.lines.vertices + command.lines.vertexCount);
+        } else if (command.type == DrawCommandType::DrawTrianglesPacked && command.triangles_packed.vertices) {
+            m_packedVertices.insert(m_packedVertices.end(), command.triangles_packed.vertices,
+                                    command.triangles_packed.vertices + command.triangles_packed.vertexCount);
+        } else if (command.type == DrawCommandType::DrawIndexedTriangles && command.indexed_triangles.indices) {
+            const auto& draw = command.indexed_triangles;
+            m_vertices.insert(m_vertices.end(), draw.vertices, draw.vertices + draw.vertexCount);
+            m_indices.insert(m_indices.end(), draw.indices, draw.indices + draw.indexCount);
+        } else if (command.type == DrawCommandType::DrawQuads && command.quads.instances) {
+            m_instances.insert(m_instances.end(), command.quads.instances,
+                               command.quads.instances + command.quads.instanceCount);
+        }
+        m_commands.push_back(command);
+        m_offsets.push_back(offsets);
+    }
+    
+    // Point the new commands at the copies; all commands if any storage moved
+    if (m_vertices.data() != vertexBase || m_packedVertices.data() != packedBase ||
+        m_indices.data() != indexBase ||
+        m_instances.data() != instanceBase) {
+        firstNew = 0;
+    }
+    for (size_t i = firstNew; i < m_commands.size(); ++i) {
+        DrawCommand& command = m_commands[i];
+        const Offsets& offsets = m_offsets[i];
+        const lab_vertex_2TC* vertices = m_vertices.data() + offsets.vertex;
+        if (command.type == DrawCommandType::DrawTriangles && command.triangles.vertices) {
+            command.triangles.vertices = vertices;
+        } else if (command.type == DrawCommandType::DrawLines && command.lines.vertices) {
+            command.lines.vertices = vertices;
+        } else if (command.type == DrawCommandType::DrawTrianglesPacked && command.triangles_packed.vertices) {
+            command.triangles_packed.vertices = m_packedVertices.data() + offsets.vertex;
+        } else if (command.type == DrawCommandType::DrawIndexedTriangles && command.indexed_triangles.indices) {
+            command.indexed_triangles.vertices = vertices;
+            command.indexed_triangles.indices = m_indices.data() + offsets.index;
+        } else if (command.type == DrawCommandType::DrawQuads && command.quads.instances) {
+            command.quads.instances = m_instances.data() + offsets.instance;
+        }
+    }
+}
+
+void CommandBuffer::Append(const DrawCommand* commands, size_t count) {
+    AppendCommands(commands, count);
+}
+
+void CommandBuffer::Append(const lab_draw_command* commands, size_t count) {
+    AppendCommands(commands, count);
+}
+
+void CommandBuffer::Clear() {
+    m_commands.clear();
+    m_offsets.clear();
+    m_vertices.clear();
+    m_packedVertices.clear();
+    m_indices.clear();
+    m_instances.clear();
+}
+
+} // namespace labfont
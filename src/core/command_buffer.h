@@ -0,0 +1,51 @@
+#ifndef LABFONT_COMMAND_BUFFER_H
+#define LABFONT_COMMAND_BUFFER_H
+
+#include "internal_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace labfont {
+
+// Draw commands together with their own copies of the vertices, indices and
+// quad instances they reference, so they stay valid after the caller's
+// buffers are gone. Texture handles are kept as they are. Clearing keeps the
+// allocations for reuse.
+class CommandBuffer {
+public:
+    void Append(const DrawCommand* commands, size_t count);
+    void Append(const std::vector<DrawCommand>& commands) { Append(commands.data(), commands.size()); }
+    
+    // Converts and appends API commands without an intermediate copy
+    void Append(const lab_draw_command* commands, size_t count);
+    
+    void Clear();
+    
+    // Vertex pointers of the commands refer to this buffer's copies and are
+    // valid until the next Append or Clear
+    const std::vector<DrawCommand>& GetCommands() const { return m_commands; }
+    size_t GetVertexCount() const { return m_vertices.size(); }
+    
+private:
+    template<typename Command>
+    void AppendCommands(const Command* commands, size_t count);
+    
+    // Where a command's copies start in each storage
+    struct Offsets {
+        uint32_t vertex;  // Into m_vertices or m_packedVertices
+        uint32_t index;
+        uint32_t instance;
+    };
+    
+    std::vector<DrawCommand> m_commands;
+    std::vector<Offsets> m_offsets;  // Per command
+    std::vector<lab_vertex_2TC> m_vertices;
+    std::vector<lab_vertex_2TC_packed> m_packedVertices;
+    std::vector<uint16_t> m_indices;
+    std::vector<lab_quad_instance> m_instances;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_BUFFER_H
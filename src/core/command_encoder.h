@@ -0,0 +1,44 @@
+#ifndef LABFONT_COMMAND_ENCODER_H
+#define LABFONT_COMMAND_ENCODER_H
+
+#include "command_list.h"
+#include <cstdint>
+
+namespace labfont {
+
+// Command recorder behind lab_encoder, for building parts of a frame on
+// other threads. An encoder is used by one thread at a time and records into
+// its own storage, so encoding takes no locks and, once its buffers have
+// grown to a frame's worth, allocates nothing. At the end of the frame the
+// context submits all encoders ordered by their sort key, then by creation,
+// and resets them; the result does not depend on thread timing.
+class CommandEncoder {
+public:
+    CommandEncoder(lab_context owner, uint32_t sortKey, uint64_t sequence)
+        : m_sortKey(sortKey)
+        , m_sequence(sequence)
+        , m_commands(owner)
+    {
+    }
+    
+    lab_result Encode(const lab_draw_command* commands, uint32_t commandCount) {
+        return m_commands.Record(commands, commandCount);
+    }
+    void Reset() { m_commands.Reset(); }
+    
+    const std::vector<DrawCommand>& GetCommands() const { return m_commands.GetCommands(); }
+    
+    // Submission order
+    bool operator<(const CommandEncoder& other) const {
+        return m_sortKey != other.m_sortKey ? m_sortKey < other.m_sortKey : m_sequence < other.m_sequence;
+    }
+    
+private:
+    uint32_t m_sortKey;
+    uint64_t m_sequence;
+    CommandList m_commands;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_ENCODER_H
@@ -0,0 +1,72 @@
+#include "command_history.h"
+#include <algorithm>
+
+namespace labfont {
+
+void CommandHistory::SetCapacity(uint32_t frames) {
+    if (frames == GetCapacity()) {
+        return;
+    }
+    // Keep the most recent frames that still fit, oldest first
+    std::vector<CommandBuffer> resized(frames);
+    uint32_t kept = std::min(m_frameCount, frames);
+    for (uint32_t i = 0; i < kept; ++i) {
+        resized[i] = std::move(Slot(m_frameCount - kept + i));
+    }
+    m_frames = std::move(resized);
+    m_frames.shrink_to_fit();
+    m_first = 0;
+    m_frameCount = kept;
+    m_frameOpen = m_frameOpen && kept > 0;
+}
+
+void CommandHistory::Record(const std::vector<DrawCommand>& commands) {
+    if (m_frames.empty()) {
+        return;
+    }
+    CurrentFrame().Append(commands);
+}
+
+void CommandHistory::Record(const CommandStream& commands) {
+    if (m_frames.empty()) {
+        return;
+    }
+    CommandBuffer& frame = CurrentFrame();
+    for (const DrawCommand& command : commands) {
+        frame.Append(&command, 1);
+    }
+}
+
+CommandBuffer& CommandHistory::CurrentFrame() {
+    if (!m_frameOpen) {
+        // Reuse the oldest slot once the ring is full; its buffers keep
+        // their capacity
+        if (m_frameCount == GetCapacity()) {
+            m_first = (m_first + 1) % GetCapacity();
+            --m_frameCount;
+        }
+        Slot(m_frameCount).Clear();
+        ++m_frameCount;
+        m_frameOpen = true;
+    }
+    return Slot(m_frameCount - 1);
+}
+
+void CommandHistory::EndFrame() {
+    m_frameOpen = false;
+}
+
+const std::vector<DrawCommand>& CommandHistory::GetFrame(uint32_t index) const {
+    return m_frames[(m_first + index) % m_frames.size()].GetCommands();
+}
+
+void CommandHistory::Clear() {
+    for (CommandBuffer& frame : m_frames) {
+        frame.Clear();
+    }
+    m_first = 0;
+    m_frameCount = 0;
+    m_frameOpen = false;
+}
+
+} // namespace labfont
@@ -0,0 +1,56 @@
+#ifndef LABFONT_COMMAND_HISTORY_H
+#define LABFONT_COMMAND_HISTORY_H
+
+#include "command_buffer.h"
+#include "command_stream.h"
+#include <cstdint>
+#include <vector>
+
+namespace labfont {
+
+// Bounded record of submitted commands for debugging. Keeps the commands of
+// the most recent frames in a ring; older frames are dropped as new ones
+// begin. Each frame is a CommandBuffer, so recorded commands stay valid
+// after the caller frees its vertex buffers.
+//
+// Disabled (a capacity of zero) it holds no memory and Record returns
+// immediately.
+class CommandHistory {
+public:
+    // Number of frames kept. Zero disables recording and frees everything
+    // recorded so far.
+    void SetCapacity(uint32_t frames);
+    uint32_t GetCapacity() const { return static_cast<uint32_t>(m_frames.size()); }
+    bool IsEnabled() const { return !m_frames.empty(); }
+
+    // Appends commands to the current frame, starting a new one if needed
+    void Record(const std::vector<DrawCommand>& commands);
+    void Record(const CommandStream& commands);
+
+    // Closes the current frame; the next Record starts a new one
+    void EndFrame();
+
+    // Number of recorded frames, including an unfinished current frame
+    uint32_t GetFrameCount() const { return m_frameCount; }
+
+    // Commands of a recorded frame, 0 being the oldest. Vertex pointers refer
+    // to the history's copies and are valid until the frame is dropped.
+    const std::vector<DrawCommand>& GetFrame(uint32_t index) const;
+
+    // Drops all recorded frames but keeps the capacity
+    void Clear();
+
+private:
+    // The open frame, starting one if needed
+    CommandBuffer& CurrentFrame();
+    CommandBuffer& Slot(uint32_t index) { return m_frames[(m_first + index) % m_frames.size()]; }
+
+    std::vector<CommandBuffer> m_frames;  // Ring of GetCapacity() slots
+    uint32_t m_first = 0;         // Slot of the oldest frame
+    uint32_t m_frameCount = 0;
+    bool m_frameOpen = false;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_HISTORY_H
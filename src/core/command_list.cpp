@@ -0,0 +1,117 @@
+#include "command_list.h"
+#include "backend.h"
+#include "context_internal.h"
+#include <new>
+
+namespace labfont {
+
+namespace {
+
+bool IsValidCommand(const lab_draw_command& command) {
+    switch (command.type) {
+        case LAB_DRAW_COMMAND_CLEAR:
+        case LAB_DRAW_COMMAND_BIND_TEXTURE:
+        case LAB_DRAW_COMMAND_SET_VIEWPORT:
+        case LAB_DRAW_COMMAND_SET_LAYER:
+            return true;
+        case LAB_DRAW_COMMAND_TRIANGLES:
+            return command.triangles.vertices || command.triangles.vertexCount == 0;
+        case LAB_DRAW_COMMAND_LINES:
+            return command.lines.vertices || command.lines.vertexCount == 0;
+        case LAB_DRAW_COMMAND_INDEXED_TRIANGLES: {
+            const auto& draw = command.indexed_triangles;
+            if (draw.indexCount == 0) {
+                return true;
+            }
+            if (!draw.vertices || !draw.indices) {
+                return false;
+            }
+            for (uint32_t i = 0; i < draw.indexCount; ++i) {
+                if (draw.indices[i] >= draw.vertexCount) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case LAB_DRAW_COMMAND_TRIANGLES_PACKED:
+            return command.triangles_packed.vertices || command.triangles_packed.vertexCount == 0;
+        case LAB_DRAW_COMMAND_QUADS:
+            return command.quads.instances || command.quads.instanceCount == 0;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+lab_result CommandList::Record(const lab_draw_command* commands, uint32_t commandCount) {
+    for (uint32_t i = 0; i < commandCount; ++i) {
+        if (!IsValidCommand(commands[i])) {
+            return LAB_RESULT_INVALID_PARAMETER;
+        }
+    }
+    m_buffer.Append(commands, commandCount);
+    return LAB_RESULT_OK;
+}
+
+} // namespace labfont
+
+extern "C" {
+
+lab_result lab_create_command_list(lab_context ctx, lab_command_list* out_list) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!out_list) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    auto list = new (std::nothrow) labfont::CommandList(ctx);
+    if (!list) {
+        return LAB_RESULT_OUT_OF_MEMORY;
+    }
+    *out_list = reinterpret_cast<lab_command_list>(list);
+    return LAB_RESULT_OK;
+}
+
+void lab_destroy_command_list(lab_context ctx, lab_command_list list) {
+    auto commandList = reinterpret_cast<labfont::CommandList*>(list);
+    if (!ctx || !commandList || commandList->GetOwner() != ctx) {
+        return;
+    }
+    delete commandList;
+}
+
+lab_result lab_record_commands(lab_command_list list, const lab_draw_command* commands, uint32_t commandCount) {
+    if (!list || !commands || commandCount == 0) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    return reinterpret_cast<labfont::CommandList*>(list)->Record(commands, commandCount);
+}
+
+lab_result lab_reset_command_list(lab_command_list list) {
+    if (!list) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    reinterpret_cast<labfont::CommandList*>(list)->Reset();
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_submit_command_list(lab_context ctx, lab_command_list list) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    auto commandList = reinterpret_cast<labfont::CommandList*>(list);
+    if (!commandList || commandList->GetOwner() != ctx) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    
+    // The commands were converted when recorded. Their draws are adjacent in
+    // the list's vertex storage, so merging them needs no copies.
+    const auto& commands = commandList->GetCommands();
+    if (commands.empty()) {
+        return LAB_RESULT_OK;
+    }
+    return labfont::GetContextImpl(ctx)->SubmitCommands(commands);
+}
+
+} // extern "C"
@@ -0,0 +1,33 @@
+#ifndef LABFONT_COMMAND_LIST_H
+#define LABFONT_COMMAND_LIST_H
+
+#include "command_buffer.h"
+
+namespace labfont {
+
+// Retained command list behind lab_command_list. Commands are validated and
+// converted when recorded and keep their own copies of the vertices, so a
+// list can be submitted any number of times without touching the caller's
+// data again.
+class CommandList {
+public:
+    explicit CommandList(lab_context owner) : m_owner(owner) {}
+    
+    // Appends API commands. Either all of them are recorded or, if any is
+    // invalid, none.
+    lab_result Record(const lab_draw_command* commands, uint32_t commandCount);
+    void Reset() { m_buffer.Clear(); }
+    
+    const std::vector<DrawCommand>& GetCommands() const { return m_buffer.GetCommands(); }
+    // The context the list was created with, the only one it can be
+    // submitted to or destroyed through
+    lab_context GetOwner() const { return m_owner; }
+    
+private:
+    lab_context m_owner;
+    CommandBuffer m_buffer;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_LIST_H
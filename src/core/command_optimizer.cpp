@@ -0,0 +1,210 @@
+#include "command_optimizer.h"
+
+namespace labfont {
+
+namespace {
+
+bool IsDraw(const DrawCommand& command) {
+    return command.type == DrawCommandType::DrawTriangles || command.type == DrawCommandType::DrawLines ||
+           command.type == DrawCommandType::DrawQuads || command.type == DrawCommandType::DrawTrianglesPacked;
+}
+
+bool IsEmptyDraw(const DrawCommand& draw) {
+    switch (draw.type) {
+        case DrawCommandType::DrawTriangles:
+            return draw.triangles.vertexCount == 0 || !draw.triangles.vertices;
+        case DrawCommandType::DrawLines:
+            return draw.lines.vertexCount == 0 || !draw.lines.vertices;
+        case DrawCommandType::DrawQuads:
+            return draw.quads.instanceCount == 0 || !draw.quads.instances;
+        case DrawCommandType::DrawTrianglesPacked:
+            return draw.triangles_packed.vertexCount == 0 || !draw.triangles_packed.vertices;
+        default:
+            return false;
+    }
+}
+
+// Vertices left over after the last whole primitive would pair with the
+// next draw's vertices if the two were merged
+bool EndsOnPrimitive(const DrawCommand& draw) {
+    switch (draw.type) {
+        case DrawCommandType::DrawTriangles:
+            return draw.triangles.vertexCount % 3 == 0;
+        case DrawCommandType::DrawLines:
+            return draw.lines.vertexCount % 2 == 0;
+        case DrawCommandType::DrawTrianglesPacked:
+            return draw.triangles_packed.vertexCount % 3 == 0;
+        default:
+            return true;
+    }
+}
+
+} // namespace
+
+int CommandOptimizer::GetStateSlot(DrawCommandType type) {
+    switch (type) {
+        case DrawCommandType::SetBlendMode:
+            return kBlendSlot;
+        case DrawCommandType::BindTexture:
+            return kTextureSlot;
+        case DrawCommandType::SetViewport:
+        case DrawCommandType::SetViewportAPI:
+            return kViewportSlot;
+        case DrawCommandType::SetScissor:
+            return kScissorSlot;
+        default:
+            return -1;
+    }
+}
+
+bool CommandOptimizer::SameState(const DrawCommand& a, const DrawCommand& b) {
+    switch (a.type) {
+        case DrawCommandType::SetBlendMode:
+            return a.blend.mode == b.blend.mode;
+        case DrawCommandType::BindTexture:
+            return a.bind_texture.texture == b.bind_texture.texture &&
+                   a.bind_texture.filter == b.bind_texture.filter;
+        case DrawCommandType::SetViewport:
+        case DrawCommandType::SetViewportAPI:
+            return a.viewport.x == b.viewport.x && a.viewport.y == b.viewport.y &&
+                   a.viewport.width == b.viewport.width && a.viewport.height == b.viewport.height;
+        case DrawCommandType::SetScissor:
+            return a.scissor.x == b.scissor.x && a.scissor.y == b.scissor.y &&
+                   a.scissor.width == b.scissor.width && a.scissor.height == b.scissor.height;
+        default:
+            return false;
+    }
+}
+
+uint32_t CommandOptimizer::FlushState(std::vector<DrawCommand>& out, lab_command_stats& stats) {
+    uint32_t emitted = 0;
+    for (State& state : m_state) {
+        if (!state.hasPending) {
+            continue;
+        }
+        state.hasPending = false;
+        if (state.hasCurrent && SameState(state.pending, state.current)) {
+            ++stats.stateChangesDropped;
+            continue;
+        }
+        state.current = state.pending;
+        state.hasCurrent = true;
+        out.push_back(state.pending);
+        m_copyOffset.push_back(kNotCopied);
+        ++emitted;
+    }
+    return emitted;
+}
+
+template<typename T>
+void CommandOptimizer::MergeRange(const T*& lastItems, uint32_t& lastCount, const T* items, uint32_t count,
+                                  size_t& offset, std::vector<T>& copies) {
+    // Ranges already adjacent in memory, as in command lists, merge in place
+    if (offset != kNotCopied || lastItems + lastCount != items) {
+        if (offset == kNotCopied) {
+            offset = copies.size();
+            copies.insert(copies.end(), lastItems, lastItems + lastCount);
+        }
+        copies.insert(copies.end(), items, items + count);
+        // The pointer is set once all copies are made
+        lastItems = nullptr;
+    }
+    lastCount += count;
+}
+
+void CommandOptimizer::AppendDraw(const DrawCommand& draw, bool merge, std::vector<DrawCommand>& out,
+                                  lab_command_stats& stats) {
+    if (merge && !out.empty()) {
+        DrawCommand& last = out.back();
+        bool compatible = last.type == draw.type && EndsOnPrimitive(last) &&
+            (draw.type != DrawCommandType::DrawLines || last.lines.lineWidth == draw.lines.lineWidth);
+        if (compatible) {
+            size_t& offset = m_copyOffset.back();
+            switch (draw.type) {
+                case DrawCommandType::DrawTriangles:
+                    MergeRange(last.triangles.vertices, last.triangles.vertexCount, draw.triangles.vertices,
+                               draw.triangles.vertexCount, offset, m_vertices);
+                    break;
+                case DrawCommandType::DrawLines:
+                    MergeRange(last.lines.vertices, last.lines.vertexCount, draw.lines.vertices,
+                               draw.lines.vertexCount, offset, m_vertices);
+                    break;
+                case DrawCommandType::DrawTrianglesPacked:
+                    MergeRange(last.triangles_packed.vertices, last.triangles_packed.vertexCount,
+                               draw.triangles_packed.vertices, draw.triangles_packed.vertexCount, offset,
+                               m_packedVertices);
+                    break;
+                default:
+                    MergeRange(last.quads.instances, last.quads.instanceCount, draw.quads.instances,
+                               draw.quads.instanceCount, offset, m_instances);
+                    break;
+            }
+            ++stats.drawsMerged;
+            return;
+        }
+    }
+    out.push_back(draw);
+    m_copyOffset.push_back(kNotCopied);
+}
+
+void CommandOptimizer::Optimize(const DrawCommand* commands, size_t count, std::vector<DrawCommand>& out,
+                                lab_command_stats& stats) {
+    out.clear();
+    m_vertices.clear();
+    m_packedVertices.clear();
+    m_instances.clear();
+    m_copyOffset.clear();
+    for (State& state : m_state) {
+        state.hasPending = false;
+        state.hasCurrent = false;
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        const DrawCommand& command = commands[i];
+        if (command.type == DrawCommandType::SetLayer) {
+            // Only draw sorting uses layers
+            continue;
+        }
+        int slot = GetStateSlot(command.type);
+        if (slot >= 0) {
+            // A change that is overwritten before it is flushed never matters
+            if (m_state[slot].hasPending) {
+                ++stats.stateChangesDropped;
+            }
+            m_state[slot].pending = command;
+            m_state[slot].hasPending = true;
+            continue;
+        }
+        
+        bool stateChanged = FlushState(out, stats) > 0;
+        if (!IsDraw(command)) {
+            out.push_back(command);
+            m_copyOffset.push_back(kNotCopied);
+        } else if (!IsEmptyDraw(command)) {
+            AppendDraw(command, !stateChanged, out, stats);
+        }
+    }
+    FlushState(out, stats);
+    
+    // Point merged draws at their copies now that the storage is final
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (m_copyOffset[i] == kNotCopied) {
+            continue;
+        }
+        DrawCommand& draw = out[i];
+        if (draw.type == DrawCommandType::DrawTriangles) {
+            draw.triangles.vertices = m_vertices.data() + m_copyOffset[i];
+        } else if (draw.type == DrawCommandType::DrawLines) {
+            draw.lines.vertices = m_vertices.data() + m_copyOffset[i];
+        } else if (draw.type == DrawCommandType::DrawTrianglesPacked) {
+            draw.triangles_packed.vertices = m_packedVertices.data() + m_copyOffset[i];
+        } else {
+            draw.quads.instances = m_instances.data() + m_copyOffset[i];
+        }
+    }
+    
+    stats.commandsSubmitted += count;
+    stats.commandsExecuted += out.size();
+}
+
+} // namespace labfont
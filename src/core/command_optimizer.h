@@ -0,0 +1,70 @@
+#ifndef LABFONT_COMMAND_OPTIMIZER_H
+#define LABFONT_COMMAND_OPTIMIZER_H
+
+#include "internal_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace labfont {
+
+// Backend-independent pass run on every submission before it reaches the
+// backend. It drops state changes that have no effect, either because they
+// repeat the current state or because they are overwritten before the next
+// draw, and merges consecutive draws of the same kind that end up with no
+// state change between them into one draw over a single vertex or quad
+// range, as long as the first ends on a whole triangle or line. Indexed draws are passed through as they are. SetLayer commands
+// are dropped; only the CommandSorter uses them.
+//
+// Backend state carries over between submissions, so the first change of
+// each kind in a submission is always kept, as is the final state.
+class CommandOptimizer {
+public:
+    // Rewrites commands into `out` and adds to `stats`. Merged draws whose
+    // vertices or quads are not already adjacent in memory refer to copies owned by
+    // the optimizer, valid until the next call.
+    void Optimize(const DrawCommand* commands, size_t count, std::vector<DrawCommand>& out,
+                  lab_command_stats& stats);
+    
+private:
+    enum StateSlot {
+        kBlendSlot,
+        kTextureSlot,
+        kViewportSlot,  // SetViewport and SetViewportAPI, which set the same state
+        kScissorSlot,
+        kStateSlotCount
+    };
+    
+    struct State {
+        DrawCommand pending;
+        DrawCommand current;
+        bool hasPending;
+        bool hasCurrent;
+    };
+    
+    static int GetStateSlot(DrawCommandType type);
+    static bool SameState(const DrawCommand& a, const DrawCommand& b);
+    
+    // Emits pending state changes that differ from the current state and
+    // returns how many were emitted
+    uint32_t FlushState(std::vector<DrawCommand>& out, lab_command_stats& stats);
+    // Extends the last draw's range by another; copies both unless the
+    // second directly follows the first in memory
+    template<typename T>
+    static void MergeRange(const T*& lastItems, uint32_t& lastCount, const T* items, uint32_t count,
+                           size_t& offset, std::vector<T>& copies);
+    void AppendDraw(const DrawCommand& draw, bool merge, std::vector<DrawCommand>& out,
+                    lab_command_stats& stats);
+    
+    State m_state[kStateSlotCount];
+    std::vector<lab_vertex_2TC> m_vertices;  // Copies for merged draws
+    std::vector<lab_vertex_2TC_packed> m_packedVertices;
+    std::vector<lab_quad_instance> m_instances;
+    std::vector<size_t> m_copyOffset;        // Per output command, or kNotCopied
+    
+    static constexpr size_t kNotCopied = ~size_t(0);
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_OPTIMIZER_H
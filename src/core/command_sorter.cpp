@@ -0,0 +1,141 @@
+#include "command_sorter.h"
+#include <algorithm>
+
+namespace labfont {
+
+int CommandSorter::GetStateSlot(DrawCommandType type) {
+    switch (type) {
+        case DrawCommandType::SetBlendMode:
+            return kBlendSlot;
+        case DrawCommandType::BindTexture:
+            return kTextureSlot;
+        case DrawCommandType::SetViewport:
+        case DrawCommandType::SetViewportAPI:
+            return kViewportSlot;
+        case DrawCommandType::SetScissor:
+            return kScissorSlot;
+        default:
+            return -1;
+    }
+}
+
+bool CommandSorter::IsDraw(DrawCommandType type) {
+    return type == DrawCommandType::DrawTriangles || type == DrawCommandType::DrawLines ||
+           type == DrawCommandType::DrawIndexedTriangles || type == DrawCommandType::DrawQuads ||
+           type == DrawCommandType::DrawTrianglesPacked;
+}
+
+uint32_t CommandSorter::TextureRank(const DrawCommand& bind) {
+    // Submissions bind few textures, so a linear search is enough
+    for (size_t i = 0; i < m_textures.size(); ++i) {
+        if (m_textures[i].bind_texture.texture == bind.bind_texture.texture &&
+            m_textures[i].bind_texture.filter == bind.bind_texture.filter) {
+            return static_cast<uint32_t>(i + 1);
+        }
+    }
+    m_textures.push_back(bind);
+    return static_cast<uint32_t>(m_textures.size());
+}
+
+size_t CommandSorter::SortSegment(size_t first) {
+    auto begin = m_items.begin() + first;
+    m_sequences.clear();
+    for (auto it = begin; it != m_items.end(); ++it) {
+        m_sequences.push_back(it->sequence);
+    }
+    std::sort(begin, m_items.end(), [](const Item& a, const Item& b) {
+        if (a.layer != b.layer) return a.layer < b.layer;
+        if (a.blend != b.blend) return a.blend < b.blend;
+        if (a.texture != b.texture) return a.texture < b.texture;
+        if (a.view != b.view) return a.view < b.view;
+        return a.sequence < b.sequence;
+    });
+    size_t moved = 0;
+    for (size_t i = 0; i < m_sequences.size(); ++i) {
+        moved += m_items[first + i].sequence != m_sequences[i];
+    }
+    return moved;
+}
+
+bool CommandSorter::Emit(const DrawCommand* commands, const int32_t* finalState,
+                         std::vector<DrawCommand>& out) {
+    int32_t emitted[kStateSlotCount];
+    std::fill(emitted, emitted + kStateSlotCount, -1);
+    auto restore = [&](const int32_t* state) {
+        for (int slot = 0; slot < kStateSlotCount; ++slot) {
+            if (state[slot] == emitted[slot]) {
+                continue;
+            }
+            if (state[slot] < 0) {
+                return false;
+            }
+            // Repeats are left for the optimizer to drop
+            out.push_back(commands[state[slot]]);
+            emitted[slot] = state[slot];
+        }
+        return true;
+    };
+
+    for (const Item& item : m_items) {
+        if (!restore(item.state)) {
+            return false;
+        }
+        out.push_back(commands[item.sequence]);
+    }
+    return restore(finalState);
+}
+
+void CommandSorter::Sort(const DrawCommand* commands, size_t count, std::vector<DrawCommand>& out,
+                         lab_command_stats& stats) {
+    out.clear();
+    m_items.clear();
+    m_textures.clear();
+
+    Item current = {};
+    std::fill(current.state, current.state + kStateSlotCount, -1);
+    size_t segment = 0;
+    size_t moved = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const DrawCommand& command = commands[i];
+        if (command.type == DrawCommandType::SetLayer) {
+            current.layer = command.layer.layer;
+            continue;
+        }
+        int slot = GetStateSlot(command.type);
+        if (slot >= 0) {
+            current.state[slot] = static_cast<int32_t>(i);
+            if (slot == kBlendSlot) {
+                current.blend = static_cast<uint32_t>(command.blend.mode) + 1;
+            } else if (slot == kTextureSlot) {
+                current.texture = TextureRank(command);
+            } else {
+                ++current.view;
+            }
+            continue;
+        }
+
+        Item item = current;
+        item.sequence = static_cast<uint32_t>(i);
+        if (!IsDraw(command.type)) {
+            moved += SortSegment(segment);
+            m_items.push_back(item);
+            segment = m_items.size();
+        } else {
+            m_items.push_back(item);
+        }
+    }
+    moved += SortSegment(segment);
+
+    if (Emit(commands, current.state, out)) {
+        stats.drawsReordered += moved;
+        return;
+    }
+    out.clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (commands[i].type != DrawCommandType::SetLayer) {
+            out.push_back(commands[i]);
+        }
+    }
+}
+
+} // namespace labfont
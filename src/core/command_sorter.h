@@ -0,0 +1,65 @@
+#ifndef LABFONT_COMMAND_SORTER_H
+#define LABFONT_COMMAND_SORTER_H
+
+#include "internal_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace labfont {
+
+// Opt-in pass that reorders the draws of a submission to reduce state
+// changes, run before the CommandOptimizer so that draws brought together
+// also merge. SetLayer commands give the draws that follow a layer, zero at
+// the start of each submission. Layers are drawn in increasing order; within
+// a layer draws are grouped by blend mode, then texture, then viewport and
+// scissor, and otherwise keep their order. Draws in one layer must therefore
+// not depend on each other's order.
+//
+// Every draw is preceded by the state it was submitted with, and the
+// submission ends in its final state. Clears are barriers that nothing moves
+// across. State inherited from an earlier submission cannot be restored once
+// changed, so a submission whose sorted order would need that is passed
+// through in its original order. SetLayer commands are removed either way.
+class CommandSorter {
+public:
+    // Rewrites commands into `out` and adds the draws that moved to `stats`.
+    // Draws refer to the caller's vertices.
+    void Sort(const DrawCommand* commands, size_t count, std::vector<DrawCommand>& out,
+              lab_command_stats& stats);
+
+private:
+    enum StateSlot {
+        kBlendSlot,
+        kTextureSlot,
+        kViewportSlot,  // SetViewport and SetViewportAPI, which set the same state
+        kScissorSlot,
+        kStateSlotCount
+    };
+
+    struct Item {
+        uint32_t layer;
+        uint32_t blend;     // Blend mode plus one, zero if inherited
+        uint32_t texture;   // Texture by first use, zero if inherited
+        uint32_t view;      // Viewport and scissor changes before the draw
+        uint32_t sequence;  // Index of the command
+        int32_t state[kStateSlotCount];  // Commands setting the state, -1 if inherited
+    };
+
+    static int GetStateSlot(DrawCommandType type);
+    static bool IsDraw(DrawCommandType type);
+
+    uint32_t TextureRank(const DrawCommand& bind);
+    // Sorts the items from `first` on and returns how many moved
+    size_t SortSegment(size_t first);
+    // False if an item needs inherited state after it has been changed
+    bool Emit(const DrawCommand* commands, const int32_t* finalState, std::vector<DrawCommand>& out);
+
+    std::vector<Item> m_items;
+    std::vector<uint32_t> m_sequences;
+    std::vector<DrawCommand> m_textures;  // Bindings in order of first use
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_SORTER_H
@@ -0,0 +1,438 @@
+#include "command_stream.h"
+#include <cstdio>
+
+namespace labfont {
+
+namespace {
+
+// Every record starts with a header and is padded to a multiple of four
+// bytes, which keeps inline vertices aligned for direct use
+struct RecordHeader {
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t size;  // Of the whole record, header included
+};
+
+struct VertexRecord {
+    uint32_t vertexCount;
+    float lineWidth;  // Lines only
+};
+
+struct IndexedRecord {
+    uint32_t vertexCount;
+    uint32_t indexCount;  // Indices follow the vertices, padded to four bytes
+};
+
+struct QuadRecord {
+    uint32_t instanceCount;
+};
+
+struct TextureRecord {
+    uint64_t texture;
+    uint32_t filter;
+    uint32_t reserved;
+};
+
+constexpr uint32_t kFileMagic = 0x5343464c;  // "LFCS"
+constexpr uint32_t kFileVersion = 4;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t commandCount;
+    uint64_t byteSize;
+};
+
+static_assert(sizeof(RecordHeader) % 4 == 0 && sizeof(VertexRecord) % 4 == 0 &&
+              sizeof(IndexedRecord) % 4 == 0 && sizeof(QuadRecord) % 4 == 0 &&
+              sizeof(TextureRecord) % 4 == 0 && sizeof(lab_quad_instance) % 4 == 0,
+              "records must keep four-byte alignment");
+static_assert(alignof(lab_vertex_2TC) <= 4 && alignof(lab_vertex_2TC_packed) <= 4 &&
+              alignof(lab_quad_instance) <= 4,
+              "inline payloads need at most four-byte alignment");
+
+uint32_t IndexBytes(uint32_t indexCount) {
+    return (indexCount * sizeof(uint16_t) + 3) & ~3u;
+}
+
+uint32_t PayloadSize(const DrawCommand& command) {
+    switch (command.type) {
+        case DrawCommandType::Clear: return sizeof(command.clear);
+        case DrawCommandType::DrawTriangles:
+            return sizeof(VertexRecord) + command.triangles.vertexCount * sizeof(lab_vertex_2TC);
+        case DrawCommandType::DrawLines:
+            return sizeof(VertexRecord) + command.lines.vertexCount * sizeof(lab_vertex_2TC);
+        case DrawCommandType::DrawIndexedTriangles:
+            return sizeof(IndexedRecord) + command.indexed_triangles.vertexCount * sizeof(lab_vertex_2TC) +
+                   IndexBytes(command.indexed_triangles.indexCount);
+        case DrawCommandType::DrawQuads:
+            return sizeof(QuadRecord) + command.quads.instanceCount * sizeof(lab_quad_instance);
+        case DrawCommandType::DrawTrianglesPacked:
+            return sizeof(VertexRecord) + command.triangles_packed.vertexCount * sizeof(lab_vertex_2TC_packed);
+        case DrawCommandType::BindTexture: return sizeof(TextureRecord);
+        case DrawCommandType::SetViewportAPI:
+        case DrawCommandType::SetViewport: return sizeof(command.viewport);
+        case DrawCommandType::SetBlendMode: return sizeof(uint32_t);
+        case DrawCommandType::SetScissor: return sizeof(command.scissor);
+        case DrawCommandType::SetLayer: return sizeof(command.layer);
+    }
+    return 0;
+}
+
+// Checks that a loaded record is well formed, with its enumerations in
+// range, and fits in `available` bytes, and returns its size. Texture handles are cleared unless kept, as handles
+// from another process mean nothing here.
+bool CheckRecord(uint8_t* record, size_t available, bool keepTextureHandles, uint32_t& size) {
+    RecordHeader header;
+    if (available < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, record, sizeof(header));
+    if (header.type > static_cast<uint16_t>(DrawCommandType::SetViewport) ||
+        header.size % 4 != 0 || header.size < sizeof(header) || header.size > available) {
+        return false;
+    }
+    size = header.size;
+    const uint8_t* payload = record + sizeof(header);
+    const size_t payloadSize = header.size - sizeof(header);
+    
+    switch (static_cast<DrawCommandType>(header.type)) {
+        case DrawCommandType::DrawTriangles:
+        case DrawCommandType::DrawLines: {
+            VertexRecord draw;
+            if (payloadSize < sizeof(draw)) {
+                return false;
+            }
+            std::memcpy(&draw, payload, sizeof(draw));
+            return uint64_t(draw.vertexCount) * sizeof(lab_vertex_2TC) == payloadSize - sizeof(draw);
+        }
+        case DrawCommandType::DrawTrianglesPacked: {
+            VertexRecord draw;
+            if (payloadSize < sizeof(draw)) {
+                return false;
+            }
+            std::memcpy(&draw, payload, sizeof(draw));
+            return uint64_t(draw.vertexCount) * sizeof(lab_vertex_2TC_packed) == payloadSize - sizeof(draw);
+        }
+        case DrawCommandType::DrawIndexedTriangles: {
+            IndexedRecord indexed;
+            if (payloadSize < sizeof(indexed)) {
+                return false;
+            }
+            std::memcpy(&indexed, payload, sizeof(indexed));
+            uint64_t vertexBytes = uint64_t(indexed.vertexCount) * sizeof(lab_vertex_2TC);
+            uint64_t indexBytes = (uint64_t(indexed.indexCount) * sizeof(uint16_t) + 3) & ~uint64_t(3);
+            if (sizeof(indexed) + vertexBytes + indexBytes != payloadSize) {
+                return false;
+            }
+            const uint8_t* indices = payload + sizeof(indexed) + vertexBytes;
+            for (uint32_t i = 0; i < indexed.indexCount; ++i) {
+                uint16_t index;
+                std::memcpy(&index, indices + i * sizeof(index), sizeof(index));
+                if (index >= indexed.vertexCount) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case DrawCommandType::DrawQuads: {
+            QuadRecord quads;
+            if (payloadSize < sizeof(quads)) {
+                return false;
+            }
+            std::memcpy(&quads, payload, sizeof(quads));
+            return uint64_t(quads.instanceCount) * sizeof(lab_quad_instance) == payloadSize - sizeof(quads);
+        }
+        case DrawCommandType::BindTexture: {
+            TextureRecord bind;
+            if (payloadSize != sizeof(bind)) {
+                return false;
+            }
+            std::memcpy(&bind, payload, sizeof(bind));
+            if (bind.filter > LAB_TEXTURE_FILTER_NEAREST) {
+                return false;
+            }
+            if (!keepTextureHandles) {
+                std::memset(record + sizeof(header), 0, sizeof(uint64_t));
+            }
+            return true;
+        }
+        default: {
+            DrawCommand command;
+            command.type = static_cast<DrawCommandType>(header.type);
+            if (payloadSize != PayloadSize(command)) {
+                return false;
+            }
+            // Backends index tables by blend mode
+            if (command.type == DrawCommandType::SetBlendMode) {
+                uint32_t mode;
+                std::memcpy(&mode, payload, sizeof(mode));
+                return mode <= static_cast<uint32_t>(BlendMode::Screen);
+            }
+            return true;
+        }
+    }
+}
+
+} // namespace
+
+void CommandStream::Append(const DrawCommand& command) {
+    const uint32_t size = sizeof(RecordHeader) + PayloadSize(command);
+    const size_t offset = m_bytes.size();
+    m_bytes.resize(offset + size);
+    uint8_t* record = m_bytes.data() + offset;
+    
+    RecordHeader header = {static_cast<uint16_t>(command.type), 0, size};
+    std::memcpy(record, &header, sizeof(header));
+    uint8_t* payload = record + sizeof(header);
+    
+    switch (command.type) {
+        case DrawCommandType::Clear:
+            std::memcpy(payload, &command.clear, sizeof(command.clear));
+            break;
+        case DrawCommandType::DrawTriangles:
+        case DrawCommandType::DrawLines: {
+            const bool lines = command.type == DrawCommandType::DrawLines;
+            VertexRecord draw = {
+                lines ? command.lines.vertexCount : command.triangles.vertexCount,
+                lines ? command.lines.lineWidth : 0.0f
+            };
+            const lab_vertex_2TC* vertices = lines ? command.lines.vertices : command.triangles.vertices;
+            std::memcpy(payload, &draw, sizeof(draw));
+            if (draw.vertexCount > 0) {
+                std::memcpy(payload + sizeof(draw), vertices, draw.vertexCount * sizeof(lab_vertex_2TC));
+            }
+            break;
+        }
+        case DrawCommandType::DrawIndexedTriangles: {
+            const auto& draw = command.indexed_triangles;
+            IndexedRecord indexed = {draw.vertexCount, draw.indexCount};
+            std::memcpy(payload, &indexed, sizeof(indexed));
+            payload += sizeof(indexed);
+            if (draw.vertexCount > 0) {
+                std::memcpy(payload, draw.vertices, draw.vertexCount * sizeof(lab_vertex_2TC));
+            }
+            payload += draw.vertexCount * sizeof(lab_vertex_2TC);
+            if (draw.indexCount > 0) {
+                std::memcpy(payload, draw.indices, draw.indexCount * sizeof(uint16_t));
+            }
+            break;
+        }
+        case DrawCommandType::DrawTrianglesPacked: {
+            VertexRecord draw = {command.triangles_packed.vertexCount, 0.0f};
+            std::memcpy(payload, &draw, sizeof(draw));
+            if (draw.vertexCount > 0) {
+                std::memcpy(payload + sizeof(draw), command.triangles_packed.vertices,
+                            draw.vertexCount * sizeof(lab_vertex_2TC_packed));
+            }
+            break;
+        }
+        case DrawCommandType::DrawQuads: {
+            QuadRecord quads = {command.quads.instanceCount};
+            std::memcpy(payload, &quads, sizeof(quads));
+            if (quads.instanceCount > 0) {
+                std::memcpy(payload + sizeof(quads), command.quads.instances,
+                            quads.instanceCount * sizeof(lab_quad_instance));
+            }
+            break;
+        }
+        case DrawCommandType::BindTexture: {
+            TextureRecord bind = {
+                static_cast<uint64_t>(reinterpret_cast<uintptr_t>(command.bind_texture.texture)),
+                static_cast<uint32_t>(command.bind_texture.filter),
+                0
+            };
+            std::memcpy(payload, &bind, sizeof(bind));
+            break;
+        }
+        case DrawCommandType::SetViewportAPI:
+        case DrawCommandType::SetViewport:
+            std::memcpy(payload, &command.viewport, sizeof(command.viewport));
+            break;
+        case DrawCommandType::SetBlendMode: {
+            uint32_t mode = static_cast<uint32_t>(command.blend.mode);
+            std::memcpy(payload, &mode, sizeof(mode));
+            break;
+        }
+        case DrawCommandType::SetScissor:
+            std::memcpy(payload, &command.scissor, sizeof(command.scissor));
+            break;
+        case DrawCommandType::SetLayer:
+            std::memcpy(payload, &command.layer, sizeof(command.layer));
+            break;
+    }
+    ++m_commandCount;
+}
+
+void CommandStream::Append(const DrawCommand* commands, size_t count) {
+    Reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        Append(commands[i]);
+    }
+}
+
+void CommandStream::Reserve(size_t count) {
+    // Appending grows the buffer command by command; a rough estimate up
+    // front avoids most of the reallocations for a large batch
+    const size_t estimate = m_bytes.size() + count * (sizeof(RecordHeader) + sizeof(VertexRecord) +
+                                                      3 * sizeof(lab_vertex_2TC));
+    if (estimate > m_bytes.capacity()) {
+        m_bytes.reserve(estimate);
+    }
+}
+
+void CommandStream::Clear() {
+    m_bytes.clear();
+    m_commandCount = 0;
+}
+
+DrawCommand CommandStream::Iterator::operator*() const {
+    RecordHeader header;
+    std::memcpy(&header, m_position, sizeof(header));
+    const uint8_t* payload = m_position + sizeof(header);
+    
+    DrawCommand command;
+    command.type = static_cast<DrawCommandType>(header.type);
+    switch (command.type) {
+        case DrawCommandType::Clear:
+            std::memcpy(&command.clear, payload, sizeof(command.clear));
+            break;
+        case DrawCommandType::DrawTriangles:
+        case DrawCommandType::DrawLines: {
+            VertexRecord draw;
+            std::memcpy(&draw, payload, sizeof(draw));
+            const lab_vertex_2TC* vertices = reinterpret_cast<const lab_vertex_2TC*>(payload + sizeof(draw));
+            if (command.type == DrawCommandType::DrawLines) {
+                command.lines.vertices = vertices;
+                command.lines.vertexCount = draw.vertexCount;
+                command.lines.lineWidth = draw.lineWidth;
+            } else {
+                command.triangles.vertices = vertices;
+                command.triangles.vertexCount = draw.vertexCount;
+            }
+            break;
+        }
+        case DrawCommandType::DrawIndexedTriangles: {
+            IndexedRecord indexed;
+            std::memcpy(&indexed, payload, sizeof(indexed));
+            const uint8_t* vertices = payload + sizeof(indexed);
+            auto& draw = command.indexed_triangles;
+            draw.vertices = reinterpret_cast<const lab_vertex_2TC*>(vertices);
+            draw.indices = reinterpret_cast<const uint16_t*>(vertices + indexed.vertexCount * sizeof(lab_vertex_2TC));
+            draw.vertexCount = indexed.vertexCount;
+            draw.indexCount = indexed.indexCount;
+            break;
+        }
+        case DrawCommandType::DrawTrianglesPacked: {
+            VertexRecord draw;
+            std::memcpy(&draw, payload, sizeof(draw));
+            command.triangles_packed.vertices = reinterpret_cast<const lab_vertex_2TC_packed*>(payload + sizeof(draw));
+            command.triangles_packed.vertexCount = draw.vertexCount;
+            break;
+        }
+        case DrawCommandType::DrawQuads: {
+            QuadRecord quads;
+            std::memcpy(&quads, payload, sizeof(quads));
+            command.quads.instances = reinterpret_cast<const lab_quad_instance*>(payload + sizeof(quads));
+            command.quads.instanceCount = quads.instanceCount;
+            break;
+        }
+        case DrawCommandType::BindTexture: {
+            TextureRecord bind;
+            std::memcpy(&bind, payload, sizeof(bind));
+            command.bind_texture.texture = reinterpret_cast<lab_texture>(static_cast<uintptr_t>(bind.texture));
+            command.bind_texture.filter = static_cast<lab_texture_filter>(bind.filter);
+            break;
+        }
+        case DrawCommandType::SetViewportAPI:
+        case DrawCommandType::SetViewport:
+            std::memcpy(&command.viewport, payload, sizeof(command.viewport));
+            break;
+        case DrawCommandType::SetBlendMode: {
+            uint32_t mode;
+            std::memcpy(&mode, payload, sizeof(mode));
+            command.blend.mode = static_cast<BlendMode>(mode);
+            break;
+        }
+        case DrawCommandType::SetScissor:
+            std::memcpy(&command.scissor, payload, sizeof(command.scissor));
+            break;
+        case DrawCommandType::SetLayer:
+            std::memcpy(&command.layer, payload, sizeof(command.layer));
+            break;
+    }
+    return command;
+}
+
+CommandStream::Iterator& CommandStream::Iterator::operator++() {
+    RecordHeader header;
+    std::memcpy(&header, m_position, sizeof(header));
+    m_position += header.size;
+    return *this;
+}
+
+lab_result CommandStream::Save(const char* path) const {
+    if (!path) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        return LAB_RESULT_FILE_IO_FAILED;
+    }
+    FileHeader header = {kFileMagic, kFileVersion, m_commandCount, m_bytes.size()};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              (m_bytes.empty() || std::fwrite(m_bytes.data(), m_bytes.size(), 1, file) == 1);
+    ok = std::fclose(file) == 0 && ok;
+    return ok ? LAB_RESULT_OK : LAB_RESULT_FILE_IO_FAILED;
+}
+
+lab_result CommandStream::Load(const char* path) {
+    if (!path) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return LAB_RESULT_FILE_IO_FAILED;
+    }
+    FileHeader header;
+    std::vector<uint8_t> bytes;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == kFileMagic && header.version == kFileVersion;
+    if (ok) {
+        // The size is checked against the file before anything is allocated
+        long start = std::ftell(file);
+        ok = start >= 0 && std::fseek(file, 0, SEEK_END) == 0;
+        long end = ok ? std::ftell(file) : -1;
+        ok = ok && end >= start && header.byteSize <= static_cast<uint64_t>(end - start) &&
+             std::fseek(file, start, SEEK_SET) == 0;
+    }
+    if (ok) {
+        bytes.resize(header.byteSize);
+        ok = bytes.empty() || std::fread(bytes.data(), bytes.size(), 1, file) == 1;
+    }
+    std::fclose(file);
+    if (!ok) {
+        return LAB_RESULT_INVALID_COMMAND_BUFFER;
+    }
+    return Assign(std::move(bytes), header.commandCount);
+}
+
+lab_result CommandStream::Assign(std::vector<uint8_t> bytes, size_t commandCount, bool keepTextureHandles) {
+    // Walk the records before accepting them, so damaged data cannot send a
+    // decoder out of bounds
+    bool ok = true;
+    size_t count = 0;
+    for (size_t offset = 0; ok && offset < bytes.size(); ++count) {
+        uint32_t size = 0;
+        ok = CheckRecord(bytes.data() + offset, bytes.size() - offset, keepTextureHandles, size);
+        offset += size;
+    }
+    if (!ok || count != commandCount) {
+        return LAB_RESULT_INVALID_COMMAND_BUFFER;
+    }
+    m_bytes = std::move(bytes);
+    m_commandCount = count;
+    return LAB_RESULT_OK;
+}
+
+} // namespace labfont
@@ -0,0 +1,76 @@
+#ifndef LABFONT_COMMAND_STREAM_H
+#define LABFONT_COMMAND_STREAM_H
+
+#include "internal_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace labfont {
+
+// Packed encoding of a command sequence in one linear buffer. Each command is
+// a small header followed by only the fields its type uses, and draw
+// commands carry their vertices inline, so a stream owns everything it
+// refers to except texture handles. Commands are decoded in order by
+// iterating the stream; decoded vertex pointers point into the stream and
+// are valid until it is next modified.
+//
+// A stream can be saved to a file and loaded again for replay. The file is
+// the buffer as is, in the byte order of the machine that wrote it. Texture
+// handles do not survive the round trip and load as no texture.
+class CommandStream {
+public:
+    void Append(const DrawCommand& command);
+    void Append(const DrawCommand* commands, size_t count);
+    void Append(const std::vector<DrawCommand>& commands) { Append(commands.data(), commands.size()); }
+    
+    // Keeps the allocation for reuse
+    void Clear();
+    
+    size_t GetCommandCount() const { return m_commandCount; }
+    size_t GetByteSize() const { return m_bytes.size(); }
+    bool IsEmpty() const { return m_commandCount == 0; }
+    
+    lab_result Save(const char* path) const;
+    lab_result Load(const char* path);
+    
+    // The encoded records, for callers that store streams themselves
+    const uint8_t* GetData() const { return m_bytes.data(); }
+    
+    // Takes over records from GetData after checking that they are well
+    // formed. Texture handles are cleared unless the caller maps them itself.
+    lab_result Assign(std::vector<uint8_t> bytes, size_t commandCount, bool keepTextureHandles = false);
+    
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = DrawCommand;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const DrawCommand*;
+        using reference = const DrawCommand&;
+        
+        Iterator(const uint8_t* position) : m_position(position) {}
+        
+        DrawCommand operator*() const;
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const { return m_position == other.m_position; }
+        bool operator!=(const Iterator& other) const { return m_position != other.m_position; }
+        
+    private:
+        const uint8_t* m_position;
+    };
+    
+    Iterator begin() const { return Iterator(m_bytes.data()); }
+    Iterator end() const { return Iterator(m_bytes.data() + m_bytes.size()); }
+    
+private:
+    void Reserve(size_t count);
+    
+    std::vector<uint8_t> m_bytes;
+    size_t m_commandCount = 0;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_COMMAND_STREAM_H
@@ -2,7 +2,9 @@
 #include "context_impl.h"
 #include "core/memory.h"
 #include "core/internal_types.h"
+#include <algorithm>
 #include <memory>
+#include <thread>
 #include <vector>
 
 // Use stb_image_write to save the image
@@ -82,6 +84,15 @@ lab_result Context::Initialize(lab_backend_type type, const lab_context_desc* de
         return result;
     }
     
+    // Opt-in tile-binned rendering for the CPU backend
+    if (type == LAB_BACKEND_CPU && desc && desc->worker_threads > 0) {
+        static_cast<CPUBackend*>(m_backend.get())->SetWorkerThreads(desc->worker_threads);
+    }
+    
+    if (desc && desc->pipelined_frames > 0) {
+        m_renderThread = std::make_unique<RenderThread>(*m_backend, desc->pipelined_frames);
+    }
+    
     // Initialize managers
     m_fontManager = std::make_unique<FontManager>();
     m_drawState = std::make_unique<DrawState>();
@@ -102,12 +113,215 @@ lab_result Context::Initialize(lab_backend_type type, const lab_context_desc* de
     return lab_result(LAB_RESULT_OK);
 }
 
-void Context::BeginFrame() {
-    m_backend->BeginFrame();
+lab_result Context::BeginFrame() {
+    if (m_capture) {
+        m_capture->BeginFrame();
+    }
+    UploadLoadedTextures();
+    EnforceMemoryBudget();
+    if (m_renderThread) {
+        m_pendingBeginFrame = true;
+        return LAB_RESULT_OK;
+    }
+    return m_backend->BeginFrame();
 }
 
-void Context::EndFrame() {
-    m_backend->EndFrame();
+TextureLoader* Context::GetTextureLoader() {
+    if (!m_textureLoader) {
+        // Leave a core to the thread that renders
+        uint32_t cores = std::thread::hardware_concurrency();
+        m_textureLoader = std::make_unique<TextureLoader>(cores > 2 ? cores - 1 : 1);
+    }
+    return m_textureLoader.get();
+}
+
+void Context::UploadLoadedTextures() {
+    if (!m_textureLoader || !m_textureLoader->HasDecoded()) {
+        return;
+    }
+    Synchronize();
+    m_textureLoader->Upload(*m_resourceManager, m_capture.get(), m_frameIndex);
+}
+
+void Context::SetMemoryBudget(size_t bytes) {
+    m_memoryBudget = bytes;
+    EnforceMemoryBudget();
+}
+
+void Context::EnforceMemoryBudget() {
+    if (m_memoryBudget == 0) {
+        return;
+    }
+    size_t usage = m_backend->GetTotalMemoryUsage();
+    if (usage <= m_memoryBudget) {
+        return;
+    }
+    // Textures of recorded draws must stay until the draws have executed
+    Synchronize();
+    m_resourceManager->FreeMemory(usage - m_memoryBudget, m_frameIndex);
+}
+
+void Context::TrackTextureUse(const std::vector<DrawCommand>& commands) {
+    for (const DrawCommand& command : commands) {
+        if (command.type != DrawCommandType::BindTexture || !command.bind_texture.texture) {
+            continue;
+        }
+        auto texture = reinterpret_cast<TextureResource*>(command.bind_texture.texture);
+        texture->MarkUsed(m_frameIndex);
+        // Draws show the placeholder until the image is back
+        if (m_resourceManager->BeginReload(texture)) {
+            TextureLoader* loader = GetTextureLoader();
+            loader->Release(loader->Start(texture->GetSourcePath().c_str(), texture->GetHandle()));
+        }
+    }
+}
+
+lab_result Context::EndFrame() {
+    // Stitch the encoders' commands into one submission, in order
+    lab_result result = LAB_RESULT_OK;
+    {
+        std::lock_guard<std::mutex> lock(m_encoderMutex);
+        m_encodedCommands.clear();
+        for (auto& encoder : m_encoders) {
+            const auto& commands = encoder->GetCommands();
+            if (commands.empty()) {
+                continue;
+            }
+            // Each encoder starts in layer zero, as a submission does
+            if (!m_encodedCommands.empty()) {
+                DrawCommand resetLayer;
+                resetLayer.type = DrawCommandType::SetLayer;
+                resetLayer.layer.layer = 0;
+                m_encodedCommands.push_back(resetLayer);
+            }
+            m_encodedCommands.insert(m_encodedCommands.end(), commands.begin(), commands.end());
+        }
+        if (!m_encodedCommands.empty()) {
+            result = SubmitCommands(m_encodedCommands);
+        }
+        for (auto& encoder : m_encoders) {
+            encoder->Reset();
+        }
+    }
+    
+    if (m_capture) {
+        m_capture->EndFrame();
+    }
+    
+    lab_result endResult = LAB_RESULT_OK;
+    if (m_renderThread) {
+        // Errors of earlier frames surface here, as the backend reports them
+        m_frameFence = m_renderThread->Submit(std::move(m_pendingStream), m_pendingBeginFrame, true);
+        m_pendingStream = m_renderThread->AcquireStream();
+        m_pendingBeginFrame = false;
+        endResult = m_renderThread->TakeError();
+    } else {
+        endResult = m_backend->EndFrame();
+        ++m_frameFence;
+    }
+    ++m_frameIndex;
+    m_frameArena.EndFrame();
+    return result != LAB_RESULT_OK ? result : endResult;
+}
+
+uint64_t Context::GetCompletedFrameFence() const {
+    return m_renderThread ? m_renderThread->GetCompletedFence() : m_frameFence;
+}
+
+lab_result Context::WaitForFrame(uint64_t fence) {
+    if (!m_renderThread) {
+        return LAB_RESULT_OK;
+    }
+    m_renderThread->Wait(std::min(fence, m_renderThread->GetSubmittedFence()));
+    return m_renderThread->TakeError();
+}
+
+void Context::Synchronize() {
+    if (!m_renderThread) {
+        return;
+    }
+    if (!m_pendingStream.IsEmpty() || m_pendingBeginFrame) {
+        m_renderThread->Submit(std::move(m_pendingStream), m_pendingBeginFrame, false);
+        m_pendingStream = m_renderThread->AcquireStream();
+        m_pendingBeginFrame = false;
+    }
+    m_renderThread->WaitIdle();
+}
+
+lab_result Context::BeginCapture(const char* path) {
+    Synchronize();
+    auto capture = std::make_unique<CaptureWriter>();
+    lab_result result = capture->Open(path, *m_backend);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
+    // Drawing continues into whatever target is current
+    if (m_currentRenderTarget) {
+        capture->SetRenderTarget(m_currentRenderTarget);
+    }
+    m_capture = std::move(capture);
+    return LAB_RESULT_OK;
+}
+
+lab_result Context::EndCapture() {
+    if (!m_capture) {
+        return LAB_RESULT_INVALID_OPERATION;
+    }
+    lab_result result = m_capture->Close();
+    m_capture.reset();
+    return result;
+}
+
+CommandEncoder* Context::CreateEncoder(uint32_t sortKey) {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    auto encoder = std::make_unique<CommandEncoder>(GetContextHandle(this), sortKey,
+                                                  m_nextEncoderSequence++);
+    auto position = std::upper_bound(m_encoders.begin(), m_encoders.end(), encoder,
+        [](const std::unique_ptr<CommandEncoder>& a, const std::unique_ptr<CommandEncoder>& b) {
+            return *a < *b;
+        });
+    return m_encoders.insert(position, std::move(encoder))->get();
+}
+
+void Context::DestroyEncoder(CommandEncoder* encoder) {
+    std::lock_guard<std::mutex> lock(m_encoderMutex);
+    m_encoders.erase(std::remove_if(m_encoders.begin(), m_encoders.end(),
+        [encoder](const std::unique_ptr<CommandEncoder>& e) { return e.get() == encoder; }),
+        m_encoders.end());
+}
+
+lab_result Context::SubmitCommands(const std::vector<DrawCommand>& commands) {
+    if (m_capture) {
+        m_capture->Submit(commands);
+    }
+    const std::vector<DrawCommand>* input = &commands;
+    if (m_sortDraws) {
+        m_commandSorter.Sort(input->data(), input->size(), m_sortedCommands, m_commandStats);
+        input = &m_sortedCommands;
+    }
+    if (PrimitiveExpander::NeedsExpansion(input->data(), input->size(), *m_backend)) {
+        m_primitiveExpander.Expand(input->data(), input->size(), *m_backend, m_expandedCommands);
+        input = &m_expandedCommands;
+    }
+    m_commandOptimizer.Optimize(input->data(), input->size(), m_optimizedCommands, m_commandStats);
+    if (m_optimizedCommands.empty()) {
+        return LAB_RESULT_OK;
+    }
+    TrackTextureUse(m_optimizedCommands);
+    if (m_renderThread) {
+        // The render thread runs after the caller's vertices may be gone, so
+        // the commands are packed with copies of them
+        m_pendingStream.Append(m_optimizedCommands);
+        return LAB_RESULT_OK;
+    }
+    // The backend executes the commands before returning, so they can refer
+    // to the caller's vertices without a copy
+    return m_backend->SubmitCommands(m_optimizedCommands);
+}
+
+lab_result Context::SubmitCommands(const lab_draw_command* commands, uint32_t count) {
+    m_submittedCommands.assign(commands, commands + count);
+    return SubmitCommands(m_submittedCommands);
 }
 
 void Context::SetCoordinateSystem(const lab_coordinate_system& coord_system) {
@@ -135,7 +349,9 @@ lab_result lab_create_context(const lab_backend_desc* desc, lab_context* out_con
         .native_window = desc->native_window,
         .max_vertices = 1024,  // Default value
         .atlas_width = 1024,   // Default value
-        .atlas_height = 1024   // Default value
+        .atlas_height = 1024,  // Default value
+        .worker_threads = desc->worker_threads,
+        .pipelined_frames = desc->pipelined_frames
     };
     
     labfont::Context* context = nullptr;
@@ -157,9 +373,7 @@ lab_result lab_begin_frame(lab_context ctx) {
         return LAB_RESULT_INVALID_PARAMETER;
     }
     
-    auto context = labfont::GetContextImpl(ctx);
-    auto result = context->GetBackend()->BeginFrame();
-    return result;
+    return labfont::GetContextImpl(ctx)->BeginFrame();
 }
 
 lab_result lab_end_frame(lab_context ctx) {
@@ -167,9 +381,44 @@ lab_result lab_end_frame(lab_context ctx) {
         return LAB_RESULT_INVALID_CONTEXT;
     }
     
+    return labfont::GetContextImpl(ctx)->EndFrame();
+}
+
+lab_result lab_get_frame_fences(lab_context ctx, uint64_t* out_submitted, uint64_t* out_completed) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!out_submitted || !out_completed) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
     auto context = labfont::GetContextImpl(ctx);
-    auto result = context->GetBackend()->EndFrame();
-    return result;
+    *out_submitted = context->GetFrameFence();
+    *out_completed = context->GetCompletedFrameFence();
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_wait_for_frame(lab_context ctx, uint64_t fence) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    return labfont::GetContextImpl(ctx)->WaitForFrame(fence);
+}
+
+lab_result lab_begin_capture(lab_context ctx, const char* path) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!path) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    return labfont::GetContextImpl(ctx)->BeginCapture(path);
+}
+
+lab_result lab_end_capture(lab_context ctx) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    return labfont::GetContextImpl(ctx)->EndCapture();
 }
 
 lab_result lab_submit_commands(lab_context ctx, const lab_draw_command* commands, uint32_t commandCount) {
@@ -181,10 +430,71 @@ lab_result lab_submit_commands(lab_context ctx, const lab_draw_command* commands
         return LAB_RESULT_INVALID_PARAMETER;
     }
     
-    auto context = labfont::GetContextImpl(ctx);
-    std::vector<labfont::DrawCommand> internalCommands(commands, commands + commandCount);
-    auto result = context->GetBackend()->SubmitCommands(internalCommands);
-    return result;
+    return labfont::GetContextImpl(ctx)->SubmitCommands(commands, commandCount);
+}
+
+void* lab_frame_alloc(lab_context ctx, size_t size) {
+    if (!ctx) {
+        return nullptr;
+    }
+    return labfont::GetContextImpl(ctx)->GetFrameArena().Allocate(size);
+}
+
+lab_vertex_2TC* lab_frame_alloc_vertices(lab_context ctx, uint32_t count) {
+    return static_cast<lab_vertex_2TC*>(lab_frame_alloc(ctx, size_t(count) * sizeof(lab_vertex_2TC)));
+}
+
+lab_result lab_create_encoder(lab_context ctx, uint32_t sort_key, lab_encoder* out_encoder) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!out_encoder) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    auto encoder = labfont::GetContextImpl(ctx)->CreateEncoder(sort_key);
+    *out_encoder = reinterpret_cast<lab_encoder>(encoder);
+    return LAB_RESULT_OK;
+}
+
+void lab_destroy_encoder(lab_context ctx, lab_encoder encoder) {
+    if (!ctx || !encoder) {
+        return;
+    }
+    labfont::GetContextImpl(ctx)->DestroyEncoder(reinterpret_cast<labfont::CommandEncoder*>(encoder));
+}
+
+lab_result lab_encode_commands(lab_encoder encoder, const lab_draw_command* commands, uint32_t commandCount) {
+    if (!encoder || !commands || commandCount == 0) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    return reinterpret_cast<labfont::CommandEncoder*>(encoder)->Encode(commands, commandCount);
+}
+
+lab_result lab_get_command_stats(lab_context ctx, lab_command_stats* out_stats) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!out_stats) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    *out_stats = labfont::GetContextImpl(ctx)->GetCommandStats();
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_set_draw_sorting(lab_context ctx, bool enabled) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    labfont::GetContextImpl(ctx)->SetDrawSorting(enabled);
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_reset_command_stats(lab_context ctx) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    labfont::GetContextImpl(ctx)->ResetCommandStats();
+    return LAB_RESULT_OK;
 }
 
 // Render target creation and destruction moved to resource_manager.cpp
@@ -195,10 +505,17 @@ lab_result lab_set_render_target(lab_context ctx, lab_render_target target) {
     }
 
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto targetResource = reinterpret_cast<labfont::RenderTargetResource*>(target);
     auto backendTarget = targetResource->GetBackendTarget();
     
     auto result = context->GetBackend()->SetRenderTarget(backendTarget);
+    if (result == LAB_RESULT_OK) {
+        context->SetCurrentRenderTarget(targetResource);
+        if (auto capture = context->GetCapture()) {
+            capture->SetRenderTarget(targetResource);
+        }
+    }
     return result;
 }
 
@@ -208,6 +525,7 @@ lab_result lab_save_render_target(lab_context ctx, lab_render_target target, con
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto targetResource = reinterpret_cast<labfont::RenderTargetResource*>(target);
     auto backendTarget = targetResource->GetBackendTarget();
     
@@ -280,35 +598,26 @@ lab_result lab_resize_render_target(lab_context ctx, lab_render_target target, u
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto targetResource = reinterpret_cast<labfont::RenderTargetResource*>(target);
-    auto backendTarget = targetResource->GetBackendTarget();
-    
-    // Get current render target properties
-    auto format = backendTarget->GetFormat();
-    bool hasDepth = backendTarget->HasDepth();
     
-    // Create a new render target descriptor with the new dimensions
-    labfont::RenderTargetDesc desc;
-    desc.width = width;
-    desc.height = height;
-    desc.format = format;
-    desc.hasDepth = hasDepth;
-    
-    // Create a new backend render target
-    std::shared_ptr<labfont::RenderTarget> newBackendTarget;
-    lab_result result = context->GetBackend()->CreateRenderTarget(desc, newBackendTarget);
+    // The new backend target may come from the texture pool, and the old one
+    // goes back to it
+    lab_result result = context->GetResourceManager()->ResizeRenderTarget(targetResource, width, height);
     if (result != LAB_RESULT_OK) {
         return result;
     }
     
-    // Update the resource with the new backend target
-    targetResource->SetBackendTarget(newBackendTarget);
-    
     // Set the render target to ensure it's active
-    result = context->GetBackend()->SetRenderTarget(newBackendTarget.get());
+    result = context->GetBackend()->SetRenderTarget(targetResource->GetBackendTarget());
     if (result != LAB_RESULT_OK) {
         return result;
     }
+    context->SetCurrentRenderTarget(targetResource);
+    if (auto capture = context->GetCapture()) {
+        capture->ResizeRenderTarget(targetResource);
+        capture->SetRenderTarget(targetResource);
+    }
     
     return LAB_RESULT_OK;
 }
@@ -321,6 +630,7 @@ lab_result lab_get_render_target_data(
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto targetResource = reinterpret_cast<labfont::RenderTargetResource*>(target);
     auto backendTarget = targetResource->GetBackendTarget();
     
@@ -376,4 +686,30 @@ lab_result lab_get_render_target_data(
     return LAB_RESULT_OK;
 }
 
+lab_result lab_read_render_target_changes(lab_context ctx, lab_render_target target, uint8_t* data, size_t size,
+                                          lab_rect* out_rects, uint32_t max_rects, uint32_t* out_rect_count) {
+    if (!ctx || !target || !data || !out_rect_count || (max_rects > 0 && !out_rects)) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    
+    auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
+    auto targetResource = reinterpret_cast<labfont::RenderTargetResource*>(target);
+    auto backendTarget = targetResource->GetBackendTarget();
+    
+    auto colorTexture = backendTarget->GetColorTexture();
+    if (!colorTexture) {
+        return LAB_RESULT_INVALID_RENDER_TARGET;
+    }
+    if (!colorTexture->SupportsReadback()) {
+        return LAB_RESULT_READBACK_NOT_SUPPORTED;
+    }
+    if (size < size_t(colorTexture->GetWidth()) * colorTexture->GetHeight() * 4) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    
+    return context->GetBackend()->ReadbackChanges(backendTarget, data, size, out_rects, max_rects,
+                                                  *out_rect_count);
+}
+
 } // extern "C"
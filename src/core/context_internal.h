@@ -3,14 +3,24 @@
 
 #include <labfont/labfont.h>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include "backend.h"
+#include "capture.h"
 #include "font_manager.h"
 #include "draw_state.h"
 #include "resource_manager.h"
 #include "memory.h"
 #include "error.h"
 #include "coordinate_system.h"
+#include "command_encoder.h"
+#include "command_optimizer.h"
+#include "command_sorter.h"
+#include "command_stream.h"
+#include "frame_arena.h"
+#include "primitive_expander.h"
+#include "render_thread.h"
+#include "texture_loader.h"
 
 namespace labfont {
 
@@ -21,11 +31,60 @@ public:
 
     lab_result Resize(unsigned int width, unsigned int height);
     
-    // Frame management
-    void BeginFrame();
-    void EndFrame();
+    // Frame management. EndFrame submits the encoders first and then starts
+    // a new frame arena frame.
+    lab_result BeginFrame();
+    lab_result EndFrame();
+    
+    // Frames ended so far and frames the backend has finished, as fences.
+    // Without a render thread every frame is finished when it ends.
+    uint64_t GetFrameFence() const { return m_frameFence; }
+    uint64_t GetCompletedFrameFence() const;
+    // Blocks until the frame has been executed; returns backend errors
+    // reported since the previous call
+    lab_result WaitForFrame(uint64_t fence);
+    
+    // In pipelined mode, hands over what has been recorded so far and waits
+    // until the render thread is idle. Anything that uses the backend other
+    // than submission calls this first.
+    void Synchronize();
     void Clear(lab_color color);
     
+    // Optimizes commands and hands them to the backend
+    lab_result SubmitCommands(const std::vector<DrawCommand>& commands);
+    lab_result SubmitCommands(const lab_draw_command* commands, uint32_t count);
+    const lab_command_stats& GetCommandStats() const { return m_commandStats; }
+    // Reorders each submission by layer and state before optimizing it
+    void SetDrawSorting(bool enabled) { m_sortDraws = enabled; }
+    void ResetCommandStats() { m_commandStats = {}; }
+    
+    // Records everything submitted from now on to a file for labfont_replay
+    lab_result BeginCapture(const char* path);
+    lab_result EndCapture();
+    // Null unless capturing
+    CaptureWriter* GetCapture() { return m_capture.get(); }
+    
+    // Asynchronous texture loads; the loader's workers start with the first
+    TextureLoader* GetTextureLoader();
+    // Gives the textures of decoded loads their images. BeginFrame calls it,
+    // as the safe point where no draws of the previous frame are pending.
+    void UploadLoadedTextures();
+    
+    // Backend memory the context tries to stay under, zero for no limit.
+    // When usage exceeds it, BeginFrame frees pooled objects and then evicts
+    // the least recently bound textures that were loaded from files; binding
+    // an evicted texture loads it again.
+    void SetMemoryBudget(size_t bytes);
+    size_t GetMemoryBudget() const { return m_memoryBudget; }
+    
+    // The render target resource last set, so a capture can start with it
+    RenderTargetResource* GetCurrentRenderTarget() const { return m_currentRenderTarget; }
+    void SetCurrentRenderTarget(RenderTargetResource* target) { m_currentRenderTarget = target; }
+    
+    // Encoders are created and destroyed under a lock but record without one
+    CommandEncoder* CreateEncoder(uint32_t sortKey);
+    void DestroyEncoder(CommandEncoder* encoder);
+    
     // State management
     void BeginText();
     void EndText();
@@ -38,6 +97,7 @@ public:
     DrawState* GetDrawState() { return m_drawState.get(); }
     ResourceManagerImpl* GetResourceManager() { return m_resourceManager.get(); }
     MemoryManager* GetMemoryManager() { return &MemoryManager::Instance(); }
+    FrameArena& GetFrameArena() { return m_frameArena; }
     
     // Viewport
     void SetViewport(float x, float y, float width, float height);
@@ -54,6 +114,10 @@ protected:
     
     lab_result Initialize(lab_backend_type type, const lab_context_desc* desc);
     
+    // Stamps the textures a submission binds, reloading evicted ones
+    void TrackTextureUse(const std::vector<DrawCommand>& commands);
+    void EnforceMemoryBudget();
+    
     std::unique_ptr<Backend> m_backend;
     std::unique_ptr<FontManager> m_fontManager;
     std::unique_ptr<DrawState> m_drawState;
@@ -67,6 +131,44 @@ protected:
     // Coordinate system
     lab_coordinate_system m_coordinateSystem;
     bool m_coordinateSystemInitialized;
+    
+    // Submission sorting, expansion and optimization; the output buffers are
+    // reused between calls
+    bool m_sortDraws = false;
+    CommandSorter m_commandSorter;
+    std::vector<DrawCommand> m_sortedCommands;
+    PrimitiveExpander m_primitiveExpander;
+    std::vector<DrawCommand> m_expandedCommands;
+    CommandOptimizer m_commandOptimizer;
+    std::vector<DrawCommand> m_optimizedCommands;
+    lab_command_stats m_commandStats = {};
+    std::vector<DrawCommand> m_submittedCommands;  // API commands converted
+    
+    // Transient per-frame allocations
+    FrameArena m_frameArena;
+    
+    uint64_t m_frameFence = 0;
+    // Frames ended, which dates texture use for the memory budget. Unlike
+    // the fence, it does not move when work is flushed mid-frame.
+    uint64_t m_frameIndex = 0;
+    
+    RenderTargetResource* m_currentRenderTarget = nullptr;
+    std::unique_ptr<CaptureWriter> m_capture;
+    std::unique_ptr<TextureLoader> m_textureLoader;
+    size_t m_memoryBudget = 0;
+    
+    // Live encoders in submission order, and their commands stitched together
+    std::mutex m_encoderMutex;
+    std::vector<std::unique_ptr<CommandEncoder>> m_encoders;
+    uint64_t m_nextEncoderSequence = 0;
+    std::vector<DrawCommand> m_encodedCommands;
+    
+    // Pipelined mode: submissions are packed into the pending stream, which
+    // is handed to the render thread when the frame ends. Declared last so
+    // queued frames finish before anything else is destroyed.
+    CommandStream m_pendingStream;
+    bool m_pendingBeginFrame = false;
+    std::unique_ptr<RenderThread> m_renderThread;
 };
 
 // Helper function to convert C handle to C++ object
@@ -66,6 +66,10 @@ const char* GetResultString(lab_result error) {
             return "Invalid command buffer";
         case LAB_RESULT_TEXTURE_LOAD_FAILED:
             return "Texture Load failed";
+        case LAB_RESULT_FILE_IO_FAILED:
+            return "File I/O failed";
+        case LAB_RESULT_NOT_READY:
+            return "Not ready";
         default:
             return "Unknown error";
     }
@@ -0,0 +1,98 @@
+#include "frame_arena.h"
+#include "memory.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace labfont {
+
+namespace {
+
+constexpr size_t kMinBlockSize = 64 * 1024;
+
+} // namespace
+
+FrameArena::~FrameArena() {
+    for (Frame& frame : m_frames) {
+        FreeBlocks(frame);
+    }
+}
+
+bool FrameArena::AddBlock(Frame& frame, size_t size) {
+    void* data = MemoryManager::Instance().Allocate(size, MemoryCategory::Temporary);
+    if (!data) {
+        return false;
+    }
+    frame.blocks.push_back({static_cast<uint8_t*>(data), size});
+    frame.used = 0;
+    return true;
+}
+
+void FrameArena::FreeBlocks(Frame& frame) {
+    for (const Block& block : frame.blocks) {
+        MemoryManager::Instance().Free(block.data);
+    }
+    frame.blocks.clear();
+    frame.used = 0;
+    frame.allocated = 0;
+}
+
+void* FrameArena::Allocate(size_t size) {
+    if (size == 0 || size > SIZE_MAX - kAlignment) {
+        return nullptr;
+    }
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Frame& frame = m_frames[m_current];
+    if (frame.blocks.empty() || frame.blocks.back().size - frame.used < size) {
+        // Blocks double so a growing frame chains only a few of them
+        size_t blockSize = frame.blocks.empty() ? kMinBlockSize : frame.blocks.back().size * 2;
+        if (!AddBlock(frame, std::max(blockSize, size))) {
+            return nullptr;
+        }
+    }
+    
+    // Blocks come from malloc, so offsets that are multiples of the
+    // alignment keep the memory aligned
+    Block& block = frame.blocks.back();
+    void* result = block.data + frame.used;
+    frame.used += size;
+    frame.allocated += size;
+    return result;
+}
+
+void FrameArena::EndFrame() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current = (m_current + 1) % kFrameCount;
+    
+    // The frame being recycled was submitted kFrameCount frames ago
+    Frame& frame = m_frames[m_current];
+    if (frame.blocks.size() > 1) {
+        size_t total = 0;
+        for (const Block& block : frame.blocks) {
+            total += block.size;
+        }
+        FreeBlocks(frame);
+        AddBlock(frame, total);
+    }
+    frame.used = 0;
+    frame.allocated = 0;
+}
+
+size_t FrameArena::GetFrameUsage() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frames[m_current].allocated;
+}
+
+size_t FrameArena::GetCapacity() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t capacity = 0;
+    for (const Frame& frame : m_frames) {
+        for (const Block& block : frame.blocks) {
+            capacity += block.size;
+        }
+    }
+    return capacity;
+}
+
+} // namespace labfont
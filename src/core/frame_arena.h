@@ -0,0 +1,64 @@
+#ifndef LABFONT_FRAME_ARENA_H
+#define LABFONT_FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace labfont {
+
+// Linear allocator for data that lives for a frame, such as the vertices of
+// immediate mode draws. Allocation bumps a pointer and nothing is freed
+// individually; instead each frame has its own memory, and a frame's memory
+// is recycled kFrameCount frames later, once the backend is done with it.
+//
+// A frame that outgrows its block chains more blocks, and they are merged
+// into one when the frame is recycled, so after a few frames of steady use
+// the arena allocates nothing. Allocation is thread safe.
+class FrameArena {
+public:
+    static constexpr uint32_t kFrameCount = 3;
+    static constexpr size_t kAlignment = 16;
+    
+    FrameArena() = default;
+    ~FrameArena();
+    
+    // Memory aligned to kAlignment, valid until EndFrame has been called
+    // kFrameCount times. Null if size is zero or the system is out of memory.
+    void* Allocate(size_t size);
+    
+    // Starts the next frame, recycling the oldest frame's memory
+    void EndFrame();
+    
+    // Bytes handed out during the current frame
+    size_t GetFrameUsage() const;
+    // Bytes held for all frames
+    size_t GetCapacity() const;
+    
+private:
+    struct Block {
+        uint8_t* data;
+        size_t size;
+    };
+    
+    struct Frame {
+        std::vector<Block> blocks;
+        size_t used = 0;       // Of the last block
+        size_t allocated = 0;  // In all blocks, including alignment padding
+    };
+    
+    static bool AddBlock(Frame& frame, size_t size);
+    static void FreeBlocks(Frame& frame);
+    
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    
+    Frame m_frames[kFrameCount];
+    uint32_t m_current = 0;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_FRAME_ARENA_H
@@ -0,0 +1,177 @@
+#ifndef LABFONT_HANDLE_TABLE_H
+#define LABFONT_HANDLE_TABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace labfont {
+
+// Generational 32-bit handle: a slot index in the low bits and the slot's
+// generation in the high bits. Zero is never a valid handle.
+using ResourceHandle = uint32_t;
+
+// Slot map from generational handles to shared objects, with constant-time
+// lookup. Removing an object bumps its slot's generation, so its handle goes
+// stale and fails every lookup, also once the slot is reused, until the
+// generation wraps after 4095 reuses of that slot.
+//
+// Insert and Remove take a lock; Get does not. Slots live in fixed pages
+// that are never moved or freed while the table exists, so other threads,
+// such as a render thread, can resolve handles while the table grows. The
+// pointer Get returns is valid until its object is removed, which callers
+// must not do while another thread may still use it.
+template<typename T>
+class HandleTable {
+public:
+    static constexpr uint32_t kIndexBits = 20;
+    static constexpr uint32_t kMaxSlots = 1u << kIndexBits;
+
+    HandleTable() {
+        for (auto& page : m_pages) {
+            page.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~HandleTable() {
+        for (auto& page : m_pages) {
+            delete[] page.load(std::memory_order_relaxed);
+        }
+    }
+
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    // Zero if the object is null or all slots are in use
+    ResourceHandle Insert(std::shared_ptr<T> object) {
+        if (!object) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t index;
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        } else if (m_slotCount < kMaxSlots) {
+            index = m_slotCount++;
+            auto& page = m_pages[index >> kPageBits];
+            if (!page.load(std::memory_order_relaxed)) {
+                page.store(new Slot[kPageSize], std::memory_order_release);
+            }
+        } else {
+            return 0;
+        }
+
+        Slot& slot = GetSlot(index);
+        slot.object.store(object.get(), std::memory_order_release);
+        slot.owner = std::move(object);
+        ++m_count;
+        return (slot.generation.load(std::memory_order_relaxed) << kIndexBits) | index;
+    }
+
+    // Returns the removed object, or null if the handle was stale
+    std::shared_ptr<T> Remove(ResourceHandle handle) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Slot* slot = Find(handle);
+        if (!slot) {
+            return nullptr;
+        }
+        uint32_t generation = slot->generation.load(std::memory_order_relaxed);
+        slot->object.store(nullptr, std::memory_order_relaxed);
+        slot->generation.store(generation % kMaxGeneration + 1, std::memory_order_release);
+        m_free.push_back(handle & kIndexMask);
+        --m_count;
+        return std::move(slot->owner);
+    }
+
+    // Null for stale and invalid handles. Does not lock.
+    T* Get(ResourceHandle handle) const {
+        const Slot* slot = Find(handle);
+        if (!slot) {
+            return nullptr;
+        }
+        // A Remove and Insert between Find and this load put another object
+        // in the slot, so the generation is checked again once the object is
+        // read. The object's acquire load orders the second check after it.
+        T* object = slot->object.load(std::memory_order_acquire);
+        if (slot->generation.load(std::memory_order_relaxed) != handle >> kIndexBits) {
+            return nullptr;
+        }
+        return object;
+    }
+
+    std::shared_ptr<T> GetShared(ResourceHandle handle) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Slot* slot = Find(handle);
+        return slot ? slot->owner : nullptr;
+    }
+
+    uint32_t GetCount() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    // Removes every object; their handles go stale
+    void Clear() {
+        std::vector<std::shared_ptr<T>> removed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (uint32_t index = 0; index < m_slotCount; ++index) {
+                Slot& slot = GetSlot(index);
+                if (slot.owner) {
+                    uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+                    slot.object.store(nullptr, std::memory_order_relaxed);
+                    slot.generation.store(generation % kMaxGeneration + 1, std::memory_order_release);
+                    removed.push_back(std::move(slot.owner));
+                    m_free.push_back(index);
+                }
+            }
+            m_count = 0;
+        }
+        // Destroyed outside the lock, as Remove's callers do
+    }
+
+private:
+    static constexpr uint32_t kIndexMask = kMaxSlots - 1;
+    static constexpr uint32_t kMaxGeneration = (1u << (32 - kIndexBits)) - 1;
+    static constexpr uint32_t kPageBits = 10;
+    static constexpr uint32_t kPageSize = 1u << kPageBits;
+    static constexpr uint32_t kPageCount = kMaxSlots / kPageSize;
+
+    struct Slot {
+        std::atomic<uint32_t> generation{1};  // Of the current or next object
+        std::atomic<T*> object{nullptr};
+        std::shared_ptr<T> owner;             // Accessed under the lock
+    };
+
+    Slot& GetSlot(uint32_t index) const {
+        return m_pages[index >> kPageBits].load(std::memory_order_acquire)[index & (kPageSize - 1)];
+    }
+
+    // The slot holding the handle's object, or null if it is stale
+    Slot* Find(ResourceHandle handle) const {
+        const uint32_t index = handle & kIndexMask;
+        Slot* page = m_pages[index >> kPageBits].load(std::memory_order_acquire);
+        if (!page) {
+            return nullptr;
+        }
+        Slot& slot = page[index & (kPageSize - 1)];
+        if (slot.generation.load(std::memory_order_acquire) != handle >> kIndexBits ||
+            !slot.object.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    std::atomic<Slot*> m_pages[kPageCount];
+    mutable std::mutex m_mutex;
+    std::vector<uint32_t> m_free;  // Indices of removed objects' slots
+    uint32_t m_slotCount = 0;      // Slots ever used
+    uint32_t m_count = 0;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_HANDLE_TABLE_H
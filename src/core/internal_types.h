@@ -22,11 +22,30 @@ enum class DrawCommandType {
     DrawLines = LAB_DRAW_COMMAND_LINES,
     BindTexture = LAB_DRAW_COMMAND_BIND_TEXTURE,
     SetViewportAPI = LAB_DRAW_COMMAND_SET_VIEWPORT,  // Map to public API
+    DrawIndexedTriangles = LAB_DRAW_COMMAND_INDEXED_TRIANGLES,
+    DrawQuads = LAB_DRAW_COMMAND_QUADS,
+    DrawTrianglesPacked = LAB_DRAW_COMMAND_TRIANGLES_PACKED,
+    SetLayer = LAB_DRAW_COMMAND_SET_LAYER,
     SetBlendMode,  // Extended commands for internal use
     SetScissor,
     SetViewport    // Internal viewport command
 };
 
+// Size of one texel in bytes
+inline uint32_t GetTextureFormatBytesPerPixel(lab_texture_format format) {
+    switch (format) {
+        case LAB_TEXTURE_FORMAT_R8_UNORM: return 1;
+        case LAB_TEXTURE_FORMAT_RG8_UNORM: return 2;
+        case LAB_TEXTURE_FORMAT_R16F: return 2;
+        case LAB_TEXTURE_FORMAT_RG16F: return 4;
+        case LAB_TEXTURE_FORMAT_RGBA16F: return 8;
+        case LAB_TEXTURE_FORMAT_R32F: return 4;
+        case LAB_TEXTURE_FORMAT_RG32F: return 8;
+        case LAB_TEXTURE_FORMAT_RGBA32F: return 16;
+        default: return 4;
+    }
+}
+
 enum class BlendMode {
     None,
     Alpha,
@@ -41,6 +60,7 @@ struct RenderTargetDesc {
     uint32_t height;
     lab_texture_format format;
     bool hasDepth;
+    lab_antialias antialias;
 };
 
 struct DrawCommand {
@@ -58,8 +78,23 @@ struct DrawCommand {
             uint32_t vertexCount;
             float lineWidth;
         } lines;
+        struct {
+            const lab_vertex_2TC* vertices;
+            const uint16_t* indices;
+            uint32_t vertexCount;
+            uint32_t indexCount;
+        } indexed_triangles;
+        struct {
+            const lab_quad_instance* instances;
+            uint32_t instanceCount;
+        } quads;
+        struct {
+            const lab_vertex_2TC_packed* vertices;
+            uint32_t vertexCount;
+        } triangles_packed;
         struct {
             lab_texture texture;
+            lab_texture_filter filter;
         } bind_texture;
         struct {
             BlendMode mode;
@@ -76,6 +111,9 @@ struct DrawCommand {
             float width;
             float height;
         } viewport;
+        struct {
+            uint32_t layer;
+        } layer;
     };
 
     // Default constructor
@@ -113,6 +151,22 @@ struct DrawCommand {
                 viewport.width = cmd.set_viewport.width;
                 viewport.height = cmd.set_viewport.height;
                 break;
+            case LAB_DRAW_COMMAND_INDEXED_TRIANGLES:
+                type = DrawCommandType::DrawIndexedTriangles;
+                std::memcpy(&indexed_triangles, &cmd.indexed_triangles, sizeof(indexed_triangles));
+                break;
+            case LAB_DRAW_COMMAND_QUADS:
+                type = DrawCommandType::DrawQuads;
+                std::memcpy(&quads, &cmd.quads, sizeof(quads));
+                break;
+            case LAB_DRAW_COMMAND_TRIANGLES_PACKED:
+                type = DrawCommandType::DrawTrianglesPacked;
+                std::memcpy(&triangles_packed, &cmd.triangles_packed, sizeof(triangles_packed));
+                break;
+            case LAB_DRAW_COMMAND_SET_LAYER:
+                type = DrawCommandType::SetLayer;
+                layer.layer = cmd.set_layer.layer;
+                break;
         }
     }
 
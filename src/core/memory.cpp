@@ -35,16 +35,29 @@ inline lab_memory_stats ToPublicStats(const MemoryStats& stats) {
     return result;
 }
 
+namespace {
+
+// Keeps the pointer handed out aligned as malloc's
+struct alignas(std::max_align_t) AllocationHeader {
+    size_t size;
+    MemoryCategory category;
+};
+
+// Counters have a single writer, which needs no read-modify-write
+inline void Add(std::atomic<size_t>& counter, size_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+} // namespace
+
+thread_local MemoryManager::ThreadCounters* MemoryManager::s_threadCounters = nullptr;
+thread_local bool MemoryManager::s_threadRetired = false;
+
 MemoryManager::MemoryManager() {
-    m_categoryUsage[MemoryCategory::General] = 0;
-    m_categoryUsage[MemoryCategory::Graphics] = 0;
-    m_categoryUsage[MemoryCategory::Text] = 0;
-    m_categoryUsage[MemoryCategory::Resources] = 0;
-    m_categoryUsage[MemoryCategory::Temporary] = 0;
 }
 
 MemoryManager::~MemoryManager() {
-    if (m_leakDetectionEnabled && m_currentUsage > 0) {
+    if (m_leakDetectionEnabled && GetStats().currentUsage > 0) {
         DumpLeaks();
     }
 }
@@ -54,61 +67,121 @@ MemoryManager& MemoryManager::Instance() {
     return instance;
 }
 
+MemoryManager::ThreadSlot::ThreadSlot()
+    : counters(Instance().AcquireCounters())
+{
+}
+
+MemoryManager::ThreadSlot::~ThreadSlot() {
+    Instance().RetireCounters(counters);
+    // The block may go to another thread now, which must be its only writer
+    s_threadCounters = nullptr;
+    s_threadRetired = true;
+}
+
+MemoryManager::ThreadCounters* MemoryManager::GetThreadCounters() {
+    if (!s_threadCounters && !s_threadRetired) {
+        thread_local ThreadSlot slot;
+        s_threadCounters = slot.counters;
+    }
+    return s_threadCounters;
+}
+
+MemoryManager::ThreadCounters* MemoryManager::AcquireCounters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& counters : m_threads) {
+        if (!counters->inUse) {
+            counters->inUse = true;
+            return counters.get();
+        }
+    }
+    m_threads.push_back(std::make_unique<ThreadCounters>());
+    m_threads.back()->inUse = true;
+    return m_threads.back().get();
+}
+
+void MemoryManager::RetireCounters(ThreadCounters* counters) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_retired.allocated += counters->allocated.exchange(0, std::memory_order_relaxed);
+    m_retired.freed += counters->freed.exchange(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < kMemoryCategoryCount; ++i) {
+        m_retired.categoryUsage[i] += counters->categoryUsage[i].exchange(0, std::memory_order_relaxed);
+    }
+    counters->inUse = false;
+}
+
+void MemoryManager::CountRetired(size_t allocated, size_t freed, MemoryCategory category, size_t usage) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_retired.allocated += allocated;
+    m_retired.freed += freed;
+    m_retired.categoryUsage[static_cast<size_t>(category)] += usage;
+}
+
+MemoryManager::Totals MemoryManager::Sum() const {
+    Totals totals = m_retired;
+    for (auto& counters : m_threads) {
+        totals.allocated += counters->allocated.load(std::memory_order_relaxed);
+        totals.freed += counters->freed.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kMemoryCategoryCount; ++i) {
+            totals.categoryUsage[i] += counters->categoryUsage[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
 void* MemoryManager::Allocate(size_t size, MemoryCategory category) {
-    void* ptr = std::malloc(size);
-    if (!ptr) {
+    auto header = static_cast<AllocationHeader*>(std::malloc(sizeof(AllocationHeader) + size));
+    if (!header) {
         return nullptr;
     }
+    header->size = size;
+    header->category = category;
     
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_totalAllocated += size;
-    m_currentUsage += size;
-    m_categoryUsage[category] += size;
-    
-    if (m_currentUsage > m_peakUsage) {
-        m_peakUsage = m_currentUsage;
+    if (ThreadCounters* counters = GetThreadCounters()) {
+        Add(counters->allocated, size);
+        Add(counters->categoryUsage[static_cast<size_t>(category)], size);
+    } else {
+        CountRetired(size, 0, category, size);
     }
-    
-    m_allocations[ptr] = {size, category, nullptr, 0};
-    return ptr;
+    return header + 1;
 }
 
 void MemoryManager::Free(void* ptr) {
     if (!ptr) return;
     
-    std::lock_guard<std::mutex> lock(m_mutex);
-    auto it = m_allocations.find(ptr);
-    if (it != m_allocations.end()) {
-        const auto& info = it->second;
-        m_totalFreed += info.size;
-        m_currentUsage -= info.size;
-        m_categoryUsage[info.category] -= info.size;
-        m_allocations.erase(it);
+    auto header = static_cast<AllocationHeader*>(ptr) - 1;
+    // Usage wraps when another thread allocated it; the sum over threads does not
+    if (ThreadCounters* counters = GetThreadCounters()) {
+        Add(counters->freed, header->size);
+        Add(counters->categoryUsage[static_cast<size_t>(header->category)], 0 - header->size);
+    } else {
+        CountRetired(0, header->size, header->category, 0 - header->size);
     }
-    
-    std::free(ptr);
+    std::free(header);
 }
 
 MemoryStats MemoryManager::GetStats() const {
     std::lock_guard<std::mutex> lock(m_mutex);
-    return MemoryStats{
-        .totalAllocated = m_totalAllocated,
-        .totalFreed = m_totalFreed,
-        .currentUsage = m_currentUsage,
-        .peakUsage = m_peakUsage,
-        .categoryUsage = m_categoryUsage
-    };
+    Totals totals = Sum();
+    MemoryStats stats = {};
+    stats.totalAllocated = totals.allocated - m_baseline.allocated;
+    stats.totalFreed = totals.freed - m_baseline.freed;
+    stats.currentUsage = stats.totalAllocated - stats.totalFreed;
+    for (size_t i = 0; i < kMemoryCategoryCount; ++i) {
+        stats.categoryUsage[static_cast<MemoryCategory>(i)] =
+            totals.categoryUsage[i] - m_baseline.categoryUsage[i];
+    }
+    if (stats.currentUsage > m_peakUsage) {
+        m_peakUsage = stats.currentUsage;
+    }
+    stats.peakUsage = m_peakUsage;
+    return stats;
 }
 
 void MemoryManager::ResetStats() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_totalAllocated = 0;
-    m_totalFreed = 0;
-    m_currentUsage = 0;
+    m_baseline = Sum();
     m_peakUsage = 0;
-    for (auto& [category, usage] : m_categoryUsage) {
-        usage = 0;
-    }
 }
 
 void MemoryManager::EnableLeakDetection(bool enable) {
@@ -5,8 +5,10 @@
 #include "error.h"
 #include <cstddef>
 #include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <mutex>
+#include <vector>
 
 namespace labfont {
 
@@ -18,6 +20,7 @@ enum class MemoryCategory {
     Resources,
     Temporary
 };
+constexpr size_t kMemoryCategoryCount = 5;
 
 // Memory statistics
 struct MemoryStats {
@@ -28,7 +31,11 @@ struct MemoryStats {
     std::unordered_map<MemoryCategory, size_t> categoryUsage;
 };
 
-// Memory manager interface
+// Memory manager interface. Each allocation carries a header with its size
+// and category, and each thread counts into its own block of counters, so
+// Allocate and Free take no lock and share no cache lines. GetStats adds the
+// blocks up. Peak usage is sampled there too, so it misses peaks between
+// reads.
 class MemoryManager {
 public:
     static MemoryManager& Instance();
@@ -47,22 +54,50 @@ private:
     MemoryManager();
     ~MemoryManager();
 
-    struct AllocationInfo {
-        size_t size;
-        MemoryCategory category;
-        const char* file;
-        int line;
+    // Written only by the owning thread; read by GetStats. Frees count on
+    // the thread that frees, so a block's usage may wrap, but the sums hold.
+    struct alignas(64) ThreadCounters {
+        std::atomic<size_t> allocated{0};
+        std::atomic<size_t> freed{0};
+        std::atomic<size_t> categoryUsage[kMemoryCategoryCount] = {};
+        bool inUse = false;
     };
-
-    size_t m_totalAllocated{0};
-    size_t m_totalFreed{0};
-    size_t m_currentUsage{0};
-    size_t m_peakUsage{0};
-    std::unordered_map<MemoryCategory, size_t> m_categoryUsage;
-    std::unordered_map<void*, AllocationInfo> m_allocations;
+    
+    struct Totals {
+        size_t allocated = 0;
+        size_t freed = 0;
+        size_t categoryUsage[kMemoryCategoryCount] = {};
+    };
+    
+    // Registers the calling thread on its first allocation or free and
+    // folds its counts into the totals when it exits
+    struct ThreadSlot {
+        ThreadSlot();
+        ~ThreadSlot();
+        ThreadCounters* counters;
+    };
+    // Null once the thread's slot is retired, as it is before the
+    // destructors of thread_locals constructed ahead of it run
+    static ThreadCounters* GetThreadCounters();
+    ThreadCounters* AcquireCounters();
+    void RetireCounters(ThreadCounters* counters);
+    // Counts straight into the retired totals, under the lock
+    void CountRetired(size_t allocated, size_t freed, MemoryCategory category, size_t usage);
+    // Everything counted so far; requires m_mutex
+    Totals Sum() const;
+
+    // The calling thread's counters, cached as a plain pointer to spare
+    // calls the slot's initialization check
+    static thread_local ThreadCounters* s_threadCounters;
+    static thread_local bool s_threadRetired;
+
+    mutable std::mutex m_mutex;  // Guards the registry, not the counters
+    std::vector<std::unique_ptr<ThreadCounters>> m_threads;
+    Totals m_retired;   // Counts of threads that have exited
+    Totals m_baseline;  // Counts at the last ResetStats
+    mutable size_t m_peakUsage{0};
     
     bool m_leakDetectionEnabled{false};
-    mutable std::mutex m_mutex;
 };
 
 // Allocation helpers
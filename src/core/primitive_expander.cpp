@@ -0,0 +1,110 @@
+#include "primitive_expander.h"
+#include "backend.h"
+#include "vertex.h"
+
+namespace labfont {
+
+namespace {
+
+bool NeedsExpansion(const DrawCommand& command, const Backend& backend) {
+    return (command.type == DrawCommandType::DrawIndexedTriangles ||
+            command.type == DrawCommandType::DrawQuads ||
+            command.type == DrawCommandType::DrawTrianglesPacked) &&
+           !backend.SupportsDrawCommand(command.type);
+}
+
+} // namespace
+
+bool PrimitiveExpander::NeedsExpansion(const DrawCommand* commands, size_t count, const Backend& backend) {
+    for (size_t i = 0; i < count; ++i) {
+        if (labfont::NeedsExpansion(commands[i], backend)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PrimitiveExpander::QuadToTriangles(const lab_quad_instance& quad, lab_vertex_2TC* out) {
+    const float x0 = quad.position[0];
+    const float y0 = quad.position[1];
+    const float x1 = x0 + quad.size[0];
+    const float y1 = y0 + quad.size[1];
+    float color[4];
+    for (int c = 0; c < 4; ++c) {
+        color[c] = quad.color[c] / 255.0f;
+    }
+    const lab_vertex_2TC corners[4] = {
+        {{x0, y0}, {quad.uv[0], quad.uv[1]}, {color[0], color[1], color[2], color[3]}},
+        {{x1, y0}, {quad.uv[2], quad.uv[1]}, {color[0], color[1], color[2], color[3]}},
+        {{x0, y1}, {quad.uv[0], quad.uv[3]}, {color[0], color[1], color[2], color[3]}},
+        {{x1, y1}, {quad.uv[2], quad.uv[3]}, {color[0], color[1], color[2], color[3]}},
+    };
+    out[0] = corners[0];
+    out[1] = corners[1];
+    out[2] = corners[2];
+    out[3] = corners[2];
+    out[4] = corners[1];
+    out[5] = corners[3];
+}
+
+void PrimitiveExpander::Expand(const DrawCommand* commands, size_t count, const Backend& backend,
+                               std::vector<DrawCommand>& out) {
+    // Size the vertex storage first so pointers into it stay valid
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const DrawCommand& command = commands[i];
+        if (!labfont::NeedsExpansion(command, backend)) {
+            continue;
+        }
+        if (command.type == DrawCommandType::DrawQuads) {
+            vertexCount += size_t(command.quads.instanceCount) * 6;
+        } else if (command.type == DrawCommandType::DrawTrianglesPacked) {
+            vertexCount += command.triangles_packed.vertexCount;
+        } else {
+            vertexCount += command.indexed_triangles.indexCount - command.indexed_triangles.indexCount % 3;
+        }
+    }
+    m_vertices.clear();
+    m_vertices.reserve(vertexCount);
+    
+    out.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const DrawCommand& command = commands[i];
+        if (!labfont::NeedsExpansion(command, backend)) {
+            out.push_back(command);
+            continue;
+        }
+        
+        const size_t first = m_vertices.size();
+        if (command.type == DrawCommandType::DrawQuads) {
+            for (uint32_t q = 0; q < command.quads.instanceCount; ++q) {
+                m_vertices.resize(m_vertices.size() + 6);
+                QuadToTriangles(command.quads.instances[q], &m_vertices[m_vertices.size() - 6]);
+            }
+        } else if (command.type == DrawCommandType::DrawTrianglesPacked) {
+            const auto& draw = command.triangles_packed;
+            for (uint32_t v = 0; v < draw.vertexCount; ++v) {
+                m_vertices.push_back(UnpackVertex(draw.vertices[v]));
+            }
+        } else {
+            // Triangles with an index out of range are dropped
+            const auto& draw = command.indexed_triangles;
+            for (uint32_t t = 0; t + 3 <= draw.indexCount; t += 3) {
+                const uint16_t* index = &draw.indices[t];
+                if (index[0] < draw.vertexCount && index[1] < draw.vertexCount && index[2] < draw.vertexCount) {
+                    m_vertices.push_back(draw.vertices[index[0]]);
+                    m_vertices.push_back(draw.vertices[index[1]]);
+                    m_vertices.push_back(draw.vertices[index[2]]);
+                }
+            }
+        }
+        
+        DrawCommand triangles;
+        triangles.type = DrawCommandType::DrawTriangles;
+        triangles.triangles.vertices = m_vertices.data() + first;
+        triangles.triangles.vertexCount = static_cast<uint32_t>(m_vertices.size() - first);
+        out.push_back(triangles);
+    }
+}
+
+} // namespace labfont
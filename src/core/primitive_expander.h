@@ -0,0 +1,33 @@
+#ifndef LABFONT_PRIMITIVE_EXPANDER_H
+#define LABFONT_PRIMITIVE_EXPANDER_H
+
+#include "internal_types.h"
+#include <cstddef>
+#include <vector>
+
+namespace labfont {
+
+class Backend;
+
+// Rewrites indexed triangles, quads and packed triangles into plain triangle
+// lists for backends that do not draw them natively. Other commands are copied as
+// they are. Expanded vertices are owned by the expander and valid until the
+// next call.
+class PrimitiveExpander {
+public:
+    // True if any command needs expanding for the backend
+    static bool NeedsExpansion(const DrawCommand* commands, size_t count, const Backend& backend);
+    
+    void Expand(const DrawCommand* commands, size_t count, const Backend& backend,
+                std::vector<DrawCommand>& out);
+    
+    // Writes the six vertices of a quad's two triangles
+    static void QuadToTriangles(const lab_quad_instance& quad, lab_vertex_2TC* out);
+    
+private:
+    std::vector<lab_vertex_2TC> m_vertices;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_PRIMITIVE_EXPANDER_H
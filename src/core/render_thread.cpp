@@ -0,0 +1,106 @@
+#include "render_thread.h"
+#include "backend.h"
+#include <algorithm>
+
+namespace labfont {
+
+RenderThread::RenderThread(Backend& backend, uint32_t maxQueuedFrames)
+    : m_backend(backend)
+    , m_maxQueuedFrames(std::max(maxQueuedFrames, 1u))
+    , m_thread(&RenderThread::ThreadMain, this) {
+}
+
+RenderThread::~RenderThread() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_queued.notify_one();
+    m_thread.join();
+}
+
+uint64_t RenderThread::Submit(CommandStream&& stream, bool beginsFrame, bool endsFrame) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (endsFrame) {
+        m_completed.wait(lock, [this] { return m_queuedFrames < m_maxQueuedFrames; });
+        ++m_queuedFrames;
+    }
+    const uint64_t fence = ++m_submittedFence;
+    m_queue.push_back({std::move(stream), fence, beginsFrame, endsFrame});
+    lock.unlock();
+    m_queued.notify_one();
+    return fence;
+}
+
+CommandStream RenderThread::AcquireStream() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_freeStreams.empty()) {
+        return CommandStream();
+    }
+    CommandStream stream = std::move(m_freeStreams.back());
+    m_freeStreams.pop_back();
+    return stream;
+}
+
+void RenderThread::Wait(uint64_t fence) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_completed.wait(lock, [this, fence] { return m_completedFence >= fence; });
+}
+
+lab_result RenderThread::TakeError() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    lab_result error = m_error;
+    m_error = LAB_RESULT_OK;
+    return error;
+}
+
+uint64_t RenderThread::GetSubmittedFence() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_submittedFence;
+}
+
+uint64_t RenderThread::GetCompletedFence() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completedFence;
+}
+
+void RenderThread::ThreadMain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_queued.wait(lock, [this] { return m_shutdown || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            return;  // Shut down with nothing left to execute
+        }
+        
+        // The packet stays queued while it executes, so only this thread
+        // touches it and Submit still counts its frame
+        Packet& packet = m_queue.front();
+        lock.unlock();
+        lab_result result = LAB_RESULT_OK;
+        if (packet.beginsFrame) {
+            result = m_backend.BeginFrame();
+        }
+        if (result == LAB_RESULT_OK && !packet.stream.IsEmpty()) {
+            result = m_backend.SubmitCommandStream(packet.stream);
+        }
+        if (packet.endsFrame) {
+            lab_result endResult = m_backend.EndFrame();
+            result = result != LAB_RESULT_OK ? result : endResult;
+        }
+        packet.stream.Clear();
+        lock.lock();
+        
+        if (m_error == LAB_RESULT_OK) {
+            m_error = result;
+        }
+        if (packet.endsFrame) {
+            --m_queuedFrames;
+        }
+        m_completedFence = packet.fence;
+        m_freeStreams.push_back(std::move(packet.stream));
+        m_queue.pop_front();
+        m_completed.notify_all();
+    }
+}
+
+} // namespace labfont
@@ -0,0 +1,83 @@
+#ifndef LABFONT_RENDER_THREAD_H
+#define LABFONT_RENDER_THREAD_H
+
+#include "command_stream.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace labfont {
+
+class Backend;
+
+// Executes command streams on a dedicated thread, so a context can record
+// one frame while the backend is still drawing the previous ones.
+//
+// Work is submitted as packets: a stream together with whether it begins
+// and ends a frame. Each packet gets a fence value, and fences complete in
+// submission order. At most maxQueuedFrames frame-ending packets wait in the
+// queue; Submit blocks until one of them has been executed, which bounds how
+// far recording can run ahead.
+//
+// The backend may only be used through the render thread while packets are
+// queued; callers wait for the thread to go idle before using it directly.
+class RenderThread {
+public:
+    RenderThread(Backend& backend, uint32_t maxQueuedFrames);
+    // Executes everything queued, then stops the thread
+    ~RenderThread();
+    
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+    
+    // Queues a stream for execution and returns its fence. The stream is
+    // moved from; it is recycled once executed.
+    uint64_t Submit(CommandStream&& stream, bool beginsFrame, bool endsFrame);
+    
+    // An empty stream, reusing the storage of an executed one if possible
+    CommandStream AcquireStream();
+    
+    // Blocks until the fence has completed
+    void Wait(uint64_t fence);
+    void WaitIdle() { Wait(GetSubmittedFence()); }
+    
+    // The first error the backend reported since the previous call
+    lab_result TakeError();
+    
+    uint64_t GetSubmittedFence() const;
+    uint64_t GetCompletedFence() const;
+    uint32_t GetMaxQueuedFrames() const { return m_maxQueuedFrames; }
+    
+private:
+    struct Packet {
+        CommandStream stream;
+        uint64_t fence;
+        bool beginsFrame;
+        bool endsFrame;
+    };
+    
+    void ThreadMain();
+    
+    Backend& m_backend;
+    const uint32_t m_maxQueuedFrames;
+    
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queued;     // Work arrived, or shutdown
+    std::condition_variable m_completed;  // A packet finished
+    std::deque<Packet> m_queue;
+    std::vector<CommandStream> m_freeStreams;
+    uint32_t m_queuedFrames = 0;
+    uint64_t m_submittedFence = 0;
+    uint64_t m_completedFence = 0;
+    lab_result m_error = LAB_RESULT_OK;
+    bool m_shutdown = false;
+    
+    std::thread m_thread;  // Last, so it starts after everything it uses
+};
+
+} // namespace labfont
+
+#endif // LABFONT_RENDER_THREAD_H
@@ -2,9 +2,10 @@
 #define LABFONT_RESOURCE_H
 
 #include "backend_types.h"
+#include "handle_table.h"
 #include "internal_types.h"
-#include <string>
 #include <memory>
+#include <string>
 
 namespace labfont {
 
@@ -25,27 +26,28 @@ public:
     virtual ~Resource() = default;
     
     ResourceType GetType() const { return m_type; }
-    const std::string& GetName() const { return m_name; }
+    // Zero for resources not owned by a resource manager
+    ResourceHandle GetHandle() const { return m_handle; }
     bool IsValid() const { return m_valid; }
 
 protected:
     friend class ResourceManagerImpl;
-    Resource(ResourceType type, const std::string& name)
-        : m_type(type), m_name(name), m_valid(false) {}
+    explicit Resource(ResourceType type)
+        : m_type(type), m_handle(0), m_valid(false) {}
     
     void SetValid(bool valid) { m_valid = valid; }
 
 private:
     ResourceType m_type;
-    std::string m_name;
+    ResourceHandle m_handle;
     bool m_valid;
 };
 
 // Texture resource
 class TextureResource : public Resource {
 public:
-    TextureResource(const std::string& name, unsigned int width, unsigned int height, lab_texture_format format)
-        : Resource(ResourceType::Texture, name)
+    TextureResource(unsigned int width, unsigned int height, lab_texture_format format)
+        : Resource(ResourceType::Texture)
         , m_width(width)
         , m_height(height)
         , m_format(format) {}
@@ -53,6 +55,24 @@ public:
     unsigned int GetWidth() const { return m_width; }
     unsigned int GetHeight() const { return m_height; }
     lab_texture_format GetFormat() const { return m_format; }
+    // For textures that receive their contents later, see RecreateTexture
+    void SetSize(unsigned int width, unsigned int height) { m_width = width; m_height = height; }
+    
+    // Textures loaded from a file can be evicted under a memory budget, and
+    // are loaded again when next drawn with
+    enum class Residency {
+        Resident,
+        Loading,   // Waiting for its image from the texture loader
+        Evicted    // Showing a placeholder
+    };
+    const std::string& GetSourcePath() const { return m_sourcePath; }
+    void SetSourcePath(const char* path) { m_sourcePath = path; }
+    Residency GetResidency() const { return m_residency; }
+    void SetResidency(Residency residency) { m_residency = residency; }
+    // One more than the context's frame index when a submission last bound
+    // the texture, zero if none has
+    uint64_t GetLastUse() const { return m_lastUse; }
+    void MarkUsed(uint64_t frame) { m_lastUse = frame + 1; }
     
     std::shared_ptr<Texture> texture;
 
@@ -61,13 +81,16 @@ private:
     unsigned int m_width;
     unsigned int m_height;
     lab_texture_format m_format;
+    std::string m_sourcePath;
+    Residency m_residency = Residency::Resident;
+    uint64_t m_lastUse = 0;
 };
 
 // Buffer resource
 class BufferResource : public Resource {
 public:
-    BufferResource(const std::string& name, size_t size, bool dynamic)
-        : Resource(ResourceType::Buffer, name)
+    BufferResource(size_t size, bool dynamic)
+        : Resource(ResourceType::Buffer)
         , m_size(size)
         , m_dynamic(dynamic) {}
     
@@ -82,9 +105,8 @@ private:
 // Render target resource
 class RenderTargetResource : public Resource {
 public:
-    RenderTargetResource(const std::string& name, unsigned int width, unsigned int height, 
-                         lab_texture_format format, bool hasDepth)
-        : Resource(ResourceType::RenderTarget, name)
+    RenderTargetResource(unsigned int width, unsigned int height, lab_texture_format format, bool hasDepth)
+        : Resource(ResourceType::RenderTarget)
         , m_width(width)
         , m_height(height)
         , m_format(format)
@@ -101,6 +123,9 @@ public:
     
     // Get the backend render target
     RenderTarget* GetBackendTarget() const { return m_backendTarget.get(); }
+    
+    // Hands the backend render target over, leaving the resource without one
+    std::shared_ptr<RenderTarget> ReleaseBackendTarget() { return std::move(m_backendTarget); }
 
 private:
     unsigned int m_width;
@@ -129,6 +154,7 @@ struct RenderTargetParams {
     unsigned int height;
     lab_texture_format format;
     bool hasDepth;
+    lab_antialias antialias;
 };
 
 // Resource manager interface
@@ -136,18 +162,17 @@ class ResourceManager {
 public:
     virtual ~ResourceManager() = default;
 
-    virtual lab_result CreateTexture(const std::string& name,
-                                     const TextureParams& params,
+    // Created resources are identified by their GetHandle()
+    virtual lab_result CreateTexture(const TextureParams& params,
                                      std::shared_ptr<TextureResource>& out_texture) = 0;
-    virtual lab_result CreateBuffer(const std::string& name,
-                                    const BufferParams& params,
+    virtual lab_result CreateBuffer(const BufferParams& params,
                                     std::shared_ptr<BufferResource>& out_buffer) = 0;
-    virtual lab_result CreateRenderTarget(const std::string& name,
-                                         const RenderTargetParams& params,
+    virtual lab_result CreateRenderTarget(const RenderTargetParams& params,
                                          std::shared_ptr<RenderTargetResource>& out_target) = 0;
     
-    virtual void DestroyResource(const std::string& name) = 0;
-    virtual std::shared_ptr<Resource> GetResource(const std::string& name) = 0;
+    // Stale handles are ignored, and resolve to null
+    virtual void DestroyResource(ResourceHandle handle) = 0;
+    virtual std::shared_ptr<Resource> GetResource(ResourceHandle handle) = 0;
 };
 
 } // namespace labfont
@@ -2,6 +2,7 @@
 #include "backend.h"
 #include "error_macros.h"
 #include "context_internal.h"
+#include <algorithm>
 #include <cassert>
 #define STB_IMAGE_IMPLEMENTATION
 #include "../third_party/stb/stb_image.h"
@@ -10,40 +11,38 @@ namespace labfont {
 
 ResourceManagerImpl::ResourceManagerImpl(Backend* backend)
     : m_backend(backend)
+    , m_texturePool(backend)
 {
     // Backend can be null for testing
 }
 
 ResourceManagerImpl::~ResourceManagerImpl()
 {
-    // Clear all resources
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_resources.clear();
+    m_resources.Clear();
+}
+
+lab_result ResourceManagerImpl::AddResource(std::shared_ptr<Resource> resource)
+{
+    Resource* raw = resource.get();
+    ResourceHandle handle = m_resources.Insert(std::move(resource));
+    if (!handle) {
+        return LAB_RESULT_OUT_OF_MEMORY;
+    }
+    raw->m_handle = handle;
+    return LAB_RESULT_OK;
 }
 
 lab_result ResourceManagerImpl::CreateTexture(
-    const std::string& name,
     const TextureParams& params,
     std::shared_ptr<TextureResource>& out_texture)
 {
     LAB_RESULT_GUARD();
     
-    if (name.empty()) {
-        return LAB_RESULT_INVALID_RESOURCE_NAME;
-    }
-    
     if (params.width == 0 || params.height == 0) {
         return LAB_RESULT_INVALID_DIMENSION;
     }
     
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (ResourceExists(name)) {
-        return LAB_RESULT_DUPLICATE_RESOURCE_NAME;
-    }
-    
     auto textureResource = std::make_shared<TextureResource>(
-                                                             name,
                                                              params.width,
                                                              params.height,
                                                              params.format
@@ -56,47 +55,38 @@ lab_result ResourceManagerImpl::CreateTexture(
         params.data,
         false,   //bool renderTarget;
         false,   //bool readback;
-        params.width * params.height * 4,       //size_t dataSize;
+        params.width * params.height * GetTextureFormatBytesPerPixel(params.format),  //size_t dataSize;
     };
     
     /// @TODO add size to params
     /// @TODO make texture resource private
     ///
-    result = m_backend->CreateTexture(tdesc, textureResource->texture);
+    result = m_texturePool.AcquireTexture(tdesc, textureResource->texture);
     if (result != LAB_RESULT_OK || !textureResource->texture) {
         return result;
     }
 
     textureResource->SetValid(true);
 
-    m_resources[name] = textureResource;
+    result = AddResource(textureResource);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
     out_texture = textureResource;
     return LAB_RESULT_OK;
 }
 
 lab_result ResourceManagerImpl::CreateBuffer(
-    const std::string& name,
     const BufferParams& params,
     std::shared_ptr<BufferResource>& out_buffer)
 {
     LAB_RESULT_GUARD();
 
-    if (name.empty()) {
-        return LAB_RESULT_INVALID_RESOURCE_NAME;
-    }
-
     if (params.size == 0) {
         return LAB_RESULT_INVALID_BUFFER_SIZE;
    }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (ResourceExists(name)) {
-        return LAB_RESULT_DUPLICATE_RESOURCE_NAME;
-    }
-
     auto buffer = std::make_shared<BufferResource>(
-        name,
         params.size,
         params.dynamic
     );
@@ -105,34 +95,25 @@ lab_result ResourceManagerImpl::CreateBuffer(
     // lab_result result = m_backend->CreateBuffer(params, buffer.get());
     // LAB_RETURN_IF_ERROR(result);
 
-    m_resources[name] = buffer;
+    result = AddResource(buffer);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
     out_buffer = buffer;
     return LAB_RESULT_OK;
 }
 
 lab_result ResourceManagerImpl::CreateRenderTarget(
-    const std::string& name,
     const RenderTargetParams& params,
     std::shared_ptr<RenderTargetResource>& out_target)
 {
     LAB_RESULT_GUARD();
 
-    if (name.empty()) {
-        return LAB_RESULT_INVALID_RESOURCE_NAME;
-    }
-
     if (params.width == 0 || params.height == 0) {
         return LAB_RESULT_INVALID_DIMENSION;
     }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (ResourceExists(name)) {
-        return LAB_RESULT_DUPLICATE_RESOURCE_NAME;
-    }
-
     auto target = std::make_shared<RenderTargetResource>(
-        name,
         params.width,
         params.height,
         params.format,
@@ -145,11 +126,12 @@ lab_result ResourceManagerImpl::CreateRenderTarget(
     desc.height = params.height;
     desc.format = params.format;
     desc.hasDepth = params.hasDepth;
+    desc.antialias = params.antialias;
     
     // Create the backend render target
     std::shared_ptr<RenderTarget> backendTarget;
     if (m_backend) {
-        lab_result result = m_backend->CreateRenderTarget(desc, backendTarget);
+        lab_result result = m_texturePool.AcquireRenderTarget(desc, backendTarget);
         if (result != LAB_RESULT_OK) {
             return result;
         }
@@ -159,39 +141,187 @@ lab_result ResourceManagerImpl::CreateRenderTarget(
     }
 
     // Store the resource
-    m_resources[name] = target;
+    result = AddResource(target);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
     out_target = target;
     return LAB_RESULT_OK;
 }
 
-void ResourceManagerImpl::DestroyResource(const std::string& name)
+void ResourceManagerImpl::DestroyResource(ResourceHandle handle)
+{
+    // TODO: Once backend interface is implemented
+    // m_backend->DestroyResource(resource.get());
+    std::shared_ptr<Resource> resource = m_resources.Remove(handle);
+    if (!resource || resource.use_count() != 1) {
+        return;
+    }
+    switch (resource->GetType()) {
+        case ResourceType::Texture:
+            ReleaseBackendTexture(std::move(static_cast<TextureResource*>(resource.get())->texture));
+            break;
+        case ResourceType::RenderTarget:
+            m_texturePool.ReleaseRenderTarget(
+                static_cast<RenderTargetResource*>(resource.get())->ReleaseBackendTarget());
+            break;
+        default:
+            break;
+    }
+}
+
+lab_result ResourceManagerImpl::RecreateTexture(TextureResource* texture, const TextureParams& params)
+{
+    if (params.width == 0 || params.height == 0) {
+        return LAB_RESULT_INVALID_DIMENSION;
+    }
+    if (params.format != texture->GetFormat()) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    
+    TextureDesc desc = {
+        params.width,
+        params.height,
+        params.format,
+        params.data,
+        false,
+        false,
+        params.width * params.height * GetTextureFormatBytesPerPixel(params.format),
+    };
+    std::shared_ptr<Texture> backendTexture;
+    lab_result result = m_texturePool.AcquireTexture(desc, backendTexture);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
+    ReleaseBackendTexture(std::move(texture->texture));
+    texture->texture = std::move(backendTexture);
+    texture->SetSize(params.width, params.height);
+    texture->SetResidency(TextureResource::Residency::Resident);
+    return LAB_RESULT_OK;
+}
+
+void ResourceManagerImpl::ReleaseBackendTexture(std::shared_ptr<Texture> texture)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    RemoveResource(name);
+    if (texture != m_placeholder) {
+        m_texturePool.ReleaseTexture(std::move(texture));
+    }
 }
 
-std::shared_ptr<Resource> ResourceManagerImpl::GetResource(const std::string& name)
+void ResourceManagerImpl::SetTextureSource(TextureResource* texture, const char* path)
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    auto it = m_resources.find(name);
-    return (it != m_resources.end()) ? it->second : nullptr;
+    texture->SetSourcePath(path);
+    m_evictable.push_back(texture->GetHandle());
 }
 
-bool ResourceManagerImpl::ResourceExists(const std::string& name)
+size_t ResourceManagerImpl::FreeMemory(size_t bytes, uint64_t frame)
 {
-    // Caller must hold mutex
-    return m_resources.find(name) != m_resources.end();
+    size_t freed = m_texturePool.Trim(bytes);
+    if (freed >= bytes || !m_backend) {
+        return freed;
+    }
+    
+    // Destroyed textures leave stale handles behind, which are dropped here
+    std::vector<TextureResource*> candidates;
+    size_t live = 0;
+    for (ResourceHandle handle : m_evictable) {
+        auto texture = static_cast<TextureResource*>(m_resources.Get(handle));
+        if (!texture) {
+            continue;
+        }
+        m_evictable[live++] = handle;
+        if (texture->GetResidency() == TextureResource::Residency::Resident &&
+            texture->GetLastUse() < frame) {
+            candidates.push_back(texture);
+        }
+    }
+    m_evictable.resize(live);
+    std::sort(candidates.begin(), candidates.end(), [](TextureResource* a, TextureResource* b) {
+        return a->GetLastUse() < b->GetLastUse();
+    });
+    
+    for (TextureResource* texture : candidates) {
+        if (freed >= bytes) {
+            break;
+        }
+        if (!m_placeholder) {
+            const uint8_t transparent[4] = {0, 0, 0, 0};
+            TextureDesc desc = {1, 1, LAB_TEXTURE_FORMAT_RGBA8_UNORM, transparent, false, false, 4};
+            if (m_backend->CreateTexture(desc, m_placeholder) != LAB_RESULT_OK) {
+                break;
+            }
+        }
+        // The resource keeps its size, so layouts made with it still hold
+        std::shared_ptr<Texture> evicted = std::move(texture->texture);
+        freed += TexturePool::GetTextureBytes(evicted->GetWidth(), evicted->GetHeight(), evicted->GetFormat());
+        texture->texture = m_placeholder;
+        texture->SetResidency(TextureResource::Residency::Evicted);
+        m_backend->DestroyTexture(evicted.get());
+        ++m_evictions;
+    }
+    return freed;
 }
 
-void ResourceManagerImpl::RemoveResource(const std::string& name)
+bool ResourceManagerImpl::BeginReload(TextureResource* texture)
 {
-    // Caller must hold mutex
-    auto it = m_resources.find(name);
-    if (it != m_resources.end()) {
-        // TODO: Once backend interface is implemented
-        // m_backend->DestroyResource(it->second.get());
-        m_resources.erase(it);
+    if (texture->GetResidency() != TextureResource::Residency::Evicted) {
+        return false;
     }
+    texture->SetResidency(TextureResource::Residency::Loading);
+    ++m_reloads;
+    return true;
+}
+
+void ResourceManagerImpl::FailLoad(TextureResource* texture)
+{
+    if (texture->GetResidency() != TextureResource::Residency::Loading) {
+        return;
+    }
+    texture->SetResidency(TextureResource::Residency::Evicted);
+    ++m_loadFailures;
+}
+
+ResourceManagerImpl::EvictionStats ResourceManagerImpl::GetEvictionStats()
+{
+    EvictionStats stats = {0, 0, m_evictions, m_reloads, m_loadFailures};
+    for (ResourceHandle handle : m_evictable) {
+        auto texture = static_cast<TextureResource*>(m_resources.Get(handle));
+        if (texture) {
+            ++stats.evictableCount;
+            if (texture->GetResidency() == TextureResource::Residency::Resident) {
+                ++stats.residentCount;
+            }
+        }
+    }
+    return stats;
+}
+
+lab_result ResourceManagerImpl::ResizeRenderTarget(RenderTargetResource* target, uint32_t width, uint32_t height)
+{
+    RenderTarget* backendTarget = target->GetBackendTarget();
+    if (!backendTarget) {
+        return LAB_RESULT_INVALID_RENDER_TARGET;
+    }
+    
+    RenderTargetDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.format = backendTarget->GetFormat();
+    desc.hasDepth = backendTarget->HasDepth();
+    desc.antialias = backendTarget->GetAntialias();
+    
+    std::shared_ptr<RenderTarget> newBackendTarget;
+    lab_result result = m_texturePool.AcquireRenderTarget(desc, newBackendTarget);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
+    m_texturePool.ReleaseRenderTarget(target->ReleaseBackendTarget());
+    target->SetBackendTarget(newBackendTarget);
+    return LAB_RESULT_OK;
+}
+
+std::shared_ptr<Resource> ResourceManagerImpl::GetResource(ResourceHandle handle)
+{
+    return m_resources.GetShared(handle);
 }
 
 } // namespace labfont
@@ -209,8 +339,18 @@ lab_result lab_create_render_target(lab_context ctx, const lab_render_target_des
     if (!desc) {
         return LAB_RESULT_INVALID_PARAMETER;
     }
+    switch (desc->antialias) {
+        case LAB_ANTIALIAS_NONE:
+        case LAB_ANTIALIAS_4X:
+        case LAB_ANTIALIAS_8X:
+        case LAB_ANTIALIAS_16X:
+            break;
+        default:
+            return LAB_RESULT_INVALID_PARAMETER;
+    }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto resourceManager = context->GetResourceManager();
     
     // Convert C API render target desc to internal format
@@ -219,12 +359,10 @@ lab_result lab_create_render_target(lab_context ctx, const lab_render_target_des
     params.height = desc->height;
     params.format = desc->format;
     params.hasDepth = desc->hasDepth;
-    
-    // Generate a unique name for the render target
-    std::string name = "render_target_" + std::to_string(reinterpret_cast<uintptr_t>(desc));
+    params.antialias = desc->antialias;
     
     std::shared_ptr<labfont::RenderTargetResource> target;
-    auto result = resourceManager->CreateRenderTarget(name, params, target);
+    auto result = resourceManager->CreateRenderTarget(params, target);
     
     if (result == LAB_RESULT_OK) {
         *out_target = reinterpret_cast<lab_render_target>(target.get());
@@ -239,10 +377,58 @@ void lab_destroy_render_target(lab_context ctx, lab_render_target target) {
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto resourceManager = context->GetResourceManager();
     
     auto targetResource = reinterpret_cast<labfont::RenderTargetResource*>(target);
-    resourceManager->DestroyResource(targetResource->GetName());
+    if (auto capture = context->GetCapture()) {
+        capture->DestroyRenderTarget(targetResource);
+    }
+    if (context->GetCurrentRenderTarget() == targetResource) {
+        context->SetCurrentRenderTarget(nullptr);
+    }
+    resourceManager->DestroyResource(targetResource->GetHandle());
+}
+
+lab_result lab_set_texture_pool_budget(lab_context ctx, size_t budget_bytes) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
+    context->GetResourceManager()->GetTexturePool().SetBudget(budget_bytes);
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_set_memory_budget(lab_context ctx, size_t budget_bytes) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    labfont::GetContextImpl(ctx)->SetMemoryBudget(budget_bytes);
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_get_resource_memory_stats(lab_context ctx, lab_resource_memory_stats* out_stats) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!out_stats) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
+    auto resourceManager = context->GetResourceManager();
+    auto eviction = resourceManager->GetEvictionStats();
+    out_stats->textureBytes = context->GetBackend()->GetTextureMemoryUsage();
+    out_stats->totalBytes = context->GetBackend()->GetTotalMemoryUsage();
+    out_stats->pooledBytes = resourceManager->GetTexturePool().GetStats().pooledBytes;
+    out_stats->budget = context->GetMemoryBudget();
+    out_stats->evictableCount = eviction.evictableCount;
+    out_stats->residentCount = eviction.residentCount;
+    out_stats->evictions = eviction.evictions;
+    out_stats->reloads = eviction.reloads;
+    out_stats->loadFailures = eviction.loadFailures;
+    return LAB_RESULT_OK;
 }
 
 lab_result lab_create_texture(lab_context ctx, const lab_texture_desc* desc, lab_texture* out_texture) {
@@ -257,7 +443,6 @@ lab_result lab_create_texture(lab_context ctx, const lab_texture_desc* desc, lab
     if (!ctx) {
         // Create a simple texture descriptor that can be used later
         auto texture = new labfont::TextureResource(
-            "texture_" + std::to_string(reinterpret_cast<uintptr_t>(desc)),
             desc->width,
             desc->height,
             desc->format
@@ -268,6 +453,7 @@ lab_result lab_create_texture(lab_context ctx, const lab_texture_desc* desc, lab
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto resourceManager = context->GetResourceManager();
     
     // Convert C API texture desc to internal format
@@ -277,14 +463,14 @@ lab_result lab_create_texture(lab_context ctx, const lab_texture_desc* desc, lab
     params.format = desc->format;
     params.data = desc->initial_data;
     
-    // Generate a unique name for the texture
-    std::string name = "texture_" + std::to_string(reinterpret_cast<uintptr_t>(desc));
-    
     std::shared_ptr<labfont::TextureResource> texture;
-    auto result = resourceManager->CreateTexture(name, params, texture);
+    auto result = resourceManager->CreateTexture(params, texture);
     
     if (result == LAB_RESULT_OK) {
         *out_texture = reinterpret_cast<lab_texture>(texture.get());
+        if (auto capture = context->GetCapture()) {
+            capture->CreateTexture(texture.get(), desc->initial_data);
+        }
     }
     return result;
 }
@@ -326,10 +512,14 @@ void lab_destroy_texture(lab_context ctx, lab_texture texture) {
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto resourceManager = context->GetResourceManager();
     
     auto textureResource = reinterpret_cast<labfont::TextureResource*>(texture);
-    resourceManager->DestroyResource(textureResource->GetName());
+    if (auto capture = context->GetCapture()) {
+        capture->DestroyTexture(textureResource);
+    }
+    resourceManager->DestroyResource(textureResource->GetHandle());
 }
 
 lab_result lab_create_buffer(lab_context ctx, const lab_buffer_desc* desc, lab_buffer* out_buffer) {
@@ -344,6 +534,7 @@ lab_result lab_create_buffer(lab_context ctx, const lab_buffer_desc* desc, lab_b
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto resourceManager = context->GetResourceManager();
     
     // Convert C API buffer desc to internal format
@@ -352,11 +543,8 @@ lab_result lab_create_buffer(lab_context ctx, const lab_buffer_desc* desc, lab_b
     params.dynamic = desc->dynamic;
     params.data = desc->initial_data;
     
-    // Generate a unique name for the buffer
-    std::string name = "buffer_" + std::to_string(reinterpret_cast<uintptr_t>(desc));
-    
     std::shared_ptr<labfont::BufferResource> buffer;
-    auto result = resourceManager->CreateBuffer(name, params, buffer);
+    auto result = resourceManager->CreateBuffer(params, buffer);
     
     if (result == LAB_RESULT_OK) {
         *out_buffer = reinterpret_cast<lab_buffer>(buffer.get());
@@ -371,10 +559,11 @@ void lab_destroy_buffer(lab_context ctx, lab_buffer buffer) {
     }
     
     auto context = labfont::GetContextImpl(ctx);
+    context->Synchronize();
     auto resourceManager = context->GetResourceManager();
     
     auto bufferResource = reinterpret_cast<labfont::BufferResource*>(buffer);
-    resourceManager->DestroyResource(bufferResource->GetName());
+    resourceManager->DestroyResource(bufferResource->GetHandle());
 }
 
 lab_result lab_load_texture(lab_context ctx, const char* path, lab_texture* out_texture) {
@@ -403,7 +592,80 @@ lab_result lab_load_texture(lab_context ctx, const char* path, lab_texture* out_
     
     // Free the image data
     stbi_image_free(data);
+    
+    // Textures with a file behind them can be evicted and loaded again
+    if (result == LAB_RESULT_OK && ctx) {
+        auto textureResource = reinterpret_cast<labfont::TextureResource*>(*out_texture);
+        labfont::GetContextImpl(ctx)->GetResourceManager()->SetTextureSource(textureResource, path);
+    }
     return result;
 }
 
+lab_result lab_load_texture_async(lab_context ctx, const char* path, lab_texture* out_texture,
+                                  lab_texture_load* out_load) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!path || !out_texture || !out_load) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    
+    // The placeholder is an ordinary texture until the image replaces it
+    const uint8_t placeholder[4] = {0, 0, 0, 0};
+    lab_texture_desc desc = {
+        .width = 1,
+        .height = 1,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .initial_data = placeholder
+    };
+    lab_texture texture = nullptr;
+    lab_result result = lab_create_texture(ctx, &desc, &texture);
+    if (result != LAB_RESULT_OK) {
+        return result;
+    }
+    
+    auto context = labfont::GetContextImpl(ctx);
+    auto textureResource = reinterpret_cast<labfont::TextureResource*>(texture);
+    context->GetResourceManager()->SetTextureSource(textureResource, path);
+    textureResource->SetResidency(labfont::TextureResource::Residency::Loading);
+    auto load = context->GetTextureLoader()->Start(path, textureResource->GetHandle());
+    *out_texture = texture;
+    *out_load = reinterpret_cast<lab_texture_load>(load);
+    return LAB_RESULT_OK;
+}
+
+lab_result lab_texture_load_result(lab_context ctx, lab_texture_load load) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!load) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    auto loader = labfont::GetContextImpl(ctx)->GetTextureLoader();
+    return loader->GetResult(reinterpret_cast<labfont::TextureLoader::Load*>(load));
+}
+
+lab_result lab_wait_texture_load(lab_context ctx, lab_texture_load load) {
+    if (!ctx) {
+        return LAB_RESULT_INVALID_CONTEXT;
+    }
+    if (!load) {
+        return LAB_RESULT_INVALID_PARAMETER;
+    }
+    auto context = labfont::GetContextImpl(ctx);
+    auto loader = context->GetTextureLoader();
+    auto textureLoad = reinterpret_cast<labfont::TextureLoader::Load*>(load);
+    loader->Wait(textureLoad);
+    context->UploadLoadedTextures();
+    return loader->GetResult(textureLoad);
+}
+
+void lab_release_texture_load(lab_context ctx, lab_texture_load load) {
+    if (!ctx || !load) {
+        return;
+    }
+    auto loader = labfont::GetContextImpl(ctx)->GetTextureLoader();
+    loader->Release(reinterpret_cast<labfont::TextureLoader::Load*>(load));
+}
+
 } // extern "C"
@@ -3,8 +3,9 @@
 
 #include "resource.h"
 #include "error.h"
-#include <unordered_map>
-#include <mutex>
+#include "handle_table.h"
+#include "texture_pool.h"
+#include <vector>
 
 namespace labfont {
 
@@ -13,24 +14,69 @@ public:
     ResourceManagerImpl(Backend* backend);
     ~ResourceManagerImpl() override;
 
-    lab_result CreateTexture(const std::string& name, const TextureParams& params,
+    lab_result CreateTexture(const TextureParams& params,
                              std::shared_ptr<TextureResource>& out_texture) override;
-    lab_result CreateBuffer(const std::string& name, const BufferParams& params,
+    lab_result CreateBuffer(const BufferParams& params,
                             std::shared_ptr<BufferResource>& out_buffer) override;
-    lab_result CreateRenderTarget(const std::string& name, const RenderTargetParams& params,
+    lab_result CreateRenderTarget(const RenderTargetParams& params,
                                   std::shared_ptr<RenderTargetResource>& out_target) override;
     
-    void DestroyResource(const std::string& name) override;
-    std::shared_ptr<Resource> GetResource(const std::string& name) override;
+    // Backend textures and render targets of destroyed resources go to the
+    // texture pool, unless the resource is still referenced elsewhere
+    void DestroyResource(ResourceHandle handle) override;
+    std::shared_ptr<Resource> GetResource(ResourceHandle handle) override;
+    
+    // Swaps the backend texture for one of the params' size and contents,
+    // pooling the old one. The format cannot change.
+    lab_result RecreateTexture(TextureResource* texture, const TextureParams& params);
+    // Swaps the backend target for one of the new size, pooling the old one
+    lab_result ResizeRenderTarget(RenderTargetResource* target, uint32_t width, uint32_t height);
+    
+    // Resolves a handle without locking, for render threads. The resource
+    // stays valid until it is destroyed.
+    Resource* LookupResource(ResourceHandle handle) const { return m_resources.Get(handle); }
+    uint32_t GetResourceCount() const { return m_resources.GetCount(); }
+    TexturePool& GetTexturePool() { return m_texturePool; }
+    
+    // Marks a texture as loaded from a file, which makes it evictable
+    void SetTextureSource(TextureResource* texture, const char* path);
+    // Frees at least `bytes` of backend memory if it can: pooled objects
+    // first, then the least recently used evictable textures. `frame` is the
+    // context's frame index; textures bound in the last ended frame or later,
+    // or loaded since, are kept. Evicted textures show a shared placeholder
+    // until they are reloaded. Returns the estimated bytes freed.
+    size_t FreeMemory(size_t bytes, uint64_t frame);
+    // Marks an evicted texture as loading; false if it is not evicted
+    bool BeginReload(TextureResource* texture);
+    // Returns a loading texture whose image could not be loaded to the
+    // placeholder, so that the next draw with it tries again
+    void FailLoad(TextureResource* texture);
+    
+    struct EvictionStats {
+        uint32_t evictableCount;  // Live textures loaded from files
+        uint32_t residentCount;   // Of those, holding their image
+        uint64_t evictions;
+        uint64_t reloads;
+        uint64_t loadFailures;
+    };
+    EvictionStats GetEvictionStats();
 
 private:
-    Backend* m_backend;  // Non-owning pointer to backend
-    std::unordered_map<std::string, std::shared_ptr<Resource>> m_resources;
-    std::mutex m_mutex;  // Protect resource map access
+    // Hands the resource to the table and gives it its handle
+    lab_result AddResource(std::shared_ptr<Resource> resource);
+    // Pools a texture's backend texture, unless it is the placeholder
+    void ReleaseBackendTexture(std::shared_ptr<Texture> texture);
 
-    // Helper methods
-    bool ResourceExists(const std::string& name);
-    void RemoveResource(const std::string& name);
+    Backend* m_backend;  // Non-owning pointer to backend
+    // Declared first, so it outlives the resources
+    TexturePool m_texturePool;
+    HandleTable<Resource> m_resources;
+    
+    std::vector<ResourceHandle> m_evictable;
+    std::shared_ptr<Texture> m_placeholder;  // Shown by evicted textures
+    uint64_t m_evictions = 0;
+    uint64_t m_reloads = 0;
+    uint64_t m_loadFailures = 0;
 };
 
 } // namespace labfont
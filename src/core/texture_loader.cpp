@@ -0,0 +1,154 @@
+#include "texture_loader.h"
+#include "capture.h"
+#include "resource_manager.h"
+#include "../third_party/stb/stb_image.h"
+
+namespace labfont {
+
+struct TextureLoader::Load {
+    std::string path;
+    ResourceHandle texture;
+    // Set by the worker under the loader's mutex
+    bool decoded = false;
+    unsigned char* pixels = nullptr;  // RGBA8, null if decoding failed
+    int width = 0;
+    int height = 0;
+    // Set by Upload under the loader's mutex
+    lab_result result = LAB_RESULT_NOT_READY;
+
+    ~Load() {
+        if (pixels) {
+            stbi_image_free(pixels);
+        }
+    }
+};
+
+TextureLoader::TextureLoader(uint32_t workerCount) {
+    m_workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&TextureLoader::WorkerMain, this);
+    }
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+TextureLoader::Load* TextureLoader::Start(const char* path, ResourceHandle texture) {
+    auto load = std::make_shared<Load>();
+    load->path = path;
+    load->texture = texture;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_handles[load.get()] = load;
+        m_queue.push_back(load);
+    }
+    m_wake.notify_one();
+    return load.get();
+}
+
+void TextureLoader::Release(Load* load) {
+    std::shared_ptr<Load> released;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_handles.find(load);
+    if (it != m_handles.end()) {
+        released = std::move(it->second);
+        m_handles.erase(it);
+    }
+}
+
+lab_result TextureLoader::GetResult(const Load* load) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return load->result;
+}
+
+void TextureLoader::Wait(const Load* load) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_decoded.wait(lock, [load] { return load->decoded; });
+}
+
+bool TextureLoader::HasDecoded() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_ready.empty();
+}
+
+void TextureLoader::Upload(ResourceManagerImpl& resources, CaptureWriter* capture, uint64_t frame) {
+    std::vector<std::shared_ptr<Load>> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ready.swap(m_ready);
+    }
+    for (auto& load : ready) {
+        // Decoding has finished, so the pixels are no longer written
+        lab_result result = LAB_RESULT_TEXTURE_LOAD_FAILED;
+        // The texture may have been destroyed while its image was decoded
+        auto resource = resources.GetResource(load->texture);
+        auto texture = resource && resource->GetType() == ResourceType::Texture
+            ? static_cast<TextureResource*>(resource.get())
+            : nullptr;
+        if (load->pixels) {
+            if (!texture) {
+                result = LAB_RESULT_INVALID_TEXTURE;
+            } else {
+                TextureParams params = {static_cast<unsigned int>(load->width),
+                                        static_cast<unsigned int>(load->height),
+                                        LAB_TEXTURE_FORMAT_RGBA8_UNORM, load->pixels};
+                result = resources.RecreateTexture(texture, params);
+                if (result == LAB_RESULT_OK) {
+                    texture->MarkUsed(frame);
+                }
+                if (result == LAB_RESULT_OK && capture) {
+                    // Replays switch from the placeholder to the image here
+                    capture->DestroyTexture(texture);
+                    capture->CreateTexture(texture, load->pixels);
+                }
+            }
+        }
+        if (texture && result != LAB_RESULT_OK) {
+            resources.FailLoad(texture);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        load->result = result;
+        stbi_image_free(load->pixels);
+        load->pixels = nullptr;
+    }
+}
+
+void TextureLoader::WorkerMain() {
+    for (;;) {
+        std::shared_ptr<Load> load;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_shutdown || !m_queue.empty(); });
+            if (m_shutdown) {
+                return;
+            }
+            load = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        // stb_image keeps its error state per thread
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        unsigned char* pixels = stbi_load(load->path.c_str(), &width, &height, &channels, 4);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            load->pixels = pixels;
+            load->width = width;
+            load->height = height;
+            load->decoded = true;
+            m_ready.push_back(std::move(load));
+        }
+        m_decoded.notify_all();
+    }
+}
+
+} // namespace labfont
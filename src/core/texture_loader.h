@@ -0,0 +1,69 @@
+#ifndef LABFONT_TEXTURE_LOADER_H
+#define LABFONT_TEXTURE_LOADER_H
+
+#include "handle_table.h"
+#include "labfont/labfont_types.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace labfont {
+
+class CaptureWriter;
+class ResourceManagerImpl;
+
+// Decodes image files on worker threads for lab_load_texture_async. The
+// texture of a load exists from the start, showing a placeholder; Upload
+// swaps the decoded image in on the context's thread at a safe point. The
+// texture keeps its handle throughout, so draws recorded with it show the
+// image from then on.
+class TextureLoader {
+public:
+    struct Load;
+
+    explicit TextureLoader(uint32_t workerCount);
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // Queues the file for decoding into the texture
+    Load* Start(const char* path, ResourceHandle texture);
+    // Drops the load handle. The texture still receives its image.
+    void Release(Load* load);
+
+    // LAB_RESULT_NOT_READY until the image has been uploaded, then the
+    // outcome of the load
+    lab_result GetResult(const Load* load) const;
+    // Blocks until the load has been decoded
+    void Wait(const Load* load);
+
+    // True if Upload has something to do
+    bool HasDecoded() const;
+    // Gives the textures of decoded loads their images, counting them as
+    // used in `frame` so the budget does not evict them straight away. The
+    // backend must not be in use.
+    void Upload(ResourceManagerImpl& resources, CaptureWriter* capture, uint64_t frame);
+
+private:
+    void WorkerMain();
+
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;     // Workers, for queued loads
+    std::condition_variable m_decoded;  // Waiters, for decoded loads
+    std::deque<std::shared_ptr<Load>> m_queue;
+    std::vector<std::shared_ptr<Load>> m_ready;  // Decoded, not uploaded
+    std::unordered_map<const Load*, std::shared_ptr<Load>> m_handles;
+    bool m_shutdown = false;
+};
+
+} // namespace labfont
+
+#endif // LABFONT_TEXTURE_LOADER_H
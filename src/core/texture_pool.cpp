@@ -0,0 +1,212 @@
+#include "texture_pool.h"
+
+namespace labfont {
+
+TexturePool::TexturePool(Backend* backend)
+    : m_backend(backend)
+{
+}
+
+size_t TexturePool::GetTextureBytes(uint32_t width, uint32_t height, lab_texture_format format) {
+    return size_t(width) * height * GetTextureFormatBytesPerPixel(format);
+}
+
+size_t TexturePool::GetRenderTargetBytes(uint32_t width, uint32_t height, lab_texture_format format,
+                                         bool hasDepth, lab_antialias antialias) {
+    size_t pixels = size_t(width) * height;
+    size_t bytes = pixels * GetTextureFormatBytesPerPixel(format);
+    if (hasDepth) {
+        bytes += pixels * GetTextureFormatBytesPerPixel(LAB_TEXTURE_FORMAT_D32F);
+    }
+    if (antialias != LAB_ANTIALIAS_NONE) {
+        // RGBA8 samples and a coverage flag per pixel
+        bytes += pixels * (static_cast<uint32_t>(antialias) * 4 + 1);
+    }
+    return bytes;
+}
+
+TexturePool::Key TexturePool::TextureKey(uint32_t width, uint32_t height, lab_texture_format format,
+                                         bool renderTarget, bool readback) {
+    uint32_t usage = (renderTarget ? kRenderTargetBit : 0) | (readback ? kReadbackBit : 0);
+    return {format, width, height, usage};
+}
+
+TexturePool::Key TexturePool::RenderTargetKey(uint32_t width, uint32_t height, lab_texture_format format,
+                                              bool hasDepth, lab_antialias antialias) {
+    uint32_t usage = kRenderTargetBit | (hasDepth ? kDepthBit : 0) |
+                     static_cast<uint32_t>(antialias) << kSampleCountShift;
+    return {format, width, height, usage};
+}
+
+lab_result TexturePool::AcquireTexture(const TextureDesc& desc, std::shared_ptr<Texture>& out_texture) {
+    Entry entry;
+    if (!Take(TextureKey(desc.width, desc.height, desc.format, desc.renderTarget, desc.readback), entry)) {
+        return m_backend->CreateTexture(desc, out_texture);
+    }
+    // Initial data that does not cover the texture leaves the rest as new
+    if (!desc.data || desc.dataSize < GetTextureBytes(desc.width, desc.height, desc.format)) {
+        m_backend->ResetTexture(entry.texture.get());
+    }
+    if (desc.data && desc.dataSize > 0) {
+        lab_result result = m_backend->UpdateTexture(entry.texture.get(), desc.data, desc.dataSize);
+        if (result != LAB_RESULT_OK) {
+            return result;
+        }
+    }
+    out_texture = std::move(entry.texture);
+    return LAB_RESULT_OK;
+}
+
+lab_result TexturePool::AcquireRenderTarget(const RenderTargetDesc& desc,
+                                            std::shared_ptr<RenderTarget>& out_target) {
+    Entry entry;
+    if (!Take(RenderTargetKey(desc.width, desc.height, desc.format, desc.hasDepth, desc.antialias), entry)) {
+        return m_backend->CreateRenderTarget(desc, out_target);
+    }
+    m_backend->ResetRenderTarget(entry.target.get());
+    out_target = std::move(entry.target);
+    return LAB_RESULT_OK;
+}
+
+void TexturePool::ReleaseTexture(std::shared_ptr<Texture> texture) {
+    if (!texture) {
+        return;
+    }
+    Key key = TextureKey(texture->GetWidth(), texture->GetHeight(), texture->GetFormat(),
+                         texture->IsRenderTarget(), texture->SupportsReadback());
+    size_t bytes = GetTextureBytes(key.width, key.height, key.format);
+    Add(key, {0, bytes, std::move(texture), nullptr});
+}
+
+void TexturePool::ReleaseRenderTarget(std::shared_ptr<RenderTarget> target) {
+    if (!target) {
+        return;
+    }
+    Key key = RenderTargetKey(target->GetWidth(), target->GetHeight(), target->GetFormat(),
+                              target->HasDepth(), target->GetAntialias());
+    size_t bytes = GetRenderTargetBytes(key.width, key.height, key.format, target->HasDepth(),
+                                        target->GetAntialias());
+    Add(key, {0, bytes, nullptr, std::move(target)});
+}
+
+bool TexturePool::Take(const Key& key, Entry& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_buckets.find(key);
+    if (it == m_buckets.end()) {
+        ++m_stats.misses;
+        return false;
+    }
+    // The most recently released object is the likeliest to still be warm
+    out = std::move(it->second.back());
+    it->second.pop_back();
+    if (it->second.empty()) {
+        m_buckets.erase(it);
+    }
+    --m_stats.pooledCount;
+    m_stats.pooledBytes -= out.bytes;
+    ++m_stats.hits;
+    return true;
+}
+
+void TexturePool::Add(const Key& key, Entry entry) {
+    std::deque<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (entry.bytes > m_budget) {
+            evicted.push_back(std::move(entry));
+        } else {
+            entry.sequence = m_nextSequence++;
+            m_stats.pooledBytes += entry.bytes;
+            ++m_stats.pooledCount;
+            m_buckets[key].push_back(std::move(entry));
+            Evict(m_budget, evicted);
+        }
+    }
+    Free(evicted);
+}
+
+void TexturePool::Evict(size_t limit, std::deque<Entry>& evicted) {
+    while (m_stats.pooledBytes > limit) {
+        // Buckets are few, so the oldest entry is found by scanning their fronts
+        auto oldest = m_buckets.begin();
+        for (auto it = m_buckets.begin(); it != m_buckets.end(); ++it) {
+            if (it->second.front().sequence < oldest->second.front().sequence) {
+                oldest = it;
+            }
+        }
+        Entry& entry = oldest->second.front();
+        m_stats.pooledBytes -= entry.bytes;
+        --m_stats.pooledCount;
+        ++m_stats.evictions;
+        evicted.push_back(std::move(entry));
+        oldest->second.pop_front();
+        if (oldest->second.empty()) {
+            m_buckets.erase(oldest);
+        }
+    }
+}
+
+void TexturePool::Free(std::deque<Entry>& entries) {
+    for (Entry& entry : entries) {
+        if (!m_backend) {
+            break;
+        }
+        if (entry.texture) {
+            m_backend->DestroyTexture(entry.texture.get());
+        } else {
+            m_backend->DestroyRenderTarget(entry.target.get());
+        }
+    }
+    entries.clear();
+}
+
+void TexturePool::SetBudget(size_t bytes) {
+    std::deque<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = bytes;
+        Evict(m_budget, evicted);
+    }
+    Free(evicted);
+}
+
+size_t TexturePool::GetBudget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t TexturePool::Trim(size_t bytes) {
+    std::deque<Entry> evicted;
+    size_t freed = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t pooled = m_stats.pooledBytes;
+        Evict(bytes < pooled ? pooled - bytes : 0, evicted);
+        freed = pooled - m_stats.pooledBytes;
+    }
+    Free(evicted);
+    return freed;
+}
+
+void TexturePool::Clear() {
+    std::deque<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& bucket : m_buckets) {
+            for (Entry& entry : bucket.second) {
+                entries.push_back(std::move(entry));
+            }
+        }
+        m_buckets.clear();
+        m_stats.pooledCount = 0;
+        m_stats.pooledBytes = 0;
+    }
+    Free(entries);
+}
+
+TexturePool::Stats TexturePool::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace labfont
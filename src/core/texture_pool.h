@@ -0,0 +1,117 @@
+#ifndef LABFONT_TEXTURE_POOL_H
+#define LABFONT_TEXTURE_POOL_H
+
+#include "backend.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace labfont {
+
+// Recycles the backend textures and render targets of destroyed resources.
+// Released objects are kept by format, size class and usage, and handed out
+// again to the next creation that matches, reset by the backend to the state
+// of a new one. A texture cannot be larger than the size it is sampled at, so
+// the size class is the exact size.
+//
+// Pooled objects are kept within a byte budget; releasing past it evicts the
+// objects released longest ago. A budget of zero disables pooling. Objects
+// the pool frees while it exists are handed to the backend's Destroy calls,
+// for backends that keep references of their own.
+class TexturePool {
+public:
+    static constexpr size_t kDefaultBudget = 64u << 20;
+
+    struct Stats {
+        uint64_t hits;          // Acquisitions served from the pool
+        uint64_t misses;        // Acquisitions the backend created
+        uint64_t evictions;     // Pooled objects freed to stay within budget
+        uint32_t pooledCount;
+        size_t pooledBytes;
+    };
+
+    explicit TexturePool(Backend* backend);
+
+    // Creates through the backend if nothing pooled matches
+    lab_result AcquireTexture(const TextureDesc& desc, std::shared_ptr<Texture>& out_texture);
+    lab_result AcquireRenderTarget(const RenderTargetDesc& desc, std::shared_ptr<RenderTarget>& out_target);
+
+    // The caller's reference must be the last one outside the backend
+    void ReleaseTexture(std::shared_ptr<Texture> texture);
+    void ReleaseRenderTarget(std::shared_ptr<RenderTarget> target);
+
+    void SetBudget(size_t bytes);
+    size_t GetBudget() const;
+    // Frees pooled objects, oldest first, until at least `bytes` have been
+    // freed or none are left, and returns the bytes freed
+    size_t Trim(size_t bytes);
+    // Frees every pooled object
+    void Clear();
+    Stats GetStats() const;
+
+    // Estimated backend memory of a texture or render target
+    static size_t GetTextureBytes(uint32_t width, uint32_t height, lab_texture_format format);
+    static size_t GetRenderTargetBytes(uint32_t width, uint32_t height, lab_texture_format format,
+                                       bool hasDepth, lab_antialias antialias);
+
+private:
+    // Bits of Key::usage
+    static constexpr uint32_t kRenderTargetBit = 1;
+    static constexpr uint32_t kDepthBit = 2;
+    static constexpr uint32_t kReadbackBit = 4;
+    static constexpr uint32_t kSampleCountShift = 8;  // Antialias samples of render targets
+
+    struct Key {
+        lab_texture_format format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t usage;
+        bool operator==(const Key& other) const {
+            return format == other.format && width == other.width && height == other.height &&
+                   usage == other.usage;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t h = (uint64_t(key.width) << 32) | key.height;
+            h ^= (uint64_t(key.format) << 8 | key.usage) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    struct Entry {
+        uint64_t sequence;  // Release order, for eviction
+        size_t bytes;
+        std::shared_ptr<Texture> texture;
+        std::shared_ptr<RenderTarget> target;
+    };
+
+    static Key TextureKey(uint32_t width, uint32_t height, lab_texture_format format,
+                          bool renderTarget, bool readback);
+    static Key RenderTargetKey(uint32_t width, uint32_t height, lab_texture_format format,
+                               bool hasDepth, lab_antialias antialias);
+    // Takes the most recently released match, false if there is none
+    bool Take(const Key& key, Entry& out);
+    void Add(const Key& key, Entry entry);
+    // Moves the oldest entries into `evicted` until the pool holds at most
+    // `limit` bytes
+    void Evict(size_t limit, std::deque<Entry>& evicted);
+    // Called without the lock held
+    void Free(std::deque<Entry>& entries);
+
+    Backend* m_backend;  // Non-owning
+    mutable std::mutex m_mutex;
+    // Oldest first within each bucket
+    std::unordered_map<Key, std::deque<Entry>, KeyHash> m_buckets;
+    size_t m_budget = kDefaultBudget;
+    uint64_t m_nextSequence = 0;
+    Stats m_stats = {};
+};
+
+} // namespace labfont
+
+#endif // LABFONT_TEXTURE_POOL_H
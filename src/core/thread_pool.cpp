@@ -0,0 +1,85 @@
+#include "thread_pool.h"
+
+namespace labfont {
+
+ThreadPool::ThreadPool(uint32_t workerCount) {
+    m_workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&ThreadPool::WorkerMain, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    if (m_workers.empty() || count == 1) {
+        for (uint32_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_jobCount = count;
+        m_nextIndex.store(0, std::memory_order_relaxed);
+        m_activeWorkers = static_cast<uint32_t>(m_workers.size());
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    
+    RunJob();
+    
+    // Every worker checks in before the job (and fn) can go out of scope
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_activeWorkers == 0; });
+    m_job = nullptr;
+}
+
+void ThreadPool::RunJob() {
+    for (;;) {
+        uint32_t i = m_nextIndex.fetch_add(1, std::memory_order_relaxed);
+        if (i >= m_jobCount) {
+            break;
+        }
+        (*m_job)(i);
+    }
+}
+
+void ThreadPool::WorkerMain() {
+    uint64_t seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_shutdown || m_generation != seenGeneration; });
+            if (m_shutdown) {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+        
+        RunJob();
+        
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_activeWorkers == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+}
+
+} // namespace labfont
@@ -0,0 +1,53 @@
+#ifndef LABFONT_THREAD_POOL_H
+#define LABFONT_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace labfont {
+
+// Fixed set of worker threads for data-parallel work inside the library.
+// The calling thread takes part in every ParallelFor, so a pool created with
+// N workers runs on N + 1 threads.
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t workerCount);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_workers.size()); }
+    
+    // Calls fn(i) for every i in [0, count) and returns once all calls have
+    // finished. Indices are handed out dynamically, so uneven work balances
+    // itself. Not reentrant: fn must not call ParallelFor on the same pool.
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn);
+    
+private:
+    void WorkerMain();
+    void RunJob();
+    
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    
+    // Current job, published under m_mutex
+    const std::function<void(uint32_t)>* m_job = nullptr;
+    uint32_t m_jobCount = 0;
+    uint64_t m_generation = 0;
+    uint32_t m_activeWorkers = 0;
+    bool m_shutdown = false;
+    
+    std::atomic<uint32_t> m_nextIndex{0};
+};
+
+} // namespace labfont
+
+#endif // LABFONT_THREAD_POOL_H
@@ -6,6 +6,21 @@
 
 namespace labfont {
 
+static_assert(sizeof(lab_vertex_2TC_packed) == 16, "packed vertices must stay 16 bytes");
+
+// Expands a packed vertex to the full format
+inline lab_vertex_2TC UnpackVertex(const lab_vertex_2TC_packed& v) {
+    lab_vertex_2TC result;
+    result.position[0] = v.position[0];
+    result.position[1] = v.position[1];
+    result.texcoord[0] = v.texcoord[0] / 65535.0f;
+    result.texcoord[1] = v.texcoord[1] / 65535.0f;
+    for (int c = 0; c < 4; ++c) {
+        result.color[c] = v.color[c] / 255.0f;
+    }
+    return result;
+}
+
 // C++ wrapper for lab_vertex_2TC
 struct Vertex {
     float position[2];  // x, y
@@ -29,6 +44,8 @@ struct Vertex {
         std::memcpy(color, v.color, sizeof(color));
     }
 
+    explicit Vertex(const lab_vertex_2TC_packed& v) : Vertex(UnpackVertex(v)) {}
+
     // Conversion operator to lab_vertex_2TC
     operator lab_vertex_2TC() const {
         lab_vertex_2TC result;
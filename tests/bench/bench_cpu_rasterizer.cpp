@@ -0,0 +1,237 @@
+// Microbenchmark for the CPU backend triangle rasterizer.
+//
+// Reports triangles/sec and pixels/sec for two workloads that bracket what the
+// text renderer produces: many glyph-sized quads, and a few full-screen
+// triangles. Glyph quads are also drawn sampling an R8 atlas, as text is. The span kernels for every instruction set the CPU supports are
+// measured on their own as well, and whole frames are submitted through the
+// CPU backend both serially and in tile-binned mode. Run it from a Release build:
+//
+//     ./labfont_bench_rasterizer [width] [height]
+
+#include "backends/cpu/rasterizer.h"
+#include "backends/cpu/span_kernels.h"
+#include "backends/cpu/cpu_backend.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace labfont;
+
+namespace {
+
+struct BenchResult {
+    double seconds;
+    size_t triangles;
+    size_t pixels;
+};
+
+// Vertices are in the rasterizer's normalized (0,1) target space
+lab_vertex_2TC MakeVertex(float x, float y, float r, float g, float b, float a) {
+    lab_vertex_2TC v = {{x, y}, {0.0f, 0.0f}, {r, g, b, a}};
+    return v;
+}
+
+template<typename Fn>
+BenchResult Run(Fn&& fn, double minSeconds) {
+    using Clock = std::chrono::steady_clock;
+    BenchResult result = {0.0, 0, 0};
+    auto start = Clock::now();
+    do {
+        fn(result);
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (result.seconds < minSeconds);
+    return result;
+}
+
+void Report(const char* name, const BenchResult& r) {
+    if (r.triangles == 0) {
+        std::printf("%-28s %12s        %14.0f pixels/s  (%.2fs)\n",
+                    name, "", r.pixels / r.seconds, r.seconds);
+        return;
+    }
+    std::printf("%-28s %12.0f tris/s %14.0f pixels/s  (%zu tris, %.2fs)\n",
+                name,
+                r.triangles / r.seconds,
+                r.pixels / r.seconds,
+                r.triangles,
+                r.seconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t width = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 1920;
+    uint32_t height = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1080;
+    if (width == 0 || height == 0) {
+        std::fprintf(stderr, "usage: %s [width] [height]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<uint8_t> color(size_t(width) * height * 4, 0);
+    const double minSeconds = 1.0;
+
+    // Glyph quads: 10x14 pixel cells, two triangles each, scattered over the target
+    const int glyphCount = 10000;
+    const float gw = 10.0f / width;
+    const float gh = 14.0f / height;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> px(0.0f, 1.0f - gw);
+    std::uniform_real_distribution<float> py(0.0f, 1.0f - gh);
+    std::vector<lab_vertex_2TC> glyphs;
+    glyphs.reserve(glyphCount * 6);
+    for (int i = 0; i < glyphCount; ++i) {
+        float x = px(rng);
+        float y = py(rng);
+        lab_vertex_2TC tl = MakeVertex(x, y, 1.0f, 1.0f, 1.0f, 0.8f);
+        lab_vertex_2TC tr = MakeVertex(x + gw, y, 1.0f, 1.0f, 1.0f, 0.8f);
+        lab_vertex_2TC bl = MakeVertex(x, y + gh, 1.0f, 1.0f, 1.0f, 0.8f);
+        lab_vertex_2TC br = MakeVertex(x + gw, y + gh, 1.0f, 1.0f, 1.0f, 0.8f);
+        glyphs.insert(glyphs.end(), {tl, tr, bl, tr, br, bl});
+    }
+
+    BenchResult glyphResult = Run([&](BenchResult& r) {
+        for (size_t i = 0; i < glyphs.size(); i += 3) {
+            r.pixels += cpu::DrawTriangle(color.data(), nullptr, width, height,
+                                          &glyphs[i], BlendMode::Alpha);
+        }
+        r.triangles += glyphs.size() / 3;
+    }, minSeconds);
+
+    // Full-screen triangle: one oversized triangle clipped to the target
+    lab_vertex_2TC fullscreen[3] = {
+        MakeVertex(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f),
+        MakeVertex(2.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.5f),
+        MakeVertex(0.0f, 2.0f, 0.0f, 0.0f, 1.0f, 0.5f),
+    };
+
+    BenchResult fullResult = Run([&](BenchResult& r) {
+        r.pixels += cpu::DrawTriangle(color.data(), nullptr, width, height,
+                                      fullscreen, BlendMode::Alpha);
+        r.triangles += 1;
+    }, minSeconds);
+
+    // The same glyph quads sampling 10x14 cells of a 256x256 R8 atlas
+    std::vector<uint8_t> atlas(256 * 256);
+    for (size_t i = 0; i < atlas.size(); ++i) {
+        atlas[i] = static_cast<uint8_t>(rng());
+    }
+    std::vector<lab_vertex_2TC> texturedGlyphs(glyphs);
+    for (size_t i = 0; i < texturedGlyphs.size(); i += 6) {
+        float u = static_cast<float>((i / 6) % 25) * 10.0f / 256.0f;
+        float v = static_cast<float>((i / 6 / 25) % 18) * 14.0f / 256.0f;
+        const float corner[6][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 0}, {1, 1}, {0, 1}};
+        for (int k = 0; k < 6; ++k) {
+            texturedGlyphs[i + k].texcoord[0] = u + corner[k][0] * 10.0f / 256.0f;
+            texturedGlyphs[i + k].texcoord[1] = v + corner[k][1] * 14.0f / 256.0f;
+        }
+    }
+    BenchResult texturedResult[2];
+    for (lab_texture_filter filter : {LAB_TEXTURE_FILTER_NEAREST, LAB_TEXTURE_FILTER_LINEAR}) {
+        cpu::TextureSampler sampler = {atlas.data(), 256, 256, 1, filter};
+        cpu::ClipRect clip = cpu::FullClipRect(width, height);
+        texturedResult[filter == LAB_TEXTURE_FILTER_LINEAR] = Run([&](BenchResult& r) {
+            for (size_t i = 0; i < texturedGlyphs.size(); i += 3) {
+                r.pixels += cpu::DrawTriangle(color.data(), nullptr, width, height,
+                                              &texturedGlyphs[i], BlendMode::Alpha, clip, &sampler);
+            }
+            r.triangles += texturedGlyphs.size() / 3;
+        }, minSeconds);
+    }
+
+    std::printf("CPU rasterizer, %ux%u target, %s span kernels\n", width, height,
+                cpu::GetSpanKernelLevelName(cpu::GetSpanKernels().level));
+    Report("glyph quads (10x14)", glyphResult);
+    Report("glyph quads, R8 nearest", texturedResult[0]);
+    Report("glyph quads, R8 bilinear", texturedResult[1]);
+    Report("full-screen triangle", fullResult);
+
+    // Span kernels alone, one full row of the target per call
+    const float spanColor[4] = {1.0f, 0.0f, 0.0f, 0.5f};
+    const float spanStep[4] = {-1.0f / width, 1.0f / width, 0.0f, 0.0f};
+    std::printf("\nSpan kernels, %u pixel spans\n", width);
+    for (cpu::SpanKernelLevel level : {cpu::SpanKernelLevel::Scalar, cpu::SpanKernelLevel::SSE4,
+                                       cpu::SpanKernelLevel::AVX2, cpu::SpanKernelLevel::NEON}) {
+        const cpu::SpanKernels* kernels = cpu::GetSpanKernels(level);
+        if (!kernels) {
+            continue;
+        }
+        char name[64];
+        BenchResult fill = Run([&](BenchResult& r) {
+            for (uint32_t y = 0; y < height; ++y) {
+                kernels->fill(&color[size_t(y) * width * 4], width, 0xff000000u);
+            }
+            r.pixels += size_t(width) * height;
+        }, minSeconds);
+        std::snprintf(name, sizeof(name), "%s fill", cpu::GetSpanKernelLevelName(level));
+        Report(name, fill);
+        const char* modeNames[cpu::kBlendModeCount] = {
+            "replace", "alpha", "additive", "multiply", "screen"
+        };
+        for (int mode = 0; mode < cpu::kBlendModeCount; ++mode) {
+            BenchResult shade = Run([&](BenchResult& r) {
+                for (uint32_t y = 0; y < height; ++y) {
+                    kernels->shade[mode](&color[size_t(y) * width * 4], width, spanColor, spanStep, 0);
+                }
+                r.pixels += size_t(width) * height;
+            }, minSeconds);
+            std::snprintf(name, sizeof(name), "%s shade %s", cpu::GetSpanKernelLevelName(level),
+                          modeNames[mode]);
+            Report(name, shade);
+        }
+    }
+
+    // Whole frames through the backend: clear, glyph quads and a few large
+    // translucent panels, in NDC as submitted by the context
+    std::vector<lab_vertex_2TC> frame;
+    frame.reserve(glyphs.size() + 6 * 8);
+    for (const auto& v : glyphs) {
+        frame.push_back(MakeVertex(v.position[0] * 2.0f - 1.0f, v.position[1] * 2.0f - 1.0f,
+                                   v.color[0], v.color[1], v.color[2], v.color[3]));
+    }
+    for (int i = 0; i < 8; ++i) {
+        float x = -1.0f + 0.2f * i;
+        float y = -0.9f + 0.1f * i;
+        lab_vertex_2TC tl = MakeVertex(x, y, 0.2f, 0.4f, 0.8f, 0.3f);
+        lab_vertex_2TC tr = MakeVertex(x + 1.0f, y, 0.8f, 0.4f, 0.2f, 0.3f);
+        lab_vertex_2TC bl = MakeVertex(x, y + 1.0f, 0.2f, 0.8f, 0.4f, 0.3f);
+        lab_vertex_2TC br = MakeVertex(x + 1.0f, y + 1.0f, 0.4f, 0.2f, 0.8f, 0.3f);
+        frame.insert(frame.end(), {tl, tr, bl, tr, br, bl});
+    }
+
+    std::vector<DrawCommand> commands;
+    lab_draw_command clearCommand = {};
+    clearCommand.type = LAB_DRAW_COMMAND_CLEAR;
+    clearCommand.clear.color[3] = 1.0f;
+    commands.push_back(DrawCommand(clearCommand));
+    DrawCommand drawCommand;
+    drawCommand.type = DrawCommandType::DrawTriangles;
+    drawCommand.triangles.vertices = frame.data();
+    drawCommand.triangles.vertexCount = static_cast<uint32_t>(frame.size());
+    commands.push_back(drawCommand);
+
+    uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("\nCPUBackend frames, %zu triangles each\n", frame.size() / 3);
+    for (uint32_t workers : {0u, std::max(1u, hardwareThreads - 1)}) {
+        CPUBackend backend;
+        backend.Initialize(width, height);
+        backend.SetWorkerThreads(workers);
+        RenderTargetDesc targetDesc = {width, height, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false};
+        std::shared_ptr<RenderTarget> target;
+        backend.CreateRenderTarget(targetDesc, target);
+        backend.SetRenderTarget(target.get());
+
+        BenchResult result = Run([&](BenchResult& r) {
+            backend.SubmitCommands(commands);
+            r.triangles += 1;  // Counts frames
+        }, minSeconds);
+        char name[64];
+        std::snprintf(name, sizeof(name), workers ? "tiled, %u workers" : "serial", workers);
+        std::printf("%-28s %12.1f frames/s  (%zu frames, %.2fs)\n",
+                    name, result.triangles / result.seconds, result.triangles, result.seconds);
+    }
+    return 0;
+}
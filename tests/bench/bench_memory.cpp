@@ -0,0 +1,138 @@
+// Microbenchmark for lab_alloc/lab_free under contention.
+//
+// Every thread allocates and frees small blocks of mixed sizes, keeping a
+// window of them live. Compares plain malloc/free, the tracking scheme the
+// memory manager used before, where every call took one global lock and
+// updated a map of live pointers, and lab_alloc with its per-thread
+// counters. Run it from a Release build:
+//
+//     ./labfont_bench_memory [max threads]
+
+#include <labfont/labfont.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const int kOpsPerThread = 1 << 20;
+const int kWindow = 64;
+
+// The previous scheme: malloc, then a map insert under a global lock
+class LockedMapTracker {
+public:
+    void* Allocate(size_t size, lab_memory_category category) {
+        void* ptr = std::malloc(size);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_currentUsage += size;
+        m_categoryUsage[category] += size;
+        m_allocations[ptr] = {size, category};
+        return ptr;
+    }
+
+    void Free(void* ptr) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_allocations.find(ptr);
+        if (it != m_allocations.end()) {
+            m_currentUsage -= it->second.size;
+            m_categoryUsage[it->second.category] -= it->second.size;
+            m_allocations.erase(it);
+        }
+        std::free(ptr);
+    }
+
+private:
+    struct Info {
+        size_t size;
+        lab_memory_category category;
+    };
+    std::mutex m_mutex;
+    size_t m_currentUsage = 0;
+    std::unordered_map<int, size_t> m_categoryUsage;
+    std::unordered_map<void*, Info> m_allocations;
+};
+
+// Runs `threads` threads of kOpsPerThread allocations and frees each;
+// returns nanoseconds per allocation and free, per thread
+template<typename Alloc, typename Free>
+double Run(int threads, Alloc&& alloc, Free&& release) {
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    std::vector<double> seconds(threads);
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            void* live[kWindow] = {};
+            uint32_t state = 0x9e3779b9u * (t + 1);
+            ++ready;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kOpsPerThread; ++i) {
+                state = state * 1664525u + 1013904223u;
+                int slot = (state >> 8) % kWindow;
+                if (live[slot]) {
+                    release(live[slot]);
+                }
+                size_t size = 16 + ((state >> 16) & 255);
+                live[slot] = alloc(size, static_cast<lab_memory_category>((state >> 24) % 5));
+                static_cast<char*>(live[slot])[0] = 1;
+            }
+            for (void* ptr : live) {
+                if (ptr) {
+                    release(ptr);
+                }
+            }
+            seconds[t] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        });
+    }
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    go = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double slowest = *std::max_element(seconds.begin(), seconds.end());
+    return 1e9 * slowest / kOpsPerThread;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int maxThreads = argc > 1 ? std::atoi(argv[1]) : int(std::max(1u, std::thread::hardware_concurrency()));
+    if (maxThreads <= 0) {
+        std::fprintf(stderr, "usage: %s [max threads]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%-8s %14s %14s %14s   (ns per alloc+free, slowest thread)\n",
+                "threads", "malloc", "locked map", "lab_alloc");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double raw = Run(threads,
+            [](size_t size, lab_memory_category) { return std::malloc(size); },
+            [](void* ptr) { std::free(ptr); });
+        LockedMapTracker tracker;
+        double locked = Run(threads,
+            [&](size_t size, lab_memory_category category) { return tracker.Allocate(size, category); },
+            [&](void* ptr) { tracker.Free(ptr); });
+        double tracked = Run(threads,
+            [](size_t size, lab_memory_category category) { return lab_alloc(size, category); },
+            [](void* ptr) { lab_free(ptr); });
+        std::printf("%-8d %14.1f %14.1f %14.1f\n", threads, raw, locked, tracked);
+    }
+
+    lab_memory_stats stats = lab_get_memory_stats();
+    if (stats.currentUsage != 0) {
+        std::printf("unexpected live bytes: %zu\n", stats.currentUsage);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Microbenchmark for resource create/destroy churn and handle lookup.
+//
+// Compares the generational handle table the resource manager keeps its
+// resources in with the string-keyed map it used before, where every
+// resource was named after the address of its descriptor. Also runs whole
+// texture creations through ResourceManagerImpl on the CPU backend, and
+// render target churn with and without the texture pool. Run it from a
+// Release build:
+//
+//     ./labfont_bench_resource_churn [live resources]
+
+#include "backends/cpu/cpu_backend.h"
+#include "core/handle_table.h"
+#include "core/resource_manager.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace labfont;
+
+namespace {
+
+struct Object {
+    uint32_t value;
+};
+
+struct BenchResult {
+    double seconds;
+    size_t operations;
+};
+
+template<typename Fn>
+BenchResult Run(Fn&& fn, double minSeconds) {
+    using Clock = std::chrono::steady_clock;
+    BenchResult result = {0.0, 0};
+    auto start = Clock::now();
+    do {
+        fn(result);
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (result.seconds < minSeconds);
+    return result;
+}
+
+void Report(const char* name, const BenchResult& r) {
+    std::printf("%-36s %14.0f ops/s  %8.1f ns/op\n",
+                name,
+                r.operations / r.seconds,
+                1e9 * r.seconds / r.operations);
+}
+
+// The previous scheme: names built from an address, hashed under a lock
+class StringKeyedMap {
+public:
+    std::string Insert(const void* key, std::shared_ptr<Object> object) {
+        std::string name = "texture_" + std::to_string(reinterpret_cast<uintptr_t>(key));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_objects[name] = std::move(object);
+        return name;
+    }
+
+    void Remove(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_objects.erase(name);
+    }
+
+    Object* Get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_objects.find(name);
+        return it != m_objects.end() ? it->second.get() : nullptr;
+    }
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<Object>> m_objects;
+    std::mutex m_mutex;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int live = argc > 1 ? std::atoi(argv[1]) : 1000;
+    if (live <= 0) {
+        std::fprintf(stderr, "usage: %s [live resources]\n", argv[0]);
+        return 1;
+    }
+    const double minSeconds = 1.0;
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> pick(0, live - 1);
+
+    // Churn: replace a random live resource, keeping `live` of them
+    {
+        StringKeyedMap map;
+        std::vector<std::string> names(live);
+        std::vector<Object> keys(live);
+        for (int i = 0; i < live; ++i) {
+            names[i] = map.Insert(&keys[i], std::make_shared<Object>());
+        }
+        Report("string map create/destroy", Run([&](BenchResult& r) {
+            for (int i = 0; i < 10000; ++i) {
+                int slot = pick(rng);
+                map.Remove(names[slot]);
+                names[slot] = map.Insert(&keys[slot], std::make_shared<Object>());
+            }
+            r.operations += 10000;
+        }, minSeconds));
+
+        uint64_t sum = 0;
+        Report("string map lookup", Run([&](BenchResult& r) {
+            for (int i = 0; i < 10000; ++i) {
+                sum += map.Get(names[pick(rng)]) != nullptr;
+            }
+            r.operations += 10000;
+        }, minSeconds));
+        if (sum == 0) {
+            std::printf("unexpected lookup failures\n");
+        }
+    }
+
+    {
+        HandleTable<Object> table;
+        std::vector<ResourceHandle> handles(live);
+        for (int i = 0; i < live; ++i) {
+            handles[i] = table.Insert(std::make_shared<Object>());
+        }
+        Report("handle table create/destroy", Run([&](BenchResult& r) {
+            for (int i = 0; i < 10000; ++i) {
+                int slot = pick(rng);
+                table.Remove(handles[slot]);
+                handles[slot] = table.Insert(std::make_shared<Object>());
+            }
+            r.operations += 10000;
+        }, minSeconds));
+
+        uint64_t sum = 0;
+        Report("handle table lookup", Run([&](BenchResult& r) {
+            for (int i = 0; i < 10000; ++i) {
+                sum += table.Get(handles[pick(rng)]) != nullptr;
+            }
+            r.operations += 10000;
+        }, minSeconds));
+        if (sum == 0) {
+            std::printf("unexpected lookup failures\n");
+        }
+    }
+
+    // Whole texture creations, including the CPU backend's allocation
+    {
+        CPUBackend backend;
+        backend.Initialize(1, 1);
+        ResourceManagerImpl resources(&backend);
+        const uint8_t texel[4] = {255, 255, 255, 255};
+        TextureParams params = {1, 1, LAB_TEXTURE_FORMAT_RGBA8_UNORM, texel};
+        std::vector<ResourceHandle> handles(live);
+        for (int i = 0; i < live; ++i) {
+            std::shared_ptr<TextureResource> texture;
+            resources.CreateTexture(params, texture);
+            handles[i] = texture->GetHandle();
+        }
+        Report("resource manager texture churn", Run([&](BenchResult& r) {
+            for (int i = 0; i < 10000; ++i) {
+                int slot = pick(rng);
+                resources.DestroyResource(handles[slot]);
+                std::shared_ptr<TextureResource> texture;
+                resources.CreateTexture(params, texture);
+                handles[slot] = texture->GetHandle();
+            }
+            r.operations += 10000;
+        }, minSeconds));
+    }
+
+    // Same-sized thumbnail targets created, cleared and destroyed one after
+    // another
+    for (size_t budget : {size_t(0), TexturePool::kDefaultBudget}) {
+        CPUBackend backend;
+        backend.Initialize(1, 1);
+        ResourceManagerImpl resources(&backend);
+        resources.GetTexturePool().SetBudget(budget);
+        RenderTargetParams params = {256, 256, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+        DrawCommand clear = {};
+        clear.type = DrawCommandType::Clear;
+        const std::vector<DrawCommand> commands = {clear};
+        Report(budget ? "render target churn, pooled" : "render target churn, unpooled",
+               Run([&](BenchResult& r) {
+            for (int i = 0; i < 100; ++i) {
+                std::shared_ptr<RenderTargetResource> target;
+                resources.CreateRenderTarget(params, target);
+                backend.SetRenderTarget(target->GetBackendTarget());
+                backend.SubmitCommands(commands);
+                backend.SetRenderTarget(nullptr);
+                ResourceHandle handle = target->GetHandle();
+                target.reset();
+                resources.DestroyResource(handle);
+            }
+            r.operations += 100;
+        }, minSeconds));
+    }
+    return 0;
+}
@@ -2,7 +2,93 @@
 #include <labfont/labfont.h>
 #include "../../src/core/backend.h"
 #include "../../src/backends/cpu/cpu_backend.h"
+#include "../../src/backends/cpu/span_kernels.h"
+#include "../../src/core/capture.h"
+#include "../../src/core/command_optimizer.h"
+#include "../../src/core/command_sorter.h"
+#include "../../src/core/handle_table.h"
+#include "../../src/core/primitive_expander.h"
+#include "../../src/core/render_thread.h"
+#include "../../src/core/resource_manager.h"
 #include "../utils/test_patterns.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Counts heap allocations from any thread while enabled, for tests that
+// check a code path does not allocate. Every form of operator new and delete
+// is replaced, so that all of them pair malloc with free.
+static std::atomic<bool> g_countAllocations{false};
+static std::atomic<size_t> g_allocationCount{0};
+
+static void* CountedAlloc(std::size_t size, std::size_t alignment) {
+    if (g_countAllocations.load(std::memory_order_relaxed)) {
+        g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void* CountedAllocOrThrow(std::size_t size, std::size_t alignment) {
+    if (void* p = CountedAlloc(size, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) {
+    return CountedAllocOrThrow(size, 0);
+}
+
+void* operator new[](std::size_t size) {
+    return CountedAllocOrThrow(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return CountedAllocOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return CountedAllocOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, 0);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
 
 // Define Vertex type for tests
 namespace labfont {
@@ -207,6 +293,1810 @@ static MunitResult test_draw_commands(const MunitParameter params[], void* data)
     return MUNIT_OK;
 }
 
+static MunitResult test_triangle_fill_rule(const MunitParameter params[], void* data) {
+    auto backend = std::make_unique<CPUBackend>();
+    lab_result result = backend->Initialize(13, 9);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    
+    RenderTargetDesc rtDesc = {
+        .width = 13,
+        .height = 9,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    std::shared_ptr<RenderTarget> target;
+    result = backend->CreateRenderTarget(rtDesc, target);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    result = backend->SetRenderTarget(target.get());
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    
+    // A fan of four half-transparent triangles around an off-grid center that
+    // covers the whole target. With a correct fill rule every pixel is blended
+    // exactly once; a pixel hit twice would come out noticeably brighter.
+    const float c[4] = {1.0f, 1.0f, 1.0f, 0.5f};
+    const float cx = 0.137f;
+    const float cy = -0.291f;
+    lab_vertex_2TC fan[12] = {
+        {{-1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{   cx,    cy}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{   cx,    cy}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{   cx,    cy}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{   cx,    cy}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+    };
+    
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.0f, 0.0f, 0.0f, 1.0f}
+        }
+    };
+    lab_draw_command draw_cmd = {
+        .type = LAB_DRAW_COMMAND_TRIANGLES,
+        .triangles = {
+            .vertices = fan,
+            .vertexCount = 12
+        }
+    };
+    std::vector<DrawCommand> commands;
+    commands.push_back(DrawCommand(clear_cmd));
+    commands.push_back(DrawCommand(draw_cmd));
+    
+    result = backend->SubmitCommands(commands);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    
+    std::vector<uint8_t> pixels(13 * 9 * 4);
+    result = backend->ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size());
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    
+    for (size_t i = 0; i < 13 * 9; ++i) {
+        munit_assert_uint8(pixels[i * 4 + 0], >=, 126);
+        munit_assert_uint8(pixels[i * 4 + 0], <=, 128);
+    }
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_span_kernels_match_scalar(const MunitParameter params[], void* data) {
+    const cpu::SpanKernels* scalar = cpu::GetSpanKernels(cpu::SpanKernelLevel::Scalar);
+    munit_assert_not_null(scalar);
+    
+    const cpu::SpanKernelLevel levels[] = {
+        cpu::SpanKernelLevel::SSE4,
+        cpu::SpanKernelLevel::AVX2,
+        cpu::SpanKernelLevel::NEON
+    };
+    
+    // Span lengths around the vector widths, with gradients that leave [0,1]
+    // so clamping is exercised as well.
+    const uint32_t maxCount = 37;
+    std::vector<uint8_t> background(maxCount * 4);
+    for (size_t i = 0; i < background.size(); ++i) {
+        background[i] = static_cast<uint8_t>(munit_rand_int_range(0, 255));
+    }
+    
+    for (cpu::SpanKernelLevel level : levels) {
+        const cpu::SpanKernels* simd = cpu::GetSpanKernels(level);
+        if (!simd) {
+            continue;
+        }
+        
+        for (uint32_t count = 0; count <= maxCount; ++count) {
+            std::vector<uint8_t> expected(background);
+            std::vector<uint8_t> actual(background);
+            uint32_t rgba = munit_rand_uint32();
+            scalar->fill(expected.data(), count, rgba);
+            simd->fill(actual.data(), count, rgba);
+            munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+            
+            float color[4];
+            float dcdx[4];
+            for (int c = 0; c < 4; ++c) {
+                color[c] = static_cast<float>(munit_rand_double()) * 1.4f - 0.2f;
+                dcdx[c] = (static_cast<float>(munit_rand_double()) - 0.5f) * 0.1f;
+            }
+            uint32_t first = static_cast<uint32_t>(munit_rand_int_range(0, 100));
+            for (int mode = 0; mode < cpu::kBlendModeCount; ++mode) {
+                expected = background;
+                actual = background;
+                scalar->shade[mode](expected.data(), count, color, dcdx, first);
+                simd->shade[mode](actual.data(), count, color, dcdx, first);
+                munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+            }
+            
+            std::vector<uint8_t> source(maxCount * 4);
+            for (size_t i = 0; i < source.size(); ++i) {
+                source[i] = static_cast<uint8_t>(munit_rand_int_range(0, 255));
+            }
+            for (int mode = 0; mode < cpu::kBlendModeCount; ++mode) {
+                expected = background;
+                actual = background;
+                scalar->blend[mode](expected.data(), source.data(), count);
+                simd->blend[mode](actual.data(), source.data(), count);
+                munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+            }
+        }
+    }
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_blend_modes(const MunitParameter params[], void* data) {
+    auto backend = std::make_unique<CPUBackend>();
+    munit_assert_int(backend->Initialize(4, 4), ==, LAB_RESULT_OK);
+    RenderTargetDesc rtDesc = {4, 4, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    
+    // Straight alpha source (255, 153, 0, 153) over an opaque (102, 102, 102)
+    // target; the source premultiplies to (153, 92, 0, 153)
+    const float c[4] = {1.0f, 0.6f, 0.0f, 0.6f};
+    lab_vertex_2TC quad[6] = {
+        {{-1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f, -1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f,  1.0f}, {0, 0}, {c[0], c[1], c[2], c[3]}},
+    };
+    const struct {
+        BlendMode mode;
+        uint8_t expected[4];
+    } cases[] = {
+        {BlendMode::None,     {255, 153,   0, 153}},
+        {BlendMode::Alpha,    {194, 133,  41, 255}},
+        {BlendMode::Additive, {255, 194, 102, 255}},
+        {BlendMode::Multiply, {102,  78,  41, 255}},
+        {BlendMode::Screen,   {194, 157, 102, 255}},
+    };
+    
+    for (const auto& test : cases) {
+        lab_draw_command clear_cmd = {
+            .type = LAB_DRAW_COMMAND_CLEAR,
+            .clear = {
+                .color = {0.4f, 0.4f, 0.4f, 1.0f}
+            }
+        };
+        std::vector<DrawCommand> commands;
+        commands.push_back(DrawCommand(clear_cmd));
+        commands.push_back(DrawCommand::CreateBlendCommand(test.mode));
+        DrawCommand draw;
+        draw.type = DrawCommandType::DrawTriangles;
+        draw.triangles.vertices = quad;
+        draw.triangles.vertexCount = 6;
+        commands.push_back(draw);
+        munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+        
+        uint8_t pixels[4 * 4 * 4];
+        munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), pixels, sizeof(pixels)),
+                         ==, LAB_RESULT_OK);
+        for (int i = 0; i < 16; ++i) {
+            munit_assert_memory_equal(4, &pixels[i * 4], test.expected);
+        }
+    }
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_scissor(const MunitParameter params[], void* data) {
+    const lab_vertex_2TC quad[6] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f, -1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f,  1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f,  1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    const lab_vertex_2TC line[2] = {
+        {{0.0f, 0.5f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{1.0f, 0.5f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    
+    for (uint32_t threads : {0u, 2u}) {
+        auto backend = std::make_unique<CPUBackend>();
+        munit_assert_int(backend->Initialize(80, 70), ==, LAB_RESULT_OK);
+        backend->SetWorkerThreads(threads);
+        RenderTargetDesc rtDesc = {80, 70, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false};
+        std::shared_ptr<RenderTarget> target;
+        munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+        munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+        
+        lab_draw_command clear_cmd = {
+            .type = LAB_DRAW_COMMAND_CLEAR,
+            .clear = {
+                .color = {0.0f, 0.0f, 0.0f, 1.0f}
+            }
+        };
+        DrawCommand drawQuad;
+        drawQuad.type = DrawCommandType::DrawTriangles;
+        drawQuad.triangles.vertices = quad;
+        drawQuad.triangles.vertexCount = 6;
+        DrawCommand drawLine;
+        drawLine.type = DrawCommandType::DrawLines;
+        drawLine.lines.vertices = line;
+        drawLine.lines.vertexCount = 2;
+        drawLine.lines.lineWidth = 1.0f;
+        
+        // The quad covers the target and the line crosses it, but only the
+        // scissor rectangle, which straddles a tile corner, is written. A
+        // scissor outside the target draws nothing.
+        std::vector<DrawCommand> commands;
+        commands.push_back(DrawCommand(clear_cmd));
+        commands.push_back(DrawCommand::CreateBlendCommand(BlendMode::None));
+        commands.push_back(DrawCommand::CreateScissorCommand(60, 30, 10, 40));
+        commands.push_back(drawQuad);
+        commands.push_back(DrawCommand::CreateScissorCommand(5, 35, 20, 10));
+        commands.push_back(drawLine);
+        commands.push_back(DrawCommand::CreateScissorCommand(100, 0, 10, 10));
+        commands.push_back(drawQuad);
+        munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+        
+        std::vector<uint8_t> pixels(80 * 70 * 4);
+        munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size()),
+                         ==, LAB_RESULT_OK);
+        for (int y = 0; y < 70; ++y) {
+            for (int x = 0; x < 80; ++x) {
+                bool inQuad = x >= 60 && x < 70 && y >= 30;
+                bool inLine = x >= 5 && x < 25 && y == 35;
+                munit_assert_uint8(pixels[(y * 80 + x) * 4], ==, (inQuad || inLine) ? 255 : 0);
+            }
+        }
+    }
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_antialiasing(const MunitParameter params[], void* data) {
+    // A white rectangle whose right edge is at x = 4.25 pixels. Pixel 4 has
+    // its center at 4.5, so of the 16 samples only the four more than a
+    // quarter pixel left of the center are covered. The diagonal shared by
+    // the two triangles must not leave a seam.
+    const float edge = 4.25f / 8.0f * 2.0f - 1.0f;
+    const lab_vertex_2TC quad[6] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ edge, -1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ edge,  1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ edge,  1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    const lab_vertex_2TC line[2] = {
+        {{0.1f, 0.2f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{0.9f, 0.7f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    
+    for (lab_antialias antialias : {LAB_ANTIALIAS_NONE, LAB_ANTIALIAS_16X}) {
+        auto backend = std::make_unique<CPUBackend>();
+        munit_assert_int(backend->Initialize(8, 4), ==, LAB_RESULT_OK);
+        RenderTargetDesc rtDesc = {8, 4, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, antialias};
+        std::shared_ptr<RenderTarget> target;
+        munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+        munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+        munit_assert_int(target->GetAntialias(), ==, antialias);
+        
+        lab_draw_command clear_cmd = {
+            .type = LAB_DRAW_COMMAND_CLEAR,
+            .clear = {
+                .color = {0.0f, 0.0f, 0.0f, 1.0f}
+            }
+        };
+        std::vector<DrawCommand> commands;
+        commands.push_back(DrawCommand(clear_cmd));
+        commands.push_back(DrawCommand::CreateBlendCommand(BlendMode::None));
+        DrawCommand draw;
+        draw.type = DrawCommandType::DrawTriangles;
+        draw.triangles.vertices = quad;
+        draw.triangles.vertexCount = 6;
+        commands.push_back(draw);
+        munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+        
+        uint8_t pixels[8 * 4 * 4];
+        munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), pixels, sizeof(pixels)),
+                         ==, LAB_RESULT_OK);
+        const uint8_t expected[8] = {
+            255, 255, 255, 255, antialias == LAB_ANTIALIAS_NONE ? uint8_t(0) : uint8_t(64), 0, 0, 0
+        };
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                munit_assert_uint8(pixels[(y * 8 + x) * 4 + 0], ==, expected[x]);
+                munit_assert_uint8(pixels[(y * 8 + x) * 4 + 3], ==, 255);
+            }
+        }
+        
+        // An anti-aliased line leaves partly covered pixels along its sides
+        commands.clear();
+        commands.push_back(DrawCommand(clear_cmd));
+        DrawCommand drawLine;
+        drawLine.type = DrawCommandType::DrawLines;
+        drawLine.lines.vertices = line;
+        drawLine.lines.vertexCount = 2;
+        drawLine.lines.lineWidth = 1.0f;
+        commands.push_back(drawLine);
+        munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+        munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), pixels, sizeof(pixels)),
+                         ==, LAB_RESULT_OK);
+        int partial = 0;
+        for (int i = 0; i < 8 * 4; ++i) {
+            partial += (pixels[i * 4] != 0 && pixels[i * 4] != 255) ? 1 : 0;
+        }
+        if (antialias == LAB_ANTIALIAS_NONE) {
+            munit_assert_int(partial, ==, 0);
+        } else {
+            munit_assert_int(partial, >, 0);
+        }
+    }
+    
+    return MUNIT_OK;
+}
+
+static DrawCommand BindTextureCommand(const std::shared_ptr<TextureResource>& texture,
+                                      lab_texture_filter filter) {
+    DrawCommand bind;
+    bind.type = DrawCommandType::BindTexture;
+    bind.bind_texture.texture = reinterpret_cast<lab_texture>(texture.get());
+    bind.bind_texture.filter = filter;
+    return bind;
+}
+
+// Draws a quad covering the whole target with texture coordinates 0..1
+static std::vector<uint8_t> DrawTexturedQuad(uint32_t width, uint32_t height,
+                                             lab_texture_format format, uint32_t texWidth,
+                                             uint32_t texHeight, const uint8_t* texels,
+                                             lab_texture_filter filter, const float color[4]) {
+    auto backend = std::make_unique<CPUBackend>();
+    munit_assert_int(backend->Initialize(width, height), ==, LAB_RESULT_OK);
+    ResourceManagerImpl resources(backend.get());
+    
+    TextureParams texParams = {texWidth, texHeight, format, texels};
+    std::shared_ptr<TextureResource> texture;
+    munit_assert_int(resources.CreateTexture(texParams, texture), ==, LAB_RESULT_OK);
+    
+    RenderTargetDesc rtDesc = {width, height, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    
+    const float* c = color;
+    lab_vertex_2TC quad[6] = {
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f, -1.0f}, {1.0f, 0.0f}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f,  1.0f}, {1.0f, 1.0f}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {c[0], c[1], c[2], c[3]}},
+        {{ 1.0f,  1.0f}, {1.0f, 1.0f}, {c[0], c[1], c[2], c[3]}},
+        {{-1.0f,  1.0f}, {0.0f, 1.0f}, {c[0], c[1], c[2], c[3]}},
+    };
+    
+    std::vector<DrawCommand> commands;
+    commands.push_back(DrawCommand::CreateBlendCommand(BlendMode::None));
+    commands.push_back(BindTextureCommand(texture, filter));
+    DrawCommand draw;
+    draw.type = DrawCommandType::DrawTriangles;
+    draw.triangles.vertices = quad;
+    draw.triangles.vertexCount = 6;
+    commands.push_back(draw);
+    munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+    
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size()),
+                     ==, LAB_RESULT_OK);
+    return pixels;
+}
+
+static MunitResult test_textured_triangles(const MunitParameter params[], void* data) {
+    const float white[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    
+    // Nearest sampling at one texel per pixel reproduces the texture exactly
+    std::vector<uint8_t> image(8 * 6 * 4);
+    for (size_t i = 0; i < image.size(); ++i) {
+        image[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    std::vector<uint8_t> pixels = DrawTexturedQuad(8, 6, LAB_TEXTURE_FORMAT_RGBA8_UNORM, 8, 6,
+                                                   image.data(), LAB_TEXTURE_FILTER_NEAREST, white);
+    munit_assert_memory_equal(image.size(), image.data(), pixels.data());
+    
+    // An R8 texture is an alpha mask over the vertex color
+    const uint8_t mask[4] = {0, 85, 170, 255};
+    const float red[4] = {1.0f, 0.0f, 0.0f, 1.0f};
+    pixels = DrawTexturedQuad(4, 1, LAB_TEXTURE_FORMAT_R8_UNORM, 4, 1, mask,
+                              LAB_TEXTURE_FILTER_NEAREST, red);
+    for (int x = 0; x < 4; ++x) {
+        munit_assert_uint8(pixels[x * 4 + 0], ==, 255);
+        munit_assert_uint8(pixels[x * 4 + 1], ==, 0);
+        munit_assert_uint8(pixels[x * 4 + 2], ==, 0);
+        munit_assert_uint8(pixels[x * 4 + 3], ==, mask[x]);
+    }
+    
+    // Magnifying two texels over four pixels with bilinear filtering samples
+    // at texel positions -0.25, 0.25, 0.75 and 1.25, clamped to the edge
+    const uint8_t ramp[2] = {0, 255};
+    const int expected[4] = {0, 64, 191, 255};
+    pixels = DrawTexturedQuad(4, 1, LAB_TEXTURE_FORMAT_R8_UNORM, 2, 1, ramp,
+                              LAB_TEXTURE_FILTER_LINEAR, white);
+    for (int x = 0; x < 4; ++x) {
+        munit_assert_int(std::abs(pixels[x * 4 + 3] - expected[x]), <=, 1);
+    }
+    
+    return MUNIT_OK;
+}
+
+// Renders a fixed pseudo-random scene of overlapping triangles and lines
+// with mixed blend modes and textures and returns the resulting pixels
+static std::vector<uint8_t> RenderRandomScene(uint32_t width, uint32_t height, uint32_t workerThreads,
+                                              lab_antialias antialias) {
+    auto backend = std::make_unique<CPUBackend>();
+    munit_assert_int(backend->Initialize(width, height), ==, LAB_RESULT_OK);
+    backend->SetWorkerThreads(workerThreads);
+    munit_assert_uint32(backend->GetWorkerThreads(), ==, workerThreads);
+    
+    RenderTargetDesc rtDesc = {width, height, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, antialias};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    
+    // An RGBA image and an R8 mask, each larger than a tile when magnified
+    ResourceManagerImpl resources(backend.get());
+    std::vector<uint8_t> texels(16 * 16 * 4);
+    for (size_t i = 0; i < texels.size(); ++i) {
+        texels[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+    }
+    std::shared_ptr<TextureResource> image;
+    std::shared_ptr<TextureResource> mask;
+    TextureParams imageParams = {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM, texels.data()};
+    TextureParams maskParams = {32, 8, LAB_TEXTURE_FORMAT_R8_UNORM, texels.data()};
+    munit_assert_int(resources.CreateTexture(imageParams, image), ==, LAB_RESULT_OK);
+    munit_assert_int(resources.CreateTexture(maskParams, mask), ==, LAB_RESULT_OK);
+    
+    // A small LCG keeps the scene identical between the two renders
+    uint32_t state = 12345;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+    };
+    auto vertex = [&](float x, float y) {
+        lab_vertex_2TC v = {{x, y}, {next() * 1.5f - 0.25f, next() * 1.5f - 0.25f},
+                            {next(), next(), next(), next()}};
+        return v;
+    };
+    
+    std::vector<lab_vertex_2TC> triangles;
+    for (int i = 0; i < 200; ++i) {
+        float cx = next() * 2.4f - 1.2f;
+        float cy = next() * 2.4f - 1.2f;
+        float size = next() * (i % 10 == 0 ? 1.5f : 0.3f);
+        for (int k = 0; k < 3; ++k) {
+            triangles.push_back(vertex(cx + (next() - 0.5f) * size, cy + (next() - 0.5f) * size));
+        }
+    }
+    std::vector<lab_vertex_2TC> lines;
+    for (int i = 0; i < 60; ++i) {
+        lines.push_back(vertex(next() * 1.2f - 0.1f, next() * 1.2f - 0.1f));
+        lines.push_back(vertex(next() * 1.2f - 0.1f, next() * 1.2f - 0.1f));
+    }
+    
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.1f, 0.2f, 0.3f, 1.0f}
+        }
+    };
+    std::vector<DrawCommand> commands;
+    commands.push_back(DrawCommand(clear_cmd));
+    for (size_t i = 0; i < triangles.size(); i += 60) {
+        BlendMode mode = static_cast<BlendMode>((i / 60 + 1) % cpu::kBlendModeCount);
+        commands.push_back(DrawCommand::CreateBlendCommand(mode));
+        switch (i / 60) {
+            case 1:
+                commands.push_back(BindTextureCommand(image, LAB_TEXTURE_FILTER_LINEAR));
+                break;
+            case 2:
+                commands.push_back(BindTextureCommand(mask, LAB_TEXTURE_FILTER_NEAREST));
+                break;
+            case 3:
+                commands.push_back(BindTextureCommand(nullptr, LAB_TEXTURE_FILTER_LINEAR));
+                commands.push_back(DrawCommand::CreateScissorCommand(37, 21, 190, 150));
+                break;
+        }
+        
+        DrawCommand draw;
+        draw.type = DrawCommandType::DrawTriangles;
+        draw.triangles.vertices = &triangles[i];
+        draw.triangles.vertexCount = static_cast<uint32_t>(std::min<size_t>(60, triangles.size() - i));
+        commands.push_back(draw);
+    }
+    for (size_t i = 0; i < lines.size(); i += 20) {
+        DrawCommand draw;
+        draw.type = DrawCommandType::DrawLines;
+        draw.lines.vertices = &lines[i];
+        draw.lines.vertexCount = 20;
+        draw.lines.lineWidth = 1.0f + static_cast<float>(i / 20) * 1.5f;
+        commands.push_back(draw);
+    }
+    
+    // Quads, some flipped, over the image and then the mask
+    std::vector<lab_quad_instance> quads;
+    for (int i = 0; i < 80; ++i) {
+        lab_quad_instance quad = {
+            {next() * 2.4f - 1.2f, next() * 2.4f - 1.2f},
+            {next() * 0.8f - 0.2f, next() * 0.8f - 0.2f},
+            {next(), next(), next() * 1.5f, next() * 1.5f},
+            {uint8_t(next() * 255), uint8_t(next() * 255), uint8_t(next() * 255), uint8_t(next() * 255)}
+        };
+        quads.push_back(quad);
+    }
+    commands.push_back(DrawCommand::CreateBlendCommand(BlendMode::Alpha));
+    for (size_t i = 0; i < quads.size(); i += 40) {
+        commands.push_back(BindTextureCommand(i == 0 ? image : mask, LAB_TEXTURE_FILTER_LINEAR));
+        DrawCommand draw;
+        draw.type = DrawCommandType::DrawQuads;
+        draw.quads.instances = &quads[i];
+        draw.quads.instanceCount = 40;
+        commands.push_back(draw);
+    }
+    munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+    
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size()),
+                     ==, LAB_RESULT_OK);
+    return pixels;
+}
+
+static MunitResult test_tiled_rendering_matches_serial(const MunitParameter params[], void* data) {
+    // The size is not a multiple of the tile size, so edge tiles are partial
+    const uint32_t width = 301;
+    const uint32_t height = 197;
+    for (lab_antialias antialias : {LAB_ANTIALIAS_NONE, LAB_ANTIALIAS_8X}) {
+        std::vector<uint8_t> serial = RenderRandomScene(width, height, 0, antialias);
+        
+        for (uint32_t threads : {1u, 4u}) {
+            std::vector<uint8_t> tiled = RenderRandomScene(width, height, threads, antialias);
+            munit_assert_memory_equal(serial.size(), serial.data(), tiled.data());
+        }
+    }
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_steady_state_allocations(const MunitParameter params[], void* data) {
+    // A fan of small triangles, more than one transform batch of vertices
+    std::vector<lab_vertex_2TC> triangles;
+    for (int i = 0; i < 100; ++i) {
+        float a0 = i * 0.0628f;
+        float a1 = (i + 1) * 0.0628f;
+        float alpha = 0.25f + (i % 3) * 0.25f;
+        triangles.push_back({{0.0f, 0.0f}, {0, 0}, {1.0f, 0.5f, 0.0f, alpha}});
+        triangles.push_back({{std::cos(a0), std::sin(a0)}, {0, 0}, {0.0f, 1.0f, 0.5f, alpha}});
+        triangles.push_back({{std::cos(a1), std::sin(a1)}, {0, 0}, {0.5f, 0.0f, 1.0f, alpha}});
+    }
+    const lab_vertex_2TC lines[4] = {
+        {{0.1f, 0.1f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{0.9f, 0.8f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{0.9f, 0.1f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{0.1f, 0.8f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.0f, 0.0f, 0.0f, 1.0f}
+        }
+    };
+    std::vector<DrawCommand> commands;
+    commands.push_back(DrawCommand(clear_cmd));
+    commands.push_back(DrawCommand::CreateBlendCommand(BlendMode::Alpha));
+    DrawCommand drawTriangles;
+    drawTriangles.type = DrawCommandType::DrawTriangles;
+    drawTriangles.triangles.vertices = triangles.data();
+    drawTriangles.triangles.vertexCount = static_cast<uint32_t>(triangles.size());
+    commands.push_back(drawTriangles);
+    DrawCommand drawLines;
+    drawLines.type = DrawCommandType::DrawLines;
+    drawLines.lines.vertices = lines;
+    drawLines.lines.vertexCount = 4;
+    drawLines.lines.lineWidth = 3.0f;
+    commands.push_back(drawLines);
+    
+    for (uint32_t threads : {0u, 2u}) {
+        auto backend = std::make_unique<CPUBackend>();
+        munit_assert_int(backend->Initialize(128, 96), ==, LAB_RESULT_OK);
+        backend->SetWorkerThreads(threads);
+        RenderTargetDesc rtDesc = {128, 96, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+        std::shared_ptr<RenderTarget> target;
+        munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+        munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+        
+        // The first frame sizes the backend's reusable buffers
+        munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+        
+        g_allocationCount = 0;
+        g_countAllocations = true;
+        lab_result result = LAB_RESULT_OK;
+        for (int frame = 0; frame < 3 && result == LAB_RESULT_OK; ++frame) {
+            result = backend->SubmitCommands(commands);
+        }
+        g_countAllocations = false;
+        munit_assert_int(result, ==, LAB_RESULT_OK);
+        munit_assert_size(g_allocationCount.load(), ==, 0);
+    }
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_command_history(const MunitParameter params[], void* data) {
+    auto backend = std::make_unique<CPUBackend>();
+    munit_assert_int(backend->Initialize(16, 16), ==, LAB_RESULT_OK);
+    RenderTargetDesc rtDesc = {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    
+    // Submits a triangle whose vertices are freed right after, tagged by the
+    // red channel of its color
+    auto submitTriangle = [&](float tag) {
+        std::vector<lab_vertex_2TC> vertices = {
+            {{-1.0f, -1.0f}, {0, 0}, {tag, 0.0f, 0.0f, 1.0f}},
+            {{ 1.0f, -1.0f}, {0, 0}, {tag, 0.0f, 0.0f, 1.0f}},
+            {{ 0.0f,  1.0f}, {0, 0}, {tag, 0.0f, 0.0f, 1.0f}},
+        };
+        DrawCommand draw;
+        draw.type = DrawCommandType::DrawTriangles;
+        draw.triangles.vertices = vertices.data();
+        draw.triangles.vertexCount = 3;
+        std::vector<DrawCommand> commands = {DrawCommand::CreateBlendCommand(BlendMode::None), draw};
+        munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+    };
+    
+    // Off by default
+    submitTriangle(0.0f);
+    backend->EndFrame();
+    munit_assert_false(backend->GetCommandHistory().IsEnabled());
+    munit_assert_uint32(backend->GetCommandHistory().GetFrameCount(), ==, 0);
+    
+    // Only the last two frames are kept; the last frame has two submissions
+    backend->SetCommandHistory(2);
+    for (int frame = 1; frame <= 3; ++frame) {
+        submitTriangle(frame * 0.1f);
+        if (frame == 3) {
+            submitTriangle(0.5f);
+        }
+        backend->EndFrame();
+    }
+    
+    const CommandHistory& history = backend->GetCommandHistory();
+    munit_assert_uint32(history.GetFrameCount(), ==, 2);
+    const std::vector<DrawCommand>& second = history.GetFrame(0);
+    munit_assert_size(second.size(), ==, 2);
+    munit_assert_int(int(second[1].type), ==, int(DrawCommandType::DrawTriangles));
+    munit_assert_uint32(second[1].triangles.vertexCount, ==, 3);
+    munit_assert_float(second[1].triangles.vertices[2].color[0], ==, 0.2f);
+    
+    const std::vector<DrawCommand>& third = history.GetFrame(1);
+    munit_assert_size(third.size(), ==, 4);
+    munit_assert_float(third[1].triangles.vertices[0].color[0], ==, 0.3f);
+    munit_assert_float(third[3].triangles.vertices[0].color[0], ==, 0.5f);
+    
+    // Shrinking keeps the newest frames, disabling drops everything
+    backend->SetCommandHistory(1);
+    munit_assert_uint32(history.GetFrameCount(), ==, 1);
+    munit_assert_size(history.GetFrame(0).size(), ==, 4);
+    backend->SetCommandHistory(0);
+    munit_assert_uint32(history.GetFrameCount(), ==, 0);
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_readback_changes(const MunitParameter params[], void* data) {
+    auto backend = std::make_unique<CPUBackend>();
+    munit_assert_int(backend->Initialize(64, 64), ==, LAB_RESULT_OK);
+    RenderTargetDesc rtDesc = {64, 64, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    
+    std::vector<uint8_t> mirror(64 * 64 * 4, 0xcd);
+    std::vector<uint8_t> full(64 * 64 * 4);
+    lab_rect rects[4];
+    uint32_t rectCount = 0;
+    
+    // A new target has never been read back, so all of it is reported
+    munit_assert_int(backend->ReadbackChanges(target.get(), mirror.data(), mirror.size(), rects, 4, rectCount),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint32(rectCount, ==, 1);
+    munit_assert_int(rects[0].x, ==, 0);
+    munit_assert_uint32(rects[0].width, ==, 64);
+    munit_assert_uint32(rects[0].height, ==, 64);
+    
+    // Two small triangles in opposite corners, one of them partly scissored
+    const lab_vertex_2TC triangles[6] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-0.75f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f, -0.75f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 0.5f,  0.5f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 1.0f,  0.5f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 0.5f,  1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+    };
+    std::vector<DrawCommand> commands;
+    commands.push_back(DrawCommand::CreateScissorCommand(0, 0, 56, 64));
+    DrawCommand draw;
+    draw.type = DrawCommandType::DrawTriangles;
+    draw.triangles.vertices = triangles;
+    draw.triangles.vertexCount = 6;
+    commands.push_back(draw);
+    munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+    
+    munit_assert_int(backend->ReadbackChanges(target.get(), mirror.data(), mirror.size(), rects, 4, rectCount),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint32(rectCount, ==, 2);
+    size_t changedPixels = 0;
+    for (uint32_t i = 0; i < rectCount; ++i) {
+        munit_assert_int(rects[i].x + int32_t(rects[i].width), <=, 56);
+        changedPixels += size_t(rects[i].width) * rects[i].height;
+    }
+    munit_assert_size(changedPixels, <, 64 * 64 / 8);
+    
+    // The mirror now matches a full readback
+    munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), full.data(), full.size()),
+                     ==, LAB_RESULT_OK);
+    munit_assert_memory_equal(full.size(), full.data(), mirror.data());
+    
+    // Nothing changed since
+    munit_assert_int(backend->ReadbackChanges(target.get(), mirror.data(), mirror.size(), rects, 4, rectCount),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint32(rectCount, ==, 0);
+    
+    // A clear damages everything
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.0f, 0.0f, 1.0f, 1.0f}
+        }
+    };
+    commands.assign(1, DrawCommand(clear_cmd));
+    munit_assert_int(backend->SubmitCommands(commands), ==, LAB_RESULT_OK);
+    munit_assert_int(backend->ReadbackChanges(target.get(), mirror.data(), mirror.size(), rects, 4, rectCount),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint32(rectCount, ==, 1);
+    munit_assert_uint32(rects[0].width * rects[0].height, ==, 64 * 64);
+    munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), full.data(), full.size()),
+                     ==, LAB_RESULT_OK);
+    munit_assert_memory_equal(full.size(), full.data(), mirror.data());
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_parallel_encoders(const MunitParameter params[], void* data) {
+    const uint32_t kSize = 64;
+    const uint32_t kThreads = 8;
+    const uint32_t kTriangles = 200;
+    lab_backend_desc backendDesc = {LAB_BACKEND_CPU, kSize, kSize, nullptr};
+    lab_render_target_desc rtDesc = {kSize, kSize, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    lab_context contexts[2] = {};
+    lab_render_target targets[2] = {};
+    for (int i = 0; i < 2; ++i) {
+        munit_assert_int(lab_create_context(&backendDesc, &contexts[i]), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_create_render_target(contexts[i], &rtDesc, &targets[i]), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_set_render_target(contexts[i], targets[i]), ==, LAB_RESULT_OK);
+    }
+    lab_context parallel = contexts[0];
+    lab_context serial = contexts[1];
+    
+    // Overlapping opaque triangles, so the image depends on submission order
+    auto makeCommands = [&](uint32_t frame, uint32_t thread, std::vector<lab_vertex_2TC>& vertices,
+                            std::vector<lab_draw_command>& commands) {
+        vertices.clear();
+        commands.clear();
+        for (uint32_t t = 0; t < kTriangles; ++t) {
+            uint32_t seed = (frame * kThreads + thread) * kTriangles + t;
+            float x = float(seed * 37 % 29) / 16.0f - 1.0f;
+            float y = float(seed * 53 % 31) / 16.0f - 1.0f;
+            float color[4] = {float(thread) / kThreads, float(t % 7) / 6.0f, float(frame) / 3.0f, 1.0f};
+            vertices.push_back({{x, y}, {0, 0}, {color[0], color[1], color[2], color[3]}});
+            vertices.push_back({{x + 0.4f, y}, {0, 0}, {color[0], color[1], color[2], color[3]}});
+            vertices.push_back({{x, y + 0.4f}, {0, 0}, {color[0], color[1], color[2], color[3]}});
+        }
+        for (uint32_t t = 0; t < kTriangles; ++t) {
+            lab_draw_command command = {};
+            command.type = LAB_DRAW_COMMAND_TRIANGLES;
+            command.triangles.vertices = &vertices[t * 3];
+            command.triangles.vertexCount = 3;
+            commands.push_back(command);
+        }
+    };
+    
+    std::vector<uint8_t> expected(kSize * kSize * 4);
+    for (uint32_t frame = 0; frame < 3; ++frame) {
+        // Each thread creates its own encoder and records in a few batches;
+        // sort keys run against thread order
+        std::vector<std::thread> threads;
+        std::vector<lab_encoder> encoders(kThreads, nullptr);
+        std::atomic<int> failures{0};
+        for (uint32_t i = 0; i < kThreads; ++i) {
+            threads.emplace_back([&, i]() {
+                std::vector<lab_vertex_2TC> vertices;
+                std::vector<lab_draw_command> commands;
+                makeCommands(frame, i, vertices, commands);
+                if (lab_create_encoder(parallel, kThreads - 1 - i, &encoders[i]) != LAB_RESULT_OK) {
+                    failures++;
+                    return;
+                }
+                for (uint32_t first = 0; first < kTriangles; first += 50) {
+                    if (lab_encode_commands(encoders[i], &commands[first], 50) != LAB_RESULT_OK) {
+                        failures++;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        munit_assert_int(failures.load(), ==, 0);
+        
+        lab_draw_command clear = {};
+        clear.type = LAB_DRAW_COMMAND_CLEAR;
+        clear.clear.color[3] = 1.0f;
+        munit_assert_int(lab_begin_frame(parallel), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_submit_commands(parallel, &clear, 1), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_end_frame(parallel), ==, LAB_RESULT_OK);
+        
+        munit_assert_int(lab_begin_frame(serial), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_submit_commands(serial, &clear, 1), ==, LAB_RESULT_OK);
+        for (uint32_t i = kThreads; i-- > 0;) {
+            std::vector<lab_vertex_2TC> vertices;
+            std::vector<lab_draw_command> commands;
+            makeCommands(frame, i, vertices, commands);
+            munit_assert_int(lab_submit_commands(serial, commands.data(), kTriangles), ==, LAB_RESULT_OK);
+        }
+        munit_assert_int(lab_end_frame(serial), ==, LAB_RESULT_OK);
+        
+        uint8_t* pixels[2] = {};
+        size_t sizes[2] = {};
+        for (int i = 0; i < 2; ++i) {
+            munit_assert_int(lab_get_render_target_data(contexts[i], targets[i], nullptr, &pixels[i], &sizes[i]),
+                             ==, LAB_RESULT_OK);
+        }
+        munit_assert_size(sizes[0], ==, sizes[1]);
+        munit_assert_memory_equal(sizes[0], pixels[0], pixels[1]);
+        lab_free(pixels[0]);
+        lab_free(pixels[1]);
+        
+        // Encoders can go once their frame has ended
+        for (lab_encoder encoder : encoders) {
+            lab_destroy_encoder(parallel, encoder);
+        }
+    }
+    
+    for (int i = 0; i < 2; ++i) {
+        lab_destroy_render_target(contexts[i], targets[i]);
+        lab_destroy_context(contexts[i]);
+    }
+    return MUNIT_OK;
+}
+
+static MunitResult test_command_stream(const MunitParameter params[], void* data) {
+    std::vector<lab_vertex_2TC> vertices = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-0.5f,  0.5f}, {0, 0}, {0.0f, 0.0f, 1.0f, 0.5f}},
+        {{ 0.5f, -0.5f}, {0, 0}, {0.0f, 0.0f, 1.0f, 0.5f}},
+    };
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.0f, 1.0f, 0.0f, 1.0f}
+        }
+    };
+    std::vector<DrawCommand> commands;
+    commands.push_back(DrawCommand(clear_cmd));
+    commands.push_back(DrawCommand::CreateBlendCommand(BlendMode::Alpha));
+    commands.push_back(DrawCommand::CreateScissorCommand(4, 2, 20, 24));
+    DrawCommand draw;
+    draw.type = DrawCommandType::DrawTriangles;
+    draw.triangles.vertices = vertices.data();
+    draw.triangles.vertexCount = 3;
+    commands.push_back(draw);
+    draw.type = DrawCommandType::DrawLines;
+    draw.lines.vertices = vertices.data() + 3;
+    draw.lines.vertexCount = 2;
+    draw.lines.lineWidth = 3.0f;
+    commands.push_back(draw);
+    DrawCommand bind;
+    bind.type = DrawCommandType::BindTexture;
+    bind.bind_texture.texture = reinterpret_cast<lab_texture>(uintptr_t(0x1234));
+    bind.bind_texture.filter = LAB_TEXTURE_FILTER_LINEAR;
+    commands.push_back(bind);
+    const uint16_t indices[3] = {2, 0, 1};
+    draw.type = DrawCommandType::DrawIndexedTriangles;
+    draw.indexed_triangles.vertices = vertices.data();
+    draw.indexed_triangles.indices = indices;
+    draw.indexed_triangles.vertexCount = 3;
+    draw.indexed_triangles.indexCount = 3;
+    commands.push_back(draw);
+    const lab_quad_instance quad = {{-0.5f, -0.5f}, {0.25f, 0.5f}, {0, 0, 1, 1}, {1, 2, 3, 4}};
+    draw.type = DrawCommandType::DrawQuads;
+    draw.quads.instances = &quad;
+    draw.quads.instanceCount = 1;
+    commands.push_back(draw);
+    
+    CommandStream stream;
+    stream.Append(commands);
+    munit_assert_size(stream.GetCommandCount(), ==, commands.size());
+    // Smaller than the commands plus everything they point to
+    munit_assert_size(stream.GetByteSize(), <, commands.size() * sizeof(DrawCommand) +
+                                               (vertices.size() + 3) * sizeof(lab_vertex_2TC) +
+                                               sizeof(indices) + sizeof(quad));
+    
+    // The stream keeps its own vertices
+    std::vector<lab_vertex_2TC> original = vertices;
+    std::fill(vertices.begin(), vertices.end(), lab_vertex_2TC{});
+    std::vector<DrawCommand> decoded(stream.begin(), stream.end());
+    munit_assert_size(decoded.size(), ==, commands.size());
+    munit_assert_float(decoded[0].clear.color[1], ==, 1.0f);
+    munit_assert_int(int(decoded[1].blend.mode), ==, int(BlendMode::Alpha));
+    munit_assert_int(decoded[2].scissor.x, ==, 4);
+    munit_assert_uint32(decoded[2].scissor.height, ==, 24);
+    munit_assert_uint32(decoded[3].triangles.vertexCount, ==, 3);
+    munit_assert_memory_equal(3 * sizeof(lab_vertex_2TC), decoded[3].triangles.vertices, &original[0]);
+    munit_assert_uint32(decoded[4].lines.vertexCount, ==, 2);
+    munit_assert_float(decoded[4].lines.lineWidth, ==, 3.0f);
+    munit_assert_memory_equal(2 * sizeof(lab_vertex_2TC), decoded[4].lines.vertices, &original[3]);
+    munit_assert_ptr_equal(decoded[5].bind_texture.texture, bind.bind_texture.texture);
+    munit_assert_int(decoded[5].bind_texture.filter, ==, LAB_TEXTURE_FILTER_LINEAR);
+    munit_assert_uint32(decoded[6].indexed_triangles.indexCount, ==, 3);
+    munit_assert_uint16(decoded[6].indexed_triangles.indices[0], ==, 2);
+    munit_assert_memory_equal(3 * sizeof(lab_vertex_2TC), decoded[6].indexed_triangles.vertices, &original[0]);
+    munit_assert_uint32(decoded[7].quads.instanceCount, ==, 1);
+    munit_assert_memory_equal(sizeof(quad), decoded[7].quads.instances, &quad);
+    
+    // A saved and reloaded stream renders the same as the commands, except
+    // that texture handles are dropped
+    const char* path = "labfont_test_stream.lfcs";
+    munit_assert_int(stream.Save(path), ==, LAB_RESULT_OK);
+    CommandStream loaded;
+    munit_assert_int(loaded.Load(path), ==, LAB_RESULT_OK);
+    munit_assert_size(loaded.GetCommandCount(), ==, stream.GetCommandCount());
+    munit_assert_size(loaded.GetByteSize(), ==, stream.GetByteSize());
+    std::vector<DrawCommand> reloaded(loaded.begin(), loaded.end());
+    munit_assert_null(reloaded[5].bind_texture.texture);
+    munit_assert_uint16(reloaded[6].indexed_triangles.indices[2], ==, 1);
+    
+    decoded.erase(decoded.begin() + 5);
+    std::vector<uint8_t> images[2];
+    for (int i = 0; i < 2; ++i) {
+        auto backend = std::make_unique<CPUBackend>();
+        munit_assert_int(backend->Initialize(32, 32), ==, LAB_RESULT_OK);
+        RenderTargetDesc rtDesc = {32, 32, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+        std::shared_ptr<RenderTarget> target;
+        munit_assert_int(backend->CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+        munit_assert_int(backend->SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+        lab_result result = i == 0 ? backend->SubmitCommands(decoded) : backend->SubmitCommandStream(loaded);
+        munit_assert_int(result, ==, LAB_RESULT_OK);
+        images[i].resize(32 * 32 * 4);
+        munit_assert_int(backend->ReadbackTexture(target->GetColorTexture(), images[i].data(), images[i].size()),
+                         ==, LAB_RESULT_OK);
+    }
+    munit_assert_memory_equal(images[0].size(), images[0].data(), images[1].data());
+    
+    // A truncated file is rejected and leaves the stream as it was
+    std::vector<uint8_t> bytes;
+    {
+        FILE* in = fopen(path, "rb");
+        munit_assert_not_null(in);
+        fseek(in, 0, SEEK_END);
+        bytes.resize(size_t(ftell(in)));
+        fseek(in, 0, SEEK_SET);
+        munit_assert_size(fread(bytes.data(), 1, bytes.size(), in), ==, bytes.size());
+        fclose(in);
+        FILE* out = fopen(path, "wb");
+        fwrite(bytes.data(), 1, bytes.size() - 8, out);
+        fclose(out);
+    }
+    munit_assert_int(loaded.Load(path), ==, LAB_RESULT_INVALID_COMMAND_BUFFER);
+    munit_assert_size(loaded.GetCommandCount(), ==, stream.GetCommandCount());
+    
+    // So are blend modes and texture filters out of range
+    for (DrawCommandType type : {DrawCommandType::SetBlendMode, DrawCommandType::BindTexture}) {
+        // Records follow the 24 byte file header as type, reserved, size and payload
+        std::vector<uint8_t> corrupt = bytes;
+        size_t offset = 24;
+        uint16_t recordType = 0;
+        uint32_t recordSize = 0;
+        for (;;) {
+            munit_assert_size(offset + 8, <=, corrupt.size());
+            std::memcpy(&recordType, &corrupt[offset], sizeof(recordType));
+            std::memcpy(&recordSize, &corrupt[offset + 4], sizeof(recordSize));
+            if (recordType == static_cast<uint16_t>(type)) {
+                break;
+            }
+            offset += recordSize;
+        }
+        // The mode is the whole payload; the filter follows the handle
+        const uint32_t outOfRange = 1000000;
+        size_t field = offset + 8 + (type == DrawCommandType::BindTexture ? sizeof(uint64_t) : 0);
+        std::memcpy(&corrupt[field], &outOfRange, sizeof(outOfRange));
+        FILE* out = fopen(path, "wb");
+        fwrite(corrupt.data(), 1, corrupt.size(), out);
+        fclose(out);
+        munit_assert_int(loaded.Load(path), ==, LAB_RESULT_INVALID_COMMAND_BUFFER);
+    }
+    
+    // So is one whose header claims more bytes than it holds
+    {
+        const uint64_t hugeSize = ~uint64_t(0) / 2;
+        std::memcpy(bytes.data() + 16, &hugeSize, sizeof(hugeSize));
+        FILE* out = fopen(path, "wb");
+        fwrite(bytes.data(), 1, bytes.size(), out);
+        fclose(out);
+    }
+    munit_assert_int(loaded.Load(path), ==, LAB_RESULT_INVALID_COMMAND_BUFFER);
+    munit_assert_int(loaded.Load("does/not/exist.lfcs"), ==, LAB_RESULT_FILE_IO_FAILED);
+    remove(path);
+    
+    return MUNIT_OK;
+}
+
+// CPU backend that leaves indexed triangles and quads to the context, as
+// the GPU backends do
+class ExpandingCPUBackend : public CPUBackend {
+public:
+    bool SupportsDrawCommand(DrawCommandType type) const override {
+        return Backend::SupportsDrawCommand(type);
+    }
+};
+
+static std::vector<uint8_t> RenderCommands(CPUBackend& backend, const std::vector<DrawCommand>& commands,
+                                           uint32_t width, uint32_t height) {
+    munit_assert_int(backend.Initialize(width, height), ==, LAB_RESULT_OK);
+    RenderTargetDesc rtDesc = {width, height, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend.CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend.SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    munit_assert_int(backend.SubmitCommands(commands), ==, LAB_RESULT_OK);
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    munit_assert_int(backend.ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size()),
+                     ==, LAB_RESULT_OK);
+    return pixels;
+}
+
+static MunitResult test_indexed_and_quads(const MunitParameter params[], void* data) {
+    const uint32_t size = 48;
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.2f, 0.2f, 0.2f, 1.0f}
+        }
+    };
+    
+    // An indexed rectangle renders exactly as its triangles; the triangle
+    // with an out of range index is dropped
+    const lab_vertex_2TC corners[4] = {
+        {{-0.7f, -0.6f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 0.55f, -0.6f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{-0.7f,  0.45f}, {0, 0}, {0.0f, 0.0f, 1.0f, 0.5f}},
+        {{ 0.55f, 0.45f}, {0, 0}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    const uint16_t indices[9] = {0, 1, 2, 2, 1, 3, 0, 1, 4};
+    const lab_vertex_2TC triangles[6] = {corners[0], corners[1], corners[2], corners[2], corners[1], corners[3]};
+    std::vector<DrawCommand> indexed(1, DrawCommand(clear_cmd));
+    DrawCommand draw;
+    draw.type = DrawCommandType::DrawIndexedTriangles;
+    draw.indexed_triangles.vertices = corners;
+    draw.indexed_triangles.indices = indices;
+    draw.indexed_triangles.vertexCount = 4;
+    draw.indexed_triangles.indexCount = 9;
+    indexed.push_back(draw);
+    std::vector<DrawCommand> plain(1, DrawCommand(clear_cmd));
+    draw.type = DrawCommandType::DrawTriangles;
+    draw.triangles.vertices = triangles;
+    draw.triangles.vertexCount = 6;
+    plain.push_back(draw);
+    
+    CPUBackend indexedBackend;
+    CPUBackend plainBackend;
+    std::vector<uint8_t> expected = RenderCommands(plainBackend, plain, size, size);
+    std::vector<uint8_t> actual = RenderCommands(indexedBackend, indexed, size, size);
+    munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+    
+    // Quads, including flipped and sub-pixel ones, rasterized directly cover
+    // the same pixels as their triangles; flat colors may round differently
+    std::vector<lab_quad_instance> quads = {
+        {{-0.9f, -0.9f}, {0.8f, 0.5f}, {0, 0, 1, 1}, {255, 0, 0, 255}},
+        {{ 0.6f,  0.7f}, {-0.73f, -0.41f}, {0, 0, 1, 1}, {0, 255, 0, 128}},
+        {{-0.31f, 0.13f}, {0.021f, 0.9f}, {0, 0, 1, 1}, {30, 60, 250, 200}},
+        {{ 0.1f, -0.95f}, {0.9f, 0.01f}, {0, 0, 1, 1}, {255, 255, 0, 255}},
+    };
+    std::vector<lab_vertex_2TC> quadTriangles(quads.size() * 6);
+    for (size_t i = 0; i < quads.size(); ++i) {
+        PrimitiveExpander::QuadToTriangles(quads[i], &quadTriangles[i * 6]);
+    }
+    std::vector<DrawCommand> direct(1, DrawCommand(clear_cmd));
+    draw.type = DrawCommandType::DrawQuads;
+    draw.quads.instances = quads.data();
+    draw.quads.instanceCount = static_cast<uint32_t>(quads.size());
+    direct.push_back(draw);
+    plain.resize(1);
+    draw.type = DrawCommandType::DrawTriangles;
+    draw.triangles.vertices = quadTriangles.data();
+    draw.triangles.vertexCount = static_cast<uint32_t>(quadTriangles.size());
+    plain.push_back(draw);
+    
+    CPUBackend quadBackend;
+    CPUBackend triangleBackend;
+    expected = RenderCommands(triangleBackend, plain, size, size);
+    actual = RenderCommands(quadBackend, direct, size, size);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        munit_assert_int(std::abs(int(expected[i]) - int(actual[i])), <=, 1);
+    }
+    
+    // Expanded by the context for a backend without native support, both
+    // render exactly as the triangles
+    ExpandingCPUBackend expandingBackend;
+    PrimitiveExpander expander;
+    std::vector<DrawCommand> expanded;
+    munit_assert_true(PrimitiveExpander::NeedsExpansion(direct.data(), direct.size(), expandingBackend));
+    munit_assert_false(PrimitiveExpander::NeedsExpansion(direct.data(), direct.size(), quadBackend));
+    expander.Expand(direct.data(), direct.size(), expandingBackend, expanded);
+    munit_assert_size(expanded.size(), ==, 2);
+    munit_assert_int(int(expanded[1].type), ==, int(DrawCommandType::DrawTriangles));
+    actual = RenderCommands(expandingBackend, expanded, size, size);
+    munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+    
+    // A textured quad at one texel per pixel reproduces the texture
+    CPUBackend texturedBackend;
+    ResourceManagerImpl resources(&texturedBackend);
+    std::vector<uint8_t> image(8 * 6 * 4);
+    for (size_t i = 0; i < image.size(); ++i) {
+        image[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    TextureParams texParams = {8, 6, LAB_TEXTURE_FORMAT_RGBA8_UNORM, image.data()};
+    std::shared_ptr<TextureResource> texture;
+    munit_assert_int(resources.CreateTexture(texParams, texture), ==, LAB_RESULT_OK);
+    const lab_quad_instance full = {{-1.0f, -1.0f}, {2.0f, 2.0f}, {0, 0, 1, 1}, {255, 255, 255, 255}};
+    std::vector<DrawCommand> textured;
+    textured.push_back(DrawCommand::CreateBlendCommand(BlendMode::None));
+    textured.push_back(BindTextureCommand(texture, LAB_TEXTURE_FILTER_NEAREST));
+    draw.type = DrawCommandType::DrawQuads;
+    draw.quads.instances = &full;
+    draw.quads.instanceCount = 1;
+    textured.push_back(draw);
+    actual = RenderCommands(texturedBackend, textured, 8, 6);
+    munit_assert_memory_equal(image.size(), image.data(), actual.data());
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_packed_vertices(const MunitParameter params[], void* data) {
+    const uint32_t size = 40;
+    lab_draw_command clear_cmd = {
+        .type = LAB_DRAW_COMMAND_CLEAR,
+        .clear = {
+            .color = {0.1f, 0.3f, 0.2f, 1.0f}
+        }
+    };
+    
+    // Packed triangles render exactly as the full vertices they expand to
+    const lab_vertex_2TC_packed packed[6] = {
+        {{-0.8f, -0.7f}, {0, 0}, {255, 0, 0, 255}},
+        {{ 0.6f, -0.5f}, {65535, 0}, {0, 255, 0, 200}},
+        {{-0.2f,  0.8f}, {0, 65535}, {0, 0, 255, 64}},
+        {{ 0.9f,  0.9f}, {32768, 16384}, {255, 255, 255, 255}},
+        {{ 0.1f,  0.2f}, {65535, 65535}, {17, 34, 51, 128}},
+        {{ 0.7f, -0.9f}, {1, 2}, {200, 100, 50, 30}},
+    };
+    lab_vertex_2TC full[6];
+    for (int i = 0; i < 6; ++i) {
+        full[i].position[0] = packed[i].position[0];
+        full[i].position[1] = packed[i].position[1];
+        full[i].texcoord[0] = packed[i].texcoord[0] / 65535.0f;
+        full[i].texcoord[1] = packed[i].texcoord[1] / 65535.0f;
+        for (int c = 0; c < 4; ++c) {
+            full[i].color[c] = packed[i].color[c] / 255.0f;
+        }
+    }
+    
+    // Two draws, so the optimizer has packed ranges to merge
+    std::vector<DrawCommand> packedCommands(1, DrawCommand(clear_cmd));
+    packedCommands.push_back(DrawCommand::CreateBlendCommand(BlendMode::Alpha));
+    DrawCommand draw;
+    draw.type = DrawCommandType::DrawTrianglesPacked;
+    draw.triangles_packed.vertices = packed;
+    draw.triangles_packed.vertexCount = 3;
+    packedCommands.push_back(draw);
+    draw.triangles_packed.vertices = packed + 3;
+    packedCommands.push_back(draw);
+    std::vector<DrawCommand> fullCommands(packedCommands.begin(), packedCommands.begin() + 2);
+    draw.type = DrawCommandType::DrawTriangles;
+    draw.triangles.vertices = full;
+    draw.triangles.vertexCount = 6;
+    fullCommands.push_back(draw);
+    
+    CPUBackend fullBackend;
+    CPUBackend packedBackend;
+    std::vector<uint8_t> expected = RenderCommands(fullBackend, fullCommands, size, size);
+    std::vector<uint8_t> actual = RenderCommands(packedBackend, packedCommands, size, size);
+    munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+    
+    // Backends without native support get full vertices from the expander
+    ExpandingCPUBackend expandingBackend;
+    PrimitiveExpander expander;
+    std::vector<DrawCommand> expanded;
+    munit_assert_true(PrimitiveExpander::NeedsExpansion(packedCommands.data(), packedCommands.size(),
+                                                        expandingBackend));
+    expander.Expand(packedCommands.data(), packedCommands.size(), expandingBackend, expanded);
+    munit_assert_int(int(expanded[2].type), ==, int(DrawCommandType::DrawTriangles));
+    actual = RenderCommands(expandingBackend, expanded, size, size);
+    munit_assert_memory_equal(expected.size(), expected.data(), actual.data());
+    
+    // Through the context the two draws merge, and the vertices travel at
+    // 16 bytes each in the command stream
+    munit_assert_size(sizeof(lab_vertex_2TC_packed), ==, 16);
+    CommandStream stream;
+    stream.Append(packedCommands);
+    munit_assert_size(stream.GetByteSize(), <, 6 * sizeof(lab_vertex_2TC) + 4 * sizeof(DrawCommand));
+    std::vector<DrawCommand> decoded(stream.begin(), stream.end());
+    munit_assert_size(decoded.size(), ==, packedCommands.size());
+    munit_assert_memory_equal(sizeof(packed[3]) * 3, decoded[3].triangles_packed.vertices, packed + 3);
+    
+    lab_backend_desc backendDesc = {LAB_BACKEND_CPU, size, size, nullptr};
+    lab_render_target_desc rtDesc = {size, size, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    lab_context ctx = nullptr;
+    lab_render_target target = nullptr;
+    munit_assert_int(lab_create_context(&backendDesc, &ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_create_render_target(ctx, &rtDesc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    lab_draw_command commands[3] = {clear_cmd};
+    for (int i = 0; i < 2; ++i) {
+        commands[1 + i].type = LAB_DRAW_COMMAND_TRIANGLES_PACKED;
+        commands[1 + i].triangles_packed.vertices = packed + 3 * i;
+        commands[1 + i].triangles_packed.vertexCount = 3;
+    }
+    munit_assert_int(lab_submit_commands(ctx, commands, 3), ==, LAB_RESULT_OK);
+    lab_command_stats stats = {};
+    munit_assert_int(lab_get_command_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint64(stats.drawsMerged, ==, 1);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    
+    return MUNIT_OK;
+}
+
+// Holds every frame in EndFrame until the gate is opened
+class GatedCPUBackend : public CPUBackend {
+public:
+    lab_result EndFrame() override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_opened.wait(lock, [this] { return m_open; });
+        ++m_framesEnded;
+        return CPUBackend::EndFrame();
+    }
+    
+    void Open() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_open = true;
+        }
+        m_opened.notify_all();
+    }
+    
+    uint32_t GetFramesEnded() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_framesEnded;
+    }
+    
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_opened;
+    bool m_open = false;
+    uint32_t m_framesEnded = 0;
+};
+
+static MunitResult test_render_thread(const MunitParameter params[], void* data) {
+    const uint32_t size = 8;
+    GatedCPUBackend backend;
+    munit_assert_int(backend.Initialize(size, size), ==, LAB_RESULT_OK);
+    RenderTargetDesc rtDesc = {size, size, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    std::shared_ptr<RenderTarget> target;
+    munit_assert_int(backend.CreateRenderTarget(rtDesc, target), ==, LAB_RESULT_OK);
+    munit_assert_int(backend.SetRenderTarget(target.get()), ==, LAB_RESULT_OK);
+    
+    auto frameStream = [](RenderThread& thread, float red) {
+        DrawCommand clear;
+        clear.type = DrawCommandType::Clear;
+        clear.clear.color[0] = red;
+        clear.clear.color[1] = 0.0f;
+        clear.clear.color[2] = 0.0f;
+        clear.clear.color[3] = 1.0f;
+        CommandStream stream = thread.AcquireStream();
+        munit_assert_true(stream.IsEmpty());
+        stream.Append(clear);
+        return stream;
+    };
+    
+    RenderThread thread(backend, 2);
+    munit_assert_uint32(thread.GetMaxQueuedFrames(), ==, 2);
+    
+    // Two frames queue without blocking while the backend is held up
+    munit_assert_uint64(thread.Submit(frameStream(thread, 0.2f), true, true), ==, 1);
+    munit_assert_uint64(thread.Submit(frameStream(thread, 0.4f), true, true), ==, 2);
+    munit_assert_uint64(thread.GetCompletedFence(), ==, 0);
+    
+    // A third waits for room in the queue
+    std::atomic<uint64_t> thirdFence{0};
+    std::thread recorder([&] {
+        thirdFence = thread.Submit(frameStream(thread, 1.0f), true, true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    munit_assert_uint64(thirdFence.load(), ==, 0);
+    munit_assert_uint32(backend.GetFramesEnded(), ==, 0);
+    
+    backend.Open();
+    recorder.join();
+    munit_assert_uint64(thirdFence.load(), ==, 3);
+    thread.Wait(3);
+    munit_assert_uint64(thread.GetCompletedFence(), ==, 3);
+    munit_assert_uint32(backend.GetFramesEnded(), ==, 3);
+    munit_assert_int(thread.TakeError(), ==, LAB_RESULT_OK);
+    
+    // Frames executed in order, the last one is on the target
+    std::vector<uint8_t> pixels(size * size * 4);
+    munit_assert_int(backend.ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size()),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint8(pixels[0], ==, 255);
+    
+    // Backend errors are reported once
+    munit_assert_int(backend.SetRenderTarget(nullptr), ==, LAB_RESULT_OK);
+    thread.Wait(thread.Submit(frameStream(thread, 0.0f), false, false));
+    munit_assert_int(thread.TakeError(), ==, LAB_RESULT_STATE_NO_RENDER_TARGET_SET);
+    munit_assert_int(thread.TakeError(), ==, LAB_RESULT_OK);
+    munit_assert_uint64(thread.GetSubmittedFence(), ==, 4);
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_capture_replay(const MunitParameter params[], void* data) {
+    const uint32_t size = 16;
+    const char* path = "test_capture_replay.lfcp";
+    lab_backend_desc backendDesc = {LAB_BACKEND_CPU, size, size, nullptr};
+    lab_render_target_desc rtDesc = {size, size, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_NONE};
+    lab_context ctx = nullptr;
+    lab_render_target target = nullptr;
+    munit_assert_int(lab_create_context(&backendDesc, &ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_create_render_target(ctx, &rtDesc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_capture(ctx), ==, LAB_RESULT_INVALID_OPERATION);
+    
+    // Drawn before the capture begins, so replay starts from a snapshot
+    lab_draw_command blue = {};
+    blue.type = LAB_DRAW_COMMAND_CLEAR;
+    blue.clear.color[2] = 1.0f;
+    blue.clear.color[3] = 1.0f;
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_commands(ctx, &blue, 1), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_begin_capture(ctx, path), ==, LAB_RESULT_OK);
+    
+    // Uploaded during the capture, so its texels are recorded
+    const uint8_t texels[4 * 4] = {
+        255, 0, 0, 255,    0, 255, 0, 255,
+        0, 255, 0, 255,    255, 0, 0, 255,
+    };
+    lab_texture_desc texDesc = {2, 2, LAB_TEXTURE_FORMAT_RGBA8_UNORM, texels};
+    lab_texture texture = nullptr;
+    munit_assert_int(lab_create_texture(ctx, &texDesc, &texture), ==, LAB_RESULT_OK);
+    
+    lab_vertex_2TC quad[6] = {
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 0.0f, -1.0f}, {1.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 0.0f,  1.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 0.0f,  1.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    lab_vertex_2TC triangle[3] = {
+        {{0.2f, -0.8f}, {0.0f, 0.0f}, {1.0f, 1.0f, 0.0f, 0.5f}},
+        {{0.9f,  0.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 0.0f, 0.5f}},
+        {{0.2f,  0.8f}, {0.0f, 0.0f}, {1.0f, 1.0f, 0.0f, 0.5f}},
+    };
+    // The handle is const in the public struct, which C fills by initializer
+    lab_draw_command bind = {};
+    bind.type = LAB_DRAW_COMMAND_BIND_TEXTURE;
+    new (&bind.bind_texture) decltype(bind.bind_texture){texture, LAB_TEXTURE_FILTER_NEAREST};
+    lab_draw_command unbind = {};
+    unbind.type = LAB_DRAW_COMMAND_BIND_TEXTURE;
+    lab_draw_command textured = {};
+    textured.type = LAB_DRAW_COMMAND_TRIANGLES;
+    textured.triangles.vertices = quad;
+    textured.triangles.vertexCount = 6;
+    lab_draw_command plain = {};
+    plain.type = LAB_DRAW_COMMAND_TRIANGLES;
+    plain.triangles.vertices = triangle;
+    plain.triangles.vertexCount = 3;
+    
+    lab_draw_command frame0[2] = {bind, textured};
+    lab_draw_command frame1[3] = {unbind, plain, plain};
+    munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_commands(ctx, frame0, 2), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_commands(ctx, frame1, 3), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_capture(ctx), ==, LAB_RESULT_OK);
+    
+    lab_render_target_desc desc;
+    uint8_t* expected = nullptr;
+    size_t expectedSize = 0;
+    munit_assert_int(lab_get_render_target_data(ctx, target, &desc, &expected, &expectedSize), ==, LAB_RESULT_OK);
+    munit_assert_size(expectedSize, ==, size * size * 4);
+    lab_destroy_texture(ctx, texture);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    
+    CaptureReplay replay;
+    munit_assert_int(replay.Load(path), ==, LAB_RESULT_OK);
+    munit_assert_uint32(replay.GetFrameCount(), ==, 2);
+    munit_assert_size(replay.GetCommandCount(), ==, 5);
+    munit_assert_uint32(replay.GetBlankTextureCount(), ==, 0);
+    munit_assert_uint32(replay.GetWidth(), ==, size);
+    munit_assert_uint32(replay.GetHeight(), ==, size);
+    
+    // Replayed one command at a time, optimized or not, the image matches
+    CPUBackend backend;
+    munit_assert_int(backend.Initialize(size, size), ==, LAB_RESULT_OK);
+    for (int optimize = 0; optimize < 2; ++optimize) {
+        std::vector<CaptureReplay::CommandTiming> timings;
+        munit_assert_int(replay.Replay(backend, optimize != 0, &timings), ==, LAB_RESULT_OK);
+        munit_assert_size(timings.size(), ==, optimize ? 4 : 5);
+        munit_assert_uint32(timings[0].frame, ==, 0);
+        munit_assert_int(int(timings[1].type), ==, int(DrawCommandType::DrawTriangles));
+        munit_assert_uint32(timings.back().frame, ==, 1);
+        munit_assert_uint32(timings.back().index, ==, optimize ? 1 : 2);
+        for (const auto& timing : timings) {
+            munit_assert_double(timing.seconds, >=, 0.0);
+        }
+        
+        RenderTarget* replayed = replay.GetRenderTarget();
+        munit_assert_not_null(replayed);
+        std::vector<uint8_t> pixels(expectedSize);
+        munit_assert_int(backend.ReadbackTexture(replayed->GetColorTexture(), pixels.data(), pixels.size()),
+                         ==, LAB_RESULT_OK);
+        munit_assert_memory_equal(expectedSize, expected, pixels.data());
+    }
+    lab_free(expected);
+    
+    // Truncated captures, and events larger than the file, are rejected
+    std::vector<uint8_t> bytes;
+    {
+        FILE* file = fopen(path, "rb");
+        munit_assert_not_null(file);
+        fseek(file, 0, SEEK_END);
+        bytes.resize(size_t(ftell(file)));
+        fseek(file, 0, SEEK_SET);
+        munit_assert_size(fread(bytes.data(), 1, bytes.size(), file), ==, bytes.size());
+        fclose(file);
+        file = fopen(path, "wb");
+        fwrite(bytes.data(), 1, bytes.size() - 4, file);
+        fclose(file);
+    }
+    munit_assert_int(replay.Load(path), ==, LAB_RESULT_INVALID_COMMAND_BUFFER);
+    {
+        // Events follow the 8 byte file header as type, id and payload size
+        size_t offset = 8;
+        uint32_t type = 0;
+        uint64_t payload = 0;
+        for (;;) {
+            munit_assert_size(offset + 16, <=, bytes.size());
+            memcpy(&type, &bytes[offset], sizeof(type));
+            memcpy(&payload, &bytes[offset + 8], sizeof(payload));
+            if (type == 3) {  // The first submit
+                break;
+            }
+            offset += 16 + payload;
+        }
+        const uint64_t hugeSize = ~uint64_t(0) / 2;
+        memcpy(&bytes[offset + 8], &hugeSize, sizeof(hugeSize));
+        FILE* file = fopen(path, "wb");
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+    }
+    munit_assert_int(replay.Load(path), ==, LAB_RESULT_INVALID_COMMAND_BUFFER);
+    
+    // So are render targets of unknown formats or anti-aliasing, or too
+    // large, in captures that hold nothing else
+    {
+        struct {
+            uint32_t width, height, format, antialias;
+        } targets[4] = {
+            {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM, LAB_ANTIALIAS_16X},
+            {16, 16, 1000, LAB_ANTIALIAS_NONE},
+            {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM, 3},
+            {65535, 65535, LAB_TEXTURE_FORMAT_RGBA8_UNORM, LAB_ANTIALIAS_16X},
+        };
+        for (int i = 0; i < 4; ++i) {
+            // The file header as captured, then one render target event of
+            // type, id, size and a ResourceInfo without pixels
+            std::vector<uint8_t> file(bytes.begin(), bytes.begin() + 8);
+            const uint32_t event[4] = {6, 1, 24, 0};
+            const uint32_t info[6] = {targets[i].width, targets[i].height, targets[i].format, 0,
+                                      targets[i].antialias, 0};
+            file.insert(file.end(), reinterpret_cast<const uint8_t*>(event),
+                        reinterpret_cast<const uint8_t*>(event) + sizeof(event));
+            file.insert(file.end(), reinterpret_cast<const uint8_t*>(info),
+                        reinterpret_cast<const uint8_t*>(info) + sizeof(info));
+            FILE* out = fopen(path, "wb");
+            fwrite(file.data(), 1, file.size(), out);
+            fclose(out);
+            munit_assert_int(replay.Load(path), ==, (i == 0 ? LAB_RESULT_OK : LAB_RESULT_INVALID_COMMAND_BUFFER));
+        }
+    }
+    munit_assert_uint32(replay.GetFrameCount(), ==, 0);
+    munit_assert_int(replay.Load("does/not/exist.lfcp"), ==, LAB_RESULT_FILE_IO_FAILED);
+    remove(path);
+    
+    return MUNIT_OK;
+}
+
+static MunitResult test_handle_table(const MunitParameter params[], void* data) {
+    HandleTable<int> table;
+    munit_assert_uint32(table.Insert(nullptr), ==, 0);
+    munit_assert_null(table.Get(0));
+    
+    ResourceHandle a = table.Insert(std::make_shared<int>(1));
+    ResourceHandle b = table.Insert(std::make_shared<int>(2));
+    munit_assert_uint32(a, !=, 0);
+    munit_assert_uint32(a, !=, b);
+    munit_assert_int(*table.Get(a), ==, 1);
+    munit_assert_int(*table.GetShared(b), ==, 2);
+    munit_assert_uint32(table.GetCount(), ==, 2);
+    
+    // A removed object's handle goes stale, also once its slot is reused
+    std::shared_ptr<int> removed = table.Remove(a);
+    munit_assert_not_null(removed.get());
+    munit_assert_int(*removed, ==, 1);
+    munit_assert_null(table.Get(a));
+    munit_assert_null(table.Remove(a).get());
+    ResourceHandle c = table.Insert(std::make_shared<int>(3));
+    munit_assert_uint32(c & (HandleTable<int>::kMaxSlots - 1), ==, a & (HandleTable<int>::kMaxSlots - 1));
+    munit_assert_uint32(c, !=, a);
+    munit_assert_null(table.Get(a));
+    munit_assert_int(*table.Get(c), ==, 3);
+    
+    // Lookups from another thread do not lock, and stay valid while the
+    // table grows by several pages
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::thread reader([&] {
+        while (!done.load()) {
+            int* value = table.Get(b);
+            if (!value || *value != 2) {
+                failed = true;
+            }
+        }
+    });
+    std::vector<ResourceHandle> handles;
+    for (int i = 0; i < 5000; ++i) {
+        handles.push_back(table.Insert(std::make_shared<int>(i)));
+    }
+    for (size_t i = 0; i < handles.size(); i += 2) {
+        table.Remove(handles[i]);
+    }
+    done = true;
+    reader.join();
+    munit_assert_false(failed.load());
+    munit_assert_uint32(table.GetCount(), ==, 2 + 2500);
+    munit_assert_int(*table.Get(handles[4999]), ==, 4999);
+    table.Clear();
+    munit_assert_uint32(table.GetCount(), ==, 0);
+    munit_assert_null(table.Get(b));
+    
+    // A lookup racing a Remove and an Insert that reuse its slot returns the
+    // handle's object or null, never the new one. The objects outlive the
+    // table so that a wrong answer can be read safely.
+    {
+        const int kObjects = 200000;
+        std::vector<int> objects(kObjects);
+        HandleTable<int> churn;
+        std::atomic<ResourceHandle> published{0};
+        std::atomic<bool> churning{true};
+        std::atomic<bool> mismatch{false};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 2; ++r) {
+            readers.emplace_back([&] {
+                while (churning.load()) {
+                    ResourceHandle handle = published.load();
+                    int* object = churn.Get(handle);
+                    // Every object goes into the same slot, the i-th with
+                    // generation i % 4095 + 1
+                    if (object && uint32_t((object - objects.data()) % 4095 + 1) !=
+                                      handle >> HandleTable<int>::kIndexBits) {
+                        mismatch = true;
+                    }
+                }
+            });
+        }
+        for (int i = 0; i < kObjects; ++i) {
+            ResourceHandle handle = churn.Insert(std::shared_ptr<int>(&objects[i], [](int*) {}));
+            published.store(handle);
+            churn.Remove(handle);
+        }
+        churning = false;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        munit_assert_false(mismatch.load());
+    }
+    
+    // Resources are identified by handles
+    CPUBackend backend;
+    munit_assert_int(backend.Initialize(4, 4), ==, LAB_RESULT_OK);
+    ResourceManagerImpl resources(&backend);
+    const uint8_t texel[4] = {255, 255, 255, 255};
+    TextureParams texParams = {1, 1, LAB_TEXTURE_FORMAT_RGBA8_UNORM, texel};
+    std::shared_ptr<TextureResource> textures[2];
+    for (auto& texture : textures) {
+        munit_assert_int(resources.CreateTexture(texParams, texture), ==, LAB_RESULT_OK);
+    }
+    munit_assert_uint32(textures[0]->GetHandle(), !=, textures[1]->GetHandle());
+    munit_assert_ptr_equal(resources.LookupResource(textures[0]->GetHandle()), textures[0].get());
+    munit_assert_uint32(resources.GetResourceCount(), ==, 2);
+    ResourceHandle stale = textures[0]->GetHandle();
+    resources.DestroyResource(stale);
+    resources.DestroyResource(stale);
+    munit_assert_null(resources.LookupResource(stale));
+    munit_assert_null(resources.GetResource(stale).get());
+    munit_assert_uint32(resources.GetResourceCount(), ==, 1);
+
+    return MUNIT_OK;
+}
+
+static MunitResult test_texture_pool(const MunitParameter params[], void* data) {
+    CPUBackend backend;
+    munit_assert_int(backend.Initialize(16, 16), ==, LAB_RESULT_OK);
+    ResourceManagerImpl resources(&backend);
+    TexturePool& pool = resources.GetTexturePool();
+
+    // A destroyed texture is reused by the next one of its format and size,
+    // with the new contents or cleared
+    const uint8_t texels[4 * 4] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    TextureParams texParams = {2, 2, LAB_TEXTURE_FORMAT_RGBA8_UNORM, texels};
+    std::shared_ptr<TextureResource> texture;
+    munit_assert_int(resources.CreateTexture(texParams, texture), ==, LAB_RESULT_OK);
+    Texture* backendTexture = texture->texture.get();
+    ResourceHandle handle = texture->GetHandle();
+    texture.reset();
+    resources.DestroyResource(handle);
+    munit_assert_uint32(pool.GetStats().pooledCount, ==, 1);
+    munit_assert_size(pool.GetStats().pooledBytes, ==, 16);
+
+    texParams.data = nullptr;
+    munit_assert_int(resources.CreateTexture(texParams, texture), ==, LAB_RESULT_OK);
+    munit_assert_ptr_equal(texture->texture.get(), backendTexture);
+    const uint8_t* contents = static_cast<CPUTexture*>(backendTexture)->GetData();
+    for (int i = 0; i < 16; ++i) {
+        munit_assert_uint8(contents[i], ==, 0);
+    }
+    TexturePool::Stats stats = pool.GetStats();
+    munit_assert_uint64(stats.hits, ==, 1);
+    munit_assert_uint64(stats.misses, ==, 1);
+    munit_assert_uint32(stats.pooledCount, ==, 0);
+
+    // Other formats and sizes are created anew
+    std::shared_ptr<TextureResource> other;
+    TextureParams r8Params = {2, 2, LAB_TEXTURE_FORMAT_R8_UNORM, nullptr};
+    munit_assert_int(resources.CreateTexture(r8Params, other), ==, LAB_RESULT_OK);
+    munit_assert_uint64(pool.GetStats().misses, ==, 2);
+
+    // Resources still referenced elsewhere keep their backend objects
+    resources.DestroyResource(other->GetHandle());
+    munit_assert_not_null(other->texture.get());
+    munit_assert_uint32(pool.GetStats().pooledCount, ==, 0);
+
+    // Render targets come back as new, and resizes recycle too
+    RenderTargetParams rtParams = {8, 8, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false, LAB_ANTIALIAS_4X};
+    std::shared_ptr<RenderTargetResource> target;
+    munit_assert_int(resources.CreateRenderTarget(rtParams, target), ==, LAB_RESULT_OK);
+    auto cpuTarget = static_cast<CPURenderTarget*>(target->GetBackendTarget());
+    munit_assert_int(backend.SetRenderTarget(cpuTarget), ==, LAB_RESULT_OK);
+    DrawCommand clear = {};
+    clear.type = DrawCommandType::Clear;
+    clear.clear.color[0] = 1.0f;
+    clear.clear.color[3] = 1.0f;
+    munit_assert_int(backend.SubmitCommands({clear}), ==, LAB_RESULT_OK);
+    lab_rect rects[4];
+    uint32_t rectCount = 0;
+    std::vector<uint8_t> pixels(8 * 8 * 4);
+    munit_assert_int(backend.ReadbackChanges(cpuTarget, pixels.data(), pixels.size(), rects, 4, rectCount),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint32(cpuTarget->GetDirtyRegion().GetCount(), ==, 0);
+
+    handle = target->GetHandle();
+    target.reset();
+    resources.DestroyResource(handle);
+    munit_assert_size(pool.GetStats().pooledBytes, ==,
+                      TexturePool::GetRenderTargetBytes(8, 8, LAB_TEXTURE_FORMAT_RGBA8_UNORM, false,
+                                                        LAB_ANTIALIAS_4X));
+    munit_assert_int(resources.CreateRenderTarget(rtParams, target), ==, LAB_RESULT_OK);
+    munit_assert_ptr_equal(target->GetBackendTarget(), cpuTarget);
+    auto color = static_cast<CPUTexture*>(cpuTarget->GetColorTexture());
+    munit_assert_uint8(color->GetData()[0], ==, 0);
+    munit_assert_uint32(cpuTarget->GetDirtyRegion().GetCount(), ==, 1);
+
+    munit_assert_int(resources.ResizeRenderTarget(target.get(), 4, 4), ==, LAB_RESULT_OK);
+    munit_assert_uint32(target->GetBackendTarget()->GetWidth(), ==, 4);
+    munit_assert_uint32(pool.GetStats().pooledCount, ==, 1);
+    munit_assert_int(resources.ResizeRenderTarget(target.get(), 8, 8), ==, LAB_RESULT_OK);
+    munit_assert_ptr_equal(target->GetBackendTarget(), cpuTarget);
+
+    // Releases past the budget free what was released longest ago
+    handle = texture->GetHandle();
+    texture.reset();
+    resources.DestroyResource(handle);
+    munit_assert_uint32(pool.GetStats().pooledCount, ==, 2);
+    pool.SetBudget(16);
+    stats = pool.GetStats();
+    munit_assert_uint32(stats.pooledCount, ==, 1);
+    munit_assert_size(stats.pooledBytes, ==, 16);
+    munit_assert_uint64(stats.evictions, ==, 1);
+
+    // Without a budget nothing is pooled
+    pool.SetBudget(0);
+    munit_assert_uint32(pool.GetStats().pooledCount, ==, 0);
+    handle = target->GetHandle();
+    target.reset();
+    resources.DestroyResource(handle);
+    munit_assert_uint32(pool.GetStats().pooledCount, ==, 0);
+
+    return MUNIT_OK;
+}
+
+// The x of the viewport in effect at each draw
+static std::vector<float> ViewportsAtDraws(const std::vector<DrawCommand>& commands) {
+    std::vector<float> viewports;
+    float x = -1.0f;
+    for (const DrawCommand& command : commands) {
+        if (command.type == DrawCommandType::SetViewport || command.type == DrawCommandType::SetViewportAPI) {
+            x = command.viewport.x;
+        } else if (command.type == DrawCommandType::DrawTriangles) {
+            viewports.push_back(x);
+        }
+    }
+    return viewports;
+}
+
+static MunitResult test_viewport_state(const MunitParameter params[], void* data) {
+    const lab_vertex_2TC triangles[2][3] = {};
+    DrawCommand api = DrawCommand::CreateViewportCommand(1.0f, 0.0f, 8.0f, 8.0f);
+    api.type = DrawCommandType::SetViewportAPI;
+    DrawCommand internal = DrawCommand::CreateViewportCommand(2.0f, 0.0f, 8.0f, 8.0f);
+    DrawCommand draws[2];
+    for (int i = 0; i < 2; ++i) {
+        draws[i].type = DrawCommandType::DrawTriangles;
+        draws[i].triangles.vertices = triangles[i];
+        draws[i].triangles.vertexCount = 3;
+    }
+    
+    // Both viewport commands set the same state, so the second API viewport
+    // is a change even though it repeats the first
+    std::vector<DrawCommand> commands = {api, internal, draws[0], api, draws[1]};
+    lab_command_stats stats = {};
+    std::vector<DrawCommand> optimized;
+    CommandOptimizer optimizer;
+    optimizer.Optimize(commands.data(), commands.size(), optimized, stats);
+    std::vector<float> expected = {2.0f, 1.0f};
+    munit_assert_true(ViewportsAtDraws(optimized) == expected);
+    munit_assert_uint64(stats.stateChangesDropped, ==, 1);
+    
+    std::vector<DrawCommand> sorted;
+    CommandSorter sorter;
+    sorter.Sort(commands.data(), commands.size(), sorted, stats);
+    munit_assert_true(ViewportsAtDraws(sorted) == expected);
+    
+    return MUNIT_OK;
+}
+
 static MunitTest backend_tests[] = {
     {
         (char*)"/texture_creation",
@@ -240,6 +2130,158 @@ static MunitTest backend_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        (char*)"/triangle_fill_rule",
+        test_triangle_fill_rule,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/span_kernels_match_scalar",
+        test_span_kernels_match_scalar,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/blend_modes",
+        test_blend_modes,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/scissor",
+        test_scissor,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/antialiasing",
+        test_antialiasing,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/textured_triangles",
+        test_textured_triangles,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/tiled_rendering_matches_serial",
+        test_tiled_rendering_matches_serial,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/steady_state_allocations",
+        test_steady_state_allocations,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/command_history",
+        test_command_history,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/readback_changes",
+        test_readback_changes,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/viewport_state",
+        test_viewport_state,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/parallel_encoders",
+        test_parallel_encoders,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/command_stream",
+        test_command_stream,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/indexed_and_quads",
+        test_indexed_and_quads,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/packed_vertices",
+        test_packed_vertices,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/render_thread",
+        test_render_thread,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/capture_replay",
+        test_capture_replay,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/handle_table",
+        test_handle_table,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/texture_pool",
+        test_texture_pool,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -1,5 +1,8 @@
 #include <munit.h>
 #include <labfont/labfont.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 static MunitResult test_context_creation(const MunitParameter params[], void* data) {
     lab_context ctx = NULL;
@@ -46,6 +49,584 @@ static MunitResult test_context_creation(const MunitParameter params[], void* da
 // Note: The resize and state tests are removed because the functions they test
 // (lab_resize_context, lab_clear, lab_set_viewport) don't exist in the current API
 
+static MunitResult test_command_list(const MunitParameter params[], void* data) {
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_context ctx = NULL;
+    munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+    
+    lab_render_target_desc rt_desc = {
+        .width = 16,
+        .height = 16,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_render_target(ctx, &rt_desc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    
+    lab_command_list list = NULL;
+    munit_assert_int(lab_create_command_list(ctx, &list), ==, LAB_RESULT_OK);
+    munit_assert_not_null(list);
+    
+    // Record a full-target triangle from a buffer that is wiped right after
+    lab_vertex_2TC* vertices = (lab_vertex_2TC*)malloc(3 * sizeof(lab_vertex_2TC));
+    const lab_vertex_2TC triangle[3] = {
+        {{-1.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 3.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{-1.0f,  3.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+    };
+    memcpy(vertices, triangle, sizeof(triangle));
+    lab_draw_command commands[2] = {
+        {.type = LAB_DRAW_COMMAND_CLEAR, .clear = {.color = {1.0f, 0.0f, 0.0f, 1.0f}}},
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = vertices, .vertexCount = 3}},
+    };
+    munit_assert_int(lab_record_commands(list, commands, 2), ==, LAB_RESULT_OK);
+    memset(vertices, 0, 3 * sizeof(lab_vertex_2TC));
+    free(vertices);
+    
+    // An invalid command rejects the whole call and leaves the list as it was
+    lab_draw_command invalid[2] = {
+        commands[0],
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = NULL, .vertexCount = 3}},
+    };
+    munit_assert_int(lab_record_commands(list, invalid, 2), ==, LAB_RESULT_INVALID_PARAMETER);
+    
+    uint8_t* pixels = NULL;
+    size_t size = 0;
+    for (int frame = 0; frame < 2; ++frame) {
+        munit_assert_int(lab_submit_command_list(ctx, list), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels, &size), ==, LAB_RESULT_OK);
+        munit_assert_size(size, ==, 16 * 16 * 4);
+        for (size_t i = 0; i < 16 * 16; ++i) {
+            munit_assert_uint8(pixels[i * 4 + 0], ==, 0);
+            munit_assert_uint8(pixels[i * 4 + 1], ==, 255);
+        }
+    }
+    
+    // After a reset the list submits nothing
+    munit_assert_int(lab_reset_command_list(list), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_command_list(ctx, list), ==, LAB_RESULT_OK);
+    
+    // Another context can neither submit nor destroy the list
+    lab_context other = NULL;
+    munit_assert_int(lab_create_context(&backend_desc, &other), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_command_list(other, list), ==, LAB_RESULT_INVALID_PARAMETER);
+    lab_destroy_command_list(other, list);
+    munit_assert_int(lab_record_commands(list, commands, 1), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_command_list(ctx, list), ==, LAB_RESULT_OK);
+    lab_destroy_context(other);
+    
+    lab_free(pixels);
+    lab_destroy_command_list(ctx, list);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+static MunitResult test_command_optimization(const MunitParameter params[], void* data) {
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_context ctx = NULL;
+    munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+    
+    lab_render_target_desc rt_desc = {
+        .width = 16,
+        .height = 16,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_render_target(ctx, &rt_desc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    
+    // A red triangle over the whole target, then a green one over its left
+    // half, in separate arrays
+    const lab_vertex_2TC red[3] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 3.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f,  3.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+    };
+    const lab_vertex_2TC green[6] = {
+        {{-1.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 0.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 0.0f,  1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{-1.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 0.0f,  1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+    };
+    lab_draw_command viewport = {
+        .type = LAB_DRAW_COMMAND_SET_VIEWPORT,
+        .set_viewport = {.x = 0.0f, .y = 0.0f, .width = 1.0f, .height = 1.0f}
+    };
+    lab_draw_command unbind = {.type = LAB_DRAW_COMMAND_BIND_TEXTURE};
+    lab_draw_command commands[7] = {
+        viewport,
+        viewport,  // Overwritten before any draw
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = red, .vertexCount = 3}},
+        viewport,  // Same as the current state
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = green, .vertexCount = 6}},
+        unbind,
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = green, .vertexCount = 0}},
+    };
+    munit_assert_int(lab_reset_command_stats(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_commands(ctx, commands, 7), ==, LAB_RESULT_OK);
+    
+    // Viewport, the two merged triangles and the trailing texture binding
+    lab_command_stats stats;
+    munit_assert_int(lab_get_command_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint64(stats.commandsSubmitted, ==, 7);
+    munit_assert_uint64(stats.commandsExecuted, ==, 3);
+    munit_assert_uint64(stats.drawsMerged, ==, 1);
+    munit_assert_uint64(stats.stateChangesDropped, ==, 2);
+    
+    uint8_t* pixels = NULL;
+    size_t size = 0;
+    munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels, &size), ==, LAB_RESULT_OK);
+    for (int x = 0; x < 16; ++x) {
+        const uint8_t* pixel = &pixels[(8 * 16 + x) * 4];
+        munit_assert_uint8(pixel[0], ==, x < 8 ? 0 : 255);
+        munit_assert_uint8(pixel[1], ==, x < 8 ? 255 : 0);
+    }
+    
+    lab_free(pixels);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+static MunitResult test_frame_arena(const MunitParameter params[], void* data) {
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_context ctx = NULL;
+    munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+    
+    lab_render_target_desc rt_desc = {
+        .width = 16,
+        .height = 16,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_render_target(ctx, &rt_desc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    
+    munit_assert_null(lab_frame_alloc(NULL, 16));
+    munit_assert_null(lab_frame_alloc(ctx, 0));
+    
+    // Each frame draws from frame memory, including an allocation larger
+    // than a block; earlier frames' memory is untouched until recycled
+    lab_vertex_2TC* first[3] = {NULL};
+    size_t allocated = 0;
+    for (int frame = 0; frame < 8; ++frame) {
+        if (frame == 6) {
+            allocated = lab_get_memory_stats().totalAllocated;
+        }
+        munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+        lab_vertex_2TC* vertices = lab_frame_alloc_vertices(ctx, 3);
+        munit_assert_not_null(vertices);
+        munit_assert_size((uintptr_t)vertices % 16, ==, 0);
+        const float shade = frame / 8.0f;
+        for (int i = 0; i < 3; ++i) {
+            lab_vertex_2TC v = {{i == 1 ? 3.0f : -1.0f, i == 2 ? 3.0f : -1.0f}, {0, 0}, {shade, 1.0f, 0.0f, 1.0f}};
+            vertices[i] = v;
+        }
+        uint8_t* bulk = (uint8_t*)lab_frame_alloc(ctx, 100 * 1024);
+        munit_assert_not_null(bulk);
+        memset(bulk, 0xcd, 100 * 1024);
+        
+        if (frame >= 6) {
+            // The slot used three frames ago is reused from its start once
+            // its blocks have been merged
+            munit_assert_ptr_equal(vertices, first[frame % 3]);
+        }
+        first[frame % 3] = vertices;
+        if (frame >= 2) {
+            for (int f = 1; f < 3; ++f) {
+                munit_assert_ptr_not_equal(first[(frame + f) % 3], vertices);
+                munit_assert_float(first[(frame + f) % 3][0].color[0], ==, (frame - 3 + f) / 8.0f);
+            }
+        }
+        
+        lab_draw_command draw = {
+            .type = LAB_DRAW_COMMAND_TRIANGLES,
+            .triangles = {.vertices = vertices, .vertexCount = 3}
+        };
+        munit_assert_int(lab_submit_commands(ctx, &draw, 1), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    }
+    
+    // Once every frame's blocks have been merged nothing more is allocated
+    munit_assert_size(lab_get_memory_stats().totalAllocated, ==, allocated);
+    
+    uint8_t* pixels = NULL;
+    size_t size = 0;
+    munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels, &size), ==, LAB_RESULT_OK);
+    munit_assert_uint8(pixels[0], ==, (uint8_t)(7 / 8.0f * 255.0f + 0.5f));
+    munit_assert_uint8(pixels[1], ==, 255);
+    
+    lab_free(pixels);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+static MunitResult test_pipelined_frames(const MunitParameter params[], void* data) {
+    // The same frames rendered synchronously and through a render thread
+    lab_context contexts[2] = {NULL};
+    lab_render_target targets[2] = {NULL};
+    for (int c = 0; c < 2; ++c) {
+        lab_backend_desc backend_desc = {
+            .type = LAB_BACKEND_CPU,
+            .width = 16,
+            .height = 16,
+            .native_window = NULL,
+            .pipelined_frames = c == 0 ? 0 : 2
+        };
+        munit_assert_int(lab_create_context(&backend_desc, &contexts[c]), ==, LAB_RESULT_OK);
+        lab_render_target_desc rt_desc = {
+            .width = 16,
+            .height = 16,
+            .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+            .hasDepth = false
+        };
+        munit_assert_int(lab_create_render_target(contexts[c], &rt_desc, &targets[c]), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_set_render_target(contexts[c], targets[c]), ==, LAB_RESULT_OK);
+    }
+    
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    munit_assert_int(lab_get_frame_fences(NULL, &submitted, &completed), ==, LAB_RESULT_INVALID_CONTEXT);
+    munit_assert_int(lab_get_frame_fences(contexts[1], NULL, &completed), ==, LAB_RESULT_INVALID_PARAMETER);
+    
+    for (int frame = 0; frame < 10; ++frame) {
+        for (int c = 0; c < 2; ++c) {
+            munit_assert_int(lab_begin_frame(contexts[c]), ==, LAB_RESULT_OK);
+            lab_vertex_2TC* vertices = lab_frame_alloc_vertices(contexts[c], 3);
+            for (int i = 0; i < 3; ++i) {
+                lab_vertex_2TC v = {
+                    {-1.0f + frame * 0.1f + (i == 1 ? 1.5f : 0.0f), i == 2 ? 1.0f : -1.0f},
+                    {0, 0},
+                    {frame / 10.0f, 1.0f, 0.5f, 1.0f}
+                };
+                vertices[i] = v;
+            }
+            lab_draw_command commands[2] = {
+                {.type = LAB_DRAW_COMMAND_CLEAR, .clear = {.color = {0.0f, 0.0f, frame / 10.0f, 1.0f}}},
+                {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = vertices, .vertexCount = 3}},
+            };
+            munit_assert_int(lab_submit_commands(contexts[c], commands, 2), ==, LAB_RESULT_OK);
+            munit_assert_int(lab_end_frame(contexts[c]), ==, LAB_RESULT_OK);
+            
+            munit_assert_int(lab_get_frame_fences(contexts[c], &submitted, &completed), ==, LAB_RESULT_OK);
+            if (c == 0) {
+                munit_assert_uint64(submitted, ==, (uint64_t)frame + 1);
+                munit_assert_uint64(completed, ==, submitted);
+            }
+        }
+    }
+    
+    // Waiting for the last frame; the readback would wait as well
+    munit_assert_int(lab_wait_for_frame(contexts[1], submitted), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_get_frame_fences(contexts[1], &submitted, &completed), ==, LAB_RESULT_OK);
+    munit_assert_uint64(completed, >=, submitted);
+    
+    uint8_t* pixels[2] = {NULL};
+    size_t size = 0;
+    for (int c = 0; c < 2; ++c) {
+        munit_assert_int(lab_get_render_target_data(contexts[c], targets[c], NULL, &pixels[c], &size),
+                         ==, LAB_RESULT_OK);
+    }
+    munit_assert_memory_equal(size, pixels[0], pixels[1]);
+    
+    // A readback mid-frame sees what was submitted so far
+    munit_assert_int(lab_begin_frame(contexts[1]), ==, LAB_RESULT_OK);
+    lab_draw_command clear = {.type = LAB_DRAW_COMMAND_CLEAR, .clear = {.color = {1.0f, 0.0f, 0.0f, 1.0f}}};
+    munit_assert_int(lab_submit_commands(contexts[1], &clear, 1), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_get_render_target_data(contexts[1], targets[1], NULL, &pixels[1], &size),
+                     ==, LAB_RESULT_OK);
+    munit_assert_uint8(pixels[1][0], ==, 255);
+    munit_assert_int(lab_end_frame(contexts[1]), ==, LAB_RESULT_OK);
+    
+    for (int c = 0; c < 2; ++c) {
+        lab_free(pixels[c]);
+        lab_destroy_render_target(contexts[c], targets[c]);
+        lab_destroy_context(contexts[c]);
+    }
+    return MUNIT_OK;
+}
+
+static MunitResult test_draw_sorting(const MunitParameter params[], void* data) {
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_render_target_desc rt_desc = {
+        .width = 16,
+        .height = 16,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    const uint8_t green[4] = {0, 255, 0, 255};
+    const uint8_t blue[4] = {0, 0, 255, 255};
+    
+    // Quadrants alternating between two textures, and a full target
+    // background in red
+    lab_vertex_2TC quads[4][6];
+    for (int q = 0; q < 4; ++q) {
+        float x0 = (q % 2) ? 0.0f : -1.0f;
+        float y0 = (q / 2) ? 0.0f : -1.0f;
+        const float corners[6][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1}};
+        for (int v = 0; v < 6; ++v) {
+            lab_vertex_2TC vertex = {{x0 + corners[v][0], y0 + corners[v][1]}, {0, 0}, {1, 1, 1, 1}};
+            quads[q][v] = vertex;
+        }
+    }
+    const lab_vertex_2TC red[3] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 3.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f,  3.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+    };
+    
+    uint8_t* pixels[2] = {NULL};
+    size_t size = 0;
+    lab_command_stats stats[2];
+    for (int sorted = 0; sorted < 2; ++sorted) {
+        lab_context ctx = NULL;
+        lab_render_target target = NULL;
+        lab_texture textures[2] = {NULL};
+        munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_create_render_target(ctx, &rt_desc, &target), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+        lab_texture_desc tex_desc[2] = {
+            {1, 1, LAB_TEXTURE_FORMAT_RGBA8_UNORM, green},
+            {1, 1, LAB_TEXTURE_FORMAT_RGBA8_UNORM, blue},
+        };
+        for (int t = 0; t < 2; ++t) {
+            munit_assert_int(lab_create_texture(ctx, &tex_desc[t], &textures[t]), ==, LAB_RESULT_OK);
+        }
+        lab_draw_command bind[3] = {
+            {.type = LAB_DRAW_COMMAND_BIND_TEXTURE, .bind_texture = {.texture = textures[0]}},
+            {.type = LAB_DRAW_COMMAND_BIND_TEXTURE, .bind_texture = {.texture = textures[1]}},
+            {.type = LAB_DRAW_COMMAND_BIND_TEXTURE},
+        };
+        lab_draw_command draw[5] = {
+            {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = quads[0], .vertexCount = 6}},
+            {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = quads[1], .vertexCount = 6}},
+            {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = quads[2], .vertexCount = 6}},
+            {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = quads[3], .vertexCount = 6}},
+            {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = red, .vertexCount = 3}},
+        };
+        lab_draw_command layer[2] = {
+            {.type = LAB_DRAW_COMMAND_SET_LAYER, .set_layer = {.layer = 0}},
+            {.type = LAB_DRAW_COMMAND_SET_LAYER, .set_layer = {.layer = 1}},
+        };
+        
+        munit_assert_int(lab_reset_command_stats(ctx), ==, LAB_RESULT_OK);
+        if (sorted) {
+            // The background comes last but is in the lower layer
+            lab_draw_command commands[12] = {
+                layer[1], bind[0], draw[0], bind[1], draw[1], bind[0], draw[2], bind[1], draw[3],
+                layer[0], bind[2], draw[4],
+            };
+            munit_assert_int(lab_set_draw_sorting(ctx, true), ==, LAB_RESULT_OK);
+            munit_assert_int(lab_submit_commands(ctx, commands, 12), ==, LAB_RESULT_OK);
+        } else {
+            // The order sorting should produce; layers are ignored
+            lab_draw_command commands[9] = {
+                layer[1], bind[2], draw[4], bind[0], draw[0], draw[2], bind[1], draw[1], draw[3],
+            };
+            munit_assert_int(lab_submit_commands(ctx, commands, 9), ==, LAB_RESULT_OK);
+        }
+        munit_assert_int(lab_get_command_stats(ctx, &stats[sorted]), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels[sorted], &size),
+                         ==, LAB_RESULT_OK);
+        
+        if (sorted) {
+            // A draw in a higher layer that relies on the texture bound by an
+            // earlier submission cannot follow a binding in a lower layer, so
+            // the submission keeps its order
+            lab_draw_command commands[5] = {layer[1], draw[0], layer[0], bind[1], draw[1]};
+            lab_command_stats before;
+            munit_assert_int(lab_get_command_stats(ctx, &before), ==, LAB_RESULT_OK);
+            munit_assert_int(lab_submit_commands(ctx, commands, 5), ==, LAB_RESULT_OK);
+            lab_command_stats after;
+            munit_assert_int(lab_get_command_stats(ctx, &after), ==, LAB_RESULT_OK);
+            munit_assert_uint64(after.drawsReordered, ==, before.drawsReordered);
+        }
+        
+        for (int t = 0; t < 2; ++t) {
+            lab_destroy_texture(ctx, textures[t]);
+        }
+        lab_destroy_render_target(ctx, target);
+        lab_destroy_context(ctx);
+    }
+    
+    // Same image and state changes as submitting in the sorted order
+    munit_assert_memory_equal(size, pixels[0], pixels[1]);
+    munit_assert_uint8(pixels[1][0], ==, 0);
+    munit_assert_uint8(pixels[1][1], ==, 255);
+    munit_assert_uint64(stats[1].drawsReordered, ==, 4);
+    munit_assert_uint64(stats[1].drawsMerged, ==, 2);
+    munit_assert_uint64(stats[1].commandsExecuted, ==, stats[0].commandsExecuted + 1);
+    
+    for (int c = 0; c < 2; ++c) {
+        lab_free(pixels[c]);
+    }
+    return MUNIT_OK;
+}
+
+// Draws ending in a partial primitive look the same submitted together as
+// submitted one at a time
+static MunitResult test_partial_primitives(const MunitParameter params[], void* data) {
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_render_target_desc rt_desc = {
+        .width = 16,
+        .height = 16,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    // A triangle on the left with a stray vertex, then one on the right
+    const lab_vertex_2TC left[4] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 0.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f,  0.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+    };
+    const lab_vertex_2TC right[3] = {
+        {{0.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{1.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{1.0f,  1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+    };
+    lab_draw_command commands[5] = {
+        {.type = LAB_DRAW_COMMAND_CLEAR, .clear = {.color = {0.0f, 0.0f, 0.0f, 1.0f}}},
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = left, .vertexCount = 4}},
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = right, .vertexCount = 3}},
+        {.type = LAB_DRAW_COMMAND_LINES, .lines = {.vertices = left, .vertexCount = 3, .lineWidth = 1.0f}},
+        {.type = LAB_DRAW_COMMAND_LINES, .lines = {.vertices = right, .vertexCount = 2, .lineWidth = 1.0f}},
+    };
+    
+    uint8_t* pixels[2] = {NULL, NULL};
+    size_t size = 0;
+    for (int together = 0; together < 2; ++together) {
+        lab_context ctx = NULL;
+        lab_render_target target = NULL;
+        munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_create_render_target(ctx, &rt_desc, &target), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+        if (together) {
+            munit_assert_int(lab_submit_commands(ctx, commands, 5), ==, LAB_RESULT_OK);
+        } else {
+            for (int i = 0; i < 5; ++i) {
+                munit_assert_int(lab_submit_commands(ctx, &commands[i], 1), ==, LAB_RESULT_OK);
+            }
+        }
+        munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels[together], &size),
+                         ==, LAB_RESULT_OK);
+        lab_destroy_render_target(ctx, target);
+        lab_destroy_context(ctx);
+    }
+    munit_assert_memory_equal(size, pixels[0], pixels[1]);
+    
+    for (int i = 0; i < 2; ++i) {
+        lab_free(pixels[i]);
+    }
+    return MUNIT_OK;
+}
+
+// Layer commands recorded into lists and encoders sort as submitted ones do
+static MunitResult test_layered_recording(const MunitParameter params[], void* data) {
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_render_target_desc rt_desc = {
+        .width = 16,
+        .height = 16,
+        .format = LAB_TEXTURE_FORMAT_RGBA8_UNORM,
+        .hasDepth = false
+    };
+    lab_context ctx = NULL;
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_create_render_target(ctx, &rt_desc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_draw_sorting(ctx, true), ==, LAB_RESULT_OK);
+    
+    const lab_vertex_2TC red[3] = {
+        {{-1.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{ 3.0f, -1.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+        {{-1.0f,  3.0f}, {0, 0}, {1.0f, 0.0f, 0.0f, 1.0f}},
+    };
+    const lab_vertex_2TC green[3] = {
+        {{-1.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{ 3.0f, -1.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+        {{-1.0f,  3.0f}, {0, 0}, {0.0f, 1.0f, 0.0f, 1.0f}},
+    };
+    lab_draw_command top[2] = {
+        {.type = LAB_DRAW_COMMAND_SET_LAYER, .set_layer = {.layer = 1}},
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = red, .vertexCount = 3}},
+    };
+    lab_draw_command bottom[2] = {
+        {.type = LAB_DRAW_COMMAND_SET_LAYER, .set_layer = {.layer = 0}},
+        {.type = LAB_DRAW_COMMAND_TRIANGLES, .triangles = {.vertices = green, .vertexCount = 3}},
+    };
+    uint8_t* pixels = NULL;
+    size_t size = 0;
+    
+    // The green triangle comes last but is in the lower layer
+    lab_command_list list = NULL;
+    munit_assert_int(lab_create_command_list(ctx, &list), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_record_commands(list, top, 2), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_record_commands(list, bottom, 2), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_command_list(ctx, list), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels, &size), ==, LAB_RESULT_OK);
+    munit_assert_uint8(pixels[0], ==, 255);
+    munit_assert_uint8(pixels[1], ==, 0);
+    lab_destroy_command_list(ctx, list);
+    
+    // Each encoder starts in layer zero, so the layer set by the first does
+    // not carry over to the green triangle of the second
+    lab_encoder encoders[2] = {NULL, NULL};
+    munit_assert_int(lab_create_encoder(ctx, 0, &encoders[0]), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_create_encoder(ctx, 1, &encoders[1]), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_encode_commands(encoders[0], top, 2), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_encode_commands(encoders[1], &bottom[1], 1), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels, &size), ==, LAB_RESULT_OK);
+    munit_assert_uint8(pixels[0], ==, 255);
+    munit_assert_uint8(pixels[1], ==, 0);
+    lab_free(pixels);
+    
+    lab_destroy_encoder(ctx, encoders[0]);
+    lab_destroy_encoder(ctx, encoders[1]);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
 static MunitTest context_tests[] = {
     {
         "/creation",
@@ -55,6 +636,62 @@ static MunitTest context_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/command_list",
+        test_command_list,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/command_optimization",
+        test_command_optimization,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/partial_primitives",
+        test_partial_primitives,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/layered_recording",
+        test_layered_recording,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/frame_arena",
+        test_frame_arena,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/pipelined_frames",
+        test_pipelined_frames,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/draw_sorting",
+        test_draw_sorting,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -0,0 +1,164 @@
+#include <munit.h>
+#include <labfont/labfont.h>
+#include <thread>
+
+// Statistics over allocations and frees made on several threads. Each thread
+// counts into its own block of counters, which the memory manager folds into
+// its totals when the thread exits and hands to the next new thread.
+
+static void assert_stats(size_t allocated, size_t freed) {
+    lab_memory_stats stats = lab_get_memory_stats();
+    munit_assert_size(stats.totalAllocated, ==, allocated);
+    munit_assert_size(stats.totalFreed, ==, freed);
+    munit_assert_size(stats.currentUsage, ==, allocated - freed);
+}
+
+// Test that a block freed on another thread than it was allocated on
+// balances in the totals and in its category
+static MunitResult test_cross_thread_free(const MunitParameter params[], void* data) {
+    lab_reset_memory_stats();
+
+    void* fromWorker = NULL;
+    std::thread([&] { fromWorker = lab_alloc(1000, LAB_MEMORY_GRAPHICS); }).join();
+    munit_assert_not_null(fromWorker);
+    void* fromMain = lab_alloc(300, LAB_MEMORY_TEXT);
+    munit_assert_not_null(fromMain);
+    assert_stats(1300, 0);
+
+    // The worker above has exited, so this one may reuse its counters
+    lab_free(fromWorker);
+    std::thread([&] { lab_free(fromMain); }).join();
+    assert_stats(1300, 1300);
+    lab_memory_stats stats = lab_get_memory_stats();
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_GRAPHICS], ==, 0);
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_TEXT], ==, 0);
+    return MUNIT_OK;
+}
+
+// Test that the counts of exited threads stay in the totals, also once
+// their counters serve another thread
+static MunitResult test_thread_exit(const MunitParameter params[], void* data) {
+    lab_reset_memory_stats();
+
+    void* first = NULL;
+    std::thread([&] { first = lab_alloc(1000, LAB_MEMORY_GRAPHICS); }).join();
+    assert_stats(1000, 0);
+
+    void* second = NULL;
+    std::thread([&] {
+        second = lab_alloc(500, LAB_MEMORY_TEXT);
+        lab_free(first);
+    }).join();
+    assert_stats(1500, 1000);
+    lab_memory_stats stats = lab_get_memory_stats();
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_GRAPHICS], ==, 0);
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_TEXT], ==, 500);
+
+    lab_free(second);
+    assert_stats(1500, 1500);
+    return MUNIT_OK;
+}
+
+// Test that resetting the statistics starts them from zero, whichever
+// threads counted before
+static MunitResult test_reset_baseline(const MunitParameter params[], void* data) {
+    void* live = lab_alloc(300, LAB_MEMORY_GENERAL);
+    void* exited = NULL;
+    std::thread([&] { exited = lab_alloc(700, LAB_MEMORY_RESOURCES); }).join();
+    lab_memory_stats stats = lab_get_memory_stats();
+    munit_assert_size(stats.currentUsage, >=, 1000);
+
+    lab_reset_memory_stats();
+    assert_stats(0, 0);
+    stats = lab_get_memory_stats();
+    munit_assert_size(stats.peakUsage, ==, 0);
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_GENERAL], ==, 0);
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_RESOURCES], ==, 0);
+
+    void* fresh = NULL;
+    std::thread([&] { fresh = lab_alloc(200, LAB_MEMORY_GENERAL); }).join();
+    assert_stats(200, 0);
+    stats = lab_get_memory_stats();
+    munit_assert_size(stats.peakUsage, ==, 200);
+    munit_assert_size(stats.categoryUsage[LAB_MEMORY_GENERAL], ==, 200);
+    lab_free(fresh);
+    assert_stats(200, 200);
+
+    lab_free(live);
+    lab_free(exited);
+    return MUNIT_OK;
+}
+
+// Frees its block when the thread exits
+struct ThreadExitFree {
+    void* block = nullptr;
+    ~ThreadExitFree() { lab_free(block); }
+};
+
+// Test that a free from a thread_local destructor that runs after the
+// thread's counters are retired is still counted
+static MunitResult test_free_after_retire(const MunitParameter params[], void* data) {
+    lab_reset_memory_stats();
+
+    std::thread([] {
+        // Constructed before the thread's counters, so destroyed after them
+        thread_local ThreadExitFree holder;
+        holder.block = lab_alloc(400, LAB_MEMORY_TEXT);
+    }).join();
+    assert_stats(400, 400);
+    munit_assert_size(lab_get_memory_stats().categoryUsage[LAB_MEMORY_TEXT], ==, 0);
+
+    // The retired counters serve the next thread as before
+    void* block = NULL;
+    std::thread([&] { block = lab_alloc(100, LAB_MEMORY_TEXT); }).join();
+    assert_stats(500, 400);
+    lab_free(block);
+    assert_stats(500, 500);
+    return MUNIT_OK;
+}
+
+static MunitTest memory_thread_tests[] = {
+    {
+        (char*)"/cross_thread_free",
+        test_cross_thread_free,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/thread_exit",
+        test_thread_exit,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/reset_baseline",
+        test_reset_baseline,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        (char*)"/free_after_retire",
+        test_free_after_retire,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+extern "C" {
+    MunitSuite memory_thread_suite = {
+        (char*)"/memory_threads",
+        memory_thread_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    };
+}
@@ -7,6 +7,7 @@ extern "C" {
     extern MunitSuite resource_suite;
     extern MunitSuite error_suite;
     extern MunitSuite memory_suite;
+    extern MunitSuite memory_thread_suite;
     extern MunitSuite backend_suite;
     extern MunitSuite texture_suite;
     
@@ -32,7 +33,7 @@ static const char* suite_name = "/labfont";
 
 int main(int argc, char* argv[]) {
     // Count number of enabled suites
-    int suite_count = 6; // Core suites
+    int suite_count = 7; // Core suites
     
     #ifdef LABFONT_VULKAN_ENABLED
     suite_count++;
@@ -59,6 +60,7 @@ int main(int argc, char* argv[]) {
     suites[idx++] = resource_suite;
     suites[idx++] = error_suite;
     suites[idx++] = memory_suite;
+    suites[idx++] = memory_thread_suite;
     suites[idx++] = backend_suite;
     suites[idx++] = texture_suite;
     
@@ -2,6 +2,10 @@
 #include <labfont/labfont.h>
 #include <string.h>
 #include <stdio.h>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
 
 // Test loading a texture from a file
 static MunitResult test_load_texture(const MunitParameter params[], void* data) {
@@ -182,6 +186,380 @@ static MunitResult test_load_texture_invalid_params(const MunitParameter params[
     return MUNIT_OK;
 }
 
+// Test decoding textures on worker threads
+static MunitResult test_load_texture_async(const MunitParameter params[], void* data) {
+    lab_context ctx = NULL;
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 64,
+        .height = 64,
+        .native_window = NULL
+    };
+    lab_result result = lab_create_context(&backend_desc, &ctx);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    
+    lab_texture reference = NULL;
+    result = lab_load_texture(ctx, "resources/labfont-logo1.jpg", &reference);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    int referenceWidth = 0;
+    int referenceHeight = 0;
+    lab_texture_width(reference, &referenceWidth);
+    lab_texture_height(reference, &referenceHeight);
+    
+    // The texture shows a placeholder until the next frame or wait
+    lab_texture texture = NULL;
+    lab_texture_load load = NULL;
+    result = lab_load_texture_async(ctx, "resources/labfont-logo1.jpg", &texture, &load);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    munit_assert_not_null(texture);
+    munit_assert_not_null(load);
+    int width = 0;
+    int height = 0;
+    lab_texture_width(texture, &width);
+    munit_assert_int(width, ==, 1);
+    munit_assert_int(lab_texture_load_result(ctx, load), ==, LAB_RESULT_NOT_READY);
+    
+    result = lab_wait_texture_load(ctx, load);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    lab_texture_width(texture, &width);
+    lab_texture_height(texture, &height);
+    munit_assert_int(width, ==, referenceWidth);
+    munit_assert_int(height, ==, referenceHeight);
+    lab_release_texture_load(ctx, load);
+    
+    // Loads started together finish in lab_begin_frame
+    enum { kLoadCount = 8 };
+    lab_texture textures[kLoadCount];
+    lab_texture_load loads[kLoadCount];
+    for (int i = 0; i < kLoadCount; ++i) {
+        result = lab_load_texture_async(ctx, "resources/labfont-logo1.jpg", &textures[i], &loads[i]);
+        munit_assert_int(result, ==, LAB_RESULT_OK);
+    }
+    int finished = 0;
+    for (int frame = 0; frame < 10000 && finished < kLoadCount; ++frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+        finished = 0;
+        for (int i = 0; i < kLoadCount; ++i) {
+            finished += lab_texture_load_result(ctx, loads[i]) == LAB_RESULT_OK;
+        }
+    }
+    munit_assert_int(finished, ==, kLoadCount);
+    for (int i = 0; i < kLoadCount; ++i) {
+        lab_texture_width(textures[i], &width);
+        munit_assert_int(width, ==, referenceWidth);
+        lab_release_texture_load(ctx, loads[i]);
+        lab_destroy_texture(ctx, textures[i]);
+    }
+    
+    // Files that cannot be decoded leave the placeholder
+    result = lab_load_texture_async(ctx, "non_existent_file.jpg", &texture, &load);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    munit_assert_int(lab_wait_texture_load(ctx, load), ==, LAB_RESULT_TEXTURE_LOAD_FAILED);
+    lab_texture_width(texture, &width);
+    munit_assert_int(width, ==, 1);
+    lab_release_texture_load(ctx, load);
+    
+    // Destroying the texture drops its image
+    result = lab_load_texture_async(ctx, "resources/labfont-logo1.jpg", &texture, &load);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    lab_destroy_texture(ctx, texture);
+    munit_assert_int(lab_wait_texture_load(ctx, load), ==, LAB_RESULT_INVALID_TEXTURE);
+    lab_release_texture_load(ctx, load);
+    
+    // Loads still decoding when the context goes are dropped
+    result = lab_load_texture_async(ctx, "resources/labfont-logo1.jpg", &texture, &load);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+// Test evicting textures loaded from files to stay under a memory budget
+static MunitResult test_memory_budget(const MunitParameter params[], void* data) {
+    lab_context ctx = NULL;
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    lab_result result = lab_create_context(&backend_desc, &ctx);
+    munit_assert_int(result, ==, LAB_RESULT_OK);
+    lab_render_target_desc targetDesc = {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM};
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_render_target(ctx, &targetDesc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    
+    lab_resource_memory_stats stats;
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_size(stats.textureBytes, ==, 16 * 16 * 4);
+    munit_assert_size(stats.budget, ==, 0);
+    size_t baseBytes = stats.textureBytes;
+    
+    // The CPU backend counts what it allocates
+    lab_texture used = NULL;
+    lab_texture unused = NULL;
+    munit_assert_int(lab_load_texture(ctx, "resources/labfont-logo1.jpg", &used), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_load_texture(ctx, "resources/labfont-logo1.jpg", &unused), ==, LAB_RESULT_OK);
+    int width = 0;
+    int height = 0;
+    lab_texture_width(used, &width);
+    lab_texture_height(used, &height);
+    size_t imageBytes = size_t(width) * height * 4;
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_size(stats.textureBytes, ==, baseBytes + 2 * imageBytes);
+    munit_assert_uint32(stats.evictableCount, ==, 2);
+    munit_assert_uint32(stats.residentCount, ==, 2);
+    
+    lab_vertex_2TC quad[3] = {
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f, -1.0f}, {1.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f,  1.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    lab_draw_command commands[2] = {};
+    commands[0].type = LAB_DRAW_COMMAND_BIND_TEXTURE;
+    new (&commands[0].bind_texture) decltype(commands[0].bind_texture){used, LAB_TEXTURE_FILTER_NEAREST};
+    commands[1].type = LAB_DRAW_COMMAND_TRIANGLES;
+    commands[1].triangles.vertices = quad;
+    commands[1].triangles.vertexCount = 3;
+    munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_commands(ctx, commands, 2), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    
+    // Just over budget, the texture bound longest ago goes, keeping its size
+    munit_assert_int(lab_set_memory_budget(ctx, stats.totalBytes - 1), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint32(stats.residentCount, ==, 1);
+    munit_assert_uint64(stats.evictions, ==, 1);
+    munit_assert_size(stats.textureBytes, ==, baseBytes + imageBytes + 4);
+    int evictedWidth = 0;
+    lab_texture_width(unused, &evictedWidth);
+    munit_assert_int(evictedWidth, ==, width);
+    
+    // Binding it loads it again
+    munit_assert_int(lab_set_memory_budget(ctx, 0), ==, LAB_RESULT_OK);
+    new (&commands[0].bind_texture) decltype(commands[0].bind_texture){unused, LAB_TEXTURE_FILTER_NEAREST};
+    for (int frame = 0; frame < 10000 && stats.residentCount < 2; ++frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_submit_commands(ctx, commands, 2), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+        munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    }
+    munit_assert_uint32(stats.residentCount, ==, 2);
+    munit_assert_uint64(stats.reloads, ==, 1);
+    munit_assert_size(stats.textureBytes, ==, baseBytes + 2 * imageBytes + 4);
+    
+    lab_destroy_texture(ctx, used);
+    lab_destroy_texture(ctx, unused);
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint32(stats.evictableCount, ==, 0);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+// Renders one frame drawing `texture` over the whole target and reads it back.
+// With `createMidFrame`, a texture is also created after the draw, which
+// flushes the frame's commands to a render thread early.
+static uint8_t* draw_textured_frame(lab_context ctx, lab_render_target target, lab_texture texture,
+                                    bool createMidFrame = false) {
+    lab_vertex_2TC quad[6] = {
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f, -1.0f}, {1.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f,  1.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f, -1.0f}, {0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{ 1.0f,  1.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+        {{-1.0f,  1.0f}, {0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}},
+    };
+    lab_draw_command commands[3] = {};
+    commands[0].type = LAB_DRAW_COMMAND_CLEAR;
+    commands[1].type = LAB_DRAW_COMMAND_BIND_TEXTURE;
+    new (&commands[1].bind_texture) decltype(commands[1].bind_texture){texture, LAB_TEXTURE_FILTER_NEAREST};
+    commands[2].type = LAB_DRAW_COMMAND_TRIANGLES;
+    commands[2].triangles.vertices = quad;
+    commands[2].triangles.vertexCount = 6;
+    munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_submit_commands(ctx, commands, 3), ==, LAB_RESULT_OK);
+    lab_texture scratch = NULL;
+    if (createMidFrame) {
+        const uint8_t texel[4] = {255, 255, 255, 255};
+        lab_texture_desc desc = {1, 1, LAB_TEXTURE_FORMAT_RGBA8_UNORM, texel};
+        munit_assert_int(lab_create_texture(ctx, &desc, &scratch), ==, LAB_RESULT_OK);
+    }
+    munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    lab_destroy_texture(ctx, scratch);
+    uint8_t* pixels = NULL;
+    size_t size = 0;
+    munit_assert_int(lab_get_render_target_data(ctx, target, NULL, &pixels, &size), ==, LAB_RESULT_OK);
+    munit_assert_size(size, ==, 16 * 16 * 4);
+    return pixels;
+}
+
+// Test that the budget never evicts what the last frame drew. Pipelined, a
+// texture is created in every frame, which flushes work to the render thread
+// before the frame ends.
+static MunitResult check_memory_budget_working_set(bool pipelined) {
+    lab_context ctx = NULL;
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL,
+        .pipelined_frames = pipelined ? 2u : 0u
+    };
+    munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+    lab_render_target_desc targetDesc = {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM};
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_render_target(ctx, &targetDesc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    
+    lab_texture drawn = NULL;
+    lab_texture idle = NULL;
+    munit_assert_int(lab_load_texture(ctx, "resources/labfont-logo1.jpg", &drawn), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_load_texture(ctx, "resources/labfont-logo1.jpg", &idle), ==, LAB_RESULT_OK);
+    uint8_t* expected = draw_textured_frame(ctx, target, drawn, pipelined);
+    munit_assert_uint8(expected[(8 * 16 + 8) * 4 + 3], ==, 255);
+    
+    // Over budget every frame, even with one image; only the texture nobody
+    // draws goes
+    int width = 0;
+    int height = 0;
+    lab_texture_width(drawn, &width);
+    lab_texture_height(drawn, &height);
+    lab_resource_memory_stats stats;
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    size_t budget = stats.totalBytes - size_t(width) * height * 4 - 1;
+    munit_assert_int(lab_set_memory_budget(ctx, budget), ==, LAB_RESULT_OK);
+    for (int frame = 0; frame < 200; ++frame) {
+        uint8_t* pixels = draw_textured_frame(ctx, target, drawn, pipelined);
+        munit_assert_memory_equal(16 * 16 * 4, pixels, expected);
+        lab_free(pixels);
+    }
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint64(stats.evictions, ==, 1);
+    munit_assert_uint64(stats.reloads, ==, 0);
+    
+    // Drawing the evicted texture brings it back, and once back it stays,
+    // while the texture no longer drawn makes room for it
+    bool loaded = false;
+    for (int frame = 0; frame < 10000 && !loaded; ++frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uint8_t* pixels = draw_textured_frame(ctx, target, idle, pipelined);
+        loaded = memcmp(pixels, expected, 16 * 16 * 4) == 0;
+        if (!loaded) {
+            munit_assert_uint8(pixels[(8 * 16 + 8) * 4 + 3], ==, 0);
+        }
+        lab_free(pixels);
+    }
+    munit_assert_true(loaded);
+    for (int frame = 0; frame < 200; ++frame) {
+        uint8_t* pixels = draw_textured_frame(ctx, target, idle, pipelined);
+        munit_assert_memory_equal(16 * 16 * 4, pixels, expected);
+        lab_free(pixels);
+    }
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint64(stats.evictions, ==, 2);
+    munit_assert_uint64(stats.reloads, ==, 1);
+    
+    lab_free(expected);
+    lab_destroy_texture(ctx, drawn);
+    lab_destroy_texture(ctx, idle);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+// Test that a texture whose image fails to reload stays evicted, and loads
+// when drawn again once the image is back
+static MunitResult test_reload_failure(const MunitParameter params[], void* data) {
+    const char* path = "labfont_test_reload.jpg";
+    std::vector<char> image;
+    {
+        FILE* file = fopen("resources/labfont-logo1.jpg", "rb");
+        munit_assert_not_null(file);
+        fseek(file, 0, SEEK_END);
+        image.resize(size_t(ftell(file)));
+        fseek(file, 0, SEEK_SET);
+        munit_assert_size(fread(image.data(), 1, image.size(), file), ==, image.size());
+        fclose(file);
+    }
+    auto writeImage = [&] {
+        FILE* file = fopen(path, "wb");
+        munit_assert_not_null(file);
+        fwrite(image.data(), 1, image.size(), file);
+        fclose(file);
+    };
+    writeImage();
+    
+    lab_context ctx = NULL;
+    lab_backend_desc backend_desc = {
+        .type = LAB_BACKEND_CPU,
+        .width = 16,
+        .height = 16,
+        .native_window = NULL
+    };
+    munit_assert_int(lab_create_context(&backend_desc, &ctx), ==, LAB_RESULT_OK);
+    lab_render_target_desc targetDesc = {16, 16, LAB_TEXTURE_FORMAT_RGBA8_UNORM};
+    lab_render_target target = NULL;
+    munit_assert_int(lab_create_render_target(ctx, &targetDesc, &target), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_render_target(ctx, target), ==, LAB_RESULT_OK);
+    lab_texture texture = NULL;
+    munit_assert_int(lab_load_texture(ctx, path, &texture), ==, LAB_RESULT_OK);
+    
+    // Evicted once a frame has passed without it
+    munit_assert_int(lab_begin_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_end_frame(ctx), ==, LAB_RESULT_OK);
+    munit_assert_int(lab_set_memory_budget(ctx, 1), ==, LAB_RESULT_OK);
+    lab_resource_memory_stats stats;
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    munit_assert_uint64(stats.evictions, ==, 1);
+    munit_assert_uint32(stats.residentCount, ==, 0);
+    
+    // Without its file, drawing it reloads it in vain
+    remove(path);
+    for (int frame = 0; frame < 10000 && stats.loadFailures == 0; ++frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        lab_free(draw_textured_frame(ctx, target, texture));
+        munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    }
+    // The frame that took the failure drew the texture again, which retried
+    munit_assert_uint64(stats.loadFailures, ==, 1);
+    munit_assert_uint64(stats.reloads, ==, 2);
+    
+    // With the file back, a later try succeeds
+    writeImage();
+    bool loaded = false;
+    for (int frame = 0; frame < 10000 && !loaded; ++frame) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uint8_t* pixels = draw_textured_frame(ctx, target, texture);
+        loaded = pixels[(8 * 16 + 8) * 4 + 3] == 255;
+        lab_free(pixels);
+    }
+    munit_assert_true(loaded);
+    munit_assert_int(lab_get_resource_memory_stats(ctx, &stats), ==, LAB_RESULT_OK);
+    // The retry under way when the file came back may have failed too
+    munit_assert_uint64(stats.loadFailures, >=, 1);
+    munit_assert_uint64(stats.reloads, ==, stats.loadFailures + 1);
+    munit_assert_uint32(stats.residentCount, ==, 1);
+    
+    remove(path);
+    lab_destroy_texture(ctx, texture);
+    lab_destroy_render_target(ctx, target);
+    lab_destroy_context(ctx);
+    return MUNIT_OK;
+}
+
+static MunitResult test_memory_budget_working_set(const MunitParameter params[], void* data) {
+    return check_memory_budget_working_set(false);
+}
+
+static MunitResult test_memory_budget_working_set_pipelined(const MunitParameter params[], void* data) {
+    return check_memory_budget_working_set(true);
+}
+
 static MunitTest texture_tests[] = {
     {
         "/load_texture",
@@ -199,6 +577,46 @@ static MunitTest texture_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/load_texture_async",
+        test_load_texture_async,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/memory_budget",
+        test_memory_budget,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/memory_budget_working_set",
+        test_memory_budget_working_set,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/reload_failure",
+        test_reload_failure,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/memory_budget_working_set_pipelined",
+        test_memory_budget_working_set_pipelined,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -0,0 +1,176 @@
+// Replays a capture recorded with lab_begin_capture on the CPU backend.
+//
+// Each command is executed on its own and timed, so a capture of a slow frame
+// shows which draws cost the most. Reports the time of every frame, totals by
+// command type and the slowest commands. With --repeat the capture is
+// replayed several times and the fastest time of each command is kept. Run it
+// from a Release build:
+//
+//     ./labfont_replay capture.lfcp [--repeat N] [--optimize] [--tiled N]
+//                      [--top N] [--output final.png]
+
+#include "backends/cpu/cpu_backend.h"
+#include "core/capture.h"
+#include "../third_party/stb/stb_image_write.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+using namespace labfont;
+
+namespace {
+
+const char* CommandName(DrawCommandType type) {
+    switch (type) {
+        case DrawCommandType::Clear: return "Clear";
+        case DrawCommandType::DrawTriangles: return "DrawTriangles";
+        case DrawCommandType::DrawLines: return "DrawLines";
+        case DrawCommandType::BindTexture: return "BindTexture";
+        case DrawCommandType::SetViewportAPI: return "SetViewportAPI";
+        case DrawCommandType::DrawIndexedTriangles: return "DrawIndexedTriangles";
+        case DrawCommandType::DrawQuads: return "DrawQuads";
+        case DrawCommandType::DrawTrianglesPacked: return "DrawTrianglesPacked";
+        case DrawCommandType::SetLayer: return "SetLayer";
+        case DrawCommandType::SetBlendMode: return "SetBlendMode";
+        case DrawCommandType::SetScissor: return "SetScissor";
+        case DrawCommandType::SetViewport: return "SetViewport";
+    }
+    return "Unknown";
+}
+
+int Usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s capture [--repeat N] [--optimize] [--tiled N] [--top N] [--output file.png]\n",
+                 program);
+    return 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const char* path = nullptr;
+    const char* output = nullptr;
+    int repeat = 1;
+    int workers = 0;
+    int top = 10;
+    bool optimize = false;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--repeat") == 0 && hasValue) {
+            repeat = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--tiled") == 0 && hasValue) {
+            workers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--top") == 0 && hasValue) {
+            top = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--output") == 0 && hasValue) {
+            output = argv[++i];
+        } else if (std::strcmp(argv[i], "--optimize") == 0) {
+            optimize = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            return Usage(argv[0]);
+        }
+    }
+    if (!path || repeat < 1 || workers < 0 || top < 0) {
+        return Usage(argv[0]);
+    }
+
+    CaptureReplay replay;
+    if (replay.Load(path) != LAB_RESULT_OK) {
+        std::fprintf(stderr, "%s: not a readable capture\n", path);
+        return 1;
+    }
+    std::printf("%s: %u frames, %zu commands\n", path, replay.GetFrameCount(), replay.GetCommandCount());
+    if (replay.GetBlankTextureCount() > 0) {
+        std::printf("%u textures were captured without contents and replay blank\n",
+                    replay.GetBlankTextureCount());
+    }
+
+    CPUBackend backend;
+    uint32_t width = std::max(replay.GetWidth(), 1u);
+    uint32_t height = std::max(replay.GetHeight(), 1u);
+    if (backend.Initialize(width, height) != LAB_RESULT_OK) {
+        std::fprintf(stderr, "could not initialize the CPU backend\n");
+        return 1;
+    }
+    backend.SetWorkerThreads(static_cast<uint32_t>(workers));
+
+    // The fastest of the repeats, per command
+    std::vector<CaptureReplay::CommandTiming> timings;
+    std::vector<CaptureReplay::CommandTiming> run;
+    for (int r = 0; r < repeat; ++r) {
+        run.clear();
+        lab_result result = replay.Replay(backend, optimize, &run);
+        if (result != LAB_RESULT_OK) {
+            std::fprintf(stderr, "replay failed: %d\n", result);
+            return 1;
+        }
+        if (r == 0) {
+            timings = run;
+            continue;
+        }
+        for (size_t i = 0; i < timings.size() && i < run.size(); ++i) {
+            timings[i].seconds = std::min(timings[i].seconds, run[i].seconds);
+        }
+    }
+
+    std::vector<double> frameSeconds;
+    std::map<DrawCommandType, std::pair<size_t, double>> byType;
+    double total = 0.0;
+    for (const auto& timing : timings) {
+        if (timing.frame >= frameSeconds.size()) {
+            frameSeconds.resize(timing.frame + 1, 0.0);
+        }
+        frameSeconds[timing.frame] += timing.seconds;
+        byType[timing.type].first++;
+        byType[timing.type].second += timing.seconds;
+        total += timing.seconds;
+    }
+
+    std::printf("\nframes\n");
+    for (size_t i = 0; i < frameSeconds.size(); ++i) {
+        std::printf("  %5zu %10.3f ms\n", i, frameSeconds[i] * 1e3);
+    }
+
+    std::printf("\nby command type\n");
+    for (const auto& entry : byType) {
+        std::printf("  %-22s %8zu %10.3f ms %6.1f%%\n",
+                    CommandName(entry.first),
+                    entry.second.first,
+                    entry.second.second * 1e3,
+                    total > 0.0 ? 100.0 * entry.second.second / total : 0.0);
+    }
+
+    std::sort(timings.begin(), timings.end(),
+              [](const CaptureReplay::CommandTiming& a, const CaptureReplay::CommandTiming& b) {
+                  return a.seconds > b.seconds;
+              });
+    std::printf("\nslowest commands\n");
+    for (size_t i = 0; i < timings.size() && i < size_t(top); ++i) {
+        std::printf("  frame %5u command %6u %-22s %10.3f ms\n",
+                    timings[i].frame,
+                    timings[i].index,
+                    CommandName(timings[i].type),
+                    timings[i].seconds * 1e3);
+    }
+
+    if (output) {
+        RenderTarget* target = replay.GetRenderTarget();
+        if (!target || !target->GetColorTexture()->SupportsReadback()) {
+            std::fprintf(stderr, "no render target to write\n");
+            return 1;
+        }
+        std::vector<uint8_t> pixels(size_t(target->GetWidth()) * target->GetHeight() * 4);
+        if (backend.ReadbackTexture(target->GetColorTexture(), pixels.data(), pixels.size()) != LAB_RESULT_OK ||
+            !stbi_write_png(output, target->GetWidth(), target->GetHeight(), 4, pixels.data(),
+                            target->GetWidth() * 4)) {
+            std::fprintf(stderr, "%s: could not write\n", output);
+            return 1;
+        }
+    }
+    return 0;
+}